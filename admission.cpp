@@ -0,0 +1,79 @@
+#include "admission.h"
+
+#include <algorithm>
+
+namespace admission {
+
+Limiter limiter;
+
+namespace {
+
+double Refilled(double tokens, uint64_t updated_ms, uint64_t now_ms, const Settings& settings) {
+    double elapsed = now_ms > updated_ms ? (now_ms - updated_ms) / 1000.0 : 0;
+    return std::min(settings.burst, tokens + elapsed * settings.rate);
+}
+
+} // namespace
+
+Result Limiter::Admit(uint32_t ip, bool blocked, uint64_t now_ms, const Settings& settings) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (blocked) {
+        this->counters.blocked++;
+        return RESULT_BLOCKED;
+    }
+
+    if (settings.max_preauth && this->counters.preauth >= settings.max_preauth) {
+        this->counters.preauth_full++;
+        return RESULT_PREAUTH;
+    }
+
+    if (settings.rate > 0) {
+        uint32_t prefix = settings.prefix_bits >= 32 ? ip : ip & ~(0xFFFFFFFFu >> settings.prefix_bits);
+        auto bucket = this->buckets.find(prefix);
+        if (bucket == this->buckets.end()) {
+            if (this->buckets.size() >= MAX_BUCKETS) {
+                this->Prune(now_ms, settings);
+            }
+            bucket = this->buckets.emplace(prefix, Bucket{settings.burst, now_ms}).first;
+        }
+
+        bucket->second.tokens = Refilled(bucket->second.tokens, bucket->second.updated_ms, now_ms, settings);
+        bucket->second.updated_ms = now_ms;
+        if (bucket->second.tokens < 1) {
+            this->counters.rate_limited++;
+            return RESULT_RATE;
+        }
+        bucket->second.tokens -= 1;
+    }
+
+    this->counters.admitted++;
+    this->counters.preauth++;
+    return RESULT_ADMITTED;
+}
+
+void Limiter::Authenticated() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->counters.preauth) {
+        this->counters.preauth--;
+    }
+}
+
+Counters Limiter::Stats() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Counters stats = this->counters;
+    stats.buckets = this->buckets.size();
+    return stats;
+}
+
+void Limiter::Prune(uint64_t now_ms, const Settings& settings) {
+    std::erase_if(this->buckets, [&](const auto& bucket) {
+        return Refilled(bucket.second.tokens, bucket.second.updated_ms, now_ms, settings) >= settings.burst;
+    });
+    // Everyone is busy: a scan from many addresses. Starting over only forgives them.
+    if (this->buckets.size() >= MAX_BUCKETS) {
+        this->buckets.clear();
+    }
+}
+
+} // namespace admission
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Which client connections `Net_Listen` keeps, decided right after `accept` and before a `Client` is allocated.
+//
+// A connection is dropped if its address is blocked in redhat.ipf, if its address (or prefix) has used up its token
+// bucket, or if there are already too many connections that haven't logged in yet.
+namespace admission {
+
+enum Result { RESULT_ADMITTED, RESULT_BLOCKED, RESULT_RATE, RESULT_PREAUTH };
+
+struct Settings {
+    // Connections per second per prefix, 0 for no limit.
+    double rate;
+    // Connections a prefix may open at once.
+    double burst;
+    // 32 for a bucket per address, 24 for one per /24, ...
+    unsigned prefix_bits;
+    // Connections admitted and not logged in yet, 0 for no cap.
+    size_t max_preauth;
+};
+
+struct Counters {
+    uint64_t admitted = 0;
+    uint64_t blocked = 0;
+    uint64_t rate_limited = 0;
+    uint64_t preauth_full = 0;
+    // Right now.
+    size_t preauth = 0;
+    size_t buckets = 0;
+};
+
+class Limiter {
+public:
+    // Full buckets are forgotten when there are more than this.
+    static constexpr size_t MAX_BUCKETS = 65536;
+
+    // `ip` in host order; `blocked` is what redhat.ipf says about it.
+    Result Admit(uint32_t ip, bool blocked, uint64_t now_ms, const Settings& settings);
+    // An admitted connection has logged in, or closed before that.
+    void Authenticated();
+
+    Counters Stats();
+
+private:
+    struct Bucket {
+        double tokens;
+        uint64_t updated_ms;
+    };
+
+    void Prune(uint64_t now_ms, const Settings& settings);
+
+    std::mutex mutex;
+    // Prefix -> bucket.
+    std::unordered_map<uint32_t, Bucket> buckets;
+    Counters counters;
+};
+
+extern Limiter limiter;
+
+} // namespace admission
@@ -0,0 +1,403 @@
+// Offline benchmark and differential test of `UpdateCharacter`.
+//
+//   redhat-bench <directory with .a2c files> [-golden <file>] [-update] [-iterations <n>]
+//
+// Every character goes through `CCharacter::LoadFromStream`, `UpdateCharacter` and `SaveToStream` on every server.
+// There's no DB: the shelf and the SQL writes go to an in-memory stand-in that starts empty for every update.
+//
+// Prints the throughput and the number of allocations per update, then the size of the bags and dresses in the text
+// and binary item formats (see `item_blob.h`) and how long each takes to encode and decode. With `-golden`, compares what each update did
+// (the saved character, the shelf and the SQL writes) against the file and fails on any difference. With `-update`,
+// rewrites the golden file instead.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "CCharacter.hpp"
+#include "config.hpp"
+#include "item_blob.h"
+#include "login.hpp"
+#include "server_id.hpp"
+#include "shelf.hpp"
+#include "thresholds.h"
+#include "unit_of_work.h"
+#include "utils.hpp"
+
+// Counts every allocation in the process. Only the difference around the measured code is reported.
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// Everything one update wrote. Reset before each update.
+struct Writes {
+    std::vector<std::string> shelf;
+    std::vector<std::string> stored;
+};
+
+Writes writes;
+
+// An empty DB that accepts every write.
+bool LoadNoShelf(const CCharacter&, int, shelf::impl::Field, int32_t* mutex, std::string*, int64_t*, bool& shelf_exists) {
+    *mutex = 0;
+    shelf_exists = false;
+    return true;
+}
+
+bool RecordShelfWrite(std::string query) {
+    writes.shelf.push_back(std::move(query));
+    return true;
+}
+
+bool RecordStoreOnShelf(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money) {
+    CItemList list{.Items = std::move(inventory)};
+    writes.stored.push_back(Format("s%d money=%lld items=%s", server_id, static_cast<long long>(money), Login_SerializeItems(list).c_str()));
+    return true;
+}
+
+// Some statements span several lines, the golden file has one line per update.
+std::string OneLine(const std::string& statement) {
+    std::string out;
+    for (char ch : statement) {
+        if (IsWhitespace(ch)) {
+            if (!out.empty() && out.back() != ' ') {
+                out += ' ';
+            }
+        } else {
+            out += ch;
+        }
+    }
+    return TrimRight(out);
+}
+
+struct Blob {
+    std::string name;
+    BinaryStream data;
+};
+
+// Everything the golden file compares. The saved stream itself is encrypted with a time-based key, so the
+// character is read back from it and printed field by field.
+std::string Digest(const CCharacter& chr, const UpdateCharacterResult& result, const std::vector<std::string>& statements) {
+    CItemList bag = chr.Bag;
+    CItemList dress = chr.Dress;
+
+    std::string out = Format("ascended=%d reclassed=%d points=%d | %s sex=%u picture=%u skill=%u flags=%u color=%u"
+        " stats=%u/%u/%u/%u exp=%u/%u/%u/%u/%u money=%u spells=%u/%u kills=%u/%u/%u deaths=%u bag=%s dress=%s",
+        result.ascended, result.reclassed, result.points, chr.GetFullName().c_str(), chr.Sex, chr.Picture, chr.MainSkill, chr.Flags, chr.Color,
+        chr.Body, chr.Reaction, chr.Mind, chr.Spirit,
+        chr.ExpFireBlade, chr.ExpWaterAxe, chr.ExpAirBludgeon, chr.ExpEarthPike, chr.ExpAstralShooting,
+        chr.Money, chr.Spells, chr.ActiveSpell, chr.MonstersKills, chr.PlayersKills, chr.Frags, chr.Deaths,
+        Login_SerializeItems(bag).c_str(), Login_SerializeItems(dress).c_str());
+
+    for (const auto& statement : statements) {
+        out += " | sql: " + OneLine(statement);
+    }
+    for (const auto& query : writes.shelf) {
+        out += " | shelf: " + query;
+    }
+    for (const auto& stored : writes.stored) {
+        out += " | stored: " + stored;
+    }
+    return out;
+}
+
+bool LoadBlobs(const std::string& directory, std::vector<Blob>& blobs) {
+    Directory dir;
+    if (!dir.Open(directory)) {
+        std::cerr << directory << ": failed to open directory" << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> names;
+    DirectoryEntry entry;
+    while (dir.Read(entry)) {
+        std::string name = ToLower(entry.name);
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".a2c") == 0) {
+            names.push_back(entry.name);
+        }
+    }
+
+    // The golden file is compared in order.
+    std::sort(names.begin(), names.end());
+
+    for (const auto& name : names) {
+        Blob blob{.name = name};
+        if (!blob.data.LoadFromFile(directory + "/" + name)) {
+            std::cerr << name << ": failed to read file" << std::endl;
+            return false;
+        }
+        blobs.push_back(std::move(blob));
+    }
+
+    return true;
+}
+
+bool ReadGolden(const std::string& file_name, std::map<std::string, std::string>& golden) {
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in) {
+        std::cerr << file_name << ": failed to open file" << std::endl;
+        return false;
+    }
+
+    // `<file> s<server>: <digest>`
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(": ");
+        if (colon != std::string::npos) {
+            golden[line.substr(0, colon)] = line.substr(colon + 2);
+        }
+    }
+    return true;
+}
+
+// Bags and dresses of the characters in both item formats, as `-migrate-items` would convert them.
+void MeasureItems(std::vector<Blob>& blobs, int iterations) {
+    std::vector<CItemList> lists;
+    for (auto& blob : blobs) {
+        CCharacter chr;
+        if (chr.LoadFromStream(blob.data)) {
+            lists.push_back(chr.Bag);
+            lists.push_back(chr.Dress);
+        }
+    }
+    if (lists.empty()) {
+        return;
+    }
+
+    std::vector<std::string> texts, encoded_blobs;
+    uint64_t text_bytes = 0, blob_bytes = 0;
+    for (auto& list : lists) {
+        texts.push_back(Login_SerializeItems(list));
+        encoded_blobs.push_back(item_blob::Encode(list));
+        text_bytes += texts.back().size();
+        blob_bytes += encoded_blobs.back().size();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::duration text_encode{}, text_decode{}, blob_encode{}, blob_decode{};
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (size_t i = 0; i < lists.size(); i++) {
+            auto started = Clock::now();
+            Login_SerializeItems(lists[i]);
+            auto encoded = Clock::now();
+            Login_UnserializeItems(texts[i]);
+            auto decoded = Clock::now();
+            text_encode += encoded - started;
+            text_decode += decoded - encoded;
+
+            started = Clock::now();
+            item_blob::Encode(lists[i]);
+            encoded = Clock::now();
+            CItemList list;
+            item_blob::Decode(encoded_blobs[i], list);
+            decoded = Clock::now();
+            blob_encode += encoded - started;
+            blob_decode += decoded - encoded;
+        }
+    }
+
+    double count = static_cast<double>(lists.size()) * iterations;
+    auto us = [count](Clock::duration elapsed) {
+        return std::chrono::duration<double, std::micro>(elapsed).count() / count;
+    };
+    std::printf("%u item lists: text %llu bytes, binary %llu bytes (%.0f%%); per list, encode %.2f -> %.2f us, decode %.2f -> %.2f us\n",
+        static_cast<unsigned int>(lists.size()), static_cast<unsigned long long>(text_bytes), static_cast<unsigned long long>(blob_bytes),
+        text_bytes ? 100.0 * blob_bytes / text_bytes : 0.0,
+        us(text_encode), us(blob_encode), us(text_decode), us(blob_decode));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string directory;
+    std::string golden_file;
+    bool update_golden = false;
+    int iterations = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-golden" && i + 1 < argc) {
+            golden_file = argv[++i];
+        } else if (arg == "-update") {
+            update_golden = true;
+        } else if (arg == "-iterations" && i + 1 < argc && CheckInt(argv[i + 1])) {
+            iterations = std::max(1, static_cast<int>(StrToInt(argv[++i])));
+        } else if (directory.empty() && arg[0] != '-') {
+            directory = arg;
+        } else {
+            directory.clear();
+            break;
+        }
+    }
+
+    if (directory.empty() || (update_golden && golden_file.empty())) {
+        std::cerr << "usage: redhat-bench <a2c directory> [-golden <file>] [-update] [-iterations <n>]" << std::endl;
+        return 2;
+    }
+
+    Config::LogFile = "redhat-bench.log";
+    Config::LogLevel = LOG_Error;
+    // Text items, so that the golden file is readable.
+    Config::BinaryItems = false;
+
+    thresholds::thresholds.LoadBaked();
+    shelf::impl::SetStorage(LoadNoShelf, RecordShelfWrite);
+
+    std::vector<Blob> blobs;
+    if (!LoadBlobs(directory, blobs)) {
+        return 1;
+    }
+    if (blobs.empty()) {
+        std::cerr << directory << ": no .a2c files" << std::endl;
+        return 1;
+    }
+
+    // Keyed as in the golden file.
+    std::map<std::string, std::string> digests;
+
+    std::chrono::steady_clock::duration elapsed{};
+    uint64_t allocated = 0;
+    uint64_t updates = 0;
+    int broken = 0;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (size_t i = 0; i < blobs.size(); i++) {
+            for (int server = EASY; server <= QUEST_T4; server++) {
+                ServerIDType server_id = static_cast<ServerIDType>(server);
+                writes = Writes{};
+
+                uint64_t allocations_before = allocations.load(std::memory_order_relaxed);
+                auto started = std::chrono::steady_clock::now();
+
+                CCharacter chr;
+                if (!chr.LoadFromStream(blobs[i].data)) {
+                    if (iteration == 0 && server == EASY) {
+                        std::cerr << blobs[i].name << ": not a character file" << std::endl;
+                        broken++;
+                    }
+                    break;
+                }
+                // Normally come from the DB. Fixed, so that the SQL writes are the same on every run.
+                chr.LoginID = static_cast<int>(i + 1);
+                chr.ID = static_cast<int>(i + 1);
+
+                // Treasures flip a coin.
+                std::srand(static_cast<unsigned int>(i * 100 + server));
+
+                unit_of_work::UnitOfWork sql("bench");
+                UpdateCharacterResult result = UpdateCharacter(chr, server_id, RecordStoreOnShelf);
+
+                BinaryStream saved;
+                bool ok = chr.SaveToStream(saved);
+
+                elapsed += std::chrono::steady_clock::now() - started;
+                allocated += allocations.load(std::memory_order_relaxed) - allocations_before;
+                updates++;
+
+                if (iteration != 0) {
+                    continue;
+                }
+
+                std::string key = Format("%s s%d", blobs[i].name.c_str(), server);
+                CCharacter reloaded;
+                if (!ok || !reloaded.LoadFromStream(saved)) {
+                    digests[key] = "failed to save";
+                    continue;
+                }
+                reloaded.LoginID = chr.LoginID;
+                reloaded.ID = chr.ID;
+                digests[key] = Digest(reloaded, result, sql.Statements());
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf("%llu updates of %u characters in %.3f s: %.0f updates/s, %.1f us/update, %.1f allocations/update\n",
+        static_cast<unsigned long long>(updates), static_cast<unsigned int>(blobs.size() - broken), seconds,
+        seconds > 0 ? updates / seconds : 0.0, updates ? seconds * 1e6 / updates : 0.0,
+        updates ? static_cast<double>(allocated) / updates : 0.0);
+    MeasureItems(blobs, iterations);
+
+    if (golden_file.empty()) {
+        return broken ? 1 : 0;
+    }
+
+    if (update_golden) {
+        std::ofstream out(golden_file, std::ios::binary);
+        for (const auto& [key, digest] : digests) {
+            out << key << ": " << digest << "\n";
+        }
+        if (!out) {
+            std::cerr << golden_file << ": failed to write file" << std::endl;
+            return 1;
+        }
+        std::printf("wrote %u results to %s\n", static_cast<unsigned int>(digests.size()), golden_file.c_str());
+        return broken ? 1 : 0;
+    }
+
+    std::map<std::string, std::string> golden;
+    if (!ReadGolden(golden_file, golden)) {
+        return 1;
+    }
+
+    int differences = 0;
+    for (const auto& [key, digest] : digests) {
+        auto it = golden.find(key);
+        if (it == golden.end()) {
+            std::printf("%s: not in the golden file\n", key.c_str());
+            differences++;
+        } else if (it->second != digest) {
+            std::printf("%s:\n  want: %s\n  got:  %s\n", key.c_str(), it->second.c_str(), digest.c_str());
+            differences++;
+        }
+    }
+    for (const auto& [key, digest] : golden) {
+        if (digests.count(key) == 0) {
+            std::printf("%s: missing, the golden file has it\n", key.c_str());
+            differences++;
+        }
+    }
+
+    if (differences) {
+        std::printf("%d of %u results differ from %s\n", differences, static_cast<unsigned int>(std::max(digests.size(), golden.size())), golden_file.c_str());
+        return 1;
+    }
+
+    std::printf("all %u results match %s\n", static_cast<unsigned int>(digests.size()), golden_file.c_str());
+    return broken ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+#include "character_list.h"
+
+#include "cp866.h"
+
+namespace character_list {
+
+Cache cache;
+
+Cache::Cache(std::chrono::milliseconds lifetime) : lifetime(lifetime) {
+}
+
+std::optional<int> Cache::LoginID(std::string_view login) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto login_id = this->login_ids.find(cp866::Fold(login));
+    if (login_id == this->login_ids.end()) {
+        return std::nullopt;
+    }
+
+    if (Clock::now() - login_id->second.loaded > this->lifetime) {
+        this->login_ids.erase(login_id);
+        return std::nullopt;
+    }
+    return login_id->second.id;
+}
+
+void Cache::SetLoginID(std::string_view login, int login_id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->login_ids.size() >= MAX_LOGINS) {
+        this->login_ids.clear();
+        this->lists.clear();
+    }
+    this->login_ids[cp866::Fold(login)] = CachedID{Clock::now(), login_id};
+}
+
+bool Cache::Get(int login_id, int hat_id, std::vector<CharacterInfo>& info) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto login = this->lists.find(login_id);
+    if (login == this->lists.end()) {
+        return false;
+    }
+
+    auto list = login->second.find(hat_id);
+    if (list == login->second.end()) {
+        return false;
+    }
+
+    if (Clock::now() - list->second.loaded > this->lifetime) {
+        login->second.erase(list);
+        return false;
+    }
+
+    info = list->second.info;
+    return true;
+}
+
+void Cache::Put(int login_id, int hat_id, std::vector<CharacterInfo> info) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->lists.size() >= MAX_LOGINS) {
+        this->lists.clear();
+    }
+    this->lists[login_id][hat_id] = List{Clock::now(), std::move(info)};
+}
+
+void Cache::Invalidate(int login_id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->lists.erase(login_id);
+}
+
+void Cache::Forget(std::string_view login, int login_id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->login_ids.erase(cp866::Fold(login));
+    this->lists.erase(login_id);
+}
+
+} // namespace character_list
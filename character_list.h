@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "login.hpp"
+
+// The character lists `Login_GetCharacterList` sends on every login and 0xCA request, and the login ids it
+// looks them up by, so the list doesn't cost two queries each time.
+//
+// Write-through: `Login_SetCharacter`, `Login_DelCharacter` and `Login_Delete` invalidate what they change. Entries,
+// login ids included, also expire after `LIFETIME`, for the changes made by another hat or the site sharing the DB
+// (a login deleted and created again there gets another id).
+namespace character_list {
+
+class Cache {
+public:
+    static constexpr std::chrono::seconds LIFETIME{60};
+    // Starts over when this many logins are cached.
+    static constexpr size_t MAX_LOGINS = 65536;
+
+    explicit Cache(std::chrono::milliseconds lifetime = LIFETIME);
+
+    // `login` as it goes to the DB, i.e. escaped.
+    std::optional<int> LoginID(std::string_view login);
+    void SetLoginID(std::string_view login, int login_id);
+
+    bool Get(int login_id, int hat_id, std::vector<CharacterInfo>& info);
+    void Put(int login_id, int hat_id, std::vector<CharacterInfo> info);
+
+    // The lists of all hats of the login.
+    void Invalidate(int login_id);
+    // The login is deleted.
+    void Forget(std::string_view login, int login_id);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct CachedID {
+        Clock::time_point loaded;
+        int id;
+    };
+
+    struct List {
+        Clock::time_point loaded;
+        std::vector<CharacterInfo> info;
+    };
+
+    std::chrono::milliseconds lifetime;
+    std::mutex mutex;
+    // Folded login -> id.
+    std::unordered_map<std::string, CachedID> login_ids;
+    // Login id -> hat id -> characters.
+    std::unordered_map<int, std::map<int, List>> lists;
+};
+
+extern Cache cache;
+
+} // namespace character_list
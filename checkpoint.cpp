@@ -1,5 +1,6 @@
 #include "checkpoint.h"
 #include "sql.hpp"
+#include "unit_of_work.h"
 #include "utils.hpp"
 
 namespace checkpoint {
@@ -41,7 +42,10 @@ Checkpoint::Checkpoint(CCharacter& chr, bool only_stats) {
 Checkpoint::Checkpoint(int character_id) {
     this->loaded_from_db = false;
 
-    SimpleSQL data(Format("SELECT * FROM `checkpoint` WHERE `id` = %d;", character_id));
+    SimpleSQL data(Format(
+        "SELECT body, reaction, mind, spirit, monsters_kills, players_kills, frags, deaths, "
+        "exp_fire_blade, exp_water_axe, exp_air_bludgeon, exp_earth_pike, exp_astral_shooting, dress "
+        "FROM `checkpoint` WHERE `id` = %d;", character_id));
     if (!data) {
         Printf(LOG_Warning, "[checkpoint] failed to select checkpoint data for %d\n", character_id);
         return;
@@ -53,69 +57,56 @@ Checkpoint::Checkpoint(int character_id) {
 
     this->loaded_from_db = true;
     
-    MYSQL_ROW row = SQL_FetchRow(data.result);
+    ResultView row(data.result);
+    row.Next();
 
-    this->body = static_cast<uint8_t>(SQL_FetchInt(row, data.result, "body"));
-    this->reaction = static_cast<uint8_t>(SQL_FetchInt(row, data.result, "reaction"));
-    this->mind = static_cast<uint8_t>(SQL_FetchInt(row, data.result, "mind"));
-    this->spirit = static_cast<uint8_t>(SQL_FetchInt(row, data.result, "spirit"));
-    this->monsters_kills = SQL_FetchInt(row, data.result, "monsters_kills");
-    this->players_kills = SQL_FetchInt(row, data.result, "players_kills");
-    this->frags = SQL_FetchInt(row, data.result, "frags");
-    this->deaths = SQL_FetchInt(row, data.result, "deaths");
-    this->exp_fire_blade = SQL_FetchInt(row, data.result, "exp_fire_blade");
-    this->exp_water_axe = SQL_FetchInt(row, data.result, "exp_water_axe");
-    this->exp_air_bludgeon = SQL_FetchInt(row, data.result, "exp_air_bludgeon");
-    this->exp_earth_pike = SQL_FetchInt(row, data.result, "exp_earth_pike");
-    this->exp_astral_shooting = SQL_FetchInt(row, data.result, "exp_astral_shooting");
-    this->dress = SQL_FetchString(row, data.result, "dress");
+    this->body = static_cast<uint8_t>(row.Int("body"));
+    this->reaction = static_cast<uint8_t>(row.Int("reaction"));
+    this->mind = static_cast<uint8_t>(row.Int("mind"));
+    this->spirit = static_cast<uint8_t>(row.Int("spirit"));
+    this->monsters_kills = row.Int("monsters_kills");
+    this->players_kills = row.Int("players_kills");
+    this->frags = row.Int("frags");
+    this->deaths = row.Int("deaths");
+    this->exp_fire_blade = row.Int("exp_fire_blade");
+    this->exp_water_axe = row.Int("exp_water_axe");
+    this->exp_air_bludgeon = row.Int("exp_air_bludgeon");
+    this->exp_earth_pike = row.Int("exp_earth_pike");
+    this->exp_astral_shooting = row.Int("exp_astral_shooting");
+    this->dress = row.String("dress");
 }
 
 bool Checkpoint::SaveToDB(int character_id) const {
-    SimpleSQL exists(Format("SELECT 1 FROM `checkpoint` WHERE `id` = %d;", character_id));
+    Printf(LOG_Info, "[checkpoint] saving for character %d\n", character_id);
 
-    Printf(LOG_Info, "[checkpoint] saving for character %d (exists: %d)\n", character_id, SQL_NumRows(exists.result));
-
-    if (!exists || SQL_NumRows(exists.result) == 0) {
-        return SimpleSQL(Format(
-            R"(
-                INSERT INTO `checkpoint` (
-                    id,
-                    body, reaction, mind, spirit,
-                    monsters_kills, players_kills, frags, deaths,
-                    exp_fire_blade, exp_water_axe, exp_air_bludgeon, exp_earth_pike, exp_astral_shooting,
-                    dress
-                ) VALUES (
-                    %d, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, "%s"
-                );
-            )",
-            character_id,
-            this->body, this->reaction, this->mind, this->spirit,
-            this->monsters_kills, this->players_kills, this->frags, this->deaths,
-            this->exp_fire_blade, this->exp_water_axe, this->exp_air_bludgeon, this->exp_earth_pike, this->exp_astral_shooting,
-            this->dress.c_str()
-        ));
-    } else {
-        return SimpleSQL(Format(
-            R"(
-                UPDATE `checkpoint`
-                SET
-                    body = %u, reaction = %u, mind = %u, spirit = %u,
-                    monsters_kills = %u, players_kills = %u, frags = %u, deaths = %u,
-                    exp_fire_blade = %u, exp_water_axe = %u, exp_air_bludgeon = %u, exp_earth_pike = %u, exp_astral_shooting = %u,
-                    dress = "%s"
-                WHERE id = %d;
-            )",
-            this->body, this->reaction, this->mind, this->spirit,
-            this->monsters_kills, this->players_kills, this->frags, this->deaths,
-            this->exp_fire_blade, this->exp_water_axe, this->exp_air_bludgeon, this->exp_earth_pike, this->exp_astral_shooting,
-            this->dress.c_str(), character_id
-        ));
-    }
+    // One statement whether the checkpoint exists or not, `id` is unique.
+    return unit_of_work::Write(Format(
+        R"(
+            INSERT INTO `checkpoint` (
+                id,
+                body, reaction, mind, spirit,
+                monsters_kills, players_kills, frags, deaths,
+                exp_fire_blade, exp_water_axe, exp_air_bludgeon, exp_earth_pike, exp_astral_shooting,
+                dress
+            ) VALUES (
+                %d, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, "%s"
+            ) ON DUPLICATE KEY UPDATE
+                body = VALUES(body), reaction = VALUES(reaction), mind = VALUES(mind), spirit = VALUES(spirit),
+                monsters_kills = VALUES(monsters_kills), players_kills = VALUES(players_kills), frags = VALUES(frags), deaths = VALUES(deaths),
+                exp_fire_blade = VALUES(exp_fire_blade), exp_water_axe = VALUES(exp_water_axe), exp_air_bludgeon = VALUES(exp_air_bludgeon),
+                exp_earth_pike = VALUES(exp_earth_pike), exp_astral_shooting = VALUES(exp_astral_shooting),
+                dress = VALUES(dress);
+        )",
+        character_id,
+        this->body, this->reaction, this->mind, this->spirit,
+        this->monsters_kills, this->players_kills, this->frags, this->deaths,
+        this->exp_fire_blade, this->exp_water_axe, this->exp_air_bludgeon, this->exp_earth_pike, this->exp_astral_shooting,
+        SQL_EscapeBinary(this->dress).c_str()
+    ));
 }
 
 bool UpdateDeaths(int character_id, uint32_t deaths) {
-    return SimpleSQL(Format("UPDATE `checkpoint` SET deaths = %d WHERE id = %d", deaths, character_id));
+    return unit_of_work::Write(Format("UPDATE `checkpoint` SET deaths = %d WHERE id = %d", deaths, character_id));
 }
 
 }
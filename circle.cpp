@@ -10,6 +10,17 @@
 
 namespace circle {
 
+namespace {
+
+const thresholds::Key HELL_STATS_REACTION("hell.stats.reaction");
+const thresholds::Key HELL_STATS_MIND("hell.stats.mind");
+const thresholds::Key HELL_STATS_SPIRIT("hell.stats.spirit");
+const thresholds::Key HELL_EXPERIENCE("hell.experience");
+const thresholds::Key HELL_MONEY("hell.money");
+const thresholds::Key HELL_MOBS("hell.mobs");
+
+} // namespace
+
 int Circle(const CCharacter& chr) {
     char maybe_circle = chr.Nick[0];
     if (IsSolo(chr)) {
@@ -35,44 +46,44 @@ bool Allowed(CCharacter& chr) {
     }
 
     // Have they maxed out stats? We don't check the body, as the player needs to clear out QUEST_T4 to get everything to 76.
-    if (chr.Reaction < thresholds::thresholds.Value("hell.stats.reaction", chr, NIGHTMARE)) {
+    if (chr.Reaction < thresholds::thresholds.Value(HELL_STATS_REACTION, chr, NIGHTMARE)) {
         Printf(LOG_Info, "[circle] '%s' failed to circle: reaction", chr.GetFullName().c_str());
         return false;
     }
-    if (chr.Mind < thresholds::thresholds.Value("hell.stats.mind", chr, NIGHTMARE)) {
+    if (chr.Mind < thresholds::thresholds.Value(HELL_STATS_MIND, chr, NIGHTMARE)) {
         Printf(LOG_Info, "[circle] '%s' failed to circle: mind", chr.GetFullName().c_str());
         return false;
     }
-    if (chr.Spirit < thresholds::thresholds.Value("hell.stats.spirit", chr, NIGHTMARE)) {
+    if (chr.Spirit < thresholds::thresholds.Value(HELL_STATS_SPIRIT, chr, NIGHTMARE)) {
         Printf(LOG_Info, "[circle] '%s' failed to circle: spirit", chr.GetFullName().c_str());
         return false;
     }
 
     // Are they experienced enough?
-    uint32_t need_experience = thresholds::thresholds.Value("hell.experience", chr, NIGHTMARE);
+    uint32_t need_experience = thresholds::thresholds.Value(HELL_EXPERIENCE, chr, NIGHTMARE);
     if (chr.TotalExperience() < need_experience) {
         Printf(LOG_Info, "[circle] '%s' failed to circle: stats", chr.GetFullName().c_str());
         return false;
     }
 
     // Do they have the money for the ticket?    
-    uint32_t price = thresholds::thresholds.Value("hell.money", chr, NIGHTMARE);
+    uint32_t price = thresholds::thresholds.Value(HELL_MONEY, chr, NIGHTMARE);
     if (chr.Money < price) {
         Printf(LOG_Info, "[circle] '%s' failed to circle: money", chr.GetFullName().c_str());
         return false;
     }
 
     // Have they learned enough about the monsters?
-    auto* mobs = thresholds::thresholds.Mobs("hell.mobs", chr, NIGHTMARE);
-    if (mobs) {
+    auto mobs = thresholds::thresholds.Mobs(HELL_MOBS, chr, NIGHTMARE);
+    if (!mobs.empty()) {
         KillStats stats;
         if (!stats.Unmarshal(chr.Section55555555)) {
             return true; // Should not happen. Return `true` to simplify tests.
         }
 
-        for (auto it = mobs->begin(); it != mobs->end(); ++it) {
-            if (stats.by_server_id[it->first] < it->second) {
-                Printf(LOG_Info, "[circle/kills] Player %s has %d kills of %d, want %d\n", chr.GetFullName().c_str(), stats.by_server_id[it->first], it->first, it->second);
+        for (const auto& mob : mobs) {
+            if (stats.by_server_id[mob.id] < mob.kills) {
+                Printf(LOG_Info, "[circle/kills] Player %s has %d kills of %d, want %d\n", chr.GetFullName().c_str(), stats.by_server_id[mob.id], mob.id, mob.kills);
                 return false;
             }
         }
@@ -1,4 +1,5 @@
 #include "client.hpp"
+#include "admission.h"
 #include "utils.hpp"
 #include <winsock2.h>
 #include <ctime>
@@ -6,44 +7,96 @@
 #include "config.hpp"
 #include "constants.h"
 #include "login.hpp"
+#include "cp866.h"
+#include "nickname.h"
 #include "session.hpp"
 #include "version.hpp"
 #include "server_id.hpp"
 #include <algorithm>
 
 #include "server.hpp"
+#include "server_list.h"
+#include "timers.h"
+#include "trace.h"
 #include "character.hpp"
 
 #include "session.hpp"
 #include "CRC_32.h"
 
-std::vector<Client*> Clients;
+slots::Map<Client> Clients;
+static slots::Pool<ClientInfo> ClientInfos;
+
+// sets `timer` in conn->Expired after `seconds`; the timer is cancelled by CL_Disconnect
+static uint64_t CL_Schedule(Client* conn, uint32_t timer, unsigned long seconds)
+{
+    ClientHandle handle = conn->Handle;
+    return timers::wheel.Schedule(seconds * 1000, [handle, timer]()
+    {
+        if(Client* conn = Clients.Get(handle)) conn->Expired |= timer;
+    });
+}
+
+static void CL_Cancel(uint64_t& timer)
+{
+    timers::wheel.Cancel(timer);
+    timer = 0;
+}
+
+// the connection no longer counts against Config::MaxPreAuth
+static void CL_LoggedIn(Client* conn)
+{
+    if(!(conn->Flags & CLIENT_LOGGED_IN))
+        admission::limiter.Authenticated();
+    conn->Flags |= CLIENT_LOGGED_IN;
+    CL_Cancel(conn->Info->IdleTimer);
+}
+
+bool CL_Admit(sockaddr_in addr)
+{
+    std::string admin_name;
+    bool blocked = (IPFilter::Global().CheckAddress(inet_ntoa(addr.sin_addr), admin_name) == -1);
+
+    admission::Settings settings;
+    settings.rate = Config::ConnectRate;
+    settings.burst = Config::ConnectBurst;
+    settings.prefix_bits = Config::ConnectPrefix;
+    settings.max_preauth = Config::MaxPreAuth;
+
+    // no log line per connection: that is what a flood wants
+    return (admission::limiter.Admit(ntohl(addr.sin_addr.s_addr), blocked, timers::Now(), settings) == admission::RESULT_ADMITTED);
+}
 
 bool CL_AddConnection(SOCKET socket, sockaddr_in addr)
 {
-    Client* cl = new Client();
-    if(!cl) return false;
+    if(!CL_Admit(addr)) return false;
 
-    cl->HisIP = inet_ntoa(addr.sin_addr);
-    cl->HisPort = ntohs(addr.sin_port);
-    cl->HisAddr = Format("%s:%u", cl->HisIP.c_str(), cl->HisPort);
+    ClientHandle handle = Clients.Insert();
+    Client* cl = Clients.Get(handle);
+    cl->Handle = handle;
+    cl->Info = ClientInfos.New();
+
+    cl->Info->HisIP = inet_ntoa(addr.sin_addr);
+    cl->Info->HisPort = ntohs(addr.sin_port);
+    cl->Info->HisAddr = Format("%s:%u", cl->Info->HisIP.c_str(), cl->Info->HisPort);
 
     cl->Version = 0;
     cl->Flags = CLIENT_CONNECTED;
 
-    cl->GameMode = 0;
+    cl->Info->GameMode = 0;
     cl->Socket = socket;
 
     cl->Receiver.Connect(cl->Socket);
+    trace::Opened(socket, trace::PEER_CLIENT, addr);
 
-    cl->JoinTime = GetTickCount();
-    cl->IsBot = false;
-
-    cl->DoNotUnlock = false;
+    cl->Expired = 0;
+    cl->Info->IdleTimer = CL_Schedule(cl, CLIENT_TIMER_IDLE, Config::ClientTimeout);
+    cl->Info->ActiveTimer = CL_Schedule(cl, CLIENT_TIMER_ACTIVE, Config::ClientActiveTimeout);
+    cl->Info->SessionTimer = 0;
+    cl->Info->IsBot = false;
 
-    Printf(LOG_Trivial, "[CL] %s - Connected.\n", cl->HisAddr.c_str());
+    cl->Info->DoNotUnlock = false;
 
-    Clients.push_back(cl);
+    Printf(LOG_Trivial, "[CL] %s - Connected.\n", cl->Info->HisAddr.c_str());
     return true;
 }
 
@@ -78,26 +131,26 @@ bool CL_Screenshot(Client* conn, Packet& pack)
 
     if (!server)
     {
-        Printf(LOG_Error, "[CL] %s (%s) - Client tried to send a screenshot for unknown server, ignoring.\n", conn->HisAddr.c_str(), login.c_str());
+        Printf(LOG_Error, "[CL] %s (%s) - Client tried to send a screenshot for unknown server, ignoring.\n", conn->Info->HisAddr.c_str(), login.c_str());
         return false;
     }
 
-    conn->SessionServer = server;
-    conn->SessionID1 = uid;
+    conn->Info->SessionServer = server;
+    conn->Info->SessionID1 = uid;
 
     if (status == 0)
     {
-        Printf(LOG_Info, "[CL] %s (%s) - Client is sending a screenshot from server ID %u.\n", conn->HisAddr.c_str(), login.c_str(), server->Number);
+        Printf(LOG_Info, "[CL] %s (%s) - Client is sending a screenshot from server ID %u.\n", conn->Info->HisAddr.c_str(), login.c_str(), server->Number);
         SLCMD_Screenshot(server, login, uid, false, "");
-        conn->Login = login;
+        conn->Info->Login = login;
         conn->Flags |= CLIENT_SCREENSHOT;
         return true;
     }
     else
     {
-        Printf(LOG_Info, "[CL] %s (%s) - Client sent a screenshot (located in \"%s\") to server ID %u.\n", conn->HisAddr.c_str(), login.c_str(), url.c_str(), server->Number);
+        Printf(LOG_Info, "[CL] %s (%s) - Client sent a screenshot (located in \"%s\") to server ID %u.\n", conn->Info->HisAddr.c_str(), login.c_str(), url.c_str(), server->Number);
         SLCMD_Screenshot(server, login, uid, true, url);
-        conn->SessionServer = NULL;
+        conn->Info->SessionServer = NULL;
         return false;
     }
 }
@@ -109,17 +162,17 @@ bool CL_Process(Client* conn)
     if(!conn->Receiver.Receive(conn->Version)) return false;
 
     // inactive kick
-    if(GetTickCount()-conn->JoinTime > (Config::ClientTimeout*1000) && !(conn->Flags & (CLIENT_LOGGED_IN|CLIENT_PATCHFILE)))
+    if((conn->Expired & CLIENT_TIMER_IDLE) && !(conn->Flags & (CLIENT_LOGGED_IN|CLIENT_PATCHFILE)))
     {
-        Printf(LOG_Warning, "[CL] %s - Client has timed out.\n", conn->HisAddr.c_str());
+        Printf(LOG_Warning, "[CL] %s - Client has timed out.\n", conn->Info->HisAddr.c_str());
         CLCMD_Kick(conn, P_FHTAGN);
         return false;
     }
 
     // active kick
-    if(GetTickCount()-conn->JoinTime > (Config::ClientActiveTimeout*1000) && !(conn->Flags & (CLIENT_PATCHFILE)))
+    if((conn->Expired & CLIENT_TIMER_ACTIVE) && !(conn->Flags & (CLIENT_PATCHFILE)))
     {
-        Printf(LOG_Warning, "[CL] %s%s - Client (active) has timed out.\n", conn->HisAddr.c_str(), (conn->Login.length() ? Format(" (%s)", conn->Login.c_str()).c_str() : ""));
+        Printf(LOG_Warning, "[CL] %s%s - Client (active) has timed out.\n", conn->Info->HisAddr.c_str(), (conn->Info->Login.length() ? Format(" (%s)", conn->Info->Login.c_str()).c_str() : ""));
         CLCMD_Kick(conn, P_FHTAGN);
         return false;
     }
@@ -141,7 +194,7 @@ bool CL_Process(Client* conn)
         }
         else if ((packet_uid != SCREENSHOT_PID) && (conn->Flags & CLIENT_SCREENSHOT))
         {
-            Printf(LOG_Error, "[CL] %s (%s) - Client sent unexpected packet while in screenshot state.\n", conn->HisAddr.c_str(), conn->Login.c_str());
+            Printf(LOG_Error, "[CL] %s (%s) - Client sent unexpected packet while in screenshot state.\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str());
             return false;
         }
 
@@ -161,7 +214,7 @@ bool CL_Process(Client* conn)
         switch(packet_id)
         {
             default:
-                Printf(LOG_Error, "[CL] %s%s - Received unknown packet %02X.\n", conn->HisAddr.c_str(), (conn->Login.length() ? Format(" (%s)", conn->Login.c_str()).c_str() : ""), packet_id);
+                Printf(LOG_Error, "[CL] %s%s - Received unknown packet %02X.\n", conn->Info->HisAddr.c_str(), (conn->Info->Login.length() ? Format(" (%s)", conn->Info->Login.c_str()).c_str() : ""), packet_id);
                 return false;
             case 0xCA: // character request
                 if(!CL_Character(conn, pack)) return false;
@@ -197,23 +250,22 @@ bool CL_PatchDownload(Client* conn, Packet& pack)
 
 bool CL_ServerProcess(Client* conn)
 {
-    if(conn->IsBot)
+    if(conn->Info->IsBot)
     {
         CLCMD_Kick(conn, P_WRONG_VERSION);
         return false;
     }
 
-    uint32_t dtime = static_cast<uint32_t>(time(NULL));
-    if((dtime - conn->SessionTime) > 15)
+    if(conn->Expired & CLIENT_TIMER_SESSION)
     {
-        SESSION_DelLogin(conn->SessionID1, conn->SessionID2);
+        SESSION_DelLogin(conn->Info->SessionID1, conn->Info->SessionID2);
         return false;
     }
 
-    unsigned long result = SESSION_GetLogin(conn->SessionID1, conn->SessionID2);
+    unsigned long result = SESSION_GetLogin(conn->Info->SessionID1, conn->Info->SessionID2);
     if(result == 0xFFFFFFFF) return true;
 
-    SESSION_DelLogin(conn->SessionID1, conn->SessionID2);
+    SESSION_DelLogin(conn->Info->SessionID1, conn->Info->SessionID2);
 
     if(result == 0xBADFACE0) // db error
     {
@@ -276,30 +328,30 @@ bool CL_ServerProcess(Client* conn)
 
     if(retval != 0)
     {
-        Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by server ID %u (reason: %s).\n", conn->HisAddr.c_str(), conn->Login.c_str(), conn->SessionNickname.c_str(), conn->SessionServer->Number, cas.c_str());
+        Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by server ID %u (reason: %s).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), conn->Info->SessionNickname.c_str(), conn->Info->SessionServer->Number, cas.c_str());
         CLCMD_Kick(conn, retval);
         return false;
     }
 
-    Login_SetLocked(conn->Login, false, true, conn->SessionID1, conn->SessionID2, conn->SessionServer->Number);
-    if(!CLCMD_EnterSuccess(conn, conn->SessionID1, conn->SessionID2))
+    Login_SetLocked(conn->Info->Login, false, true, conn->Info->SessionID1, conn->Info->SessionID2, conn->Info->SessionServer->Number);
+    if(!CLCMD_EnterSuccess(conn, conn->Info->SessionID1, conn->Info->SessionID2))
         return false;
-    Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" entered server ID %u.\n", conn->HisAddr.c_str(), conn->Login.c_str(), conn->SessionNickname.c_str(), conn->SessionServer->Number);
+    Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" entered server ID %u.\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), conn->Info->SessionNickname.c_str(), conn->Info->SessionServer->Number);
 
     bool l_muted = false;
     unsigned long l_muted_date;
     unsigned long l_muted_unmutedate;
     std::string l_reason;
-    if (!Login_GetMuted(conn->Login, l_muted, l_muted_date, l_muted_unmutedate, l_reason))
+    if (!Login_GetMuted(conn->Info->Login, l_muted, l_muted_date, l_muted_unmutedate, l_reason))
     {
-        Printf(LOG_Error, "[DB] Error: Login_GetMuted(\"%s\", ...).\n", conn->Login.c_str());
+        Printf(LOG_Error, "[DB] Error: Login_GetMuted(\"%s\", ...).\n", conn->Info->Login.c_str());
         l_muted = false;
     }
 
     if (l_muted && l_muted_unmutedate > static_cast<unsigned long>(time(NULL)))
     {
-        Printf(LOG_Info, "[CL] %s (%s) - Character should be muted (reason: %s).\n", conn->HisAddr.c_str(), conn->Login.c_str(), l_reason.c_str());
-        SLCMD_MutePlayer(conn->SessionServer, conn->Login, l_muted_unmutedate);
+        Printf(LOG_Info, "[CL] %s (%s) - Character should be muted (reason: %s).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), l_reason.c_str());
+        SLCMD_MutePlayer(conn->Info->SessionServer, conn->Info->Login, l_muted_unmutedate);
     }
 
     return false;
@@ -307,30 +359,36 @@ bool CL_ServerProcess(Client* conn)
 
 void CL_Disconnect(Client* conn)
 {
-    if ((conn->Flags & CLIENT_SCREENSHOT) && conn->SessionServer)
-        SLCMD_Screenshot(conn->SessionServer, conn->Login, conn->SessionID1, true, "");
+    if ((conn->Flags & CLIENT_SCREENSHOT) && conn->Info->SessionServer)
+        SLCMD_Screenshot(conn->Info->SessionServer, conn->Info->Login, conn->Info->SessionID1, true, "");
 
-    Printf(LOG_Trivial, "[CL] %s%s - Disconnected.\n", conn->HisAddr.c_str(), (conn->Login.length() ? Format(" (%s)", conn->Login.c_str()).c_str() : ""));
-    if(!conn->DoNotUnlock && conn->Login.length() && !Login_UnlockOne(conn->Login))
-        Printf(LOG_Error, "[DB] Error: Login_UnlockOne(\"%s\").\n", conn->Login.c_str());
+    Printf(LOG_Trivial, "[CL] %s%s - Disconnected.\n", conn->Info->HisAddr.c_str(), (conn->Info->Login.length() ? Format(" (%s)", conn->Info->Login.c_str()).c_str() : ""));
+    if(!conn->Info->DoNotUnlock && conn->Info->Login.length() && !Login_UnlockOne(conn->Info->Login))
+        Printf(LOG_Error, "[DB] Error: Login_UnlockOne(\"%s\").\n", conn->Info->Login.c_str());
     SOCK_Destroy(conn->Socket);
     conn->Socket = 0;
+    if((conn->Flags & CLIENT_CONNECTED) && !(conn->Flags & CLIENT_LOGGED_IN))
+        admission::limiter.Authenticated();
     conn->Flags &= ~CLIENT_CONNECTED;
+
+    CL_Cancel(conn->Info->IdleTimer);
+    CL_Cancel(conn->Info->ActiveTimer);
+    CL_Cancel(conn->Info->SessionTimer);
 }
 
 void Net_ProcessClients()
 {
-    for(std::vector<Client*>::iterator it = Clients.begin(); it != Clients.end(); ++it)
+    timers::wheel.Advance(timers::Now());
+
+    // backwards: Clients.Erase moves the last client into the erased one's place, which is already done
+    for(size_t i = Clients.Size(); i-- > 0; )
     {
-        Client* conn = (*it);
+        Client* conn = Clients.At(i);
         if(!CL_Process(conn))
         {
-            std::vector<Client*>::iterator do_it = it;
-            it--;
-            Clients.erase(do_it);
-
             CL_Disconnect(conn);
-            delete conn;
+            ClientInfos.Delete(conn->Info);
+            Clients.Erase(conn->Handle);
         }
     }
 }
@@ -345,11 +403,11 @@ void CL_VersionInfo(Client* conn, Packet& pack)
     uint32_t key = key1;
     key <<= 16;
     key |= key2;
-    //conn->ClientKey = key;
+    //conn->Info->ClientKey = key;
     uint32_t sesskey = key ^ 0xDEADFACE;
 
     uint32_t sessid = V_AddSession(key) ^ sesskey;
-    //conn->ClientID = sessid;
+    //conn->Info->ClientID = sessid;
     Packet pck;
     pck << (uint8_t)0xFF;
     pck << sessid;
@@ -360,17 +418,12 @@ void CL_VersionInfo(Client* conn, Packet& pack)
 
 bool CL_Login(Client* conn, Packet& pack)
 {
-    std::ifstream ifs;
-    ifs.open("redhat.ipf", std::ios::in);
     int32_t admin_level = 0;
     int32_t access_level = 0;
     std::string admin_name = "";
-    IPFilter::IPFFile ipf;
-    if(ifs.is_open())
+    IPFilter::IPFFile& ipf = IPFilter::Global();
     {
-        std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-        ipf.ReadIPF(str);
-        int32_t result = ipf.CheckAddress(conn->HisIP, admin_name);
+        int32_t result = ipf.CheckAddress(conn->Info->HisIP, admin_name);
         if(result == 2 || result == 3)
         {
             admin_level = result - 1;
@@ -380,7 +433,6 @@ bool CL_Login(Client* conn, Packet& pack)
             admin_level = -10;
         }
         access_level = result;
-        ifs.close();
     }
 
     admin_name = Trim(admin_name);
@@ -447,7 +499,7 @@ bool CL_Login(Client* conn, Packet& pack)
 
     if(conn->Version == 0)
     {
-        Printf(LOG_Error, "[CL] %s - Unknown client version (signature %02X).\n", conn->HisAddr.c_str(), cr);
+        Printf(LOG_Error, "[CL] %s - Unknown client version (signature %02X).\n", conn->Info->HisAddr.c_str(), cr);
         CLCMD_Kick(conn, P_WRONG_VERSION);
         return false;
     }
@@ -483,7 +535,7 @@ bool CL_Login(Client* conn, Packet& pack)
         uint32_t prc_uuid_crc_original = *(uint32_t*)(datatmp + 0x2C) ^ net_key;
         if(prc_uuid_crc_original != prc_uuid_crc)
         {
-            Printf(LOG_Error, "[CL] %s - Hacking: UUID has been tampered with.\n", conn->HisAddr.c_str());
+            Printf(LOG_Error, "[CL] %s - Hacking: UUID has been tampered with.\n", conn->Info->HisAddr.c_str());
             CLCMD_Kick(conn, P_FHTAGN);
             return false;
         }
@@ -535,13 +587,13 @@ bool CL_Login(Client* conn, Packet& pack)
 
         if(badcrc)
         {
-            Printf(LOG_Error, "[CL] %s - Client CRC mismatch (%s).\n", conn->HisAddr.c_str(), crcstr.c_str());
+            Printf(LOG_Error, "[CL] %s - Client CRC mismatch (%s).\n", conn->Info->HisAddr.c_str(), crcstr.c_str());
             if(admin_level < 1)
             {
                 CLCMD_Kick(conn, P_WRONG_VERSION);
                 return false;
             }
-            else Printf(LOG_Info, "[CL] %s - Admin access used (auth: %s)\n", conn->HisAddr.c_str(), admin_name.c_str());
+            else Printf(LOG_Info, "[CL] %s - Admin access used (auth: %s)\n", conn->Info->HisAddr.c_str(), admin_name.c_str());
         }
     }
 
@@ -553,12 +605,12 @@ bool CL_Login(Client* conn, Packet& pack)
     {
         if(admin_level == -10) // ex-lend
         {
-            Printf(LOG_Warning, "[CL] %s - Switching to bot mode...\n", conn->HisAddr.c_str());
-            conn->IsBot = true;
+            Printf(LOG_Warning, "[CL] %s - Switching to bot mode...\n", conn->Info->HisAddr.c_str());
+            conn->Info->IsBot = true;
         }
         else
         {
-            Printf(LOG_Error, "[CL] %s - Client connected with wrong protocol version (%u).\n", conn->HisAddr.c_str(), conn->Version);
+            Printf(LOG_Error, "[CL] %s - Client connected with wrong protocol version (%u).\n", conn->Info->HisAddr.c_str(), conn->Version);
             CLCMD_Kick(conn, P_WRONG_VERSION);
             return false;
         }
@@ -572,23 +624,23 @@ bool CL_Login(Client* conn, Packet& pack)
        p_gamemode != GAMEMODE_Softcore &&
        p_gamemode != GAMEMODE_Sandbox)
     {
-        Printf(LOG_Error, "[CL] %s - Bad game mode %u.\n", conn->HisAddr.c_str(), p_gamemode);
+        Printf(LOG_Error, "[CL] %s - Bad game mode %u.\n", conn->Info->HisAddr.c_str(), p_gamemode);
         CLCMD_Kick(conn, P_BAD_GAMEMODE);
         return false;
     }
 
     if (p_gamemode == GAMEMODE_Softcore)
-        conn->HatID = Config::HatIDSoftcore;
+        conn->Info->HatID = Config::HatIDSoftcore;
     else if (p_gamemode == GAMEMODE_Sandbox)
-        conn->HatID = Config::HatIDSandbox;
+        conn->Info->HatID = Config::HatIDSandbox;
     else if (p_gamemode == GAMEMODE_Arena)
-        conn->HatID = 0xFFFFFFFF;
-    else conn->HatID = Config::HatID;
+        conn->Info->HatID = 0xFFFFFFFF;
+    else conn->Info->HatID = Config::HatID;
 
-    if(conn->IsBot) // ex-lend
+    if(conn->Info->IsBot) // ex-lend
     {
-        conn->GameMode = p_gamemode;
-        conn->Flags |= CLIENT_LOGGED_IN;
+        conn->Info->GameMode = p_gamemode;
+        CL_LoggedIn(conn);
         return CLCMD_SendCharacterList(conn);
     }
 
@@ -604,7 +656,7 @@ bool CL_Login(Client* conn, Packet& pack)
 
     if(access_level == -1)
     {
-        Printf(LOG_Error, "[CL] %s (%s) - IP blocked by global rules.\n", conn->HisAddr.c_str(), s_login.c_str());
+        Printf(LOG_Error, "[CL] %s (%s) - IP blocked by global rules.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
         CLCMD_Kick(conn, P_FHTAGN); // "Ктулху фхтагн!"
         return false;
     }
@@ -615,8 +667,8 @@ bool CL_Login(Client* conn, Packet& pack)
 
     if(access_level == -100)
     {
-        Printf(LOG_Error, "[CL] %s (%s) - UUID blocked by global rules.\n", conn->HisAddr.c_str(), s_login.c_str());
-        Printf(LOG_Info, "[CL] %s (%s) - UUID: %s.\n", conn->HisAddr.c_str(), s_login.c_str(), uuid.c_str());
+        Printf(LOG_Error, "[CL] %s (%s) - UUID blocked by global rules.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
+        Printf(LOG_Info, "[CL] %s (%s) - UUID: %s.\n", conn->Info->HisAddr.c_str(), s_login.c_str(), uuid.c_str());
         CLCMD_Kick(conn, P_FHTAGN);
         return false;
     }
@@ -624,10 +676,10 @@ bool CL_Login(Client* conn, Packet& pack)
     if(!Login_Exists(s_login))
     {
         if(Config::AutoRegister && Login_Create(s_login, s_password))
-            Printf(LOG_Info, "[CL] %s - Auto-registered login %s.\n", conn->HisAddr.c_str(), s_login.c_str(), s_login.c_str());
+            Printf(LOG_Info, "[CL] %s - Auto-registered login %s.\n", conn->Info->HisAddr.c_str(), s_login.c_str(), s_login.c_str());
         else
         {
-            Printf(LOG_Error, "[CL] %s - Tried to open non-existent login %s.\n", conn->HisAddr.c_str(), s_login.c_str());
+            Printf(LOG_Error, "[CL] %s - Tried to open non-existent login %s.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
             CLCMD_Kick(conn, P_WRONG_CREDENTIALS);
             return false;
         }
@@ -645,19 +697,19 @@ bool CL_Login(Client* conn, Packet& pack)
     {
         IPFilter::IPFFile ipf;
         ipf.ReadIPF(l_ipf);
-        if(ipf.CheckAddress(conn->HisIP, admin_name) != 1)
+        if(ipf.CheckAddress(conn->Info->HisIP, admin_name) != 1)
         {
             if(CheckInt(s_login) && (admin_level >= 1))
             {
-                Printf(LOG_Warning, "[CL] %s (%s) - IP blocked by local rules, GM access used (auth: %s)\n", conn->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
+                Printf(LOG_Warning, "[CL] %s (%s) - IP blocked by local rules, GM access used (auth: %s)\n", conn->Info->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
             }
             else if(!CheckInt(s_login) && (admin_level >= 2))
             {
-                Printf(LOG_Warning, "[CL] %s (%s) - IP blocked by local rules, admin access used (auth: %s)\n", conn->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
+                Printf(LOG_Warning, "[CL] %s (%s) - IP blocked by local rules, admin access used (auth: %s)\n", conn->Info->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
             }
             else if(!admin_level)
             {
-                Printf(LOG_Error, "[CL] %s (%s) - IP blocked by local rules.\n", conn->HisAddr.c_str(), s_login.c_str());
+                Printf(LOG_Error, "[CL] %s (%s) - IP blocked by local rules.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
                 CLCMD_Kick(conn, P_IP_BLOCKED);
                 return false;
             }
@@ -677,15 +729,15 @@ bool CL_Login(Client* conn, Packet& pack)
     {
         if(CheckInt(s_login) && (admin_level >= 1))
         {
-            Printf(LOG_Warning, "[CL] %s (%s) - Password mismatch, GM access used (auth: %s)\n", conn->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
+            Printf(LOG_Warning, "[CL] %s (%s) - Password mismatch, GM access used (auth: %s)\n", conn->Info->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
         }
         else if(!CheckInt(s_login) && (admin_level >= 2))
         {
-            Printf(LOG_Warning, "[CL] %s (%s) - Password mismatch, admin access used (auth: %s)\n", conn->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
+            Printf(LOG_Warning, "[CL] %s (%s) - Password mismatch, admin access used (auth: %s)\n", conn->Info->HisAddr.c_str(), s_login.c_str(), admin_name.c_str());
         }
         else
         {
-            Printf(LOG_Error, "[CL] %s (%s) - Password mismatch.\n", conn->HisAddr.c_str(), s_login.c_str());
+            Printf(LOG_Error, "[CL] %s (%s) - Password mismatch.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
             CLCMD_Kick(conn, P_WRONG_CREDENTIALS);
             return false;
         }
@@ -718,16 +770,16 @@ bool CL_Login(Client* conn, Packet& pack)
 
         if((ban_time > unban_time) || (unban_time > 0x7FFFFFFF))
         {
-            Printf(LOG_Error, "[CL] %s (%s) - Login banned forever (reason: %s).\n", conn->HisAddr.c_str(), s_login.c_str(), ban_reason.c_str());
+            Printf(LOG_Error, "[CL] %s (%s) - Login banned forever (reason: %s).\n", conn->Info->HisAddr.c_str(), s_login.c_str(), ban_reason.c_str());
             if(conn->Version >= 20 && conn->Version <= 10) CLCMD_Kick(conn, P_LOGIN_BLOCKED_FVR);
             else CLCMD_Kick(conn, P_LOGIN_BLOCKED);
             ban_intime = true;
         }
         else if(ctime < unban_time)
         {
-            if(ban_time > ctime) Printf(LOG_Warning, "[CL] %s (%s) - Ban date is bigger than current date (by %us)!\n", conn->HisAddr.c_str(), s_login.c_str(), ban_time - ctime);
+            if(ban_time > ctime) Printf(LOG_Warning, "[CL] %s (%s) - Ban date is bigger than current date (by %us)!\n", conn->Info->HisAddr.c_str(), s_login.c_str(), ban_time - ctime);
 
-            Printf(LOG_Error, "[CL] %s (%s) - Login banned (reason: %s).\n", conn->HisAddr.c_str(), s_login.c_str(), ban_reason.c_str());
+            Printf(LOG_Error, "[CL] %s (%s) - Login banned (reason: %s).\n", conn->Info->HisAddr.c_str(), s_login.c_str(), ban_reason.c_str());
             CLCMD_Kick(conn, P_LOGIN_BLOCKED);
             ban_intime = true;
         }
@@ -756,33 +808,20 @@ bool CL_Login(Client* conn, Packet& pack)
             {
                 if(!srv->Connection || !srv->Connection->Active)
                 {
-                    Printf(LOG_Error, "[CL] %s (%s) - Locked on offline server ID %u!\n", conn->HisAddr.c_str(), s_login.c_str(), srv->Number);
+                    Printf(LOG_Error, "[CL] %s (%s) - Locked on offline server ID %u!\n", conn->Info->HisAddr.c_str(), s_login.c_str(), srv->Number);
                     CLCMD_Kick(conn, P_SERVER_OFFLINE);
                     return false;
                 }
 
                 if(srv->Info.ServerCaps & SERVER_CAP_DETAILED_INFO)
                 {
-                    bool char_on_server = false;
-                    for(std::vector<ServerPlayer>::iterator jt = srv->Info.Players.begin(); jt != srv->Info.Players.end(); ++jt)
-                    {
-                        ServerPlayer& player = (*jt);
-                        if(player.Login == s_login && player.Id1 == l_id1 && player.Id2 == l_id2)
-                            char_on_server = true;
-                    }
-
-                    for(std::vector<std::string>::iterator jt = srv->Info.Locked.begin(); jt != srv->Info.Locked.end(); ++jt)
-                    {
-                        std::string& login = (*jt);
-                        if(ToLower(login) == ToLower(s_login))
-                            char_on_server = true;
-                    }
+                    bool char_on_server = online::index.Holds(srv->Number, s_login, l_id1, l_id2);
 
                     if(!char_on_server && srv->Info.Time <= 15) char_on_server = true;
 
                     if(!char_on_server)
                     {
-                        Printf(LOG_Info, "[CL] %s (%s) - Login lock dropped (not on server ID %u).\n", conn->HisAddr.c_str(), s_login.c_str(), srv->Number);
+                        Printf(LOG_Info, "[CL] %s (%s) - Login lock dropped (not on server ID %u).\n", conn->Info->HisAddr.c_str(), s_login.c_str(), srv->Number);
                         r_cancel_lock = true;
                     }
                     /// ДЮП!!!!!
@@ -807,7 +846,7 @@ bool CL_Login(Client* conn, Packet& pack)
                 //if((((srv->Info.ServerMode & SVF_SOFTCORE) == SVF_SOFTCORE) != (p_gamemode == GAMEMODE_Softcore)) || (((srv->Info.ServerMode & SVF_SOFTCORE) != SVF_SOFTCORE) && (srv->Info.GameMode != p_gamemode)))
                 if (srv->Info.GameMode != p_gamemode)
                 {
-                    Printf(LOG_Error, "[CL] %s (%s) - Locked on server ID %u with different game mode (%u != %u)!\n", conn->HisAddr.c_str(), s_login.c_str(), srv->Number, p_gamemode, srv->Info.GameMode);
+                    Printf(LOG_Error, "[CL] %s (%s) - Locked on server ID %u with different game mode (%u != %u)!\n", conn->Info->HisAddr.c_str(), s_login.c_str(), srv->Number, p_gamemode, srv->Info.GameMode);
                     CLCMD_Kick(conn, P_WRONG_GAMEMODE);
                     return false;
                 }
@@ -842,14 +881,14 @@ bool CL_Login(Client* conn, Packet& pack)
                 }
 
                 if(!CLCMD_SendReconnect(conn, l_id1, l_id2, Format("%s:%u", srv->Address.c_str(), srv->Port)))return false;
-                Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" entered server ID %u (reconnected).\n", conn->HisAddr.c_str(), s_login.c_str(), c_nickname.c_str(), srv->Number);
+                Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" entered server ID %u (reconnected).\n", conn->Info->HisAddr.c_str(), s_login.c_str(), c_nickname.c_str(), srv->Number);
                 return false;
             }
         }
 
         if(!r_cancel_lock)
         {
-            Printf(LOG_Error, "[CL] %s (%s) - Login locked on invalid server ID %u!\n", conn->HisAddr.c_str(), s_login.c_str(), l_srvid);
+            Printf(LOG_Error, "[CL] %s (%s) - Login locked on invalid server ID %u!\n", conn->Info->HisAddr.c_str(), s_login.c_str(), l_srvid);
             CLCMD_Kick(conn, P_SERVER_INVALID);
             return false;
         }
@@ -860,19 +899,20 @@ bool CL_Login(Client* conn, Packet& pack)
         if(l_locked_hat)
         {
             // check if the client is actually online (most likely) and destroy the instance
-            for(size_t i = 0; i < Clients.size(); i++)
+            for(size_t i = 0; i < Clients.Size(); i++)
             {
-                if(Clients[i] == conn) continue;
-                if(Clients[i]->Login == s_login)
+                Client* other = Clients.At(i);
+                if(other == conn) continue;
+                if(other->Info->Login == s_login)
                 {
-                    Printf(LOG_Error, "[CL] %s (%s) - Discarding connection (logged in again).\n", Clients[i]->HisAddr.c_str(), s_login.c_str());
-                    CLCMD_Kick(Clients[i], P_LOGIN_EXISTS);
-                    SOCK_Destroy(Clients[i]->Socket);
-                    Clients[i]->DoNotUnlock = true;
+                    Printf(LOG_Error, "[CL] %s (%s) - Discarding connection (logged in again).\n", other->Info->HisAddr.c_str(), s_login.c_str());
+                    CLCMD_Kick(other, P_LOGIN_EXISTS);
+                    SOCK_Destroy(other->Socket);
+                    other->Info->DoNotUnlock = true;
                 }
             }
 
-            //Printf(LOG_Error, "[CL] %s (%s) - Login is hat-locked, rejecting.\n", conn->HisAddr.c_str(), s_login.c_str());
+            //Printf(LOG_Error, "[CL] %s (%s) - Login is hat-locked, rejecting.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
             //CLCMD_Kick(conn, P_LOGIN_EXISTS);
             //return false;
         }
@@ -880,7 +920,8 @@ bool CL_Login(Client* conn, Packet& pack)
         l_locked_hat = false;
 
         // 19.06.2014 dupe fix
-        for(std::vector<Server*>::iterator it = Servers.begin(); it != Servers.end(); ++it)
+        std::vector<int> holding = online::index.Servers(s_login, l_id1, l_id2);
+        for(std::vector<Server*>::iterator it = Servers.begin(); it != Servers.end() && !holding.empty(); ++it)
         {
             Server* srv = (*it);
             if(!srv) continue;
@@ -890,26 +931,13 @@ bool CL_Login(Client* conn, Packet& pack)
 
             if(srv->Info.ServerCaps & SERVER_CAP_DETAILED_INFO)
             {
-                bool char_on_server = false;
-                for(std::vector<ServerPlayer>::iterator jt = srv->Info.Players.begin(); jt != srv->Info.Players.end(); ++jt)
-                {
-                    ServerPlayer& player = (*jt);
-                    if(player.Login == s_login && player.Id1 == l_id1 && player.Id2 == l_id2)
-                        char_on_server = true;
-                }
-
-                for(std::vector<std::string>::iterator jt = srv->Info.Locked.begin(); jt != srv->Info.Locked.end(); ++jt)
-                {
-                    std::string& login = (*jt);
-                    if(ToLower(login) == ToLower(s_login))
-                        char_on_server = true;
-                }
+                bool char_on_server = (std::find(holding.begin(), holding.end(), srv->Number) != holding.end());
 
                 //if(!char_on_server && srv->Info.Time <= 15) char_on_server = true; /// убрано: люди не смогут входить на хэт во время смены любой карты
 
                 if(char_on_server)
                 {
-                    Printf(LOG_Error, "[CL] %s (%s) - Bug: login unlocked but still ingame (playing on server ID %u)!\n", conn->HisAddr.c_str(), s_login.c_str(), srv->Number);
+                    Printf(LOG_Error, "[CL] %s (%s) - Bug: login unlocked but still ingame (playing on server ID %u)!\n", conn->Info->HisAddr.c_str(), s_login.c_str(), srv->Number);
                     //CLCMD_Kick(conn, P_FHTAGN);
                     CLCMD_Kick(conn, P_LOGIN_EXISTS); // я не помню, что это... скорее всего "ваш логин уже в игре"
                     return false;
@@ -926,18 +954,18 @@ bool CL_Login(Client* conn, Packet& pack)
         return false;
     }
 
-    Printf(LOG_Info, "[CL] %s (%s) - Logged in successfully.\n", conn->HisAddr.c_str(), s_login.c_str());
-    Printf(LOG_Info, "[CL] %s (%s) - UUID: %s.\n", conn->HisAddr.c_str(), s_login.c_str(), uuid.c_str());
-    if (!Login_LogAuthentication(s_login, conn->HisIP, uuid))
+    Printf(LOG_Info, "[CL] %s (%s) - Logged in successfully.\n", conn->Info->HisAddr.c_str(), s_login.c_str());
+    Printf(LOG_Info, "[CL] %s (%s) - UUID: %s.\n", conn->Info->HisAddr.c_str(), s_login.c_str(), uuid.c_str());
+    if (!Login_LogAuthentication(s_login, conn->Info->HisIP, uuid))
     {
-        Printf(LOG_Error, "[DB] Error: Login_LogAuthentication(\"%s\", \"%s\", \"%s\").\n", s_login.c_str(), conn->HisIP.c_str(), uuid.c_str());
+        Printf(LOG_Error, "[DB] Error: Login_LogAuthentication(\"%s\", \"%s\", \"%s\").\n", s_login.c_str(), conn->Info->HisIP.c_str(), uuid.c_str());
         //CLCMD_Kick(conn, P_UPDATE_ERROR);
         //return false;
     }
 
-    conn->Login = s_login;
-    conn->GameMode = p_gamemode;
-    conn->Flags |= CLIENT_LOGGED_IN;
+    conn->Info->Login = s_login;
+    conn->Info->GameMode = p_gamemode;
+    CL_LoggedIn(conn);
     return CLCMD_SendCharacterList(conn);
 }
 
@@ -973,11 +1001,11 @@ void CLCMD_Kick(Client* conn, uint8_t reason)
 bool CLCMD_SendCharacterList(Client* conn)
 {
     std::vector<CharacterInfo> chars;
-    if(!conn->IsBot)
+    if(!conn->Info->IsBot)
     {
-        if(!Login_GetCharacterList(conn->Login, chars, conn->HatID))
+        if(!Login_GetCharacterList(conn->Info->Login, chars, conn->Info->HatID))
         {
-            Printf(LOG_Error, "[DB] Error: Login_GetCharacterList(\"%s\", <info>).\n", conn->Login.c_str());
+            Printf(LOG_Error, "[DB] Error: Login_GetCharacterList(\"%s\", <info>).\n", conn->Info->Login.c_str());
             CLCMD_Kick(conn, P_UPDATE_ERROR);
             return false;
         }
@@ -998,7 +1026,7 @@ bool CLCMD_SendCharacterList(Client* conn)
 
 bool CLCMD_SendCharacter(Client* conn, unsigned long id1, unsigned long id2)
 {
-    if(conn->IsBot)
+    if(conn->Info->IsBot)
     {
         CLCMD_Kick(conn, P_WRONG_VERSION);
         return false;
@@ -1008,9 +1036,9 @@ bool CLCMD_SendCharacter(Client* conn, unsigned long id1, unsigned long id2)
     unsigned long size;
     std::string nickname;
 
-    if(!Login_GetCharacter(conn->Login, id1, id2, size, data, nickname, (conn->GameMode == 2)) || !data)
+    if(!Login_GetCharacter(conn->Info->Login, id1, id2, size, data, nickname, (conn->Info->GameMode == 2)) || !data)
     {
-        Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <size>, <data>, <nickname>).\n", conn->Login.c_str(), id1, id2);
+        Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <size>, <data>, <nickname>).\n", conn->Info->Login.c_str(), id1, id2);
         CLCMD_Kick(conn, P_UPDATE_ERROR);
         return false;
     }
@@ -1054,10 +1082,9 @@ uint32_t ServerDifficultyLevel(ServerIDType server_id) {
     }
 }
 
-bool CLCMD_SendServerList(Client* conn)
+// the text of the 0xCD list for clients of game_mode, see server_list.h
+static std::string ServerListText(uint32_t game_mode)
 {
-    Packet pack;
-    pack << (uint8_t)0xCD;
     std::string list = "";
     unsigned long totalcnt = 0, currentcnt = 0;
     for(std::vector<Server*>::iterator it = Servers.begin(); it != Servers.end(); ++it)
@@ -1069,11 +1096,11 @@ bool CLCMD_SendServerList(Client* conn)
         if(!srv->Connection) continue;
         if(!srv->Connection->Active) continue;
         /*
-        if(srv->Info.GameMode != conn->GameMode &&
-           conn->GameMode != GAMEMODE_Softcore) continue;
-        if((conn->GameMode == GAMEMODE_Softcore) !=
+        if(srv->Info.GameMode != conn->Info->GameMode &&
+           conn->Info->GameMode != GAMEMODE_Softcore) continue;
+        if((conn->Info->GameMode == GAMEMODE_Softcore) !=
            ((srv->Info.ServerMode & SVF_SOFTCORE) == SVF_SOFTCORE)) continue;*/
-        if (srv->Info.GameMode != conn->GameMode) continue;
+        if (srv->Info.GameMode != game_mode) continue;
 
         std::string srv_name = srv->Name.c_str();
         std::string map_name = srv->Info.MapName;
@@ -1100,79 +1127,48 @@ bool CLCMD_SendServerList(Client* conn)
         currentcnt++;
     }
     list = Format("CURRENTCOUNT|%2u$BREAK\nTOTALSERVERS|%2u$BREAK\n\n", currentcnt, totalcnt) + list;
-    pack << (uint32_t)list.length();
-    pack.AppendData((uint8_t*)list.c_str(), (uint32_t)list.length()+1);
+    return list;
+}
 
-    return (SOCK_SendPacket(conn->Socket, pack, conn->Version) == 0);
+bool CLCMD_SendServerList(Client* conn)
+{
+    outbox::Frame wire = server_list::cache.Wire(conn->Info->GameMode, conn->Version, ServerListText);
+    trace::SentFrame(conn->Socket, *wire, conn->Version);
+    return (SOCK_SendWire(conn->Socket, *wire) == 0);
 }
 
 
 // trims to the right and to the left
 std::string TrimNickname(std::string nickname)
 {
-    size_t clanSep = nickname.find_first_of('|');
-    if (clanSep != std::string::npos) // non-position (-1)
-    {
-        return Trim(nickname.substr(0, clanSep))+"|"+Trim(nickname.substr(clanSep+1));
-    }
-    else
-    {
-        return Trim(nickname);
-    }
+    return nickname::Trim(nickname);
 }
 
 
-// character creation nickname check
-// (see chain of functions at CheckNickname())
-uint32_t CheckNickname_creation(std::string nickname, int hatId, bool secondary)
-{
-    size_t w = nickname.find_first_of('|');
-    if (w == nickname.npos)
-        w = nickname.length();
-
-    bool in_clan = false;
+// what the client is told for each `nickname::Result`
+static const uint32_t NICKNAME_RESULTS[] = { 0, P_SHORT_NAME, P_BAD_CHARACTER, P_WRONG_NAME };
 
-    if (nickname[nickname.length()-1] == '|')
+// characters and length by `rules`, then whether the name is taken
+static uint32_t CheckNicknameRules(const std::string& nickname, int hatId, bool secondary, nickname::Rules rules, bool fromDB)
+{
+    nickname::Result checked = nickname::Check(nickname, rules, secondary);
+    if(checked == nickname::RESULT_WRONG)
         return P_WRONG_NAME;
 
-    unsigned long result = 0;
+    uint32_t result = NICKNAME_RESULTS[checked];
+    if(!secondary && Login_NickExists(std::string(nickname::Name(nickname)), hatId, fromDB))
+        result = P_NAME_EXISTS;
 
-    if (w < 3 && !secondary)       // min. lenght
-        result = P_SHORT_NAME;
-    else if (w > 10 && !secondary) // max. lenght
-        result = P_BAD_CHARACTER;
-    else                           // check characters
-    {
-        for (size_t i = 0; i < nickname.length(); i++)
-        {
-            uint8_t ch = nickname[i];
-            if (ch == '|' && !in_clan)
-            {
-                in_clan = true;
-                continue;
-            }
-
-            if (ch < 0x20)
-                return P_WRONG_NAME;
-
-            // characters which are allowed in nickname
-            bool allowed = (ch >= 'A' && ch <= 'Z') ||
-                           (ch >= 'a' && ch <= 'z') ||
-                           (i == 0 && // ...first character can be:
-                           (ch == '@' || ch == '_' || ch == '!'));
-
-            if (!allowed) return P_WRONG_NAME;
-        }
-    }
+    return result;
+}
 
-    if (!secondary)
-    {
-        if (w < nickname.length())
-            nickname.erase(w);
-        if (Login_NickExists(nickname, hatId)) result = P_NAME_EXISTS;
-    }
 
-    return result;
+// character creation nickname check: latin letters only, the first one can also be '@', '_' or '!'
+// (see chain of functions at CheckNickname())
+uint32_t CheckNickname_creation(std::string nickname, int hatId, bool secondary)
+{
+    // right before the character is created, so ask the DB rather than the nickname index
+    return CheckNicknameRules(nickname, hatId, secondary, nickname::RULES_CREATION, true);
 }
 
 /*
@@ -1183,7 +1179,7 @@ bool CL_CheckNickname(conn, pack)    <- (Client* conn, Packet& pack)
 
 std::string TrimNickname(nickname)   <- (std::string nickname)
 
----> uint32_t CheckNickname(nickname, conn->HatID)   <- (std::string nickname, int hatId, bool secondary)
+---> uint32_t CheckNickname(nickname, conn->Info->HatID)   <- (std::string nickname, int hatId, bool secondary)
 
 bool CLCMD_SendNicknameResult(conn, result)  <- (Client* conn, unsigned long result)
 
@@ -1193,72 +1189,7 @@ int SOCK_SendPacket(conn->Socket, pack, conn->Version)   <- (SOCKET socket, Pack
 // regular character's nickname check
 uint32_t CheckNickname(std::string nickname, int hatId, bool secondary)
 {
-    size_t w = nickname.find_first_of('|');
-    if(w == nickname.npos)
-        w = nickname.length();
-
-    bool in_clan = false;
-
-    if(nickname[nickname.length()-1] == '|')
-        return P_WRONG_NAME;
-
-    unsigned long result = 0;
-    if(w < 3 && !secondary) result = P_SHORT_NAME;
-    else if(w > 10 && !secondary) result = P_BAD_CHARACTER;
-    else
-    {
-        for(size_t i = 0; i < nickname.length(); i++)
-        {
-            uint8_t ch = nickname[i];
-            if(ch == '|' && !in_clan)
-            {
-                in_clan = true;
-                continue;
-            }
-
-            if(ch < 0x20)
-                return P_WRONG_NAME;
-
-            bool allowed = ((ch >= 0x30 && ch <= 0x39) || // 0..9
-                            (ch >= 0x41 && ch <= 0x5A) || // A..Z
-                            (ch >= 0x61 && ch <= 0x7A) || // a..z
-                            (ch == '-') ||
-                            (ch == ' ') ||
-                            (ch >= 0x80 && ch <= 0x9F) || // А..Я
-                            (ch >= 0xA0 && ch <= 0xAF) || // а..п
-                            (ch >= 0xE0 && ch <= 0xEF) || // р..я
-                            (ch == 0xF0 || ch == 0xF1) || // Ё ё
-                            (ch == '!' || ch == '?') ||
-                            (ch == '@') ||
-                            (ch == '.') ||
-                            (ch == '=') ||
-                            (ch == '+') ||
-                            (ch == '_') ||
-                            (ch == '$') ||
-                            (ch == '(') || (ch == ')') ||
-                            (ch == '<') || (ch == '>') ||
-                            (in_clan && ( // ТОЛЬКО В ПРИПИСАХ
-                                (ch == 0x7F) || // 0x7F квадрат
-                                (ch == '{' || ch == '}'/* || ch == '|'*/) ||
-                                //(ch == '[' || ch == ']') ||
-                                (ch == ':' || ch == ';') ||
-                                (ch == '*' || ch == '^') ||
-                                (ch == '#') ||
-                                (ch == '<' || ch == '>') ||
-                                (ch == '&'))));
-
-            if(!allowed) return P_WRONG_NAME;
-        }
-    }
-
-    if(!secondary)
-    {
-        if(w < nickname.length())
-            nickname.erase(w);
-        if(Login_NickExists(nickname, hatId)) result = P_NAME_EXISTS;
-    }
-
-    return result;
+    return CheckNicknameRules(nickname, hatId, secondary, nickname::RULES_REGULAR, false);
 }
 
 bool CL_CheckEasyQuestItem(const CItem& item)
@@ -1361,7 +1292,7 @@ bool IsCharacterAllowed(const CCharacter& chr, ServerIDType srvid) {
 
 bool CL_EnterServer(Client* conn, Packet& pack)
 {
-    if(conn->IsBot)
+    if(conn->Info->IsBot)
     {
         CLCMD_Kick(conn, P_WRONG_VERSION);
         return false;
@@ -1395,9 +1326,9 @@ bool CL_EnterServer(Client* conn, Packet& pack)
     bool l_locked_hat, l_locked;
     unsigned long l_id1, l_id2;
     ServerIDType l_srvid;
-    if(!Login_GetLocked(conn->Login, l_locked_hat, l_locked, l_id1, l_id2, l_srvid))
+    if(!Login_GetLocked(conn->Info->Login, l_locked_hat, l_locked, l_id1, l_id2, l_srvid))
     {
-        Printf(LOG_Error, "[DB] Error: Login_GetLocked(\"%s\", <locked_hat>, <locked>, <id1>, <id2>, <srvid>).\n", conn->Login.c_str());
+        Printf(LOG_Error, "[DB] Error: Login_GetLocked(\"%s\", <locked_hat>, <locked>, <id1>, <id2>, <srvid>).\n", conn->Info->Login.c_str());
         CLCMD_Kick(conn, P_UPDATE_ERROR);
         return false;
     }
@@ -1409,15 +1340,15 @@ bool CL_EnterServer(Client* conn, Packet& pack)
     }
 
     // Do we create a new character?
-    bool is_created = !Login_CharExists(conn->Login, p_id1, p_id2);
+    bool is_created = !Login_CharExists(conn->Info->Login, p_id1, p_id2);
 
     // yes, new character
     if (is_created)
     {
         // check new character's nickname
-        if (CheckNickname_creation(p_nickname, conn->HatID) != 0)
+        if (CheckNickname_creation(p_nickname, conn->Info->HatID) != 0)
         {
-            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create bad nickname \"%s\"!\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str());
+            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create bad nickname \"%s\"!\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str());
             CLCMD_Kick(conn, P_FUCK_OFF);
             return false;
         }
@@ -1438,7 +1369,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
 
         if((p_id2 & 0x3F000000) == 0x3F000000)
         {
-            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create GM character from \"%s\" (rights: %08X)!\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), p_id2);
+            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create GM character from \"%s\" (rights: %08X)!\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), p_id2);
             CLCMD_Kick(conn, P_FUCK_OFF);
             return false;
         }
@@ -1446,14 +1377,14 @@ bool CL_EnterServer(Client* conn, Packet& pack)
         if((p_body < 15 || p_reaction < 15 || p_mind < 15 || p_spirit < 15) ||
            (p_body + p_reaction + p_mind + p_spirit > 136))
         {
-            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create character \"%s\" with invalid stats (%u, %u, %u, %u)!\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), p_body, p_reaction, p_mind, p_spirit);
+            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create character \"%s\" with invalid stats (%u, %u, %u, %u)!\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), p_body, p_reaction, p_mind, p_spirit);
             CLCMD_Kick(conn, P_FUCK_OFF);
             return false;
         }
 
         if(p_base < 1 || p_base > 4)
         {
-            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create character \"%s\" with invalid base skill %u!\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), p_base);
+            Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: tried to create character \"%s\" with invalid base skill %u!\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), p_base);
             CLCMD_Kick(conn, P_FUCK_OFF);
             return false;
         }
@@ -1473,10 +1404,10 @@ bool CL_EnterServer(Client* conn, Packet& pack)
         // allow_female levels: 0 = not unlocked, 1 = ironman (@), 2 = pure (!), 3 = legend (_)
         if (p_picture & sex::female) {
             int want = p_nickname[0] == '_' ? 3 : p_nickname[0] == '!' ? 2 : p_nickname[0] == '@' ? 1 : 0;
-            int have_access_to = AllowFemale(conn->Login);
+            int have_access_to = AllowFemale(conn->Info->Login);
 
             if (have_access_to < want) {
-                Printf(LOG_Info, "Player %s is not allowed to create females: access %d < want %d\n", conn->Login.c_str(), have_access_to, want);
+                Printf(LOG_Info, "Player %s is not allowed to create females: access %d < want %d\n", conn->Info->Login.c_str(), have_access_to, want);
                 p_picture &= ~sex::female;
             }
         }
@@ -1487,25 +1418,25 @@ bool CL_EnterServer(Client* conn, Packet& pack)
         if (p_picture & sex::wizard) { // mage class flag
             if (p_nickname[0] == '@')
             {
-                if (AllowMage(conn->Login.c_str()) < 1) // check DB. @ must have 1+
+                if (AllowMage(conn->Info->Login.c_str()) < 1) // check DB. @ must have 1+
                 {
-                    Printf(LOG_Info, "[CL] @-mage creation is not allowed for login %s, converting to warrior\n", conn->Login.c_str());
+                    Printf(LOG_Info, "[CL] @-mage creation is not allowed for login %s, converting to warrior\n", conn->Info->Login.c_str());
                     p_picture &= ~sex::wizard; // change hero class to warrior
                 }
             }
             else if (p_nickname[0] == '!')
             {
-                if (AllowMage(conn->Login.c_str()) < 2) // check DB. ! must have 2+
+                if (AllowMage(conn->Info->Login.c_str()) < 2) // check DB. ! must have 2+
                 {
-                    Printf(LOG_Info, "[CL] !-mage creation is not allowed for login %s, converting to warrior\n", conn->Login.c_str());
+                    Printf(LOG_Info, "[CL] !-mage creation is not allowed for login %s, converting to warrior\n", conn->Info->Login.c_str());
                     p_picture &= ~sex::wizard; // change hero class to warrior
                 }
             }
             else if (p_nickname[0] == '_')
             {
-                if (AllowMage(conn->Login.c_str()) < 3) // check DB. _ must have 3
+                if (AllowMage(conn->Info->Login.c_str()) < 3) // check DB. _ must have 3
                 {
-                    Printf(LOG_Info, "[CL] _-mage creation is not allowed for login %s, converting to warrior\n", conn->Login.c_str());
+                    Printf(LOG_Info, "[CL] _-mage creation is not allowed for login %s, converting to warrior\n", conn->Info->Login.c_str());
                     p_picture &= ~sex::wizard; // change hero class to warrior
                 }
             }
@@ -1526,24 +1457,24 @@ bool CL_EnterServer(Client* conn, Packet& pack)
         *(uint32_t*)(data + 16) = p_id2;
         memcpy(data + 20, p_nickname.c_str(), p_nickname.length());
 
-        if(!Login_SetCharacter(conn->Login, p_id1, p_id2, 0x30, data, p_nickname, l_srvid))
+        if(!Login_SetCharacter(conn->Info->Login, p_id1, p_id2, 0x30, data, p_nickname, l_srvid))
         {
             delete[] data;
-            Printf(LOG_Error, "[DB] Error: Login_SetCharacter(\"%s\", %u, %u, 0x30, <data>, \"%s\").\n", conn->Login.c_str(), p_id1, p_id2, p_nickname.c_str());
+            Printf(LOG_Error, "[DB] Error: Login_SetCharacter(\"%s\", %u, %u, 0x30, <data>, \"%s\").\n", conn->Info->Login.c_str(), p_id1, p_id2, p_nickname.c_str());
             CLCMD_Kick(conn, P_UPDATE_ERROR);
             return false;
         }
 
         delete[] data;
-        Printf(LOG_Info, "[CL] %s (%s) - Created character \"%s\".\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str());
+        Printf(LOG_Info, "[CL] %s (%s) - Created character \"%s\".\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str());
     }
     // character already exists
     else
     {
         int wrC = 0;
-        if((wrC = (CheckNickname(p_nickname, conn->HatID, true))) != 0)
+        if((wrC = (CheckNickname(p_nickname, conn->Info->HatID, true))) != 0)
         {
-            Printf(LOG_Error, "[CL] %s (%s) - Tried to join with bad nickname \"%s\" (error was %u)!\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), wrC);
+            Printf(LOG_Error, "[CL] %s (%s) - Tried to join with bad nickname \"%s\" (error was %u)!\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), wrC);
             CLCMD_Kick(conn, P_WRONG_NAME);
             return false;
         }
@@ -1564,7 +1495,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
             // (or it will exploit having 34-34-34-34 at server 3 right on)
             if (is_created && srv->Number != 1)
             {
-                Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (new char: go play 1 server).\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), srv->Number);
+                Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (new char: go play 1 server).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), srv->Number);
                 CLCMD_Kick(conn, P_TOO_STRONG);
                 return false;
             }
@@ -1573,9 +1504,9 @@ bool CL_EnterServer(Client* conn, Packet& pack)
             if(!is_created)
             {
                 CCharacter chrtc;
-                if(!Login_GetCharacter(conn->Login, p_id1, p_id2, chrtc))
+                if(!Login_GetCharacter(conn->Info->Login, p_id1, p_id2, chrtc))
                 {
-                    Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <character>).\n", conn->Login.c_str(), p_id1, p_id2);
+                    Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <character>).\n", conn->Info->Login.c_str(), p_id1, p_id2);
                     CLCMD_Kick(conn, P_UPDATE_ERROR);
                     return false;
                 }
@@ -1601,9 +1532,9 @@ bool CL_EnterServer(Client* conn, Packet& pack)
                         srvHatId = Config::HatIDSandbox;
                     else srvHatId = Config::HatID;
 
-                    if(conn->HatID != 0xFFFFFFFF && ((chrtc.HatId != srvHatId) || (chrtc.HatId != conn->HatID)))
+                    if(conn->Info->HatID != 0xFFFFFFFF && ((chrtc.HatId != srvHatId) || (chrtc.HatId != conn->Info->HatID)))
                     {
-                        Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: character \"%s\" rejected by hat from server ID %u (reason: invalid HatID).\n", conn->HisAddr.c_str(), conn->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
+                        Printf(LOG_Hacking, "[CL] %s (%s) - Hacking: character \"%s\" rejected by hat from server ID %u (reason: invalid HatID).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
                         CLCMD_Kick(conn, P_FHTAGN);
                         return false;
                     }
@@ -1614,7 +1545,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
                         if (!(srv->Info.ServerMode & SVF_ENTERMAGE) &&
                             (chrtc.Sex == 64 || chrtc.Sex == 192))
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: only warriors allowed).\n", conn->HisAddr.c_str(), conn->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: only warriors allowed).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
                             CLCMD_Kick(conn, P_TOO_WEAK); // hue
                             return false;
                         }
@@ -1622,7 +1553,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
                         if (!(srv->Info.ServerMode & SVF_ENTERWARRIOR) &&
                             (chrtc.Sex == 0 || chrtc.Sex == 128))
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: only mages allowed).\n", conn->HisAddr.c_str(), conn->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: only mages allowed).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), chrtc.Nick.c_str(), srv->Number);
                             CLCMD_Kick(conn, P_TOO_STRONG); // hue
                             return false;
                         }
@@ -1630,7 +1561,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
 
                     // Character can't enter server if he finished drinking stat potions for this particular server.
                     if (!IsCharacterAllowed(chrtc, srv->Number)) {
-                        Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: stats check).\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), srv->Number);
+                        Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: stats check).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), srv->Number);
                         CLCMD_Kick(conn, P_TOO_STRONG);
                         return false;
                     }
@@ -1640,7 +1571,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
                     {
                         if(chrtc.Spells & ~0x09010422)
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong spells %08X).\n", conn->HisAddr.c_str(), conn->Login.c_str(), chrtc.Nick.c_str(), srv->Number, chrtc.Spells);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong spells %08X).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), chrtc.Nick.c_str(), srv->Number, chrtc.Spells);
                             CLCMD_Kick(conn, P_TOO_STRONG);
                             return false;
                         }
@@ -1654,7 +1585,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
 
                         if(exp_total > 7320)
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong experience %u).\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), srv->Number, exp_total);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong experience %u).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), srv->Number, exp_total);
                             CLCMD_Kick(conn, P_TOO_STRONG);
                             return false;
                         }
@@ -1671,7 +1602,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
 
                         if(points_total < 0)
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong stats, %.1f points left).\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), srv->Number, points_total);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong stats, %.1f points left).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), srv->Number, points_total);
                             CLCMD_Kick(conn, P_TOO_STRONG);
                             return false;
                         }
@@ -1700,7 +1631,7 @@ bool CL_EnterServer(Client* conn, Packet& pack)
 
                         if(!items_ok)
                         {
-                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong items).\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_nickname.c_str(), srv->Number);
+                            Printf(LOG_Error, "[CL] %s (%s) - Character \"%s\" rejected by hat from server ID %u (reason: EQuest check - strong items).\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_nickname.c_str(), srv->Number);
                             CLCMD_Kick(conn, P_TOO_STRONG);
                             return false;
                         }
@@ -1708,26 +1639,27 @@ bool CL_EnterServer(Client* conn, Packet& pack)
                 }
             }
 
-            SV_TryClient(srv->Connection, p_id1, p_id2, conn->Login, p_nickname, p_sex);
+            SV_TryClient(srv->Connection, p_id1, p_id2, conn->Info->Login, p_nickname, p_sex);
 
-            conn->SessionID1 = p_id1;
-            conn->SessionID2 = p_id2;
-            conn->SessionTime = static_cast<uint32_t>(time(NULL));
-            conn->SessionServer = srv;
-            conn->SessionNickname = p_nickname;
+            conn->Info->SessionID1 = p_id1;
+            conn->Info->SessionID2 = p_id2;
+            CL_Cancel(conn->Info->SessionTimer);
+            conn->Info->SessionTimer = CL_Schedule(conn, CLIENT_TIMER_SESSION, 15);
+            conn->Info->SessionServer = srv;
+            conn->Info->SessionNickname = p_nickname;
             conn->Flags |= CLIENT_COMPLETE;
             return true;
         }
     }
 
-    Printf(LOG_Error, "[CL] %s (%s) - Server not found: %s.\n", conn->HisAddr.c_str(), conn->Login.c_str(), p_srvname.c_str());
+    Printf(LOG_Error, "[CL] %s (%s) - Server not found: %s.\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), p_srvname.c_str());
     CLCMD_Kick(conn, P_SERVER_INVALID);
     return false;
 }
 
 bool CL_CheckNickname(Client* conn, Packet& pack)
 {
-    if(conn->IsBot)
+    if(conn->Info->IsBot)
     {
         CLCMD_SendNicknameResult(conn, P_WRONG_VERSION);
         return false;
@@ -1746,8 +1678,8 @@ bool CL_CheckNickname(Client* conn, Packet& pack)
 
     nickname = TrimNickname(nickname);
 
-    unsigned long result = CheckNickname(nickname, conn->HatID);
-    if(result) Printf(LOG_Error, "[CL] %s (%s) - Nickname \"%s\" rejected.\n", conn->HisAddr.c_str(), conn->Login.c_str(), nickname.c_str());
+    unsigned long result = CheckNickname(nickname, conn->Info->HatID);
+    if(result) Printf(LOG_Error, "[CL] %s (%s) - Nickname \"%s\" rejected.\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), nickname.c_str());
 
     return CLCMD_SendNicknameResult(conn, result);
 }
@@ -1763,7 +1695,7 @@ bool CLCMD_SendNicknameResult(Client* conn, unsigned long result)
 
 bool CL_DeleteCharacter(Client* conn, Packet& pack)
 {
-    if(conn->IsBot)
+    if(conn->Info->IsBot)
     {
         CLCMD_Kick(conn, P_WRONG_VERSION);
         return false;
@@ -1780,23 +1712,23 @@ bool CL_DeleteCharacter(Client* conn, Packet& pack)
     std::string nickname;
     char* data = NULL;
     unsigned long size;
-    if(!Login_GetCharacter(conn->Login, id1, id2, size, data, nickname) || !data)
+    if(!Login_GetCharacter(conn->Info->Login, id1, id2, size, data, nickname) || !data)
     {
         if(data) delete[] data;
-        Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <size>, <data>, <nickname>).\n", conn->Login.c_str(), id1, id2);
+        Printf(LOG_Error, "[DB] Error: Login_GetCharacter(\"%s\", %u, %u, <size>, <data>, <nickname>).\n", conn->Info->Login.c_str(), id1, id2);
         CLCMD_Kick(conn, P_UPDATE_ERROR);
         return false;
     }
     delete[] data;
 
-    if(!Login_DelCharacter(conn->Login, id1, id2))
+    if(!Login_DelCharacter(conn->Info->Login, id1, id2))
     {
-        Printf(LOG_Error, "[DB] Error: Login_DelCharacter(\"%s\", %u, %u).\n", conn->Login.c_str(), id1, id2);
+        Printf(LOG_Error, "[DB] Error: Login_DelCharacter(\"%s\", %u, %u).\n", conn->Info->Login.c_str(), id1, id2);
         CLCMD_Kick(conn, P_UPDATE_ERROR);
         return false;
     }
 
-    Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" deleted.\n", conn->HisAddr.c_str(), conn->Login.c_str(), nickname.c_str());
+    Printf(LOG_Info, "[CL] %s (%s) - Character \"%s\" deleted.\n", conn->Info->HisAddr.c_str(), conn->Info->Login.c_str(), nickname.c_str());
 
     return true;
 }
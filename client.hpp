@@ -15,6 +15,11 @@
 #define CLIENT_PATCHFILE  0x00000010
 #define CLIENT_SCREENSHOT 0x00000020
 
+// Client::Expired, the deadlines in timers::wheel that have passed
+#define CLIENT_TIMER_IDLE       0x00000001 // not logged in after Config::ClientTimeout
+#define CLIENT_TIMER_ACTIVE     0x00000002 // still connected after Config::ClientActiveTimeout
+#define CLIENT_TIMER_SESSION    0x00000004 // the server didn't take the character in 15 seconds
+
 #define P_SERVER_LOST       0
 #define P_SERVER_INVALID    3
 #define P_CHARACTER_ABSENT  11
@@ -49,15 +54,14 @@
 #define P_FHTAGN            118
 
 #include "listener.hpp"
+#include "slots.h"
 #include <fstream>
 
-struct Client
-{
-    uint32_t Flags;
-    SOCKET Socket;
-
-    uint32_t Version;
+typedef uint64_t ClientHandle; // slots::Map<Client>::Handle
 
+// what is looked at only now and then, allocated apart from Client so that the loop over Clients doesn't read it
+struct ClientInfo
+{
     std::string HisIP;
     uint16_t HisPort;
 
@@ -65,7 +69,6 @@ struct Client
 
     uint32_t GameMode;
 
-    PacketReceiver Receiver;
     std::string Login;
     uint32_t LoginID;
 
@@ -73,7 +76,6 @@ struct Client
     uint32_t SessionID2;
     std::string SessionNickname;
     Server* SessionServer;
-    uint32_t SessionTime;
 
     uint32_t ClientID;
     uint32_t ClientKey;
@@ -85,16 +87,36 @@ struct Client
     uint32_t PatchPiece;
     uint32_t PatchSize;
 
-    uint32_t JoinTime;
+    uint64_t IdleTimer;
+    uint64_t ActiveTimer;
+    uint64_t SessionTimer;
 
     bool IsBot;
     bool DoNotUnlock;
 };
 
-extern std::vector<Client*> Clients;
+// what Net_ProcessClients reads for every client on every pass
+struct Client
+{
+    uint32_t Flags;
+    uint32_t Expired;
+    SOCKET Socket;
+
+    uint32_t Version;
+
+    PacketReceiver Receiver;
+
+    ClientHandle Handle;
+    ClientInfo* Info;
+};
+
+// a handle of a client that has disconnected finds nothing, even if its slot has a new client
+extern slots::Map<Client> Clients;
 
 void Net_ProcessClients();
 
+// false if the connection is dropped by redhat.ipf, Config::ConnectRate or Config::MaxPreAuth
+bool CL_Admit(sockaddr_in addr);
 bool CL_AddConnection(SOCKET sock, sockaddr_in addr);
 bool CL_Process(Client* conn);
 void CL_Disconnect(Client* conn);
@@ -9,6 +9,7 @@ namespace Config
 {
     std::string ControlDirectory = "ctl";
     unsigned long ControlRescanDelay = 2500;
+    std::string ThresholdsFile = "";
     std::string LogFile = "redhat.log";
     unsigned long LogLevel = LOG_Trivial; // all messages
     bool UseSHA1 = true;
@@ -27,6 +28,12 @@ namespace Config
     unsigned long RecvTimeout = 15;
     unsigned long ClientTimeout = 5;
     unsigned long ClientActiveTimeout = 60;
+    unsigned long ConnectRate = 5; // client connections per second per ConnectPrefix, 0 for no limit
+    unsigned long ConnectBurst = 30;
+    unsigned long ConnectPrefix = 32;
+    unsigned long MaxPreAuth = 1000; // client connections not logged in yet, 0 for no limit
+    std::string TraceFile = ""; // traffic capture for redhat-replay from the start, see trace.h
+    bool TraceAnonymize = true;
 
     std::string PathPlayernum = "playernum.txt";
     std::string PathStatus = "playerstat.xml";
@@ -36,6 +43,9 @@ namespace Config
     std::string SqlLogin = "root";
     std::string SqlPassword = "";
     std::string SqlDatabase = "logins";
+    std::string SqlBackend = "mysql"; // or "memory", for tests and load benchmarks
+    unsigned long SqlLatency = 0; // ms added to every query
+    unsigned long NicknameReload = 600; // seconds between reloads of the nickname index, 0 to never reload
 
     std::vector<Server> Servers;
 
@@ -54,6 +64,7 @@ namespace Config
     std::string OnlineLog = "redhat.ohd";
 
     bool ReportDatabaseErrors = false;
+    bool BinaryItems = false;
 }
 
 bool ReadConfig(std::string filename)
@@ -200,6 +211,8 @@ bool ReadConfig(std::string filename)
                     if(CheckInt(value))
                         Config::ControlRescanDelay = StrToInt(value);
                 }
+                else if(parameter == "thresholdsfile")
+                    Config::ThresholdsFile = value;
                 else if(parameter == "logfile")
                     Config::LogFile = value;
 /*                else if(parameter == "silent")
@@ -295,6 +308,33 @@ bool ReadConfig(std::string filename)
                     if(CheckInt(value))
                         Config::ClientActiveTimeout = StrToInt(value);
                 }
+                else if(parameter == "connectrate")
+                {
+                    if(CheckInt(value))
+                        Config::ConnectRate = StrToInt(value);
+                }
+                else if(parameter == "connectburst")
+                {
+                    if(CheckInt(value))
+                        Config::ConnectBurst = StrToInt(value);
+                }
+                else if(parameter == "connectprefix")
+                {
+                    if(CheckInt(value) && StrToInt(value) <= 32)
+                        Config::ConnectPrefix = StrToInt(value);
+                }
+                else if(parameter == "maxpreauth")
+                {
+                    if(CheckInt(value))
+                        Config::MaxPreAuth = StrToInt(value);
+                }
+                else if(parameter == "tracefile")
+                    Config::TraceFile = value;
+                else if(parameter == "traceanonymize")
+                {
+                    if(CheckBool(value))
+                        Config::TraceAnonymize = StrToBool(value);
+                }
             }
             else if(section == "settings.status")
             {
@@ -318,11 +358,28 @@ bool ReadConfig(std::string filename)
                     Config::SqlPassword = value;
                 else if(parameter == "database")
                     Config::SqlDatabase = value;
+                else if(parameter == "backend")
+                    Config::SqlBackend = value;
+                else if(parameter == "latency")
+                {
+                    if(CheckInt(value))
+                        Config::SqlLatency = StrToInt(value);
+                }
+                else if(parameter == "nicknamereload")
+                {
+                    if(CheckInt(value))
+                        Config::NicknameReload = StrToInt(value);
+                }
                 else if(parameter == "reportdatabaseerrors")
                 {
                     if(CheckBool(value))
                         Config::ReportDatabaseErrors = StrToBool(value);
                 }
+                else if(parameter == "binaryitems")
+                {
+                    if(CheckBool(value))
+                        Config::BinaryItems = StrToBool(value);
+                }
             }
             else if(section == "settings.version")
             {
@@ -13,6 +13,7 @@ namespace Config
 {
     extern std::string ControlDirectory;
     extern unsigned long ControlRescanDelay;
+    extern std::string ThresholdsFile;
     extern std::string LogFile;
     extern unsigned long LogLevel;
     extern bool UseSHA1;
@@ -31,6 +32,12 @@ namespace Config
     extern unsigned long RecvTimeout;
     extern unsigned long ClientTimeout;
     extern unsigned long ClientActiveTimeout;
+    extern unsigned long ConnectRate;
+    extern unsigned long ConnectBurst;
+    extern unsigned long ConnectPrefix;
+    extern unsigned long MaxPreAuth;
+    extern std::string TraceFile;
+    extern bool TraceAnonymize;
 
     extern std::string PathPlayernum;
     extern std::string PathStatus;
@@ -40,6 +47,9 @@ namespace Config
     extern std::string SqlLogin;
     extern std::string SqlPassword;
     extern std::string SqlDatabase;
+    extern std::string SqlBackend;
+    extern unsigned long SqlLatency;
+    extern unsigned long NicknameReload;
 
     extern bool UseFirewall;
     extern std::string AccessLog;
@@ -52,6 +62,7 @@ namespace Config
     //extern std::vector<uint32_t> GraphicsCRC;
 
     extern bool ReportDatabaseErrors;
+    extern bool BinaryItems;
 
     extern std::string OnlineLog;
 }
@@ -0,0 +1,80 @@
+#include "control.h"
+
+#include <cstdio>
+#include <fstream>
+#include <windows.h>
+
+#include "config.hpp"
+#include "thresholds.h"
+#include "trace.h"
+#include "utils.hpp"
+
+namespace control {
+
+namespace {
+
+const char* DEFAULT_THRESHOLDS_FILE = "thresholds.cfg";
+const char* DEFAULT_TRACE_FILE = "redhat.trace";
+
+// Returns `true` and the trimmed content if the command file exists. Deletes the file.
+bool TakeCommand(const std::string& name, std::string& content) {
+    std::string path = Config::ControlDirectory + "/" + name;
+
+    std::ifstream f(path);
+    if (!f) {
+        return false;
+    }
+
+    std::getline(f, content, '\0');
+    content = Trim(content);
+    f.close();
+
+    if (std::remove(path.c_str()) != 0) {
+        Printf(LOG_Warning, "[control] failed to remove '%s', the command will run again\n", path.c_str());
+    }
+
+    return true;
+}
+
+void ReloadThresholds(std::string file_name) {
+    if (file_name.empty()) {
+        file_name = DEFAULT_THRESHOLDS_FILE;
+    }
+
+    Printf(LOG_Info, "[control] reloading thresholds from '%s'\n", file_name.c_str());
+    thresholds::thresholds.ReloadAsync(file_name);
+}
+
+void StartTrace(std::string file_name) {
+    if (file_name.empty()) {
+        file_name = Config::TraceFile.empty() ? DEFAULT_TRACE_FILE : Config::TraceFile;
+    }
+
+    Printf(LOG_Info, "[control] starting a trace to '%s'\n", file_name.c_str());
+    trace::Start(file_name, Config::TraceAnonymize);
+}
+
+} // namespace
+
+void Process() {
+    static unsigned long last_scan = 0;
+
+    unsigned long now = GetTickCount();
+    if (now - last_scan < Config::ControlRescanDelay) {
+        return;
+    }
+    last_scan = now;
+
+    std::string content;
+    if (TakeCommand("reload_thresholds", content)) {
+        ReloadThresholds(content);
+    }
+    if (TakeCommand("start_trace", content)) {
+        StartTrace(content);
+    }
+    if (TakeCommand("stop_trace", content)) {
+        trace::Stop();
+    }
+}
+
+} // namespace control
@@ -0,0 +1,18 @@
+#pragma once
+
+// Admin commands dropped as files into `Config::ControlDirectory`.
+//
+// `reload_thresholds`: reload thresholds without a restart. The file may contain the path of the
+// thresholds file, otherwise `thresholds.cfg` is used. The file is deleted once picked up.
+//
+// `start_trace`: capture the traffic of the connections accepted from now on, see trace.h. The file may contain the
+// path of the trace, otherwise TraceFile of the config is used, or `redhat.trace`. Anonymized unless TraceAnonymize
+// is false.
+//
+// `stop_trace`: stop the capture.
+namespace control {
+
+// Scans the control directory, at most once per `Config::ControlRescanDelay` ms.
+void Process();
+
+} // namespace control
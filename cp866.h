@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Nicknames and logins are cp866 (DOS Cyrillic), the same as in the game client and in the DB.
+namespace cp866 {
+
+// Byte -> its lower case, the same as MySQL's `LOWER` for cp866: A..Z, А..Я and Ё, Є, Ї, Ў.
+constexpr std::array<uint8_t, 256> LOWER = [] {
+    std::array<uint8_t, 256> lower{};
+    for (int c = 0; c < 256; c++) {
+        lower[c] = static_cast<uint8_t>(c);
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        lower[c] = static_cast<uint8_t>(c + ('a' - 'A'));
+    }
+    for (int c = 0x80; c <= 0x8F; c++) { // А..П -> а..п
+        lower[c] = static_cast<uint8_t>(c + 0x20);
+    }
+    for (int c = 0x90; c <= 0x9F; c++) { // Р..Я -> р..я
+        lower[c] = static_cast<uint8_t>(c + 0x50);
+    }
+    for (int c = 0xF0; c <= 0xF6; c += 2) { // Ё, Є, Ї, Ў
+        lower[c] = static_cast<uint8_t>(c + 1);
+    }
+    return lower;
+}();
+
+// The key two nicknames (or logins) are compared by: equal if MySQL's `LOWER` of them is equal.
+inline std::string Fold(std::string_view text) {
+    std::string folded(text.size(), '\0');
+    for (size_t i = 0; i < text.size(); i++) {
+        folded[i] = static_cast<char>(LOWER[static_cast<uint8_t>(text[i])]);
+    }
+    return folded;
+}
+
+inline bool EqualFolded(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (LOWER[static_cast<uint8_t>(a[i])] != LOWER[static_cast<uint8_t>(b[i])]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace cp866
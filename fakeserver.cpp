@@ -0,0 +1,628 @@
+// Fake game servers for load testing a running hat.
+//
+//   redhat-fakeserver [-servers <n,n,...>] [-hat <host:port>] [-duration <s>] [-accept <percent>] [-reject <reason>]
+//                     [-latency <ms>] [-play <s>] [-players <n>] [-churn <percent>] [-info <ms>] [-mode <game mode>]
+//                     [-corpus <directory>] [-v11] [-config <file>]
+//
+// Each [server.N] of the hat's config (`-config`, redhat.cfg by default, or only the `-servers` numbers) connects to
+// the hat's internal address from its IntServerAddr port, and its layer from that port + 1000, as `SV_AddConnection`
+// expects; IntServerAddr has to be an address of this machine, 127.0.0.1 for a local run.
+//
+// A client transfer (0xDD) is accepted (0xD8) `-accept` percent of the time and rejected (0xD9) with the `-reject`
+// reason otherwise (1 full, 2 nickname taken, ..., 8 teamplay; 0 picks one), after `-latency` ms (+-50%). An accepted
+// character plays for `-play` seconds (+-50%), then goes back to the hat (0xCF) as it came, or as a random character
+// of `-corpus` with its ids and nickname. Every `-info` ms, the layer reports the map and the players (0x12): those
+// that were accepted and `-players` synthetic ones, `-churn` percent of which are replaced by new ones each time.
+//
+// Use with `redhat-loadgen` for an end-to-end run. Prints what the hat sent and how long it took to confirm returned
+// characters (0xD3), which is mostly the time it takes to save them.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CCharacter.hpp"
+#include "config.hpp"
+#include "peer.h"
+#include "server.hpp"
+#include "utils.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The layer always speaks 2.0, see `SV_ProcessLayer`.
+const unsigned long LAYER_VERSION = 20;
+
+struct Options {
+    std::vector<int> servers;
+    std::string hat_host;
+    unsigned short hat_port = 0;
+    double duration = 60;
+    int accept_percent = 100;
+    uint32_t reject_reason = 1;
+    unsigned long latency_ms = 50;
+    double play = 30;
+    int players = 0;
+    int churn_percent = 10;
+    unsigned long info_ms = 1000;
+    uint32_t game_mode = GAMEMODE_Cooperative;
+    std::string corpus;
+    unsigned long version = 20;
+    std::string config = "redhat.cfg";
+};
+
+// What all servers counted.
+class Stats {
+public:
+    void Count(const std::string& what) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->counts[what]++;
+    }
+
+    void Confirmed(Clock::duration elapsed) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->confirm_ms.push_back(std::chrono::duration<double, std::milli>(elapsed).count());
+    }
+
+    void Print(double seconds, size_t servers) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        std::printf("%u servers for %.1f s\n\n", static_cast<unsigned>(servers), seconds);
+
+        for (const auto& [what, count] : this->counts) {
+            std::printf("  %-32s %10llu\n", what.c_str(), static_cast<unsigned long long>(count));
+        }
+
+        std::vector<double>& ms = this->confirm_ms;
+        std::sort(ms.begin(), ms.end());
+        std::printf("\n%-12s %8s %9s %9s %9s %9s\n", "step", "answers", "p50 ms", "p90 ms", "p99 ms", "max ms");
+        std::printf("%-12s %8u %9.1f %9.1f %9.1f %9.1f\n", "return", static_cast<unsigned>(ms.size()), Percentile(ms, 50),
+            Percentile(ms, 90), Percentile(ms, 99), ms.empty() ? 0.0 : ms.back());
+    }
+
+private:
+    // Nearest rank of sorted `ms`.
+    static double Percentile(const std::vector<double>& ms, int percent) {
+        if (ms.empty()) {
+            return 0;
+        }
+        size_t rank = (ms.size() * percent + 99) / 100;
+        return ms[std::max<size_t>(rank, 1) - 1];
+    }
+
+    std::mutex mutex;
+    std::map<std::string, uint64_t> counts;
+    std::vector<double> confirm_ms;
+};
+
+// Characters to return instead of the ones the hat sent.
+bool LoadCorpus(const std::string& directory, std::vector<CCharacter>& corpus) {
+    Directory dir;
+    if (!dir.Open(directory)) {
+        std::cerr << directory << ": failed to open directory" << std::endl;
+        return false;
+    }
+
+    DirectoryEntry entry;
+    while (dir.Read(entry)) {
+        std::string name = ToLower(entry.name);
+        if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".a2c") != 0) {
+            continue;
+        }
+        CCharacter chr;
+        if (!chr.LoadFromFile(directory + "/" + entry.name)) {
+            std::cerr << entry.name << ": not a character, skipped" << std::endl;
+            continue;
+        }
+        corpus.push_back(std::move(chr));
+    }
+    return true;
+}
+
+// A player in the 0x12 list.
+struct Player {
+    std::string nickname;
+    std::string login;
+    uint32_t id1 = 0;
+    uint32_t id2 = 0;
+    std::string ip;
+};
+
+// A character the hat transferred here.
+struct Playing {
+    Player player;
+    std::vector<uint8_t> character;
+    Clock::time_point leaves;
+};
+
+// A 0xD8 or 0xD9 waiting for its `-latency`.
+struct Answer {
+    Clock::time_point due;
+    Packet pack;
+    bool accepted;
+    Playing playing;
+};
+
+class FakeServer {
+public:
+    FakeServer(const Options& options, Stats& stats, const std::vector<CCharacter>& corpus, const Server& server)
+        : options(options), stats(stats), corpus(corpus), number(server.Number), port(server.IPort),
+          random(static_cast<unsigned>(server.Number * 7919 + Clock::now().time_since_epoch().count())) {
+    }
+
+    void Run(Clock::time_point end) {
+        if (!this->Connect()) {
+            return;
+        }
+
+        this->started = Clock::now();
+        Clock::time_point next_info = this->started;
+        while (Clock::now() < end) {
+            Clock::time_point now = Clock::now();
+            if (now >= next_info) {
+                this->Churn();
+                if (!this->SendInfo()) {
+                    return;
+                }
+                next_info = now + std::chrono::milliseconds(this->options.info_ms);
+            }
+
+            if (!this->SendAnswers(now) || !this->ReturnCharacters(now, false)) {
+                return;
+            }
+
+            Packet pack;
+            peer::Status status = this->main.Receive(pack, this->options.version, 10);
+            if (status == peer::STATUS_LOST) {
+                this->Lost("connection");
+                return;
+            }
+            if (status == peer::STATUS_OK && !this->Handle(pack)) {
+                return;
+            }
+
+            // Messages, screenshots and mutes (0x63-0x65) are only counted.
+            Packet command;
+            status = this->layer.Receive(command, LAYER_VERSION, 1);
+            if (status == peer::STATUS_LOST) {
+                this->Lost("layer");
+                return;
+            }
+            if (status == peer::STATUS_OK) {
+                uint8_t id = 0;
+                command >> id;
+                this->stats.Count(Format("layer: packet %02X", id));
+            }
+        }
+
+        this->Shutdown();
+    }
+
+private:
+    // Login, 0xD5, initialized, map info; then the layer.
+    bool Connect() {
+        if (!this->main.Connect(this->options.hat_host, this->options.hat_port, this->port)) {
+            this->Fail("connect failed");
+            return false;
+        }
+
+        // The hat reads the first packet unencrypted and takes the version from its key.
+        const unsigned char* key = (this->options.version == 11) ? key_11 : key_20;
+        Packet login;
+        login << (uint8_t)(0xD1 ^ key[0]);
+        Packet welcome;
+        if (!this->main.Send(login, 0) ||
+            this->main.Receive(welcome, this->options.version, 10000) != peer::STATUS_OK) {
+            this->Fail("no welcome (0xD5)");
+            return false;
+        }
+        uint8_t id = 0;
+        welcome >> id;
+        if (id != 0xD5) {
+            this->Fail(Format("welcome: unexpected packet %02X", id));
+            return false;
+        }
+
+        Packet initialized;
+        initialized << (uint8_t)0x03;
+        Packet info;
+        info << (uint8_t)0xD2 << (uint8_t)0 << (uint8_t)1 << (uint8_t)this->options.game_mode << (uint8_t)128;
+        info << this->MapName();
+        if (!this->main.Send(initialized, this->options.version) || !this->main.Send(info, this->options.version)) {
+            this->Lost("connection");
+            return false;
+        }
+
+        if (!this->layer.Connect(this->options.hat_host, this->options.hat_port, this->port + 1000)) {
+            this->Fail("layer connect failed");
+            return false;
+        }
+        Packet caps;
+        caps << (uint8_t)0x10 << (uint32_t)SERVER_CAP_DETAILED_INFO;
+        if (!this->layer.Send(caps, LAYER_VERSION)) {
+            this->Lost("layer");
+            return false;
+        }
+
+        this->stats.Count("servers connected");
+        return true;
+    }
+
+    bool Handle(Packet& pack) {
+        uint8_t id = 0;
+        pack >> id;
+        switch (id) {
+            case 0xDD:
+                this->Transfer(pack);
+                return true;
+            case 0xD3: {
+                uint32_t zero = 0;
+                std::string login;
+                pack >> zero >> login;
+                auto returned = this->returned.find(ToLower(login));
+                if (returned == this->returned.end()) {
+                    this->stats.Count("0xD3 for an unknown login");
+                    return true;
+                }
+                this->stats.Confirmed(Clock::now() - returned->second);
+                this->stats.Count("returns confirmed (0xD3)");
+                this->returned.erase(returned);
+                return true;
+            }
+            default:
+                this->stats.Count(Format("packet %02X", id));
+                return true;
+        }
+    }
+
+    // What `SV_TryClient` sends.
+    void Transfer(Packet& pack) {
+        uint32_t size, id1, id2, login_length, nickname_length, character_size, sex;
+        pack >> size >> id1 >> id2 >> login_length >> nickname_length >> character_size >> sex;
+
+        if (!pack || character_size + login_length + nickname_length > pack.GetLength()) {
+            this->stats.Count("transfers cut short");
+            return;
+        }
+
+        Answer answer;
+        answer.playing.character.resize(character_size);
+        std::string login(login_length, '\0');
+        std::string nickname(nickname_length, '\0');
+        pack.GetData(answer.playing.character.data(), character_size);
+        pack.GetData((uint8_t*)login.data(), login_length);
+        pack.GetData((uint8_t*)nickname.data(), nickname_length);
+        if (!pack) {
+            this->stats.Count("transfers cut short");
+            return;
+        }
+        this->stats.Count("transfers (0xDD)");
+
+        answer.playing.player = Player{nickname, login, id1, id2, "127.0.0.1"};
+        answer.due = Clock::now() + this->Jitter(std::chrono::milliseconds(this->options.latency_ms));
+        answer.accepted = static_cast<int>(this->random() % 100) < this->options.accept_percent;
+        if (answer.accepted) {
+            answer.pack << (uint8_t)0xD8 << id1 << id2;
+        } else {
+            uint32_t reason = this->options.reject_reason ? this->options.reject_reason : 1 + this->random() % 8;
+            answer.pack << (uint8_t)0xD9 << (uint32_t)12 << id1 << id2 << reason;
+        }
+        this->answers.push_back(std::move(answer));
+    }
+
+    bool SendAnswers(Clock::time_point now) {
+        for (size_t i = 0; i < this->answers.size();) {
+            Answer& answer = this->answers[i];
+            if (answer.due > now) {
+                i++;
+                continue;
+            }
+
+            if (!this->main.Send(answer.pack, this->options.version)) {
+                this->Lost("connection");
+                return false;
+            }
+            if (answer.accepted) {
+                this->stats.Count("accepted (0xD8)");
+                answer.playing.leaves = now + this->Jitter(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(this->options.play)));
+                this->playing.push_back(std::move(answer.playing));
+            } else {
+                this->stats.Count("rejected (0xD9)");
+            }
+            this->answers.erase(this->answers.begin() + i);
+        }
+        return true;
+    }
+
+    // Characters that played long enough, or all of them with `all`.
+    bool ReturnCharacters(Clock::time_point now, bool all) {
+        for (size_t i = 0; i < this->playing.size();) {
+            Playing& character = this->playing[i];
+            if (!all && character.leaves > now) {
+                i++;
+                continue;
+            }
+
+            std::vector<uint8_t> data = this->Played(character);
+            const std::string& login = character.player.login;
+            Packet pack;
+            pack << (uint8_t)0xCF << (uint32_t)(16 + data.size() + login.length());
+            pack << character.player.id1 << character.player.id2;
+            pack << (uint32_t)login.length() << (uint32_t)data.size();
+            pack.AppendData(data.data(), (uint32_t)data.size());
+            pack.AppendData((uint8_t*)login.c_str(), (uint32_t)login.length());
+            if (!this->main.Send(pack, this->options.version)) {
+                this->Lost("connection");
+                return false;
+            }
+            this->stats.Count("returned (0xCF)");
+            this->returned[ToLower(login)] = now;
+
+            this->playing.erase(this->playing.begin() + i);
+        }
+        return true;
+    }
+
+    // The character as it came, or one of the corpus in its place.
+    std::vector<uint8_t> Played(const Playing& character) {
+        if (this->corpus.empty()) {
+            return character.character;
+        }
+
+        // The hat only saves a character with the ids of the one it locked the login for.
+        CCharacter chr = this->corpus[this->random() % this->corpus.size()];
+        chr.Id1 = character.player.id1;
+        chr.Id2 = character.player.id2;
+        chr.Nick = character.player.nickname.substr(0, character.player.nickname.find('|'));
+
+        BinaryStream bs;
+        if (!chr.SaveToStream(bs)) {
+            this->stats.Count("corpus character not saved, returned as it came");
+            return character.character;
+        }
+        return bs.GetBuffer();
+    }
+
+    // Replaces `-churn` percent of the synthetic players.
+    void Churn() {
+        while (static_cast<int>(this->synthetic.size()) < this->options.players) {
+            this->synthetic.push_back(this->Synthetic());
+        }
+        for (Player& player : this->synthetic) {
+            if (static_cast<int>(this->random() % 100) < this->options.churn_percent) {
+                player = this->Synthetic();
+            }
+        }
+    }
+
+    Player Synthetic() {
+        uint32_t n = this->next_synthetic++;
+        return Player{Format("Fake%u_%u", this->number, n), Format("fake%u_%u", this->number, n),
+                      static_cast<uint32_t>(this->random()), static_cast<uint32_t>(this->random()) & 0x00FFFFFF,
+                      Format("10.%u.%u.%u", this->number & 0xFF, (n >> 8) & 0xFF, n & 0xFF)};
+    }
+
+    // What `SL_UpdateInfo` reads.
+    bool SendInfo() {
+        uint32_t seconds = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - this->started).count());
+        Packet pack;
+        pack << (uint8_t)0x12 << this->options.game_mode << this->MapName() << (uint8_t)1;
+        pack << (uint32_t)128 << (uint32_t)128 << seconds << (uint32_t)0;
+
+        pack << (uint32_t)(this->playing.size() + this->synthetic.size());
+        for (const Playing& character : this->playing) {
+            this->PutPlayer(pack, character.player);
+        }
+        for (const Player& player : this->synthetic) {
+            this->PutPlayer(pack, player);
+        }
+
+        pack << (uint32_t)this->playing.size();
+        for (const Playing& character : this->playing) {
+            pack << character.player.login;
+        }
+
+        if (!this->layer.Send(pack, LAYER_VERSION)) {
+            this->Lost("layer");
+            return false;
+        }
+        this->stats.Count("info updates (0x12)");
+        return true;
+    }
+
+    void PutPlayer(Packet& pack, const Player& player) {
+        pack << player.nickname << player.login << player.id1 << player.id2 << true << player.ip;
+    }
+
+    // Answers what's waiting, returns everyone and says goodbye, as a server that is shut down does.
+    void Shutdown() {
+        Clock::time_point now = Clock::now();
+        for (Answer& answer : this->answers) {
+            answer.due = now;
+        }
+        if (!this->SendAnswers(now) || !this->ReturnCharacters(now, true)) {
+            return;
+        }
+
+        // The last confirmations.
+        Clock::time_point end = now + std::chrono::seconds(5);
+        while (!this->returned.empty() && Clock::now() < end) {
+            Packet pack;
+            peer::Status status = this->main.Receive(pack, this->options.version, 100);
+            if (status == peer::STATUS_LOST) {
+                break;
+            }
+            if (status == peer::STATUS_OK) {
+                this->Handle(pack);
+            }
+        }
+        if (!this->returned.empty()) {
+            this->stats.Count("returns not confirmed");
+        }
+
+        Packet layer_shutdown;
+        layer_shutdown << (uint8_t)0x11;
+        this->layer.Send(layer_shutdown, LAYER_VERSION);
+        Packet shutdown;
+        shutdown << (uint8_t)0xD2 << (uint8_t)0xFF << (uint8_t)0xFF << (uint8_t)0xFF << (uint8_t)0xFF;
+        this->main.Send(shutdown, this->options.version);
+        this->main.Close();
+        this->layer.Close();
+    }
+
+    std::string MapName() const {
+        return Format("fake%u.a2m", this->number);
+    }
+
+    Clock::duration Jitter(Clock::duration duration) {
+        if (duration.count() <= 0) {
+            return Clock::duration::zero();
+        }
+        return duration / 2 + Clock::duration(this->random() % (duration.count() + 1));
+    }
+
+    void Fail(const std::string& what) {
+        this->stats.Count(Format("server %u: %s", this->number, what.c_str()));
+    }
+
+    void Lost(const char* which) {
+        this->Fail(Format("%s lost", which));
+        this->main.Close();
+        this->layer.Close();
+    }
+
+    const Options& options;
+    Stats& stats;
+    const std::vector<CCharacter>& corpus;
+    unsigned number;
+    unsigned short port;
+    std::mt19937_64 random;
+    peer::Connection main;
+    peer::Connection layer;
+    Clock::time_point started;
+    std::vector<Answer> answers;
+    std::vector<Playing> playing;
+    // Folded login -> when its character was returned.
+    std::map<std::string, Clock::time_point> returned;
+    std::vector<Player> synthetic;
+    uint32_t next_synthetic = 0;
+};
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = (i + 1 < argc);
+        std::string next = value ? argv[i + 1] : "";
+        bool number = value && CheckInt(next);
+
+        if (arg == "-servers" && value) {
+            for (const std::string& server : Explode(argv[++i], ",")) {
+                if (!CheckInt(Trim(server))) {
+                    return false;
+                }
+                options.servers.push_back(StrToInt(Trim(server)));
+            }
+        } else if (arg == "-hat" && value) {
+            if (!peer::SplitAddress(argv[++i], options.hat_host, options.hat_port)) {
+                return false;
+            }
+        } else if (arg == "-duration" && value) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "-accept" && number) {
+            options.accept_percent = std::min(100, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-reject" && number) {
+            options.reject_reason = std::min(8u, static_cast<uint32_t>(StrToInt(argv[++i])));
+        } else if (arg == "-latency" && number) {
+            options.latency_ms = StrToInt(argv[++i]);
+        } else if (arg == "-play" && value) {
+            options.play = std::atof(argv[++i]);
+        } else if (arg == "-players" && number) {
+            options.players = std::max(0, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-churn" && number) {
+            options.churn_percent = std::min(100, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-info" && number) {
+            options.info_ms = std::max(100ul, static_cast<unsigned long>(StrToInt(argv[++i])));
+        } else if (arg == "-mode" && number) {
+            options.game_mode = StrToInt(argv[++i]);
+        } else if (arg == "-corpus" && value) {
+            options.corpus = argv[++i];
+        } else if (arg == "-v11") {
+            options.version = 11;
+        } else if (arg == "-config" && value) {
+            options.config = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: redhat-fakeserver [-servers <n,n,...>] [-hat <host:port>] [-duration <s>] [-accept <percent>]"
+                     " [-reject <reason>] [-latency <ms>] [-play <s>] [-players <n>] [-churn <percent>] [-info <ms>]"
+                     " [-mode <game mode>] [-corpus <directory>] [-v11] [-config <file>]" << std::endl;
+        return 2;
+    }
+
+    Config::LogFile = "redhat-fakeserver.log";
+    Config::LogLevel = LOG_Error;
+    if (!ReadConfig(options.config)) {
+        std::cerr << options.config << ": failed to read the config" << std::endl;
+        return 1;
+    }
+    if (options.hat_host.empty()) {
+        // The hat listens on all addresses with 0.0.0.0.
+        options.hat_host = (Config::IHatAddress == "0.0.0.0") ? "127.0.0.1" : Config::IHatAddress;
+        options.hat_port = Config::IHatPort;
+    }
+
+    std::vector<CCharacter> corpus;
+    if (!options.corpus.empty() && !LoadCorpus(options.corpus, corpus)) {
+        return 1;
+    }
+
+    std::vector<Server*> servers;
+    for (Server* server : Servers) {
+        if (options.servers.empty() ||
+            std::find(options.servers.begin(), options.servers.end(), static_cast<int>(server->Number)) != options.servers.end()) {
+            servers.push_back(server);
+        }
+    }
+    if (servers.empty()) {
+        std::cerr << options.config << ": no [server.N] to play" << std::endl;
+        return 1;
+    }
+
+    WSADATA wsd;
+    WSAStartup(0x0101, &wsd);
+
+    Stats stats;
+    Clock::time_point started = Clock::now();
+    Clock::time_point end = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+    std::vector<std::thread> threads;
+    for (Server* server : servers) {
+        threads.emplace_back([&, server]() {
+            FakeServer fake(options, stats, corpus, *server);
+            fake.Run(end);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    stats.Print(std::chrono::duration<double>(Clock::now() - started).count(), servers.size());
+    WSACleanup();
+    return 0;
+}
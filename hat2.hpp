@@ -2,5 +2,7 @@
 #define HAT2_H_INCLUDED
 
 int send_msg(SOCKET sock, int ver, u_char *msg, size_t len, int timeout);
+// sends a buffer already framed by PACKET_Frame
+int send_wire(SOCKET sock, const u_char *wire, size_t len);
 
 #endif // HAT2_H_INCLUDED
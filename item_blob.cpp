@@ -0,0 +1,161 @@
+#include "item_blob.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace item_blob {
+
+namespace {
+
+void PutVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// A count or a length; the format has 32 bits for them.
+void PutSize(std::string& out, size_t value) {
+    if (value > UINT32_MAX) {
+        throw std::length_error("item_blob: size doesn't fit the format");
+    }
+    PutVarint(out, static_cast<uint32_t>(value));
+}
+
+class Reader {
+public:
+    Reader(const std::string& data, size_t pos) : data(data), pos(pos) {}
+
+    bool Byte(uint8_t& value) {
+        if (pos >= data.size()) {
+            return false;
+        }
+        value = static_cast<uint8_t>(data[pos++]);
+        return true;
+    }
+
+    bool Varint(uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b;
+            if (!Byte(b)) {
+                return false;
+            }
+            value |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t Position() const { return pos; }
+    size_t Remaining() const { return data.size() - pos; }
+
+private:
+    const std::string& data;
+    size_t pos;
+};
+
+} // namespace
+
+bool IsBlob(const std::string& data) {
+    return !data.empty() && static_cast<uint8_t>(data[0]) == MARKER;
+}
+
+std::string Encode(const CItemList& list) {
+    std::string payload;
+    payload.reserve(4 + list.Items.size() * 8);
+
+    payload += static_cast<char>(list.UnknownValue0);
+    payload += static_cast<char>(list.UnknownValue1);
+    payload += static_cast<char>(list.UnknownValue2);
+    PutSize(payload, list.Items.size());
+
+    for (const CItem& item : list.Items) {
+        PutVarint(payload, item.Id);
+        payload += static_cast<char>(item.IsMagic ? 1 : 0);
+        PutVarint(payload, item.Price);
+        PutVarint(payload, item.Count);
+
+        if (item.IsMagic) {
+            PutSize(payload, item.Effects.size());
+            for (const CEffect& effect : item.Effects) {
+                payload += static_cast<char>(effect.Id1);
+                payload += static_cast<char>(effect.Value1);
+                payload += static_cast<char>(effect.Id2);
+                payload += static_cast<char>(effect.Value2);
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(payload.size() + 7);
+    out += static_cast<char>(MARKER);
+    out += static_cast<char>(VERSION);
+    PutSize(out, payload.size());
+    out += payload;
+    return out;
+}
+
+bool Decode(const std::string& data, CItemList& list) {
+    list.UnknownValue0 = 0;
+    list.UnknownValue1 = 0;
+    list.UnknownValue2 = 0;
+    list.Items.clear();
+
+    Reader r(data, 0);
+
+    uint8_t marker, version;
+    if (!r.Byte(marker) || marker != MARKER || !r.Byte(version) || version != VERSION) {
+        return false;
+    }
+
+    uint32_t length;
+    if (!r.Varint(length) || length != r.Remaining()) {
+        return false;
+    }
+
+    uint32_t count;
+    if (!r.Byte(list.UnknownValue0) || !r.Byte(list.UnknownValue1) || !r.Byte(list.UnknownValue2) || !r.Varint(count)) {
+        return false;
+    }
+
+    // Every item takes at least 4 bytes, don't let a corrupted count allocate gigabytes.
+    if (count > r.Remaining() / 4) {
+        return false;
+    }
+    list.Items.resize(count);
+
+    for (CItem& item : list.Items) {
+        uint8_t magic;
+        uint32_t item_count;
+        if (!r.Varint(item.Id) || !r.Byte(magic) || !r.Varint(item.Price) || !r.Varint(item_count) || item_count > 0xFFFF) {
+            return false;
+        }
+        item.IsMagic = magic != 0;
+        item.Count = static_cast<uint16_t>(item_count);
+        item.Effects.clear();
+
+        if (!item.IsMagic) {
+            continue;
+        }
+
+        uint32_t effects;
+        if (!r.Varint(effects) || effects > r.Remaining() / 4) {
+            return false;
+        }
+        item.Effects.resize(effects);
+        for (CEffect& effect : item.Effects) {
+            r.Byte(effect.Id1);
+            r.Byte(effect.Value1);
+            r.Byte(effect.Id2);
+            r.Byte(effect.Value2);
+        }
+    }
+
+    return r.Remaining() == 0;
+}
+
+} // namespace item_blob
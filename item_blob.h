@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "CCharacter.hpp"
+
+// Compact binary DB format for `CItemList`.
+//
+// The layout is:
+//
+//   0x00 <version:u8> <payload length:varint> <payload>
+//
+// where the payload (version 1) is
+//
+//   <unknown0:u8> <unknown1:u8> <unknown2:u8> <item count:varint>
+//   { <id:varint> <magic:u8> <price:varint> <count:varint>
+//     [ <effect count:varint> { <id1:u8> <value1:u8> <id2:u8> <value2:u8> } ] }
+//
+// The effect block is only present for magic items. The leading zero byte
+// never starts the text format (`[u0,u1,u2,count];...`), so both formats can
+// be told apart by the first byte and live in the same column while the DB is
+// being migrated.
+namespace item_blob {
+
+const uint8_t MARKER = 0x00;
+const uint8_t VERSION = 1;
+
+// Returns `true` if `data` is in the binary format (of any version).
+bool IsBlob(const std::string& data);
+
+// Encodes the list. The result is raw bytes, escape it before putting it into a query. Throws `std::length_error`
+// if a count doesn't fit in 32 bits, which no list that fits in memory reaches.
+std::string Encode(const CItemList& list);
+
+// Decodes the binary format. Returns `false` if the data is truncated, has an
+// unknown version or trailing garbage; `list` is left in an unspecified state.
+bool Decode(const std::string& data, CItemList& list);
+
+} // namespace item_blob
@@ -5,6 +5,7 @@
 
 #include "client.hpp"
 #include "server.hpp"
+#include "trace.h"
 
 #include <winsock2.h>
 
@@ -30,12 +31,16 @@ void Net_Init()
         Printf(LOG_FatalError, "[SC] Net_Listen: On %s:%u.\n", Config::HatAddress.c_str(), Config::HatPort);
         exit(1);
     }
+
+    if(!Config::TraceFile.empty())
+        trace::Start(Config::TraceFile, Config::TraceAnonymize);
 }
 
 void Net_Quit()
 {
     SOCK_Destroy(cl_listener);
     SOCK_Destroy(sv_listener);
+    trace::Stop();
 }
 
 void Net_Listen()
@@ -104,6 +109,8 @@ bool PacketReceiver::Receive(uint32_t version)
 
     if(zz == 0)
     {
+        trace::Received(Socket, Queue.back(), version);
+
         // create "next" packet
         Packet pack2;
         pack2.Reset();
@@ -0,0 +1,541 @@
+// Synthetic clients for load testing a running hat.
+//
+//   redhat-loadgen <host:port> [-clients <n>] [-rate <sessions/s>] [-duration <s>] [-think <ms>] [-v11 <percent>]
+//                  [-create <percent>] [-mode <game mode>] [-logins <prefix>] [-password <password>]
+//                  [-server <host:port>] [-timeout <ms>] [-config <file>]
+//
+// Each of `-clients` workers plays one client after another, as a real one does: the 2.0 version request on its own
+// connection, then the login with the UUID/CRC block `CL_Login` checks, the character list, a nickname check,
+// a character, the server list and `CL_EnterServer`, with a `-think` pause (+-50%) between the steps. New sessions
+// start at `-rate` per second over all workers, or as soon as a worker is free with `-rate 0`.
+//
+// Worker N logs in as <prefix>NNNN, so the hat needs AutoRegister or these logins. The CRCs for 2.0 are the first
+// ExecutableCRC and LibraryCRC of the hat's config (`-config`, redhat.cfg by default). Entering a server only succeeds
+// if a game server answers the hat (`SV_TryClient`); the first listed server is used unless `-server` is given.
+//
+// Prints the latency percentiles of each step and what the hat answered when it didn't do what was asked: the P_*
+// reason of a 0x0B kick or of a 0xDF nickname result, a timeout, a lost connection or an unexpected packet.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CRC_32.h"
+#include "client.hpp"
+#include "config.hpp"
+#include "peer.h"
+#include "utils.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// `CL_Login` takes the 2.0 UUID and CRCs XORed by this.
+const uint32_t NET_KEY = 0x6CDB248D;
+
+enum Step { STEP_VERSION, STEP_LOGIN, STEP_NICKNAME, STEP_CHARACTER, STEP_SERVER_LIST, STEP_ENTER, STEP_COUNT };
+
+const char* const STEP_NAMES[STEP_COUNT] = {"version", "login", "nickname", "character", "server_list", "enter"};
+
+struct Options {
+    std::string host;
+    unsigned short port = 0;
+    int clients = 10;
+    double rate = 0;
+    double duration = 60;
+    unsigned long think_ms = 500;
+    int v11_percent = 0;
+    int create_percent = 10;
+    uint32_t game_mode = GAMEMODE_Cooperative;
+    std::string login_prefix = "loadgen";
+    std::string password = "loadgen";
+    std::string server;
+    unsigned long timeout_ms = 20000;
+    std::string config = "redhat.cfg";
+    uint32_t executable_crc = 0;
+    uint32_t library_crc = 0;
+};
+
+std::string ReasonName(uint32_t reason) {
+    switch (reason) {
+        case P_SERVER_LOST: return "P_SERVER_LOST";
+        case P_SERVER_INVALID: return "P_SERVER_INVALID";
+        case P_CHARACTER_ABSENT: return "P_CHARACTER_ABSENT";
+        case P_CHARACTER_PLAYING: return "P_CHARACTER_PLAYING";
+        case P_UPDATE_ERROR: return "P_UPDATE_ERROR";
+        case P_TOO_STRONG: return "P_TOO_STRONG";
+        case P_TOO_WEAK: return "P_TOO_WEAK";
+        case P_HAT_LOST: return "P_HAT_LOST";
+        case P_HAT_INVALID: return "P_HAT_INVALID";
+        case P_WRONG_CREDENTIALS: return "P_WRONG_CREDENTIALS";
+        case P_LOGIN_EXISTS: return "P_LOGIN_EXISTS";
+        case P_LOGIN_BLOCKED: return "P_LOGIN_BLOCKED";
+        case P_SERVER_OFFLINE: return "P_SERVER_OFFLINE";
+        case P_SERVER_FULL: return "P_SERVER_FULL";
+        case P_CHARACTER_EXISTS: return "P_CHARACTER_EXISTS";
+        case P_WRONG_NAME: return "P_WRONG_NAME";
+        case P_SHORT_NAME: return "P_SHORT_NAME";
+        case P_BAD_CHARACTER: return "P_BAD_CHARACTER";
+        case P_S_TOO_STRONG: return "P_S_TOO_STRONG";
+        case P_S_TOO_WEAK: return "P_S_TOO_WEAK";
+        case P_TEAMPLAY_STARTED: return "P_TEAMPLAY_STARTED";
+        case P_SERVER_SHUTDOWN: return "P_SERVER_SHUTDOWN";
+        case P_IP_BLOCKED: return "P_IP_BLOCKED";
+        case P_NAME_EXISTS: return "P_NAME_EXISTS";
+        case P_WRONG_VERSION: return "P_WRONG_VERSION";
+        case P_OUTAGE: return "P_OUTAGE";
+        case P_LOGIN_BLOCKED_FVR: return "P_LOGIN_BLOCKED_FVR";
+        case P_BAD_GAMEMODE: return "P_BAD_GAMEMODE";
+        case P_RETRY_LATER: return "P_RETRY_LATER";
+        case P_WRONG_GAMEMODE: return "P_WRONG_GAMEMODE";
+        case P_FUCK_OFF: return "P_FUCK_OFF";
+        case P_FHTAGN: return "P_FHTAGN";
+        default: return Format("reason %u", reason);
+    }
+}
+
+// What all workers measured.
+class Stats {
+public:
+    void Answered(Step step, Clock::duration elapsed) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->steps[step].ms.push_back(std::chrono::duration<double, std::milli>(elapsed).count());
+    }
+
+    void Failed(Step step, const std::string& what) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->steps[step].errors[what]++;
+    }
+
+    void Session(bool completed) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        (completed ? this->completed : this->failed)++;
+    }
+
+    void Print(double seconds, int clients) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        uint64_t sessions = this->completed + this->failed;
+        std::printf("%llu sessions (%llu entered a server) in %.1f s by %d clients: %.1f sessions/s\n\n",
+            static_cast<unsigned long long>(sessions), static_cast<unsigned long long>(this->completed), seconds,
+            clients, seconds > 0 ? sessions / seconds : 0.0);
+
+        std::printf("%-12s %8s %8s %9s %9s %9s %9s\n", "step", "answers", "errors", "p50 ms", "p90 ms", "p99 ms", "max ms");
+        for (int step = 0; step < STEP_COUNT; step++) {
+            std::vector<double>& ms = this->steps[step].ms;
+            std::sort(ms.begin(), ms.end());
+            uint64_t errors = 0;
+            for (const auto& [what, count] : this->steps[step].errors) {
+                errors += count;
+            }
+            std::printf("%-12s %8u %8llu %9.1f %9.1f %9.1f %9.1f\n", STEP_NAMES[step], static_cast<unsigned>(ms.size()),
+                static_cast<unsigned long long>(errors), Percentile(ms, 50), Percentile(ms, 90), Percentile(ms, 99),
+                ms.empty() ? 0.0 : ms.back());
+        }
+
+        bool header = false;
+        for (int step = 0; step < STEP_COUNT; step++) {
+            for (const auto& [what, count] : this->steps[step].errors) {
+                if (!header) {
+                    std::printf("\nerrors:\n");
+                    header = true;
+                }
+                std::printf("  %-12s %-28s %llu\n", STEP_NAMES[step], what.c_str(), static_cast<unsigned long long>(count));
+            }
+        }
+    }
+
+private:
+    struct Measured {
+        std::vector<double> ms;
+        std::map<std::string, uint64_t> errors;
+    };
+
+    // Nearest rank of sorted `ms`.
+    static double Percentile(const std::vector<double>& ms, int percent) {
+        if (ms.empty()) {
+            return 0;
+        }
+        size_t rank = (ms.size() * percent + 99) / 100;
+        return ms[std::max<size_t>(rank, 1) - 1];
+    }
+
+    std::mutex mutex;
+    Measured steps[STEP_COUNT];
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+};
+
+// Hands out session start times `-rate` apart.
+class Arrivals {
+public:
+    Arrivals(double rate, Clock::time_point end) : end(end), next(Clock::now()) {
+        if (rate > 0) {
+            this->interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+        }
+    }
+
+    // `false` once the run is over.
+    bool Wait() {
+        Clock::time_point at;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            at = std::max(this->next, Clock::now());
+            this->next = at + this->interval;
+        }
+        if (at >= this->end) {
+            return false;
+        }
+        std::this_thread::sleep_until(at);
+        return true;
+    }
+
+private:
+    Clock::time_point end;
+    Clock::duration interval{};
+    std::mutex mutex;
+    Clock::time_point next;
+};
+
+void Put32(uint8_t* data, uint32_t value) {
+    std::memcpy(data, &value, 4);
+}
+
+uint32_t Get32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, 4);
+    return value;
+}
+
+// What `CL_Login` reads: the signature byte, 0x40 bytes of CRCs, session and UUID (2.0 only), the version, game
+// mode and login length, then login and password in one string.
+Packet AuthPacket(const Options& options, unsigned long version, uint32_t session, uint8_t (&uuid)[20], const std::string& login) {
+    uint8_t data[0x40] = {};
+    if (version >= 20) {
+        Put32(data, options.executable_crc ^ NET_KEY);
+        Put32(data + 0x04, (options.library_crc ^ NET_KEY) + options.executable_crc);
+        Put32(data + 0x14, session ^ 0xDEADBEEF);
+        for (int i = 0; i < 5; i++) {
+            Put32(data + 0x18 + i * 4, Get32(uuid + i * 4) ^ NET_KEY);
+        }
+        CRC_32 crc;
+        Put32(data + 0x2C, crc.CalcCRC(uuid, 20) ^ NET_KEY);
+    }
+
+    Packet pack;
+    pack << (uint8_t)0;
+    pack.AppendData(data, sizeof(data));
+    pack << (uint32_t)(version << 24 | options.game_mode << 16 | login.length());
+    pack << (login + options.password);
+    return pack;
+}
+
+// A name `CheckNickname_creation` accepts.
+std::string RandomNickname(std::mt19937& random) {
+    std::string nickname(1, static_cast<char>('A' + random() % 26));
+    for (int i = 0; i < 7; i++) {
+        nickname += static_cast<char>('a' + random() % 26);
+    }
+    return nickname;
+}
+
+class Session {
+public:
+    Session(const Options& options, Stats& stats, int worker, std::mt19937& random)
+        : options(options), stats(stats), random(random),
+          login(Format("%s%04d", options.login_prefix.c_str(), worker)) {
+        this->version = (static_cast<int>(random() % 100) < options.v11_percent) ? 11 : 20;
+        for (uint8_t& byte : this->uuid) {
+            byte = static_cast<uint8_t>(random());
+        }
+    }
+
+    // `true` if the character entered a server.
+    bool Run() {
+        uint32_t session = 0;
+        if (this->version >= 20 && !this->RequestVersion(session)) {
+            return false;
+        }
+
+        if (!this->Connect(STEP_LOGIN)) {
+            return false;
+        }
+        Packet auth = AuthPacket(this->options, this->version, session, this->uuid, this->login);
+        Packet list;
+        if (!this->Exchange(STEP_LOGIN, auth, 0xCE, list)) {
+            return false;
+        }
+
+        uint8_t id;
+        uint32_t size, hat_id;
+        list >> id >> size >> hat_id;
+        std::vector<std::pair<uint32_t, uint32_t>> characters;
+        for (uint32_t i = 4; i + 8 <= size; i += 8) {
+            uint32_t id1, id2;
+            list >> id1 >> id2;
+            characters.push_back({id1, id2});
+        }
+
+        this->Think();
+        Packet nickname_check;
+        nickname_check << (uint8_t)0x4E << (uint32_t)0 << RandomNickname(this->random);
+        Packet nickname_result;
+        if (!this->Exchange(STEP_NICKNAME, nickname_check, 0xDF, nickname_result)) {
+            return false;
+        }
+        uint32_t result = 0;
+        nickname_result >> id >> result;
+        if (result) {
+            this->stats.Failed(STEP_NICKNAME, ReasonName(result));
+        }
+
+        std::pair<uint32_t, uint32_t> character{0, 0};
+        bool create = characters.empty() || static_cast<int>(this->random() % 100) < this->options.create_percent;
+        if (!characters.empty()) {
+            character = characters[this->random() % characters.size()];
+            this->Think();
+            Packet request;
+            request << (uint8_t)0xCA << character.first << character.second;
+            Packet answer;
+            if (!this->Exchange(STEP_CHARACTER, request, 0xCF, answer)) {
+                return false;
+            }
+        }
+
+        this->Think();
+        Packet list_request;
+        list_request << (uint8_t)0xC8;
+        Packet server_list;
+        if (!this->Exchange(STEP_SERVER_LIST, list_request, 0xCD, server_list)) {
+            return false;
+        }
+
+        std::string server = this->options.server;
+        if (server.empty()) {
+            server = FirstServer(server_list);
+        }
+        if (server.empty()) {
+            this->stats.Failed(STEP_ENTER, "no servers listed");
+            return false;
+        }
+
+        if (create) {
+            // Bits 0x3F000000 of id2 are for characters that can't be created.
+            character = {static_cast<uint32_t>(this->random()), static_cast<uint32_t>(this->random()) & 0x00FFFFFF};
+        }
+
+        this->Think();
+        std::string nickname = RandomNickname(this->random);
+        Packet enter;
+        enter << (uint8_t)0xCB << (uint32_t)(16 + nickname.length() + server.length());
+        enter << character.first << character.second;
+        // body, reaction, mind, spirit, base, picture, sex
+        enter << (uint8_t)34 << (uint8_t)34 << (uint8_t)34 << (uint8_t)34 << (uint8_t)1 << (uint8_t)0x20 << (uint8_t)0;
+        enter << (uint8_t)nickname.length();
+        enter.AppendData((uint8_t*)nickname.c_str(), (uint32_t)nickname.length());
+        enter.AppendData((uint8_t*)server.c_str(), (uint32_t)server.length());
+        Packet entered;
+        return this->Exchange(STEP_ENTER, enter, 0xD0, entered);
+    }
+
+private:
+    bool Connect(Step step) {
+        if (!this->connection.Connect(this->options.host, this->options.port)) {
+            this->stats.Failed(step, "connect failed");
+            return false;
+        }
+        return true;
+    }
+
+    // The 2.0 client asks for a session key first; the hat answers and closes the connection.
+    bool RequestVersion(uint32_t& session) {
+        if (!this->Connect(STEP_VERSION)) {
+            return false;
+        }
+        Packet request;
+        request << (uint8_t)0xFF;
+        Packet answer;
+        if (!this->Exchange(STEP_VERSION, request, 0xFF, answer)) {
+            return false;
+        }
+        this->connection.Close();
+
+        uint8_t id;
+        uint32_t encoded, key;
+        answer >> id >> encoded >> key;
+        session = encoded ^ key ^ 0xDEADFACE;
+        return true;
+    }
+
+    // Sends `request` and waits for `expected`. Any answer is timed; anything else than `expected` is counted as the
+    // step's error.
+    bool Exchange(Step step, Packet& request, uint8_t expected, Packet& answer) {
+        Clock::time_point started = Clock::now();
+        if (!this->connection.Send(request, this->version)) {
+            this->stats.Failed(step, "send failed");
+            return false;
+        }
+
+        peer::Status status = this->connection.Receive(answer, this->version, this->options.timeout_ms);
+        if (status == peer::STATUS_TIMEOUT) {
+            this->stats.Failed(step, "timeout");
+            this->connection.Close();
+            return false;
+        }
+        if (status == peer::STATUS_LOST) {
+            this->stats.Failed(step, "connection lost");
+            return false;
+        }
+        this->stats.Answered(step, Clock::now() - started);
+
+        uint8_t id = 0;
+        answer >> id;
+        if (id == expected) {
+            answer.ResetPosition();
+            return true;
+        }
+
+        if (id == 0x0B) {
+            uint8_t reason = 0;
+            answer >> reason;
+            this->stats.Failed(step, ReasonName(reason));
+        } else if (id == 0xDA) {
+            this->stats.Failed(step, "reconnect (login locked)");
+        } else {
+            this->stats.Failed(step, Format("unexpected packet %02X", id));
+        }
+        this->connection.Close();
+        return false;
+    }
+
+    void Think() {
+        if (!this->options.think_ms) {
+            return;
+        }
+        unsigned long ms = this->options.think_ms / 2 + this->random() % (this->options.think_ms + 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+    // "host:port" of the first line of the 0xCD text, "|name|1.02|map|WxH|level|players|host:port".
+    static std::string FirstServer(Packet& list) {
+        uint8_t id;
+        uint32_t length;
+        list >> id >> length;
+        std::string text(length, '\0');
+        if (length) {
+            list.GetData((uint8_t*)&text[0], length);
+        }
+
+        for (const std::string& line : Explode(text, "\n")) {
+            if (line.empty() || line[0] != '|') {
+                continue;
+            }
+            size_t address = line.rfind('|');
+            return Trim(line.substr(address + 1));
+        }
+        return "";
+    }
+
+    const Options& options;
+    Stats& stats;
+    std::mt19937& random;
+    std::string login;
+    unsigned long version;
+    uint8_t uuid[20];
+    peer::Connection connection;
+};
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = (i + 1 < argc);
+        std::string next = value ? argv[i + 1] : "";
+        bool number = value && CheckInt(next);
+
+        if (arg == "-clients" && number) {
+            options.clients = std::max(1, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-rate" && value) {
+            options.rate = std::atof(argv[++i]);
+        } else if (arg == "-duration" && value) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "-think" && number) {
+            options.think_ms = StrToInt(argv[++i]);
+        } else if (arg == "-v11" && number) {
+            options.v11_percent = std::min(100, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-create" && number) {
+            options.create_percent = std::min(100, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-mode" && number) {
+            options.game_mode = StrToInt(argv[++i]);
+        } else if (arg == "-logins" && value) {
+            options.login_prefix = argv[++i];
+        } else if (arg == "-password" && value) {
+            options.password = argv[++i];
+        } else if (arg == "-server" && value) {
+            options.server = argv[++i];
+        } else if (arg == "-timeout" && number) {
+            options.timeout_ms = StrToInt(argv[++i]);
+        } else if (arg == "-config" && value) {
+            options.config = argv[++i];
+        } else if (options.host.empty() && arg[0] != '-') {
+            if (!peer::SplitAddress(arg, options.host, options.port)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return !options.host.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: redhat-loadgen <host:port> [-clients <n>] [-rate <sessions/s>] [-duration <s>] [-think <ms>]"
+                     " [-v11 <percent>] [-create <percent>] [-mode <game mode>] [-logins <prefix>] [-password <password>]"
+                     " [-server <host:port>] [-timeout <ms>] [-config <file>]" << std::endl;
+        return 2;
+    }
+
+    Config::LogFile = "redhat-loadgen.log";
+    Config::LogLevel = LOG_Error;
+    if (ReadConfig(options.config) && !Config::ExecutableCRC.empty() && !Config::LibraryCRC.empty()) {
+        options.executable_crc = Config::ExecutableCRC.front();
+        options.library_crc = Config::LibraryCRC.front();
+    } else if (options.v11_percent < 100) {
+        std::cerr << options.config << ": no ExecutableCRC and LibraryCRC, 2.0 clients will be kicked with P_WRONG_VERSION" << std::endl;
+    }
+
+    WSADATA wsd;
+    WSAStartup(0x0101, &wsd);
+
+    Stats stats;
+    Clock::time_point started = Clock::now();
+    Arrivals arrivals(options.rate, started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration)));
+
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < options.clients; worker++) {
+        workers.emplace_back([&, worker]() {
+            std::mt19937 random(static_cast<unsigned>(worker * 7919 + Clock::now().time_since_epoch().count()));
+            while (arrivals.Wait()) {
+                Session session(options, stats, worker, random);
+                stats.Session(session.Run());
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    stats.Print(std::chrono::duration<double>(Clock::now() - started).count(), options.clients);
+    WSACleanup();
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "lock_recovery.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+
+#include "cp866.h"
+#include "sql.hpp"
+#include "utils.hpp"
+
+namespace lock_recovery {
+
+namespace {
+
+struct Locked {
+    int login_id;
+    std::string folded_login;
+    // The character the login was locked with.
+    unsigned long id1;
+    unsigned long id2;
+};
+
+std::mutex mutex;
+// `locked_srvid` -> logins locked there.
+std::map<int, std::vector<Locked>> pending;
+// Folded logins whose lock the hat changed since `Load`.
+std::unordered_set<std::string> changed;
+
+} // namespace
+
+bool Load() {
+    auto started = std::chrono::steady_clock::now();
+
+    SimpleSQL select{"SELECT `id`, `name`, `locked_id1`, `locked_id2`, `locked_srvid` FROM `logins` WHERE `locked`='1'"};
+    if (!select) {
+        Printf(LOG_Error, "[locks] failed to read the locked logins: %s\n", SQL_Error().c_str());
+        return false;
+    }
+
+    std::map<int, std::vector<Locked>> loaded;
+    size_t count = 0;
+    ResultView logins(select.result);
+    while (logins.Next()) {
+        loaded[logins.Int("locked_srvid")].push_back(Locked{logins.Int("id"), cp866::Fold(logins.String("name")),
+                                                            static_cast<unsigned long>(logins.Int64("locked_id1")),
+                                                            static_cast<unsigned long>(logins.Int64("locked_id2"))});
+        count++;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    Printf(LOG_Info, "[locks] %u logins are locked on %u servers, waiting for the servers to report (%lld ms)\n",
+           static_cast<unsigned>(count), static_cast<unsigned>(loaded.size()), static_cast<long long>(elapsed.count()));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = std::move(loaded);
+    changed.clear();
+    return true;
+}
+
+bool Pending(int server) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.count(server) > 0;
+}
+
+void Changed(std::string_view login) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+        return;
+    }
+    changed.insert(cp866::Fold(login));
+}
+
+int Reconcile(int server, const std::vector<std::string>& logins) {
+    std::vector<Locked> locked;
+    std::vector<Locked> stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto group = pending.find(server);
+        if (group == pending.end()) {
+            return 0;
+        }
+        locked = std::move(group->second);
+        pending.erase(group);
+
+        std::unordered_set<std::string> reported;
+        for (const std::string& login : logins) {
+            reported.insert(cp866::Fold(login));
+        }
+
+        for (const Locked& login : locked) {
+            if (!reported.count(login.folded_login) && !changed.count(login.folded_login)) {
+                stale.push_back(login);
+            }
+        }
+        if (pending.empty()) {
+            changed.clear();
+        }
+    }
+
+    int unlocked = 0;
+    for (size_t batch = 0; batch < stale.size(); batch += BATCH_SIZE) {
+        std::string ids, locks;
+        for (size_t i = batch; i < stale.size() && i < batch + BATCH_SIZE; i++) {
+            const char* separator = i == batch ? "" : ", ";
+            ids += Format("%s%d", separator, stale[i].login_id);
+            locks += Format("%s(%d, %lu, %lu)", separator, stale[i].login_id, stale[i].id1, stale[i].id2);
+        }
+
+        // Only if the lock is still the one from before the restart. `id IN` is for the primary key.
+        SimpleSQL update{Format("UPDATE `logins` SET `locked`='0', `locked_id1`='0', `locked_id2`='0', `locked_srvid`='0' "
+                                "WHERE `locked`='1' AND `locked_srvid`='%d' AND `id` IN (%s) AND (`id`, `locked_id1`, `locked_id2`) IN (%s)",
+                                server, ids.c_str(), locks.c_str())};
+        if (!update) {
+            Printf(LOG_Error, "[locks] server %d: failed to unlock logins: %s\n", server, SQL_Error().c_str());
+            return -1;
+        }
+        unlocked += SQL_AffectedRows();
+    }
+
+    Printf(LOG_Info, "[locks] server %d reported: unlocked %d of %u logins, %u are still on it or were locked again\n",
+           server, unlocked, static_cast<unsigned>(locked.size()), static_cast<unsigned>(locked.size() - stale.size()));
+    return unlocked;
+}
+
+} // namespace lock_recovery
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Logins left locked on a game server (`logins`.`locked`) when the hat went down.
+//
+// They are read in one query at startup and grouped by `locked_srvid`. Once a server reports who is on it
+// (`SL_UpdateInfo`), the logins it doesn't have are unlocked in a few batched UPDATEs, instead of one by one
+// in `CL_Login` when their players come back. Only the lock read at startup is released: a login the hat locked or
+// unlocked since is left alone, and so is one whose lock changed in the DB (`locked_srvid`, `locked_id1`,
+// `locked_id2`).
+namespace lock_recovery {
+
+// Logins per UPDATE.
+const size_t BATCH_SIZE = 500;
+
+// Reads the locked logins. Replaces whatever was loaded before.
+bool Load();
+
+// `true` if logins locked on `server` still wait for its report.
+bool Pending(int server);
+
+// The hat set or cleared the lock of `login`, see `Login_SetLocked`.
+void Changed(std::string_view login);
+
+// Unlocks the logins locked on `server` that aren't in `logins`, what the server reports as its players and locked
+// logins. Returns the number of logins unlocked, -1 if an UPDATE failed; the server is done either way.
+int Reconcile(int server, const std::vector<std::string>& logins);
+
+} // namespace lock_recovery
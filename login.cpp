@@ -1,3 +1,4 @@
+#include "character_list.h"
 #include "checkpoint.h"
 #include "circle.h"
 #include "constants.h"
@@ -6,9 +7,13 @@
 #include "utils.hpp"
 #include "config.hpp"
 #include "kill_stats.h"
+#include "lock_recovery.h"
 #include "merge_items.hpp"
+#include "nickname_index.h"
 #include "server_id.hpp"
 #include "shelf.hpp"
+#include "thresholds.h"
+#include "unit_of_work.h"
 #include "update_character.h"
 
 #include "sha1.h"
@@ -63,7 +68,8 @@ bool Login_UnlockAll()
 
     try
     {
-        std::string query_unlockall = "UPDATE `logins` SET `locked_hat`='0'";
+        // Only the rows that need it, not a write to every login
+        std::string query_unlockall = "UPDATE `logins` SET `locked_hat`='0' WHERE `locked_hat`<>'0'";
         if(SQL_Query(query_unlockall.c_str()) != 0)
         {
             SQL_Unlock();
@@ -199,6 +205,8 @@ bool Login_Delete(std::string login)
             return false;
         }
 
+        character_list::cache.Forget(login, login_id);
+
         if(login_id == -1)
         {
             SQL_Unlock();
@@ -311,6 +319,8 @@ bool Login_SetLocked(std::string login, bool locked_hat, bool locked, unsigned l
     try
     {
         if(!Login_Exists(login)) return false;
+        // The lock isn't the one from before the restart anymore.
+        lock_recovery::Changed(login);
         login = SQL_Escape(login);
 
         SQL_Lock();
@@ -557,9 +567,13 @@ bool Login_GetMuted(std::string login, bool& muted, unsigned long& date_mute, un
 }
 
 #include "CCharacter.hpp"
+#include "item_blob.h"
 
 std::string Login_SerializeItems(CItemList& list)
 {
+    if(Config::BinaryItems)
+        return item_blob::Encode(list);
+
     std::string out;
     out = Format("[%u,%u,%u,%u]", list.UnknownValue0, list.UnknownValue1, list.UnknownValue2, list.Items.size());
     for(std::vector<CItem>::iterator it = list.Items.begin(); it != list.Items.end(); ++it)
@@ -586,6 +600,16 @@ CItemList Login_UnserializeItems(std::string list)
     items.UnknownValue1 = 0;
     items.UnknownValue2 = 0;
 
+    if(item_blob::IsBlob(list))
+    {
+        if(!item_blob::Decode(list, items))
+        {
+            Printf(LOG_Error, "[DB] Login_UnserializeItems: corrupted binary item list (%u bytes).\n", list.size());
+            items.Items.clear();
+        }
+        return items;
+    }
+
     std::vector<std::string> f_str = Explode(list, ";");
     std::string of_listdata = Trim(f_str[0]);
     if(of_listdata[0] != '[' || of_listdata[of_listdata.length()-1] != ']') return items;
@@ -692,8 +716,15 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
 
         SQL_Lock(); // Lock SQL to prevent concurrent access
 
-        // Query to check if login exists
-        std::string query_checklgn = Format("SELECT `id` FROM `logins` WHERE LOWER(`name`)=LOWER('%s')", login.c_str());
+        // All writes of this save go to the DB as one transaction, see `Commit` below.
+        // If anything fails before that, the unit of work rolls back whatever already ran (e.g. shelf deposits).
+        unit_of_work::UnitOfWork save(Format("%s:%u:%u", login.c_str(), id1, id2));
+
+        // Query to get the login id and the character (NULL if it doesn't exist yet) in one go
+        std::string query_checklgn = Format("SELECT `logins`.`id` AS `id`, `characters`.`id` AS `character_id`, \
+                                            `characters`.`hat_id` AS `character_hat_id`, `characters`.`retarded` AS `character_retarded`, `characters`.`deleted` AS `character_deleted` FROM `logins` \
+                                            LEFT JOIN `characters` ON `characters`.`login_id`=`logins`.`id` AND `characters`.`id1`='%u' AND `characters`.`id2`='%u' \
+                                            WHERE LOWER(`logins`.`name`)=LOWER('%s') LIMIT 1", id1, id2, login.c_str());
         if(SQL_Query(query_checklgn.c_str()) != 0) // Execute query
         {
             SQL_Unlock(); // Unlock SQL if query fails
@@ -721,6 +752,11 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
         MYSQL_ROW row = SQL_FetchRow(result);
         // Get login id from row
         int login_id = SQL_FetchInt(row, result, "id");
+        // -1 if the character doesn't exist (NULL)
+        int character_id = SQL_FetchInt(row, result, "character_id");
+        // What decides whether the character is in the character list
+        int character_hat_id = SQL_FetchInt(row, result, "character_hat_id");
+        bool character_listed = SQL_FetchInt(row, result, "character_retarded") == 0 && SQL_FetchInt(row, result, "character_deleted") == 0;
         SQL_FreeResult(result); // Free result memory
 
         // Check if login id is valid
@@ -730,30 +766,16 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
             return false;
         }
 
-        // Query to check if character exists
-        std::string query_checkchr = Format("SELECT `id` FROM `characters` WHERE `login_id`='%d' AND `id1`='%u' AND `id2`='%u'", login_id, id1, id2);
-        int character_id = -1;
-        if(SQL_Query(query_checkchr.c_str()) != 0) // Execute query
-        {
-            SQL_Unlock();
-            return false;
-        }
-
         // FLAG to determine if character needs to be created
-        bool create = true;
+        bool create = (character_id == -1);
 
-        result = SQL_StoreResult(); // Store result of query
-        if(result)
-        {
-            // If character exists, set create FLAG to false
-            if (SQL_NumRows(result) == 1) {
-                MYSQL_ROW row = SQL_FetchRow(result);
-                character_id = SQL_FetchInt(row, result, "id");
-                create = false;
-            }
+        // What the nickname index learns once the save is committed
+        nickname_index::Key index_key{login_id, id1, id2};
+        std::optional<unsigned long> index_hat;
+        std::string index_nick;
 
-            SQL_FreeResult(result); // Free result memory
-        }
+        // Whether the save changes the character list of the login
+        bool list_changed = true;
 
         // RETARDED CHARACTER
         if(size == 0x30 && *(unsigned long*)(data) == 0xFFDDAA11)
@@ -803,16 +825,15 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
             else
             {
                 chr_query_create1 = Format("UPDATE `characters` SET `login_id`='%u', `retarded`='1', `body`='%u', `reaction`='%u', `mind`='%u', `spirit`='%u', \
-                                           `mainskill`='%u', `picture`='%u', `class`='%u', `id1`='%u', `id2`='%u', `nick`='%s', `clan`='%s', `clantag`='', `deleted`='0'", login_id,
+                                           `mainskill`='%u', `picture`='%u', `class`='%u', `id1`='%u', `id2`='%u', `nick`='%s', `clan`='%s', `clantag`='', `deleted`='0' WHERE `id`='%d'", login_id,
                                                 p_body, p_reaction, p_mind, p_spirit, p_base, p_picture, p_sex, p_id1, p_id2,
-                                                p_nick.c_str(), p_clan.c_str());
+                                                p_nick.c_str(), p_clan.c_str(), character_id);
             }
 
-            if(SQL_Query(chr_query_create1) != 0) // Execute character creation/update query
-            {
-                SQL_Unlock();
-                return false;
-            }
+            save.Add(chr_query_create1); // Character creation/update query
+
+            index_key = nickname_index::Key{login_id, p_id1, p_id2};
+            index_nick = p_nick;
         }
         // REGULAR CHARACTER
         else
@@ -943,8 +964,8 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
                                                         chr.ExpFireBlade, chr.ExpWaterAxe,
                                                         chr.ExpAirBludgeon, chr.ExpEarthPike,
                                                         chr.ExpAstralShooting,
-                                                        Login_SerializeItems(chr.Bag).c_str(),
-                                                        Login_SerializeItems(chr.Dress).c_str(),
+                                                        SQL_EscapeBinary(Login_SerializeItems(chr.Bag)).c_str(),
+                                                        SQL_EscapeBinary(Login_SerializeItems(chr.Dress)).c_str(),
                                                         SQL_Escape(chr.ClanTag).c_str());
 
 
@@ -998,8 +1019,8 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
                                                     chr.ExpFireBlade, chr.ExpWaterAxe,
                                                     chr.ExpAirBludgeon, chr.ExpEarthPike,
                                                     chr.ExpAstralShooting,
-                                                    Login_SerializeItems(chr.Bag).c_str(),
-                                                    Login_SerializeItems(chr.Dress).c_str(),
+                                                    SQL_EscapeBinary(Login_SerializeItems(chr.Bag)).c_str(),
+                                                    SQL_EscapeBinary(Login_SerializeItems(chr.Dress)).c_str(),
                                                     update_result.ascended ? 1 : 0,
                                                     update_result.reclassed ? 1 : 0);
 
@@ -1022,17 +1043,29 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
                 chr_query_update += Format("', `retarded`='0' WHERE `login_id`='%u' AND `id1`='%u' AND `id2`='%u'", login_id, id1, id2); // Finalize query
             }
 
-            if(SQL_Query(chr_query_update) != 0) // Execute update query
-            {
-                Printf(LOG_Error, "[SQL] %s\n", SQL_Error().c_str());
+            save.Add(chr_query_update); // Character insert/update query, goes last
 
-                SQL_Unlock();
-                return false;
-            }
+            index_key = nickname_index::Key{login_id, chr.Id1, chr.Id2};
+            index_hat = chr.HatId;
+            index_nick = chr.Nick;
 
-            Printf(LOG_Info, "[update] Character '%s' saved to the database\n", chr.GetFullName().c_str());
+            // The server may send the character back under other ids
+            list_changed = create || !character_listed || character_hat_id != (int)chr.HatId || chr.Id1 != id1 || chr.Id2 != id2;
         }
 
+        // Send the character row and everything `UpdateCharacter` queued in one round trip.
+        if(!save.Commit())
+        {
+            SQL_Unlock();
+            return false;
+        }
+
+        nickname_index::Saved(nickname_index::Key{login_id, id1, id2}, index_key, index_hat, index_nick);
+        if(list_changed)
+            character_list::cache.Invalidate(login_id);
+
+        Printf(LOG_Info, "[update] Character '%s' saved to the database\n", nickname.c_str());
+
         SQL_Unlock(); // Unlock SQL after successful operation
         return true;
     }
@@ -1048,6 +1081,61 @@ bool Login_SetCharacter(std::string login, unsigned long id1, unsigned long id2,
 }
 
 
+// The columns of `characters` that `Login_GetCharacter` reads, in the order it reads them.
+// Not `SELECT *`: a character load shouldn't pull the columns it doesn't need.
+static const char* const CHARACTER_COLUMNS =
+    "`login_id`, `retarded`, `id1`, `id2`, `hat_id`, `unknown_value_1`, `unknown_value_2`, `unknown_value_3`, "
+    "`nick`, `clan`, `clantag`, `picture`, `body`, `reaction`, `mind`, `spirit`, `class`, `mainskill`, `flags`, `color`, "
+    "`monsters_kills`, `players_kills`, `frags`, `deaths`, `money`, `spells`, `active_spell`, "
+    "`exp_fire_blade`, `exp_water_axe`, `exp_air_bludgeon`, `exp_earth_pike`, `exp_astral_shooting`, "
+    "`sec_55555555`, `sec_40A40A40`, `bag`, `dress`";
+
+// Fills the character from the current row of a `SELECT CHARACTER_COLUMNS`.
+static void Login_ReadCharacter(const ResultView& view, CCharacter& chr)
+{
+    chr.Id1 = view.Int("id1");
+    chr.Id2 = view.Int("id2");
+    chr.HatId = view.Int("hat_id");
+    chr.UnknownValue1 = static_cast<uint8_t>(view.Int("unknown_value_1"));
+    chr.UnknownValue2 = static_cast<uint8_t>(view.Int("unknown_value_2"));
+    chr.UnknownValue3 = static_cast<uint8_t>(view.Int("unknown_value_3"));
+    chr.Nick = view.String("nick");
+    chr.Clan = view.String("clan");
+    chr.ClanTag = view.String("clantag");
+    chr.Picture = static_cast<uint8_t>(view.Int("picture"));
+    chr.Body = static_cast<uint8_t>(view.Int("body"));
+    chr.Reaction = static_cast<uint8_t>(view.Int("reaction"));
+    chr.Mind = static_cast<uint8_t>(view.Int("mind"));
+    chr.Spirit = static_cast<uint8_t>(view.Int("spirit"));
+    chr.Sex = static_cast<uint8_t>(view.Int("class"));
+    chr.MainSkill = static_cast<uint8_t>(view.Int("mainskill"));
+    chr.Flags = static_cast<uint8_t>(view.Int("flags"));
+    chr.Color = static_cast<uint8_t>(view.Int("color"));
+    chr.MonstersKills = view.Int("monsters_kills");
+    chr.PlayersKills = view.Int("players_kills");
+    chr.Frags = view.Int("frags");
+    chr.Deaths = view.Int("deaths");
+    chr.Money = view.Int("money");
+    chr.Spells = view.Int("spells");
+    chr.ActiveSpell = view.Int("active_spell");
+    chr.ExpFireBlade = view.Int("exp_fire_blade");
+    chr.ExpWaterAxe = view.Int("exp_water_axe");
+    chr.ExpAirBludgeon = view.Int("exp_air_bludgeon");
+    chr.ExpEarthPike = view.Int("exp_earth_pike");
+    chr.ExpAstralShooting = view.Int("exp_astral_shooting");
+
+    // Handle additional sections
+    std::string data_55555555(view.String("sec_55555555"));
+    std::string data_40A40A40(view.String("sec_40A40A40"));
+    chr.Section55555555.Reset();
+    chr.Section55555555.WriteFixedString(data_55555555, data_55555555.size());
+    chr.Section40A40A40.Reset();
+    chr.Section40A40A40.WriteFixedString(data_40A40A40, data_55555555.size());
+
+    chr.Bag = Login_UnserializeItems(std::string(view.String("bag")));
+    chr.Dress = Login_UnserializeItems(std::string(view.String("dress")));
+}
+
 /**
  * Retrieves character data in binary format.
  *
@@ -1108,7 +1196,7 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
         }
 
         // Query to get character data
-        std::string query_character = Format("SELECT * FROM `characters` WHERE `login_id`='%d' AND `id1`='%u' AND `id2`='%u' AND `deleted`='0'", login_id, id1, id2);
+        std::string query_character = Format("SELECT %s FROM `characters` WHERE `login_id`='%d' AND `id1`='%u' AND `id2`='%u' AND `deleted`='0'", CHARACTER_COLUMNS, login_id, id1, id2);
         if(SQL_Query(query_character.c_str()) != 0) // Execute query
         {
             SQL_Unlock();
@@ -1128,29 +1216,30 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
             return false;
         }
 
-        row = SQL_FetchRow(result); // Fetch row from result
+        ResultView character(result);
+        character.Next(); // Fetch row from result
 
         // Check if character is flagged as "retarded"
-        bool p_retarded = (bool)SQL_FetchInt(row, result, "retarded");
+        bool p_retarded = (bool)character.Int("retarded");
         if(p_retarded)
         {
             size = 0x30; // Set size for binary data
             data = new char[size]; // Allocate memory for binary data
-            std::string p_nick = SQL_FetchString(row, result, "nick"); // Fetch nickname
-            std::string p_clan = SQL_FetchString(row, result, "clan"); // Fetch clan
+            std::string p_nick(character.String("nick")); // Fetch nickname
+            std::string p_clan(character.String("clan")); // Fetch clan
             std::string p_nickname = p_nick; // Combine nickname and clan if clan exists
             if(p_clan.length()) p_nickname += "|" + p_clan;
             *(uint32_t*)(data) = 0xFFDDAA11; // Set magic number for binary data
             *(uint8_t*)(data + 4) = (uint8_t)p_nickname.size();
-            *(uint8_t*)(data + 5) = (uint8_t)SQL_FetchInt(row, result, "body");
-            *(uint8_t*)(data + 6) = (uint8_t)SQL_FetchInt(row, result, "reaction");
-            *(uint8_t*)(data + 7) = (uint8_t)SQL_FetchInt(row, result, "mind");
-            *(uint8_t*)(data + 8) = (uint8_t)SQL_FetchInt(row, result, "spirit");
-            *(uint8_t*)(data + 9) = (uint8_t)SQL_FetchInt(row, result, "mainskill");
-            *(uint8_t*)(data + 10) = (uint8_t)SQL_FetchInt(row, result, "picture");
-            *(uint8_t*)(data + 11) = (uint8_t)SQL_FetchInt(row, result, "class");
-            *(uint32_t*)(data + 12) = (uint32_t)SQL_FetchInt(row, result, "id1");
-            *(uint32_t*)(data + 16) = (uint32_t)SQL_FetchInt(row, result, "id2");
+            *(uint8_t*)(data + 5) = (uint8_t)character.Int("body");
+            *(uint8_t*)(data + 6) = (uint8_t)character.Int("reaction");
+            *(uint8_t*)(data + 7) = (uint8_t)character.Int("mind");
+            *(uint8_t*)(data + 8) = (uint8_t)character.Int("spirit");
+            *(uint8_t*)(data + 9) = (uint8_t)character.Int("mainskill");
+            *(uint8_t*)(data + 10) = (uint8_t)character.Int("picture");
+            *(uint8_t*)(data + 11) = (uint8_t)character.Int("class");
+            *(uint32_t*)(data + 12) = (uint32_t)character.Int("id1");
+            *(uint32_t*)(data + 16) = (uint32_t)character.Int("id2");
             memcpy(data + 20, p_nickname.data(), p_nickname.size()); // Copy nickname to binary data
             nickname = p_nick; // Set nickname
         }
@@ -1158,48 +1247,9 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
         else
         {
             CCharacter chr;
-            chr.LoginID = SQL_FetchInt(row, result, "login_id");
-            chr.Id1 = SQL_FetchInt(row, result, "id1");
-            chr.Id2 = SQL_FetchInt(row, result, "id2");
-            chr.HatId = (genericId ? Config::HatID : SQL_FetchInt(row, result, "hat_id"));
-            chr.UnknownValue1 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_1"));
-            chr.UnknownValue2 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_2"));
-            chr.UnknownValue3 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_3"));
-            chr.Nick = SQL_FetchString(row, result, "nick");
-            chr.Clan = SQL_FetchString(row, result, "clan");
-            chr.ClanTag = SQL_FetchString(row, result, "clantag");
-            chr.Picture = static_cast<uint8_t>(SQL_FetchInt(row, result, "picture"));
-            chr.Body = static_cast<uint8_t>(SQL_FetchInt(row, result, "body"));
-            chr.Reaction = static_cast<uint8_t>(SQL_FetchInt(row, result, "reaction"));
-            chr.Mind = static_cast<uint8_t>(SQL_FetchInt(row, result, "mind"));
-            chr.Spirit = static_cast<uint8_t>(SQL_FetchInt(row, result, "spirit"));
-            chr.Sex = static_cast<uint8_t>(SQL_FetchInt(row, result, "class"));
-            chr.MainSkill = static_cast<uint8_t>(SQL_FetchInt(row, result, "mainskill"));
-            chr.Flags = static_cast<uint8_t>(SQL_FetchInt(row, result, "flags"));
-            chr.Color = static_cast<uint8_t>(SQL_FetchInt(row, result, "color"));
-            chr.MonstersKills = SQL_FetchInt(row, result, "monsters_kills");
-            chr.PlayersKills = SQL_FetchInt(row, result, "players_kills");
-            chr.Frags = SQL_FetchInt(row, result, "frags");
-            chr.Deaths = SQL_FetchInt(row, result, "deaths");
-            chr.Money = SQL_FetchInt(row, result, "money");
-            chr.Spells = SQL_FetchInt(row, result, "spells");
-            chr.ActiveSpell = SQL_FetchInt(row, result, "active_spell");
-            chr.ExpFireBlade = SQL_FetchInt(row, result, "exp_fire_blade");
-            chr.ExpWaterAxe = SQL_FetchInt(row, result, "exp_water_axe");
-            chr.ExpAirBludgeon = SQL_FetchInt(row, result, "exp_air_bludgeon");
-            chr.ExpEarthPike = SQL_FetchInt(row, result, "exp_earth_pike");
-            chr.ExpAstralShooting = SQL_FetchInt(row, result, "exp_astral_shooting");
-
-            // Handle additional sections
-            std::string data_55555555 = SQL_FetchString(row, result, "sec_55555555");
-            std::string data_40A40A40 = SQL_FetchString(row, result, "sec_40A40A40");
-            chr.Section55555555.Reset();
-            chr.Section55555555.WriteFixedString(data_55555555, data_55555555.size());
-            chr.Section40A40A40.Reset();
-            chr.Section40A40A40.WriteFixedString(data_40A40A40, data_55555555.size());
-
-            chr.Bag = Login_UnserializeItems(SQL_FetchString(row, result, "bag"));
-            chr.Dress = Login_UnserializeItems(SQL_FetchString(row, result, "dress"));
+            Login_ReadCharacter(character, chr);
+            chr.LoginID = character.Int("login_id");
+            if(genericId) chr.HatId = Config::HatID;
 
             // Serialize character to binary stream
             BinaryStream strm;
@@ -1289,7 +1339,7 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
         }
 
         // Query to get character data
-        std::string query_character = Format("SELECT * FROM `characters` WHERE `login_id`='%d' AND `id1`='%u' AND `id2`='%u' AND `deleted`='0'", login_id, id1, id2);
+        std::string query_character = Format("SELECT %s FROM `characters` WHERE `login_id`='%d' AND `id1`='%u' AND `id2`='%u' AND `deleted`='0'", CHARACTER_COLUMNS, login_id, id1, id2);
         if(SQL_Query(query_character.c_str()) != 0) // Execute query
         {
             SQL_Unlock();
@@ -1309,53 +1359,13 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
             return false;
         }
 
-        row = SQL_FetchRow(result); // Fetch row from result
+        ResultView view(result);
+        view.Next(); // Fetch row from result
 
         // Populate CCharacter object with character data
-        bool p_retarded = (bool)SQL_FetchInt(row, result, "retarded");
         CCharacter chr;
-        chr.Retarded = p_retarded;
-        chr.Id1 = SQL_FetchInt(row, result, "id1");
-        chr.Id2 = SQL_FetchInt(row, result, "id2");
-        chr.HatId = SQL_FetchInt(row, result, "hat_id");
-        chr.UnknownValue1 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_1"));
-        chr.UnknownValue2 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_2"));
-        chr.UnknownValue3 = static_cast<uint8_t>(SQL_FetchInt(row, result, "unknown_value_3"));
-        chr.Nick = SQL_FetchString(row, result, "nick");
-        chr.Clan = SQL_FetchString(row, result, "clan");
-        chr.ClanTag = SQL_FetchString(row, result, "clantag");
-        chr.Picture = static_cast<uint8_t>(SQL_FetchInt(row, result, "picture"));
-        chr.Body = static_cast<uint8_t>(SQL_FetchInt(row, result, "body"));
-        chr.Reaction = static_cast<uint8_t>(SQL_FetchInt(row, result, "reaction"));
-        chr.Mind = static_cast<uint8_t>(SQL_FetchInt(row, result, "mind"));
-        chr.Spirit = static_cast<uint8_t>(SQL_FetchInt(row, result, "spirit"));
-        chr.Sex = static_cast<uint8_t>(SQL_FetchInt(row, result, "class"));
-        chr.MainSkill = static_cast<uint8_t>(SQL_FetchInt(row, result, "mainskill"));
-        chr.Flags = static_cast<uint8_t>(SQL_FetchInt(row, result, "flags"));
-        chr.Color = static_cast<uint8_t>(SQL_FetchInt(row, result, "color"));
-        chr.MonstersKills = SQL_FetchInt(row, result, "monsters_kills");
-        chr.PlayersKills = SQL_FetchInt(row, result, "players_kills");
-        chr.Frags = SQL_FetchInt(row, result, "frags");
-        chr.Deaths = SQL_FetchInt(row, result, "deaths");
-        chr.Money = SQL_FetchInt(row, result, "money");
-        chr.Spells = SQL_FetchInt(row, result, "spells");
-        chr.ActiveSpell = SQL_FetchInt(row, result, "active_spell");
-        chr.ExpFireBlade = SQL_FetchInt(row, result, "exp_fire_blade");
-        chr.ExpWaterAxe = SQL_FetchInt(row, result, "exp_water_axe");
-        chr.ExpAirBludgeon = SQL_FetchInt(row, result, "exp_air_bludgeon");
-        chr.ExpEarthPike = SQL_FetchInt(row, result, "exp_earth_pike");
-        chr.ExpAstralShooting = SQL_FetchInt(row, result, "exp_astral_shooting");
-
-        // Handle additional sections
-        std::string data_55555555 = SQL_FetchString(row, result, "sec_55555555");
-        std::string data_40A40A40 = SQL_FetchString(row, result, "sec_40A40A40");
-        chr.Section55555555.Reset();
-        chr.Section55555555.WriteFixedString(data_55555555, data_55555555.size());
-        chr.Section40A40A40.Reset();
-        chr.Section40A40A40.WriteFixedString(data_40A40A40, data_55555555.size());
-
-        chr.Bag = Login_UnserializeItems(SQL_FetchString(row, result, "bag"));
-        chr.Dress = Login_UnserializeItems(SQL_FetchString(row, result, "dress"));
+        chr.Retarded = (bool)view.Int("retarded");
+        Login_ReadCharacter(view, chr);
 
         character = chr; // Set the character object
 
@@ -1384,34 +1394,45 @@ bool Login_GetCharacterList(std::string login, std::vector<CharacterInfo>& info,
     {
         login = SQL_Escape(login);
 
+        // Both the login id and the list are usually cached, see character_list.h
+        std::optional<int> cached_id = character_list::cache.LoginID(login);
+        if(cached_id && character_list::cache.Get(*cached_id, hatId, info))
+            return true;
+
         SQL_Lock();
-        std::string query_checklgn = Format("SELECT `id` FROM `logins` WHERE LOWER(`name`)=LOWER('%s')", login.c_str());
-        if(SQL_Query(query_checklgn.c_str()) != 0)
-        {
-            SQL_Unlock();
-            return false;
-        }
-        MYSQL_RES* result = SQL_StoreResult();
-        if(!result)
+        int login_id = cached_id.value_or(-1);
+        if(!cached_id)
         {
-            SQL_Unlock();
-            return false;
-        }
+            std::string query_checklgn = Format("SELECT `id` FROM `logins` WHERE LOWER(`name`)=LOWER('%s')", login.c_str());
+            if(SQL_Query(query_checklgn.c_str()) != 0)
+            {
+                SQL_Unlock();
+                return false;
+            }
+            MYSQL_RES* result = SQL_StoreResult();
+            if(!result)
+            {
+                SQL_Unlock();
+                return false;
+            }
 
-        if(!SQL_NumRows(result))
-        {
-            SQL_Unlock();
+            if(!SQL_NumRows(result))
+            {
+                SQL_Unlock();
+                SQL_FreeResult(result);
+                return false; // login does not exist
+            }
+
+            MYSQL_ROW row = SQL_FetchRow(result);
+            login_id = SQL_FetchInt(row, result, "id");
             SQL_FreeResult(result);
-            return false; // login does not exist
-        }
+            if(login_id == -1)
+            {
+                SQL_Unlock();
+                return false;
+            }
 
-        MYSQL_ROW row = SQL_FetchRow(result);
-        int login_id = SQL_FetchInt(row, result, "id");
-        SQL_FreeResult(result);
-        if(login_id == -1)
-        {
-            SQL_Unlock();
-            return false;
+            character_list::cache.SetLoginID(login, login_id);
         }
 
         std::string query_character = Format("SELECT `id1`, `id2` FROM `characters` WHERE `login_id`='%d' AND `deleted`='0' AND `retarded`='0'", login_id);
@@ -1422,25 +1443,26 @@ bool Login_GetCharacterList(std::string login, std::vector<CharacterInfo>& info,
             return false;
         }
 
-        result = SQL_StoreResult();
+        MYSQL_RES* result = SQL_StoreResult();
         if(!result)
         {
             SQL_Unlock();
             return false;
         }
 
-        int rows = SQL_NumRows(result);
-        for(int i = 0; i < rows; i++)
+        ResultView characters(result);
+        while(characters.Next())
         {
-            row = SQL_FetchRow(result);
             CharacterInfo inf;
-            inf.ID1 = SQL_FetchInt(row, result, "id1");
-            inf.ID2 = SQL_FetchInt(row, result, "id2");
+            inf.ID1 = characters.Int("id1");
+            inf.ID2 = characters.Int("id2");
             info.push_back(inf);
         }
 
         SQL_FreeResult(result);
 
+        character_list::cache.Put(login_id, hatId, info);
+
         SQL_Unlock();
         return true;
     }
@@ -1451,7 +1473,14 @@ bool Login_GetCharacterList(std::string login, std::vector<CharacterInfo>& info,
     }
 }
 
-bool Login_NickExists(std::string nickname, int hatId) {
+bool Login_NickExists(std::string nickname, int hatId, bool fromDB) {
+    if (!fromDB) {
+        std::optional<bool> indexed = nickname_index::Exists(nickname, hatId);
+        if (indexed) {
+            return *indexed;
+        }
+    }
+
     if(!SQL_CheckConnected()) return false;
 
     std::string query_nickheck = Format("SELECT `nick` FROM `characters` WHERE LOWER(`nick`) = LOWER('%s') AND `deleted`='0'", SQL_Escape(nickname).c_str());
@@ -1518,6 +1547,9 @@ bool Login_DelCharacter(std::string login, unsigned long id1, unsigned long id2)
             SQL_Unlock();
             return false;
         }
+
+        nickname_index::Deleted(nickname_index::Key{login_id, id1, id2});
+        character_list::cache.Invalidate(login_id);
         
         // Delete from treasure table by character_id
         std::string query_deltreasure = Format(
@@ -1722,6 +1754,9 @@ bool Login_LogAuthentication(std::string login, std::string ip, std::string uuid
 UpdateCharacterResult UpdateCharacter(CCharacter& chr, ServerIDType srvid, shelf::StoreOnShelfFunction store_on_shelf) {
     UpdateCharacterResult result{.ascended = false, .reclassed = false, .points = 0};
 
+    // All thresholds for this update come from the same config, even if it's reloaded meanwhile.
+    thresholds::Pin thresholds_pin(thresholds::thresholds);
+
     const std::string chr_full_name = chr.GetFullName();
     const char* full_name = chr_full_name.c_str();
     Printf(LOG_Info, "[update] character '%s' on s%d\n", full_name, srvid);
@@ -1763,31 +1798,13 @@ UpdateCharacterResult UpdateCharacter(CCharacter& chr, ServerIDType srvid, shelf
             Printf(LOG_Info, "[update] character '%s' does reborn from HARD, unlocks mages\n", full_name);
             if (chr.Nick[0] == '@') { // for @ chars: make it 1 if it's 0
                 std::string query_update_allow = Format("UPDATE `logins` SET `allow_mage` = 1 WHERE `id` = '%u' AND `allow_mage` = 0", chr.LoginID);
-
-                SQL_Lock();
-                if (SQL_Query(query_update_allow.c_str()) != 0)
-                {
-                     Printf(LOG_Error, "[DB] Failed to update allow_mage: %s\n", SQL_Error().c_str());
-                }
-                SQL_Unlock();
+                unit_of_work::Write(query_update_allow);
             } else if (chr.Nick[0] == '!') { // for ! chars: set to 2 if less than 2
                 std::string query_update_allow = Format("UPDATE `logins` SET `allow_mage` = 2 WHERE `id` = '%u' AND `allow_mage` < 2", chr.LoginID);
-
-                SQL_Lock();
-                if (SQL_Query(query_update_allow.c_str()) != 0)
-                {
-                     Printf(LOG_Error, "[DB] Failed to update allow_mage: %s\n", SQL_Error().c_str());
-                }
-                SQL_Unlock();
+                unit_of_work::Write(query_update_allow);
             } else if (chr.Nick[0] == '_') { // for _ chars: always set to 3
                 std::string query_update_allow = Format("UPDATE `logins` SET `allow_mage` = 3 WHERE `id` = '%u'", chr.LoginID);
-
-                SQL_Lock();
-                if (SQL_Query(query_update_allow.c_str()) != 0)
-                {
-                     Printf(LOG_Error, "[DB] Failed to update allow_mage: %s\n", SQL_Error().c_str());
-                }
-                SQL_Unlock();
+                unit_of_work::Write(query_update_allow);
             }
         }
 
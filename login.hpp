@@ -36,7 +36,9 @@ bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2,
 bool Login_GetCharacter(std::string login, unsigned long id1, unsigned long id2, unsigned long& size, char*& data, std::string& nickname, bool genericId = false);
 bool Login_DelCharacter(std::string login, unsigned long id1, unsigned long id2);
 bool Login_Exists(std::string login);
-bool Login_NickExists(std::string nickname, int hatId);
+// Answered by the nickname index once it's loaded. `fromDB` asks the DB anyway, e.g. right before a character
+// is created, in case another hat sharing the DB took the nickname since the last reload.
+bool Login_NickExists(std::string nickname, int hatId, bool fromDB = false);
 bool Login_CharExists(std::string login, unsigned long id1, unsigned long id2, bool onlyNormal = false);
 bool Login_GetCharacterList(std::string login, std::vector<CharacterInfo>& info, int hatId);
 bool Login_GetIPF(std::string login, std::string& ipf);
@@ -0,0 +1,76 @@
+#include "nickname.h"
+
+#include "utils.hpp"
+
+namespace nickname {
+
+namespace {
+
+std::string_view TrimView(std::string_view text) {
+    while (!text.empty() && IsWhitespace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && IsWhitespace(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+} // namespace
+
+Result Check(std::string_view nickname, Rules rules, bool secondary) {
+    if (!nickname.empty() && nickname.back() == '|') {
+        return RESULT_WRONG;
+    }
+
+    size_t name_length = Name(nickname).size();
+    if (!secondary && name_length < 3) {
+        return RESULT_SHORT;
+    }
+    if (!secondary && name_length > 10) {
+        return RESULT_LONG;
+    }
+
+    for (size_t i = 0; i < nickname.size(); i++) {
+        uint8_t bits = CLASSES[static_cast<uint8_t>(nickname[i])];
+        if (i == name_length) {
+            continue; // the `|`
+        }
+
+        bool allowed;
+        if (rules == RULES_CREATION) {
+            allowed = (bits & CLASS_LETTER) || (i == 0 && (bits & CLASS_FIRST));
+        } else {
+            allowed = (bits & CLASS_NAME) || (i > name_length && (bits & CLASS_CLAN));
+        }
+
+        if (!allowed) {
+            return RESULT_WRONG;
+        }
+    }
+
+    return RESULT_OK;
+}
+
+std::string_view Name(std::string_view nickname) {
+    return nickname.substr(0, nickname.find('|'));
+}
+
+std::string Trim(std::string_view nickname) {
+    size_t separator = nickname.find('|');
+    if (separator == std::string_view::npos) {
+        return std::string(TrimView(nickname));
+    }
+
+    std::string_view name = TrimView(nickname.substr(0, separator));
+    std::string_view clan = TrimView(nickname.substr(separator + 1));
+
+    std::string trimmed;
+    trimmed.reserve(name.size() + 1 + clan.size());
+    trimmed.append(name);
+    trimmed += '|';
+    trimmed.append(clan);
+    return trimmed;
+}
+
+} // namespace nickname
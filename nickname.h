@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// What a character may be called. A nickname is `name` or `name|clan`, cp866.
+namespace nickname {
+
+// Bits of `CLASSES`.
+enum Class : uint8_t {
+    // Anywhere in a nickname.
+    CLASS_NAME = 1,
+    // Only after the `|`.
+    CLASS_CLAN = 2,
+    // The only characters of a new character's nickname...
+    CLASS_LETTER = 4,
+    // ...besides these as the first one.
+    CLASS_FIRST = 8,
+};
+
+constexpr std::array<uint8_t, 256> CLASSES = [] {
+    std::array<uint8_t, 256> classes{};
+    auto add = [&](int from, int to, uint8_t bits) {
+        for (int c = from; c <= to; c++) {
+            classes[c] |= bits;
+        }
+    };
+
+    add('0', '9', CLASS_NAME);
+    add('A', 'Z', CLASS_NAME | CLASS_LETTER);
+    add('a', 'z', CLASS_NAME | CLASS_LETTER);
+    add(0x80, 0x9F, CLASS_NAME); // А..Я
+    add(0xA0, 0xAF, CLASS_NAME); // а..п
+    add(0xE0, 0xEF, CLASS_NAME); // р..я
+    add(0xF0, 0xF1, CLASS_NAME); // Ё ё
+    for (char c : std::string_view("- !?@.=+_$()<>")) {
+        add(c, c, CLASS_NAME);
+    }
+
+    add(0x7F, 0x7F, CLASS_CLAN); // a square
+    for (char c : std::string_view("{}:;*^#&")) {
+        add(c, c, CLASS_CLAN);
+    }
+
+    for (char c : std::string_view("@_!")) {
+        add(c, c, CLASS_FIRST);
+    }
+
+    return classes;
+}();
+
+enum Rules {
+    // Renaming and the nickname check while the player types.
+    RULES_REGULAR,
+    // A character being created: latin letters only.
+    RULES_CREATION,
+};
+
+enum Result {
+    RESULT_OK,
+    RESULT_SHORT, // less than 3 characters before the `|`
+    RESULT_LONG,  // more than 10
+    RESULT_WRONG, // a character that isn't allowed, or nothing after the `|`
+};
+
+// One pass over the nickname. `secondary` skips the length checks, e.g. for a nickname the server sent back.
+Result Check(std::string_view nickname, Rules rules, bool secondary = false);
+
+// The part before the `|`, what `Login_NickExists` compares.
+std::string_view Name(std::string_view nickname);
+
+// Trims the whitespace around the name and around the clan.
+std::string Trim(std::string_view nickname);
+
+} // namespace nickname
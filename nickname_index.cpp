@@ -0,0 +1,334 @@
+#include "nickname_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <windows.h>
+
+#include "config.hpp"
+#include "cp866.h"
+#include "sql.hpp"
+#include "sql_backend.h"
+#include "utils.hpp"
+
+namespace nickname_index {
+
+namespace {
+
+// Probes per nickname. With 10 bits per nickname that's about 1% false positives.
+const int BLOOM_PROBES = 7;
+const size_t BLOOM_BITS_PER_NICKNAME = 10;
+
+// FNV-1a, split in two halves for double hashing.
+uint64_t Hash(std::string_view folded) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : folded) {
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::mutex mutex;
+Index index;
+bool loaded = false;
+
+// While a reload reads the table: the changes to apply to what it read, in order.
+bool journaling = false;
+std::vector<std::function<void(Index&)>> journal;
+
+struct Reloader {
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    ~Reloader() {
+        if (this->thread.joinable()) {
+            this->thread.join();
+        }
+    }
+} reloader;
+
+// All characters that aren't deleted, from the DB of this thread.
+bool Read(Index& fresh) {
+    SimpleSQL select{"SELECT `login_id`, `id1`, `id2`, `hat_id`, `nick` FROM `characters` WHERE `deleted`='0'"};
+    if (!select) {
+        Printf(LOG_Error, "[nicknames] failed to load nicknames: %s\n", SQL_Error().c_str());
+        return false;
+    }
+
+    ResultView characters(select.result);
+    while (characters.Next()) {
+        Key key{characters.Int("login_id"), static_cast<unsigned long>(characters.Int64("id1")), static_cast<unsigned long>(characters.Int64("id2"))};
+        fresh.Set(key, static_cast<unsigned long>(characters.Int64("hat_id")), characters.String("nick"));
+    }
+    return true;
+}
+
+// Replaces the index with `fresh`, after the changes made since the read started.
+void Publish(Index fresh, std::chrono::steady_clock::time_point started) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& change : journal) {
+        change(fresh);
+    }
+    journaling = false;
+    journal.clear();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    if (loaded) {
+        size_t difference = index.Difference(fresh);
+        Printf(difference ? LOG_Warning : LOG_Trivial, "[nicknames] reloaded %u nicknames in %lld ms, %u were out of date\n",
+               static_cast<unsigned>(fresh.Size()), static_cast<long long>(elapsed.count()), static_cast<unsigned>(difference));
+    } else {
+        Printf(LOG_Info, "[nicknames] loaded %u nicknames in %lld ms\n", static_cast<unsigned>(fresh.Size()), static_cast<long long>(elapsed.count()));
+    }
+
+    index = std::move(fresh);
+    loaded = true;
+}
+
+} // namespace
+
+BloomFilter::BloomFilter(size_t expected) : capacity(expected) {
+    size_t bit_count = std::bit_ceil(std::max<size_t>(expected * BLOOM_BITS_PER_NICKNAME, 64));
+    this->bits.assign(bit_count / 64, 0);
+}
+
+void BloomFilter::Add(std::string_view folded) {
+    uint64_t hash = Hash(folded);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+    uint64_t mask = this->bits.size() * 64 - 1;
+    for (int i = 0; i < BLOOM_PROBES; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        this->bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool BloomFilter::MayContain(std::string_view folded) const {
+    uint64_t hash = Hash(folded);
+    uint64_t h1 = hash & 0xFFFFFFFF;
+    uint64_t h2 = (hash >> 32) | 1;
+    uint64_t mask = this->bits.size() * 64 - 1;
+    for (int i = 0; i < BLOOM_PROBES; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        if (!(this->bits[bit / 64] & (1ULL << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Index::Set(Key key, unsigned long hat_id, std::string_view nick) {
+    this->Remove(key);
+
+    std::string folded = cp866::Fold(nick);
+    this->nicknames[folded][hat_id]++;
+    this->characters[key] = Entry{hat_id, folded};
+
+    if (this->characters.size() > this->bloom.Capacity()) {
+        // Grown past what the filter was sized for: rebuild it with room to spare.
+        this->bloom = BloomFilter(this->characters.size() * 2);
+        for (const auto& [nickname, hats] : this->nicknames) {
+            this->bloom.Add(nickname);
+        }
+    } else {
+        this->bloom.Add(folded);
+    }
+}
+
+void Index::Remove(Key key) {
+    auto character = this->characters.find(key);
+    if (character == this->characters.end()) {
+        return;
+    }
+
+    auto nickname = this->nicknames.find(character->second.folded);
+    if (nickname != this->nicknames.end()) {
+        auto hat = nickname->second.find(character->second.hat_id);
+        if (hat != nickname->second.end() && --hat->second <= 0) {
+            nickname->second.erase(hat);
+        }
+        if (nickname->second.empty()) {
+            this->nicknames.erase(nickname);
+        }
+    }
+
+    this->characters.erase(character);
+}
+
+std::optional<unsigned long> Index::HatOf(Key key) const {
+    auto character = this->characters.find(key);
+    if (character == this->characters.end()) {
+        return std::nullopt;
+    }
+    return character->second.hat_id;
+}
+
+bool Index::Contains(std::string_view nick, int hat_id) const {
+    std::string folded = cp866::Fold(nick);
+    if (!this->bloom.MayContain(folded)) {
+        return false;
+    }
+
+    auto nickname = this->nicknames.find(folded);
+    if (nickname == this->nicknames.end()) {
+        return false;
+    }
+
+    if (hat_id <= 0) {
+        return true;
+    }
+    return nickname->second.count(static_cast<unsigned long>(hat_id)) > 0;
+}
+
+size_t Index::Difference(const Index& other) const {
+    size_t difference = 0;
+
+    auto mine = this->characters.begin();
+    auto theirs = other.characters.begin();
+    while (mine != this->characters.end() || theirs != other.characters.end()) {
+        if (theirs == other.characters.end() || (mine != this->characters.end() && mine->first < theirs->first)) {
+            difference++;
+            ++mine;
+        } else if (mine == this->characters.end() || theirs->first < mine->first) {
+            difference++;
+            ++theirs;
+        } else {
+            if (mine->second.hat_id != theirs->second.hat_id || mine->second.folded != theirs->second.folded) {
+                difference++;
+            }
+            ++mine;
+            ++theirs;
+        }
+    }
+
+    return difference;
+}
+
+bool Load() {
+    auto started = std::chrono::steady_clock::now();
+    Index fresh;
+    if (!Read(fresh)) {
+        return false;
+    }
+    Publish(std::move(fresh), started);
+    return true;
+}
+
+bool ReloadAsync() {
+    return ReloadAsync(sql_backend::ConnectMySQL);
+}
+
+bool ReloadAsync(Connect connect) {
+    if (reloader.running.exchange(true)) {
+        Printf(LOG_Warning, "[nicknames] reload skipped: another reload is running\n");
+        return false;
+    }
+
+    // The previous worker has finished, but still has to be joined.
+    if (reloader.thread.joinable()) {
+        reloader.thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        journaling = true;
+        journal.clear();
+    }
+
+    reloader.thread = std::thread([connect = std::move(connect)]() {
+        auto started = std::chrono::steady_clock::now();
+        Index fresh;
+        bool read = false;
+        if (std::unique_ptr<sql_backend::Backend> backend = connect()) {
+            sql_backend::ThreadScope scope(*backend);
+            read = Read(fresh);
+        } else {
+            Printf(LOG_Error, "[nicknames] reload failed: no connection to the DB\n");
+        }
+
+        if (read) {
+            Publish(std::move(fresh), started);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            journaling = false;
+            journal.clear();
+        }
+
+        reloader.running.store(false);
+    });
+
+    return true;
+}
+
+void WaitReload() {
+    if (reloader.thread.joinable()) {
+        reloader.thread.join();
+    }
+}
+
+void Process() {
+    static unsigned long last_load = GetTickCount();
+
+    if (!Config::NicknameReload) {
+        return;
+    }
+
+    unsigned long now = GetTickCount();
+    if (now - last_load < Config::NicknameReload * 1000) {
+        return;
+    }
+    last_load = now;
+
+    if (sql_backend::MySQL().Connected()) {
+        ReloadAsync();
+    } else {
+        Load();
+    }
+}
+
+std::optional<bool> Exists(std::string_view nick, int hat_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) {
+        return std::nullopt;
+    }
+    return index.Contains(nick, hat_id);
+}
+
+void Saved(Key old_key, Key key, std::optional<unsigned long> hat_id, std::string_view nick) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) {
+        return;
+    }
+
+    if (!hat_id) {
+        // A new character gets the column's default.
+        hat_id = index.HatOf(old_key).value_or(0);
+    }
+
+    auto change = [old_key, key, hat = *hat_id, nick = std::string(nick)](Index& target) {
+        target.Remove(old_key);
+        target.Set(key, hat, nick);
+    };
+    change(index);
+    if (journaling) {
+        journal.push_back(std::move(change));
+    }
+}
+
+void Deleted(Key key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) {
+        return;
+    }
+
+    index.Remove(key);
+    if (journaling) {
+        journal.push_back([key](Index& target) { target.Remove(key); });
+    }
+}
+
+} // namespace nickname_index
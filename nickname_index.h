@@ -0,0 +1,111 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The nicknames of all characters that aren't deleted, so a nickname check (packet 0x4E, sent while the player types
+// in the creation screen) doesn't have to scan `characters` with `LOWER(nick)`.
+//
+// Loaded at startup, kept up to date by `Login_SetCharacter` and `Login_DelCharacter`, and reloaded from the DB
+// every `Config::NicknameReload` seconds to pick up whatever changed behind the hat's back. The reload reads the
+// table on a thread and a connection of its own, so the main loop doesn't wait for the scan.
+namespace sql_backend {
+class Backend;
+}
+
+namespace nickname_index {
+
+// Answers "definitely not there" without touching the table. Can't forget a nickname: the index rebuilds it.
+class BloomFilter {
+public:
+    // Sized for about 1% false positives with `expected` nicknames.
+    explicit BloomFilter(size_t expected = 0);
+
+    void Add(std::string_view folded);
+    bool MayContain(std::string_view folded) const;
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+private:
+    size_t capacity;
+    std::vector<uint64_t> bits;
+};
+
+// Characters are identified the same way as in `Login_SetCharacter`.
+struct Key {
+    int login_id;
+    unsigned long id1;
+    unsigned long id2;
+
+    auto operator<=>(const Key&) const = default;
+};
+
+class Index {
+public:
+    // Adds the character or replaces its nickname and hat.
+    void Set(Key key, unsigned long hat_id, std::string_view nick);
+    void Remove(Key key);
+
+    // `hat_id` of the character, if it's in the index.
+    std::optional<unsigned long> HatOf(Key key) const;
+
+    // Same as `Login_NickExists`: any hat if `hat_id` <= 0.
+    bool Contains(std::string_view nick, int hat_id) const;
+
+    size_t Size() const {
+        return characters.size();
+    }
+
+    // Number of characters whose nickname or hat differ between the two, or which are only in one of them.
+    size_t Difference(const Index& other) const;
+
+private:
+    struct Entry {
+        unsigned long hat_id;
+        std::string folded;
+    };
+
+    std::map<Key, Entry> characters;
+    // Folded nickname -> hat -> number of characters. Two characters can share a nickname on different hats.
+    std::unordered_map<std::string, std::map<unsigned long, int>> nicknames;
+    BloomFilter bloom;
+};
+
+// Reads all characters from the DB and replaces the index with them. Logs how many were out of date.
+bool Load();
+
+using Connect = std::function<std::unique_ptr<sql_backend::Backend>()>;
+
+// Same as `Load`, but on a thread with a connection from `connect` (`sql_backend::ConnectMySQL` by default). The
+// saves and deletions that happen meanwhile are applied to the new index before it replaces the current one.
+// `false` if a reload is already running.
+bool ReloadAsync();
+bool ReloadAsync(Connect connect);
+
+// Blocks until the reload, if any, is finished.
+void WaitReload();
+
+// Reloads the index when it's time: in the background on MySQL, right away on the in-memory backend. Called from
+// the main loop.
+void Process();
+
+// `std::nullopt` if the index isn't loaded, then the caller has to ask the DB.
+std::optional<bool> Exists(std::string_view nick, int hat_id);
+
+// After a character save. `hat_id` is `std::nullopt` if the save doesn't change it. The key changes if the save
+// moved the character to other ids.
+void Saved(Key old_key, Key key, std::optional<unsigned long> hat_id, std::string_view nick);
+
+void Deleted(Key key);
+
+} // namespace nickname_index
@@ -0,0 +1,166 @@
+#include "online.h"
+
+#include <algorithm>
+
+#include "cp866.h"
+
+namespace online {
+
+Index index;
+
+namespace {
+
+uint64_t Character(const ServerPlayer& player) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(player.Id1)) << 32) | static_cast<uint32_t>(player.Id2);
+}
+
+bool Same(const ServerPlayer& a, const ServerPlayer& b) {
+    return a.Login == b.Login && a.Nickname == b.Nickname && a.Connected == b.Connected && a.IPAddress == b.IPAddress;
+}
+
+} // namespace
+
+const std::vector<Event>& Diff::Compare(const std::vector<ServerPlayer>& previous, std::vector<ServerPlayer>& reported) {
+    this->positions.clear();
+    for (size_t i = 0; i < previous.size(); i++) {
+        this->positions.emplace(Character(previous[i]), i);
+    }
+    this->seen.assign(previous.size(), false);
+    this->events.clear();
+
+    for (ServerPlayer& player : reported) {
+        auto position = this->positions.find(Character(player));
+        if (position == this->positions.end() || this->seen[position->second]) {
+            this->events.push_back(Event{EVENT_JOINED, nullptr, &player});
+            continue;
+        }
+
+        const ServerPlayer& was = previous[position->second];
+        this->seen[position->second] = true;
+        if (player.IPAddress.empty()) {
+            player.IPAddress = was.IPAddress;
+        }
+        if (!Same(was, player)) {
+            this->events.push_back(Event{EVENT_CHANGED, &was, &player});
+        }
+    }
+
+    for (size_t i = 0; i < previous.size(); i++) {
+        if (!this->seen[i]) {
+            this->events.push_back(Event{EVENT_LEFT, &previous[i], nullptr});
+        }
+    }
+
+    return this->events;
+}
+
+size_t Index::Update(int server, const std::vector<Event>& events, const std::vector<std::string>& locked) {
+    std::unordered_set<std::string> reported_locked;
+    for (const std::string& login : locked) {
+        reported_locked.insert(cp866::Fold(login));
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t changed = events.size();
+
+    for (const Event& event : events) {
+        if (event.previous) {
+            this->DropPlayer(server, *event.previous);
+        }
+        if (event.player) {
+            this->players[cp866::Fold(event.player->Login)].push_back(Entry{server, *event.player});
+        }
+    }
+
+    std::unordered_set<std::string>& previous_locked = this->reported_locked[server];
+    for (const std::string& folded : previous_locked) {
+        if (!reported_locked.count(folded)) {
+            this->DropLocked(server, folded);
+            changed++;
+        }
+    }
+    for (const std::string& folded : reported_locked) {
+        if (!previous_locked.count(folded)) {
+            this->locked[folded].push_back(server);
+            changed++;
+        }
+    }
+    previous_locked = std::move(reported_locked);
+
+    return changed;
+}
+
+void Index::Drop(int server) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto login = this->players.begin(); login != this->players.end();) {
+        std::erase_if(login->second, [server](const Entry& entry) { return entry.server == server; });
+        login = login->second.empty() ? this->players.erase(login) : std::next(login);
+    }
+    for (const std::string& folded : this->reported_locked[server]) {
+        this->DropLocked(server, folded);
+    }
+    this->reported_locked.erase(server);
+}
+
+void Index::Unlocked(int server, std::string_view login) {
+    std::string folded = cp866::Fold(login);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto reported = this->reported_locked.find(server);
+    if (reported != this->reported_locked.end() && reported->second.erase(folded)) {
+        this->DropLocked(server, folded);
+    }
+}
+
+bool Index::Holds(int server, std::string_view login, unsigned long id1, unsigned long id2) {
+    std::vector<int> servers = this->Servers(login, id1, id2);
+    return std::find(servers.begin(), servers.end(), server) != servers.end();
+}
+
+std::vector<int> Index::Servers(std::string_view login, unsigned long id1, unsigned long id2) {
+    std::string folded = cp866::Fold(login);
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    std::vector<int> servers;
+    auto entries = this->players.find(folded);
+    if (entries != this->players.end()) {
+        for (const Entry& entry : entries->second) {
+            if (entry.player.Id1 == id1 && entry.player.Id2 == id2) {
+                servers.push_back(entry.server);
+            }
+        }
+    }
+    auto locked = this->locked.find(folded);
+    if (locked != this->locked.end()) {
+        servers.insert(servers.end(), locked->second.begin(), locked->second.end());
+    }
+    return servers;
+}
+
+void Index::DropPlayer(int server, const ServerPlayer& player) {
+    auto entries = this->players.find(cp866::Fold(player.Login));
+    if (entries == this->players.end()) {
+        return;
+    }
+    auto entry = std::find_if(entries->second.begin(), entries->second.end(), [&](const Entry& entry) {
+        return entry.server == server && entry.player.Id1 == player.Id1 && entry.player.Id2 == player.Id2;
+    });
+    if (entry != entries->second.end()) {
+        entries->second.erase(entry);
+    }
+    if (entries->second.empty()) {
+        this->players.erase(entries);
+    }
+}
+
+void Index::DropLocked(int server, const std::string& folded) {
+    auto servers = this->locked.find(folded);
+    if (servers == this->locked.end()) {
+        return;
+    }
+    std::erase(servers->second, server);
+    if (servers->second.empty()) {
+        this->locked.erase(servers);
+    }
+}
+
+} // namespace online
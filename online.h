@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A player as a game server reports it in `SL_UpdateInfo`.
+struct ServerPlayer
+{
+    std::string Nickname;
+    std::string Login;
+    unsigned long Id1;
+    unsigned long Id2;
+    bool Connected;
+    std::string IPAddress;
+};
+
+// Who is on which game server, by login, so `CL_Login` and `SV_ReturnCharacter` don't walk every server's player and
+// locked-login lists comparing logins one by one.
+//
+// `SL_UpdateInfo` diffs each report of a server against the previous one (`Diff`) and feeds the index only what
+// changed. Logins are folded as by MySQL, see cp866.h.
+namespace online {
+
+enum EventType { EVENT_JOINED, EVENT_LEFT, EVENT_CHANGED };
+
+// A character that joined, left or changed between two reports of a server.
+struct Event {
+    EventType type;
+    // `nullptr` for `EVENT_JOINED`.
+    const ServerPlayer* previous;
+    // `nullptr` for `EVENT_LEFT`.
+    const ServerPlayer* player;
+};
+
+// Compares reports of one server by character (`Id1`, `Id2`). Keeps its buffers between calls.
+class Diff {
+public:
+    // A player reported without an address keeps the one from `previous`. The events point into both lists and are
+    // valid until either of them changes or the next call.
+    const std::vector<Event>& Compare(const std::vector<ServerPlayer>& previous, std::vector<ServerPlayer>& reported);
+
+private:
+    // Character -> position in `previous`.
+    std::unordered_map<uint64_t, size_t> positions;
+    std::vector<bool> seen;
+    std::vector<Event> events;
+};
+
+class Index {
+public:
+    // `server` reported these changes of its players and these locked logins. Returns the number of changes.
+    size_t Update(int server, const std::vector<Event>& events, const std::vector<std::string>& locked);
+    // The server is gone.
+    void Drop(int server);
+    // The server returned the character of `login` and no longer holds it.
+    void Unlocked(int server, std::string_view login);
+
+    // `server` has the character or the login locked, what `CL_Login` checks before reconnecting to it.
+    bool Holds(int server, std::string_view login, unsigned long id1, unsigned long id2);
+    // All servers that hold the character or the login, in no particular order.
+    std::vector<int> Servers(std::string_view login, unsigned long id1, unsigned long id2);
+
+private:
+    struct Entry {
+        int server;
+        ServerPlayer player;
+    };
+
+    void DropPlayer(int server, const ServerPlayer& player);
+    void DropLocked(int server, const std::string& folded);
+
+    std::mutex mutex;
+    // Folded login -> where its characters play; more than one entry is a dupe, but it happens.
+    std::unordered_map<std::string, std::vector<Entry>> players;
+    // Folded login -> servers it's locked on.
+    std::unordered_map<std::string, std::vector<int>> locked;
+    // Server -> folded logins it reported locked last time.
+    std::unordered_map<int, std::unordered_set<std::string>> reported_locked;
+};
+
+extern Index index;
+
+} // namespace online
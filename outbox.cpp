@@ -0,0 +1,60 @@
+#include "outbox.h"
+
+#include <algorithm>
+
+namespace outbox {
+
+Frame Encode(Packet& pack, unsigned long version) {
+    uint8_t* data = nullptr;
+    uint32_t size = 0;
+    pack.GetAllData(data, size);
+    Frame frame = std::make_shared<const std::vector<uint8_t>>(PACKET_Frame(data, size, version));
+    delete[] data;
+    return frame;
+}
+
+void Queue::Push(Frame frame) {
+    this->bytes += frame->size();
+    this->entries.push_back(Entry{std::move(frame), 0, Clock::now()});
+}
+
+bool Queue::Empty() const {
+    return this->entries.empty();
+}
+
+size_t Queue::Bytes() const {
+    return this->bytes;
+}
+
+const uint8_t* Queue::Data() const {
+    const Entry& front = this->entries.front();
+    return front.frame->data() + front.offset;
+}
+
+size_t Queue::Left() const {
+    const Entry& front = this->entries.front();
+    return front.frame->size() - front.offset;
+}
+
+void Queue::Sent(size_t size) {
+    Entry& front = this->entries.front();
+    front.offset += size;
+    this->bytes -= size;
+    if (front.offset < front.frame->size()) {
+        return;
+    }
+
+    auto took = Clock::now() - front.pushed;
+    this->delivery.frames++;
+    this->delivery.total += took;
+    this->delivery.max = std::max(this->delivery.max, took);
+    this->entries.pop_front();
+}
+
+Delivery Queue::TakeDelivery() {
+    Delivery taken = this->delivery;
+    this->delivery = Delivery{};
+    return taken;
+}
+
+} // namespace outbox
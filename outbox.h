@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "packet.hpp"
+
+// Packets waiting to be sent to a server layer.
+//
+// A packet for several layers (`SL_Broadcast`) is framed and XORed once into a `Frame` that every queue shares.
+// `SOCK_Flush` sends what a socket takes without blocking, so a stuck server only holds up its own queue.
+namespace outbox {
+
+// A packet as it goes on the wire, see `PACKET_Frame`.
+using Frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+Frame Encode(Packet& pack, unsigned long version);
+
+// How long the frames took from `Push` to their last byte being sent.
+struct Delivery {
+    size_t frames = 0;
+    std::chrono::steady_clock::duration total{};
+    std::chrono::steady_clock::duration max{};
+};
+
+class Queue {
+public:
+    // A layer that has this much unsent is dropped.
+    static constexpr size_t MAX_BYTES = 1 << 20;
+
+    void Push(Frame frame);
+
+    bool Empty() const;
+    // Unsent bytes of all frames.
+    size_t Bytes() const;
+
+    // The unsent part of the first frame.
+    const uint8_t* Data() const;
+    size_t Left() const;
+    // `size` bytes of `Data` were sent.
+    void Sent(size_t size);
+
+    // The frames delivered since the last call.
+    Delivery TakeDelivery();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Frame frame;
+        size_t offset;
+        Clock::time_point pushed;
+    };
+
+    std::deque<Entry> entries;
+    size_t bytes = 0;
+    Delivery delivery;
+};
+
+} // namespace outbox
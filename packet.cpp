@@ -52,3 +52,29 @@ void PACKET_Crypt(Archive& packet, unsigned long protover)
     packet.ResetPosition();
     delete[] data;
 }
+
+std::vector<uint8_t> PACKET_Frame(const uint8_t* data, size_t size, unsigned long protover)
+{
+    const uint8_t end[] = {0x64, 0x01, 0x00, 0x00, 0x00};
+
+    std::vector<uint8_t> msg(data, data + size);
+    msg.insert(msg.end(), end, end + sizeof(end));
+
+    std::vector<uint8_t> wire;
+    wire.reserve(msg.size() + (msg.size() / 0x8E + 1) * 8);
+    for(size_t idx = 0; idx < msg.size(); )
+    {
+        size_t len = msg.size() - idx;
+        bool last = (len <= 0x8E);
+        if(!last) len = 0x8E;
+
+        uint8_t header[8] = {(uint8_t)len, 0, 0, 0, 0, 0, 0, (uint8_t)(last ? 1 : 0)};
+        wire.insert(wire.end(), header, header + 8);
+        size_t chunk = wire.size();
+        wire.insert(wire.end(), msg.begin() + idx, msg.begin() + idx + len);
+        PACKET_XorByKey(&wire[chunk], (unsigned long)len, protover);
+        idx += len;
+    }
+
+    return wire;
+}
@@ -1,6 +1,7 @@
 #ifndef PACKET_HPP_INCLUDED
 #define PACKET_HPP_INCLUDED
 
+#include <vector>
 #include "serialize.hpp"
 
 typedef Archive Packet;
@@ -9,5 +10,7 @@ extern const unsigned char key_08[0x50], key_10[0x50], key_11[0x50], key_15[0x50
 
 void PACKET_XorByKey(unsigned char* data, unsigned long size, unsigned long protover);
 void PACKET_Crypt(Packet& packet, unsigned long protover);
+// the bytes send_msg puts on the wire for data: 0x8E-byte chunks with 8-byte headers, each XORed by protover
+std::vector<uint8_t> PACKET_Frame(const uint8_t* data, size_t size, unsigned long protover);
 
 #endif // PACKET_HPP_INCLUDED
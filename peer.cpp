@@ -0,0 +1,154 @@
+#include "peer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace peer {
+
+namespace {
+
+const size_t HEADER_SIZE = 8;
+// `SOCK_ReceivePacket` drops connections with longer chunks.
+const uint32_t MAX_CHUNK = 0xFF;
+
+} // namespace
+
+void Decoder::Feed(const uint8_t* data, size_t size) {
+    // Drop what was consumed once it's most of the buffer.
+    if (this->offset > 0 && this->offset * 2 >= this->buffer.size()) {
+        this->buffer.erase(this->buffer.begin(), this->buffer.begin() + this->offset);
+        this->offset = 0;
+    }
+    this->buffer.insert(this->buffer.end(), data, data + size);
+}
+
+bool Decoder::Next(std::vector<uint8_t>& packet, unsigned long version) {
+    while (!this->broken && this->buffer.size() - this->offset >= HEADER_SIZE) {
+        const uint8_t* header = &this->buffer[this->offset];
+        uint32_t length;
+        uint32_t origin;
+        std::memcpy(&length, header, 4);
+        std::memcpy(&origin, header + 4, 4);
+        if (!length || length > MAX_CHUNK) {
+            this->broken = true;
+            return false;
+        }
+        if (this->buffer.size() - this->offset < HEADER_SIZE + length) {
+            return false;
+        }
+
+        size_t chunk = this->partial.size();
+        this->partial.insert(this->partial.end(), header + HEADER_SIZE, header + HEADER_SIZE + length);
+        PACKET_XorByKey(&this->partial[chunk], length, version);
+        this->offset += HEADER_SIZE + length;
+
+        if (origin & 0xFFFF0000) {
+            packet.swap(this->partial);
+            this->partial.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Decoder::Broken() const {
+    return this->broken;
+}
+
+Connection::~Connection() {
+    this->Close();
+}
+
+bool Connection::Connect(const std::string& address, unsigned short port, unsigned short local_port) {
+    this->Close();
+    SOCKET socket = SOCK_Connect(address, port, local_port);
+    if (socket == SERR_NOTCREATED) {
+        return false;
+    }
+    this->Attach(socket);
+    return true;
+}
+
+void Connection::Attach(SOCKET socket) {
+    this->Close();
+    this->socket = socket;
+    this->decoder = Decoder();
+}
+
+void Connection::Close() {
+    if (this->socket != INVALID_SOCKET) {
+        SOCK_Destroy(this->socket);
+        this->socket = INVALID_SOCKET;
+    }
+}
+
+bool Connection::Connected() const {
+    return this->socket != INVALID_SOCKET;
+}
+
+bool Connection::Send(Packet& pack, unsigned long version) {
+    if (this->socket == INVALID_SOCKET) {
+        return false;
+    }
+    if (SOCK_SendPacket(this->socket, pack, version) != 0) {
+        this->Close();
+        return false;
+    }
+    return true;
+}
+
+Status Connection::Receive(Packet& pack, unsigned long version, unsigned long timeout_ms) {
+    std::vector<uint8_t> packet;
+    DWORD started = GetTickCount();
+    while (!this->decoder.Next(packet, version)) {
+        if (this->socket == INVALID_SOCKET || this->decoder.Broken()) {
+            this->Close();
+            return STATUS_LOST;
+        }
+
+        DWORD elapsed = GetTickCount() - started;
+        if (elapsed >= timeout_ms) {
+            return STATUS_TIMEOUT;
+        }
+
+        fd_set fd;
+        FD_ZERO(&fd);
+        FD_SET(this->socket, &fd);
+        timeval tv;
+        tv.tv_sec = (timeout_ms - elapsed) / 1000;
+        tv.tv_usec = (timeout_ms - elapsed) % 1000 * 1000;
+        int ready = select(0, &fd, NULL, NULL, &tv);
+        if (ready == SOCKET_ERROR) {
+            this->Close();
+            return STATUS_LOST;
+        }
+        if (!ready) {
+            continue;
+        }
+
+        char data[0x1000];
+        int received = recv(this->socket, data, sizeof(data), 0);
+        if (received == SOCKET_ERROR || !received) {
+            this->Close();
+            return STATUS_LOST;
+        }
+        this->decoder.Feed(reinterpret_cast<const uint8_t*>(data), received);
+    }
+
+    pack.Reset();
+    pack.AppendData(packet.data(), static_cast<uint32_t>(packet.size()));
+    pack.ResetPosition();
+    return STATUS_OK;
+}
+
+bool SplitAddress(const std::string& address, std::string& host, unsigned short& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size()) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = static_cast<unsigned short>(std::strtoul(address.c_str() + colon + 1, nullptr, 10));
+    return port != 0;
+}
+
+} // namespace peer
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packet.hpp"
+#include "socket.hpp"
+
+// The other end of a hat connection, for the tools that play clients and game servers (`redhat-loadgen`, `redhat-fakeserver`).
+//
+// Both directions use the same framing, see `PACKET_Frame`: chunks of up to 0x8E bytes, each with an 8-byte header
+// and XORed by the protocol version's key. The hat reads one chunk per `recv` call, so a frame is sent in one piece.
+namespace peer {
+
+enum Status { STATUS_OK, STATUS_TIMEOUT, STATUS_LOST };
+
+// Reassembles packets from the bytes of a connection.
+class Decoder {
+public:
+    void Feed(const uint8_t* data, size_t size);
+    // Takes the next complete packet out of what was fed, decrypted by `version`. The payload keeps the end bytes
+    // `PACKET_Frame` adds, as `PacketReceiver` does. `false` if there isn't one yet, or if a chunk header is broken.
+    bool Next(std::vector<uint8_t>& packet, unsigned long version);
+    // A chunk header had a length the hat never sends.
+    bool Broken() const;
+
+private:
+    std::vector<uint8_t> buffer;
+    size_t offset = 0;
+    std::vector<uint8_t> partial;
+    bool broken = false;
+};
+
+// A blocking TCP connection with timeouts.
+class Connection {
+public:
+    Connection() = default;
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    ~Connection();
+
+    // From `local_port` if it isn't 0: the hat tells game servers and their layers apart by the port they connect from.
+    bool Connect(const std::string& address, unsigned short port, unsigned short local_port = 0);
+    // Takes a socket accepted elsewhere.
+    void Attach(SOCKET socket);
+    void Close();
+    bool Connected() const;
+
+    bool Send(Packet& pack, unsigned long version);
+    // Waits up to `timeout_ms` for a whole packet. `pack` is positioned at its first byte.
+    Status Receive(Packet& pack, unsigned long version, unsigned long timeout_ms);
+
+private:
+    SOCKET socket = INVALID_SOCKET;
+    Decoder decoder;
+};
+
+// "host:port" -> parts; `false` if there's no port.
+bool SplitAddress(const std::string& address, std::string& host, unsigned short& port);
+
+} // namespace peer
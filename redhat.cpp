@@ -1,4 +1,6 @@
+#include <chrono>
 #include <fstream>
+#include <sstream>
 
 #include "config.hpp"
 #include "socket.hpp"
@@ -7,7 +9,10 @@
 #include "listener.hpp"
 #include "status.hpp"
 #include "login.hpp"
+#include "lock_recovery.h"
+#include "nickname_index.h"
 #include "circle.h"
+#include "control.h"
 #include "thresholds.h"
 
 void H_Quit()
@@ -102,7 +107,7 @@ void GiveCircleReward(std::string value) {
     item_list.Items.push_back(std::move(item));
     std::string new_bag = Login_SerializeItems(item_list);
 
-    SimpleSQL insert{Format("UPDATE characters SET bag = '%s' WHERE nick = '%s' AND deleted = 0;", SQL_Escape(new_bag).c_str(), SQL_Escape(nickname).c_str())};
+    SimpleSQL insert{Format("UPDATE characters SET bag = '%s' WHERE nick = '%s' AND deleted = 0;", SQL_EscapeBinary(new_bag).c_str(), SQL_Escape(nickname).c_str())};
     if (!query) {
         Printf(LOG_Error, "Failed to update\n");
         return;
@@ -111,8 +116,21 @@ void GiveCircleReward(std::string value) {
     Printf(LOG_Info, "Done!\n");
 }
 
+static std::chrono::steady_clock::time_point h_started, h_phase_started;
+
+// logs how long the step of the startup that just finished took
+static void H_Phase(const char* phase)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - h_phase_started).count();
+    Printf(LOG_Info, "[HC] Startup: %s took %lld ms.\n", phase, ms);
+    h_phase_started = now;
+}
+
 bool H_Init(int argc, char* argv[])
 {
+    h_started = h_phase_started = std::chrono::steady_clock::now();
+
     atexit(H_Quit);
     SetExceptionFilter();
 
@@ -127,10 +145,13 @@ bool H_Init(int argc, char* argv[])
     SetConsoleWindowInfo(wHnd, TRUE, &windowSize);
 
     if(!ReadConfig("redhat.cfg")) return false;
+    H_Phase("config");
     if(!SQL_Init()) return false;
+    H_Phase("database connection");
 
     if(!Login_UnlockAll())
         Printf(LOG_Warning, "[HC] Unable to hat-unlock all logins.\n");
+    H_Phase("hat unlock");
 
     bool exit_ = false;
     for(int i = 0; i < argc; i++)
@@ -172,22 +193,65 @@ bool H_Init(int argc, char* argv[])
         } else if (arg == "-update-reclassed") {
             SQL_UpdateReclassed();
             exit_ = true;
+        } else if (arg == "-migrate-items") {
+            // Converts `bag`, `dress` and shelf items to the binary format. Resumable, safe to run again.
+            SQL_MigrateItems();
+            exit_ = true;
+        } else if (arg == "-add-unique-keys") {
+            // Merges duplicate `treasure` and `checkpoint` rows, then adds the unique keys the upserts rely on.
+            SQL_AddUniqueKeys();
+            exit_ = true;
+        } else if (arg == "-add-indices") {
+            // Adds the index on `characters`.`login_id` to tables created before it was in `SQL_CreateTables`.
+            SQL_AddIndices();
+            exit_ = true;
         }
     }
     if(exit_) return false;
 
+    SQL_CheckUniqueKeys();
+    SQL_CheckIndices();
+    H_Phase("schema checks");
+
+    if(!lock_recovery::Load())
+        Printf(LOG_Warning, "[HC] Logins left locked on servers will be unlocked one by one as their players log in.\n");
+    H_Phase("lock recovery");
+
+    if(!nickname_index::Load())
+        Printf(LOG_Warning, "[HC] Nickname checks will query the database until the nickname index loads.\n");
+    H_Phase("nickname index");
+
     Printf(LOG_Info, "[HC] Red Hat (v1.3) started.\n");
 
     Net_Init();
+    H_Phase("network");
 
     try {
-        Printf(LOG_Info, "[thresholds] Loading thresholds\n");
 #include "thresholds.generated.h"
-        thresholds::thresholds.LoadFromContent(default_thresholds);
+        std::string content = default_thresholds;
+
+        if(Config::ThresholdsFile.empty())
+        {
+            // Compiled from thresholds.txt at build time, nothing to parse.
+            Printf(LOG_Info, "[thresholds] Loading built-in thresholds\n");
+            thresholds::thresholds.LoadBaked();
+        }
+        else
+        {
+            Printf(LOG_Info, "[thresholds] Loading thresholds from '%s'\n", Config::ThresholdsFile.c_str());
+            std::ifstream f_in(Config::ThresholdsFile);
+            if(!f_in)
+                throw thresholds::ParseException(Format("failed to open file '%s'", Config::ThresholdsFile.c_str()));
+
+            std::stringstream buffer;
+            buffer << f_in.rdbuf();
+            content = buffer.str();
+            thresholds::thresholds.LoadFromContent(content);
+        }
 
         Printf(LOG_Info, "[thresholds] Saving thresholds for servers\n");
         std::ofstream f_out("thresholds.cfg");
-        f_out.write(default_thresholds, strlen(default_thresholds));
+        f_out.write(content.data(), content.size());
         if (!f_out) {
             throw new std::exception("failed to write threshold settings to thresholds.cfg");
         }
@@ -198,6 +262,10 @@ bool H_Init(int argc, char* argv[])
         Printf(LOG_Error, "Thresholds: %s\n", e.what());
         return false;
     }
+    H_Phase("thresholds");
+
+    long long total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - h_started).count();
+    Printf(LOG_Info, "[HC] Startup took %lld ms.\n", total_ms);
 
     return true;
 }
@@ -208,6 +276,8 @@ void H_Process()
     {
         Net_Listen();
         ST_Generate();
+        control::Process();
+        nickname_index::Process();
         Sleep(1);
     }
 }
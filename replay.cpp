@@ -0,0 +1,447 @@
+// Replays a trace of a hat's traffic (see trace.h) into a hat started in this process.
+//
+//   redhat-replay <trace> [-speed <factor>] [-connections <n>] [-timeout <ms>] [-config <file>]
+//
+// The hat runs on the config (`-config`, redhat.cfg by default) as `redhat` does, but on the in-memory SQL backend,
+// with AutoRegister, without the per-address connection limits (every client comes from here) and without a trace
+// of its own. It starts empty: the logins of the trace are created when they log in, and characters that existed
+// before the trace don't. A trace that begins with the hat's start replays the closest.
+//
+// Every connection of the trace is opened again and sends what the hat received on it, encrypted as it was: clients
+// to HatAddress, servers and layers to IntHatAddress from the ports they had, so IntServerAddr of the [server.N] in
+// the config has to be 127.0.0.1 with those ports. With `-speed` 1 a packet goes at its time in the trace, with 2 at
+// twice the pace; with 0 as fast as the hat answers, at most `-connections` at a time. In all cases a packet waits
+// for the hat to send on that connection what it had sent before it in the trace, up to `-timeout` ms.
+//
+// Prints the throughput and how long the hat took to answer (from a packet to the next one the hat sent on that
+// connection) in the trace and in the replay, and how many answers differed.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "listener.hpp"
+#include "lock_recovery.h"
+#include "nickname_index.h"
+#include "peer.h"
+#include "sql.hpp"
+#include "thresholds.h"
+#include "trace.h"
+#include "utils.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* const PEER_NAMES[] = {"", "client", "server", "layer"};
+const int PEER_COUNT = 4;
+
+struct Options {
+    std::string trace;
+    double speed = 1;
+    size_t connections = 200;
+    unsigned long timeout_ms = 5000;
+    std::string config = "redhat.cfg";
+};
+
+// A packet the hat received.
+struct Inbound {
+    uint64_t us;
+    uint8_t version;
+    std::vector<uint8_t> packet;
+    // What the hat had sent on the connection before this packet.
+    uint32_t answers_before;
+    // The next packet the hat sent, if any came before the next inbound one.
+    bool answered = false;
+    uint64_t answer_us = 0;
+    uint8_t answer_id = 0;
+};
+
+// A connection of the trace.
+struct Script {
+    trace::Peer peer = trace::PEER_CLIENT;
+    uint16_t port = 0;
+    uint64_t opened_us = 0;
+    std::vector<Inbound> inbound;
+    // Versions of the packets the hat sent, in order.
+    std::vector<uint8_t> sent_versions;
+};
+
+bool LoadTrace(const std::string& path, std::vector<Script>& scripts, uint64_t& end_us) {
+    trace::Reader reader;
+    if (!reader.Open(path)) {
+        std::cerr << path << ": not a trace" << std::endl;
+        return false;
+    }
+
+    trace::Record record;
+    size_t records = 0;
+    while (reader.Next(record)) {
+        records++;
+        end_us = record.us;
+        if (record.type == trace::RECORD_OPENED) {
+            if (record.connection != scripts.size() + 1) {
+                std::cerr << path << ": connection " << record.connection << " opened out of order" << std::endl;
+                return false;
+            }
+            Script script;
+            script.peer = record.peer;
+            script.port = record.port;
+            script.opened_us = record.us;
+            scripts.push_back(std::move(script));
+            continue;
+        }
+
+        if (!record.connection || record.connection > scripts.size()) {
+            continue;
+        }
+        Script& script = scripts[record.connection - 1];
+        if (record.type == trace::RECORD_RECEIVED) {
+            script.inbound.push_back(Inbound{record.us, record.version, std::move(record.packet),
+                                             static_cast<uint32_t>(script.sent_versions.size())});
+        } else if (record.type == trace::RECORD_SENT) {
+            script.sent_versions.push_back(record.version);
+            if (!script.inbound.empty() && !script.inbound.back().answered) {
+                Inbound& last = script.inbound.back();
+                last.answered = true;
+                last.answer_us = record.us;
+                last.answer_id = record.packet.empty() ? 0 : record.packet[0];
+            }
+        }
+    }
+
+    std::printf("%s: %u records, %u connections, %.1f s%s\n", path.c_str(), static_cast<unsigned>(records),
+                static_cast<unsigned>(scripts.size()), end_us / 1e6, reader.Anonymized() ? ", anonymized" : "");
+    return true;
+}
+
+// What all connections measured.
+class Stats {
+public:
+    void Answered(trace::Peer peer, double trace_ms, double replay_ms, bool same) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->latency[peer].trace.push_back(trace_ms);
+        this->latency[peer].replay.push_back(replay_ms);
+        if (!same) {
+            this->different++;
+        }
+    }
+
+    enum Counter { CONNECTIONS, FAILED, LOST, SENT, RECEIVED, MISSING, COUNTER_COUNT };
+
+    void Add(Counter counter, unsigned long long n = 1) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->counters[counter] += n;
+    }
+
+    void Print(double seconds) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        unsigned long long* n = this->counters;
+        std::printf("replayed in %.1f s: %llu connections (%llu failed to connect, %llu lost early), %llu packets sent"
+                    " (%.1f/s), %llu received\n", seconds, n[CONNECTIONS], n[FAILED], n[LOST], n[SENT],
+                    seconds > 0 ? n[SENT] / seconds : 0.0, n[RECEIVED]);
+        std::printf("%llu answers timed out, %llu differed from the trace (another packet id)\n\n", n[MISSING],
+                    this->different);
+
+        std::printf("%-8s %8s %10s %10s %10s %10s %10s %10s\n", "answers", "count", "trace p50", "trace p99",
+                    "p50 ms", "p90 ms", "p99 ms", "max ms");
+        for (int peer = 1; peer < PEER_COUNT; peer++) {
+            std::vector<double>& trace_ms = this->latency[peer].trace;
+            std::vector<double>& replay_ms = this->latency[peer].replay;
+            if (replay_ms.empty()) {
+                continue;
+            }
+            std::sort(trace_ms.begin(), trace_ms.end());
+            std::sort(replay_ms.begin(), replay_ms.end());
+            std::printf("%-8s %8u %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", PEER_NAMES[peer],
+                        static_cast<unsigned>(replay_ms.size()), Percentile(trace_ms, 50), Percentile(trace_ms, 99),
+                        Percentile(replay_ms, 50), Percentile(replay_ms, 90), Percentile(replay_ms, 99), replay_ms.back());
+        }
+    }
+
+private:
+    struct Latency {
+        std::vector<double> trace;
+        std::vector<double> replay;
+    };
+
+    // Nearest rank of sorted `ms`.
+    static double Percentile(const std::vector<double>& ms, int percent) {
+        if (ms.empty()) {
+            return 0;
+        }
+        size_t rank = (ms.size() * percent + 99) / 100;
+        return ms[std::max<size_t>(rank, 1) - 1];
+    }
+
+    std::mutex mutex;
+    Latency latency[PEER_COUNT];
+    unsigned long long counters[COUNTER_COUNT] = {};
+    unsigned long long different = 0;
+};
+
+// Where the hat listens, and when the replay started.
+struct Target {
+    std::string client_host;
+    unsigned short client_port;
+    std::string server_host;
+    unsigned short server_port;
+    Clock::time_point started;
+};
+
+class Replay {
+public:
+    Replay(const Options& options, const Target& target, Stats& stats, const Script& script)
+        : options(options), target(target), stats(stats), script(script) {
+    }
+
+    void Run() {
+        bool client = this->script.peer == trace::PEER_CLIENT;
+        bool connected = client
+            ? this->connection.Connect(this->target.client_host, this->target.client_port)
+            : this->connection.Connect(this->target.server_host, this->target.server_port, this->script.port);
+        this->stats.Add(Stats::CONNECTIONS);
+        if (!connected) {
+            this->stats.Add(Stats::FAILED);
+            return;
+        }
+
+        // Answers the replay didn't get, so the later packets don't wait for them too.
+        uint32_t skipped = 0;
+        for (const Inbound& inbound : this->script.inbound) {
+            this->Wait(this->Due(inbound.us), inbound.answers_before - std::min(skipped, inbound.answers_before));
+            if (!this->connection.Connected()) {
+                this->stats.Add(Stats::LOST);
+                return;
+            }
+            if (this->received + skipped < inbound.answers_before) {
+                this->stats.Add(Stats::MISSING, inbound.answers_before - this->received - skipped);
+                skipped = inbound.answers_before - this->received;
+            }
+
+            Packet pack;
+            pack.AppendData(const_cast<uint8_t*>(inbound.packet.data()), static_cast<uint32_t>(inbound.packet.size()));
+            Clock::time_point sent = Clock::now();
+            uint32_t before = this->received;
+            if (!this->connection.Send(pack, inbound.version)) {
+                this->stats.Add(Stats::LOST);
+                return;
+            }
+            this->stats.Add(Stats::SENT);
+
+            if (inbound.answered) {
+                uint8_t id = 0;
+                if (this->Wait(Clock::now(), before + 1, &id)) {
+                    double replay_ms = std::chrono::duration<double, std::milli>(this->answered - sent).count();
+                    this->stats.Answered(this->script.peer, (inbound.answer_us - inbound.us) / 1e3, replay_ms,
+                                         id == inbound.answer_id);
+                }
+            }
+        }
+
+        // What the hat still had to send.
+        uint32_t expected = static_cast<uint32_t>(this->script.sent_versions.size());
+        this->Wait(Clock::now(), expected - std::min(skipped, expected));
+    }
+
+private:
+    Clock::time_point Due(uint64_t us) const {
+        if (this->options.speed <= 0) {
+            return Clock::time_point::min();
+        }
+        return this->target.started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(us / this->options.speed));
+    }
+
+    // Takes what the hat sends until `until` has passed and `count` packets have come, or for `-timeout` ms more.
+    // `true` if `count` came; `id` is the id of the packet that made it.
+    bool Wait(Clock::time_point until, uint32_t count, uint8_t* id = nullptr) {
+        Clock::time_point deadline = std::max(until, Clock::now()) + std::chrono::milliseconds(this->options.timeout_ms);
+        while (this->connection.Connected()) {
+            Clock::time_point now = Clock::now();
+            if (this->received >= count && now >= until) {
+                return true;
+            }
+            if (now >= deadline) {
+                return false;
+            }
+
+            Clock::time_point wake = (this->received >= count) ? until : deadline;
+            unsigned long ms = static_cast<unsigned long>(std::clamp<long long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count(), 1, 50));
+            Packet pack;
+            peer::Status status = this->connection.Receive(pack, this->Version(), ms);
+            if (status != peer::STATUS_OK) {
+                continue;
+            }
+
+            this->received++;
+            this->stats.Add(Stats::RECEIVED);
+            if (this->received == count) {
+                this->answered = Clock::now();
+                if (id) {
+                    pack >> *id;
+                }
+            }
+        }
+        return this->received >= count;
+    }
+
+    // Of the next packet the hat sends, as it was in the trace.
+    unsigned long Version() const {
+        const std::vector<uint8_t>& versions = this->script.sent_versions;
+        if (versions.empty()) {
+            return 20;
+        }
+        return versions[std::min<size_t>(this->received, versions.size() - 1)];
+    }
+
+    const Options& options;
+    const Target& target;
+    Stats& stats;
+    const Script& script;
+    peer::Connection connection;
+    uint32_t received = 0;
+    Clock::time_point answered;
+};
+
+// At most `-connections` at a time with `-speed 0`.
+class Slots {
+public:
+    explicit Slots(size_t free) : free(free) {
+    }
+
+    void Take() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->released.wait(lock, [this]() { return this->free > 0; });
+        this->free--;
+    }
+
+    void Give() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->free++;
+        }
+        this->released.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t free;
+};
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = (i + 1 < argc);
+        std::string next = value ? argv[i + 1] : "";
+        bool number = value && CheckInt(next);
+
+        if (arg == "-speed" && value) {
+            options.speed = std::atof(argv[++i]);
+        } else if (arg == "-connections" && number) {
+            options.connections = std::max(1, static_cast<int>(StrToInt(argv[++i])));
+        } else if (arg == "-timeout" && number) {
+            options.timeout_ms = StrToInt(argv[++i]);
+        } else if (arg == "-config" && value) {
+            options.config = argv[++i];
+        } else if (options.trace.empty() && arg[0] != '-') {
+            options.trace = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.trace.empty();
+}
+
+// A hat listens on all addresses with 0.0.0.0.
+std::string Loopback(const std::string& address) {
+    return (address == "0.0.0.0") ? "127.0.0.1" : address;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: redhat-replay <trace> [-speed <factor>] [-connections <n>] [-timeout <ms>] [-config <file>]"
+                  << std::endl;
+        return 2;
+    }
+
+    std::vector<Script> scripts;
+    uint64_t end_us = 0;
+    if (!LoadTrace(options.trace, scripts, end_us)) {
+        return 1;
+    }
+
+    Config::LogFile = "redhat-replay.log";
+    if (!ReadConfig(options.config)) {
+        std::cerr << options.config << ": failed to read the config" << std::endl;
+        return 1;
+    }
+    Config::SqlBackend = "memory";
+    Config::AutoRegister = true;
+    Config::ConnectRate = 0;
+    Config::MaxPreAuth = 0;
+    Config::TraceFile.clear();
+
+    if (!SQL_Init()) {
+        return 1;
+    }
+    lock_recovery::Load();
+    nickname_index::Load();
+    thresholds::thresholds.LoadBaked();
+    Net_Init();
+
+    // The loop of `H_Process`, without the status files and the control directory.
+    std::atomic<bool> stop{false};
+    std::thread hat([&stop]() {
+        while (!stop) {
+            Net_Listen();
+            nickname_index::Process();
+            Sleep(1);
+        }
+    });
+
+    Target target{Loopback(Config::HatAddress), Config::HatPort, Loopback(Config::IHatAddress), Config::IHatPort,
+                  Clock::now()};
+    Stats stats;
+    Slots slots(options.connections);
+
+    std::vector<std::thread> connections;
+    for (const Script& script : scripts) {
+        if (options.speed > 0) {
+            std::this_thread::sleep_until(target.started + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::micro>(script.opened_us / options.speed)));
+        } else {
+            slots.Take();
+        }
+        connections.emplace_back([&, &script = script]() {
+            Replay replay(options, target, stats, script);
+            replay.Run();
+            if (options.speed <= 0) {
+                slots.Give();
+            }
+        });
+    }
+    for (std::thread& connection : connections) {
+        connection.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - target.started).count();
+
+    stop = true;
+    hat.join();
+    Net_Quit();
+
+    stats.Print(seconds);
+    return 0;
+}
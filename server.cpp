@@ -1,10 +1,13 @@
 #include "server.hpp"
 #include "login.hpp"
+#include "lock_recovery.h"
+#include "server_list.h"
 #include "utils.hpp"
 #include "session.hpp"
 #include "character.hpp"
 #include "socket.hpp"
 #include "status.hpp"
+#include "trace.h"
 
 std::vector<Server*> Servers;
 
@@ -139,6 +142,8 @@ bool SV_UpdateInfo(ServerConnection* conn, Packet& pack)
 
         if(conn->Parent->Info.GameMode != GAMEMODE_Arena && conn->Parent->Info.GameMode != GAMEMODE_Cooperative)
             Printf(LOG_Warning, "[SV] Warning: server ID %u is serving with unknown gamemode (%u).\n", conn->ID, conn->Parent->Info.GameMode);
+
+        server_list::cache.Changed();
     }
 
     ST_ScheduleGeneration();
@@ -298,17 +303,8 @@ bool SV_ReturnCharacter(ServerConnection* conn, Packet& pack)
 
     if(should_unlock) Login_SetLocked(p_logname, false, false, 0, 0, UNDEFINED); // character left the server, so unlock it
     //conn->Parent->Layer->
-    if(conn->Parent->Info.ServerCaps & SERVER_CAP_DETAILED_INFO)
-    {
-        for(size_t i = 0; i < conn->Parent->Info.Locked.size(); i++)
-        {
-            if(ToLower(conn->Parent->Info.Locked[i]) == ToLower(p_logname))
-            {
-                conn->Parent->Info.Locked.erase(conn->Parent->Info.Locked.begin()+i);
-                i--;
-            }
-        }
-    }
+    // Info.Locked stays as reported, the next SL_UpdateInfo replaces it
+    online::index.Unlocked(conn->Parent->Number, p_logname);
 
 
     delete[] p_chrdata;
@@ -372,8 +368,10 @@ bool SV_AddConnection(SOCKET socket, sockaddr_in addr)
             conn->Socket = socket;
             conn->Flags = SERVER_CONNECTED;
             conn->Receiver.Connect(socket);
+            trace::Opened(socket, trace::PEER_SERVER, addr);
             conn->ID = srv->Number;
             srv->Connection = conn;
+            server_list::cache.Changed();
             return true;
         }
         else if((srv->IAddress == saddr) && ((srv->IPort+1000) == sport))
@@ -384,6 +382,7 @@ bool SV_AddConnection(SOCKET socket, sockaddr_in addr)
             layer->Socket = socket;
             layer->Flags.Connected = true;
             layer->Receiver.Connect(socket);
+            trace::Opened(socket, trace::PEER_LAYER, addr);
             srv->Layer = layer;
 
             Printf(LOG_Trivial, "[SV] Server layer (for ID %u) connected.\n", srv->Number);
@@ -428,6 +427,7 @@ bool SV_Process(Server* srv)
                 //Printf("[SV] Server ID %u started.\n", conn->ID);
                 conn->Active = true;
                 srv->ShuttingDown = false;
+                server_list::cache.Changed();
                 break;
             case 0xE0: // ? char update? dunno what's it, needs investigation
                 break;
@@ -491,6 +491,11 @@ void SV_Disconnect(Server* srv)
         SOCK_Destroy(srv->Connection->Socket);
         delete srv->Connection;
         srv->Connection = NULL;
+        server_list::cache.Changed();
+        // a reconnected server is diffed against nothing
+        online::index.Drop(srv->Number);
+        srv->Info.Players.clear();
+        srv->Info.Locked.clear();
     }
 }
 
@@ -526,6 +531,39 @@ void Net_ProcessServers()
             }
         }
     }
+
+    // after all layers are processed, for the broadcasts they made
+    for(std::vector<Server*>::iterator it = Servers.begin(); it != Servers.end(); ++it)
+    {
+        Server* srv = (*it);
+        if(srv && srv->Layer)
+            SL_Flush(srv);
+    }
+}
+
+void SL_Flush(Server* srv)
+{
+    ServerLayer* layer = srv->Layer;
+    if(layer->Outbox.Bytes() > outbox::Queue::MAX_BYTES)
+    {
+        Printf(LOG_Error, "[SL] Server ID %u doesn't take layer commands (%u bytes waiting).\n", srv->Number, (unsigned)layer->Outbox.Bytes());
+        SV_DisconnectLayer(srv);
+        return;
+    }
+
+    if(!SOCK_Flush(layer->Socket, layer->Outbox))
+    {
+        SV_DisconnectLayer(srv);
+        return;
+    }
+
+    outbox::Delivery delivery = layer->Outbox.TakeDelivery();
+    if(delivery.max > std::chrono::seconds(1))
+    {
+        Printf(LOG_Warning, "[SL] Server ID %u: %u layer commands delivered in %lld ms at most, %lld ms on average.\n", srv->Number, (unsigned)delivery.frames,
+               (long long)std::chrono::duration_cast<std::chrono::milliseconds>(delivery.max).count(),
+               (long long)std::chrono::duration_cast<std::chrono::milliseconds>(delivery.total / delivery.frames).count());
+    }
 }
 
 bool SL_Initialized(Server* srv, Packet& pack)
@@ -537,6 +575,7 @@ bool SL_Initialized(Server* srv, Packet& pack)
     uint32_t caps;
     pack >> caps;
     srv->Info.ServerCaps = caps;
+    server_list::cache.Changed();
 
     return true;
 }
@@ -576,6 +615,18 @@ bool SL_UpdateInfo(Server* srv, Packet& pack)
     uint32_t p_playercount;
     pack >> p_playercount;
 
+    // whether what the server list shows changes; the map time is refreshed by the list itself
+    bool shown_changed = !(srv->Info.ServerCaps & SERVER_CAP_DETAILED_INFO) ||
+                         srv->Info.PlayerCount != p_playercount ||
+                         srv->Info.MapName != p_mapname ||
+                         srv->Info.MapWidth != p_mapwidth ||
+                         srv->Info.MapHeight != p_mapheight;
+    unsigned long shown_gamemode = srv->Info.GameMode;
+    // the status also shows the level, the mode and the map time in minutes
+    bool status_changed = srv->Info.MapLevel != p_maplevel ||
+                          srv->Info.ServerMode != p_servermode ||
+                          srv->Info.Time / 60 != p_maptime / 60;
+
     srv->Info.ServerCaps |= SERVER_CAP_DETAILED_INFO;
     srv->Info.PlayerCount = p_playercount;
     srv->Info.MapName = p_mapname;
@@ -597,54 +648,49 @@ bool SL_UpdateInfo(Server* srv, Packet& pack)
 
     srv->Info.ServerMode = p_servermode;
 
-    std::vector<ServerPlayer> players_old = srv->Info.Players;
-    srv->Info.Players.clear();
+    if(shown_changed || shown_gamemode != srv->Info.GameMode)
+        server_list::cache.Changed();
 
+    // read over the list from two reports ago, so the strings keep their storage
+    std::vector<ServerPlayer>& reported = srv->Info.Reported;
+    reported.resize(p_playercount);
     for(size_t i = 0; i < p_playercount; i++)
     {
         uint32_t pp_id1;
         uint32_t pp_id2;
-        std::string pp_nickname;
-        std::string pp_login;
         bool pp_connected;
         std::string pp_ip;
-        pack >> pp_nickname >> pp_login >> pp_id1 >> pp_id2;
+        ServerPlayer& player = reported[i];
+        pack >> player.Nickname >> player.Login >> pp_id1 >> pp_id2;
         pack >> pp_connected;
         pack >> pp_ip;
-        ServerPlayer player;
         player.Id1 = pp_id1;
         player.Id2 = pp_id2;
-        player.Nickname = pp_nickname;
-        player.Login = pp_login;
-        pp_ip = Trim(pp_ip);
-        if(pp_ip.length())
-        {
-            player.IPAddress = pp_ip;
-            player.Connected = true;
-        }
-        else
-        {
-            player.IPAddress = "";
-            for(std::vector<ServerPlayer>::iterator it = players_old.begin(); it != players_old.end(); ++it)
-            {
-                ServerPlayer& plr = (*it);
-                if(plr.Id1 == player.Id1 && plr.Id2 == player.Id2)
-                    player.IPAddress = plr.IPAddress;
-            }
-            player.Connected = false;
-        }
-        srv->Info.Players.push_back(player);
+        player.IPAddress = Trim(pp_ip);
+        // without an address, the diff keeps the one from when the player was connected
+        player.Connected = (player.IPAddress.length() != 0);
     }
 
     uint32_t p_logincount;
     pack >> p_logincount;
 
-    srv->Info.Locked.clear();
+    srv->Info.Locked.resize(p_logincount);
     for(size_t i = 0; i < p_logincount; i++)
+        pack >> srv->Info.Locked[i];
+
+    const std::vector<online::Event>& events = srv->Info.PlayerDiff.Compare(srv->Info.Players, reported);
+    online::index.Update(srv->Number, events, srv->Info.Locked);
+    if(!events.empty()) status_changed = true;
+    srv->Info.Players.swap(reported);
+
+    // logins the previous run of the hat left locked here, see lock_recovery.h
+    // same as CL_Login, the first seconds of a map don't count: the players may not be back yet
+    if(srv->Info.Time > 15 && lock_recovery::Pending(srv->Number))
     {
-        std::string p_login;
-        pack >> p_login;
-        srv->Info.Locked.push_back(p_login);
+        std::vector<std::string> logins = srv->Info.Locked;
+        for(size_t i = 0; i < srv->Info.Players.size(); i++)
+            logins.push_back(srv->Info.Players[i].Login);
+        lock_recovery::Reconcile(srv->Number, logins);
     }
 /*
     if(srv->Number == 22)
@@ -654,7 +700,8 @@ bool SL_UpdateInfo(Server* srv, Packet& pack)
             Printf(LOG_Info, "[SV] Server ID %u login: %s\n", srv->Number, srv->Info.Locked[i].c_str());
     }
 */
-    ST_ScheduleGeneration();
+    if(shown_changed || status_changed || shown_gamemode != srv->Info.GameMode)
+        ST_ScheduleGeneration();
 
     return true;
 }
@@ -674,14 +721,13 @@ bool SL_Broadcast(Server* srv, Packet& pack)
     msgP << (uint8_t)0x63;
     msgP << message;
 
+    // encoded once for all layers
+    outbox::Frame frame = outbox::Encode(msgP, 20);
     for(std::vector<Server*>::iterator it = Servers.begin(); it != Servers.end(); ++it)
     {
         Server* srv = (*it);
         if(srv && srv->Layer)
-        {
-            if(SOCK_SendPacket(srv->Layer->Socket, msgP, 20) != 0)
-                srv->Layer->Flags.Connected = false;
-        }
+            srv->Layer->Outbox.Push(frame);
     }
 
     return true;
@@ -695,7 +741,8 @@ bool SLCMD_Screenshot(Server* srv, std::string login, uint32_t uid, bool done, s
     msgP << uid;
     msgP << done;
     msgP << url;
-    return (SOCK_SendPacket(srv->Layer->Socket, msgP, 20) == 0);
+    srv->Layer->Outbox.Push(outbox::Encode(msgP, 20));
+    return true;
 }
 
 bool SLCMD_MutePlayer(Server* srv, std::string login, uint32_t unmutedate)
@@ -704,5 +751,6 @@ bool SLCMD_MutePlayer(Server* srv, std::string login, uint32_t unmutedate)
     msgP << (uint8_t)0x65;
     msgP << login;
     msgP << unmutedate;
-    return (SOCK_SendPacket(srv->Layer->Socket, msgP, 20) == 0);
+    srv->Layer->Outbox.Push(outbox::Encode(msgP, 20));
+    return true;
 }
@@ -6,6 +6,7 @@
 #include "socket.hpp"
 #include <windows.h>
 #include "server_id.hpp"
+#include "online.h"
 
 #define SERVER_CONNECTED 0x00000001
 #define SERVER_LOGGED_IN 0x00000002
@@ -29,16 +30,6 @@
 #define SVF_ENTERMAGE       0x00008000
 #define SVF_ENTERWARRIOR    0x00010000
 
-struct ServerPlayer
-{
-    std::string Nickname;
-    std::string Login;
-    unsigned long Id1;
-    unsigned long Id2;
-    bool Connected;
-    std::string IPAddress;
-};
-
 struct ServerInfo
 {
     unsigned long ServerCaps;
@@ -54,6 +45,8 @@ struct ServerInfo
     unsigned long ServerMode;
 
     std::vector<ServerPlayer> Players;
+    std::vector<ServerPlayer> Reported; // storage SL_UpdateInfo reads into before swapping it with Players
+    online::Diff PlayerDiff;
     std::vector<std::string> Locked;
 };
 
@@ -86,6 +79,7 @@ struct ServerLayer
     } Flags;
 
     PacketReceiver Receiver;
+    outbox::Queue Outbox; // sent by Net_ProcessServers
 
     ServerLayer()
     {
@@ -138,6 +132,8 @@ bool SL_Initialized(Server* layer, Packet& pack);
 bool SL_Shutdown(Server* layer, Packet& pack);
 bool SL_UpdateInfo(Server* srv, Packet& pack);
 bool SL_Broadcast(Server* srv, Packet& pack);
+// sends what waits in srv->Layer->Outbox; disconnects the layer if it's lost or stuck
+void SL_Flush(Server* srv);
 
 bool SLCMD_Screenshot(Server* srv, std::string login, uint32_t uid, bool done, std::string url);
 bool SLCMD_MutePlayer(Server* srv, std::string login, uint32_t unmutedate);
@@ -0,0 +1,36 @@
+#include "server_list.h"
+
+namespace server_list {
+
+Cache cache;
+
+void Cache::Changed() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->texts.clear();
+}
+
+outbox::Frame Cache::Wire(uint32_t game_mode, unsigned long version, const Builder& build) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    auto text = this->texts.find(game_mode);
+    if (text != this->texts.end() && Clock::now() - text->second.built >= LIFETIME) {
+        this->texts.erase(text);
+        text = this->texts.end();
+    }
+    if (text == this->texts.end()) {
+        text = this->texts.emplace(game_mode, Text{Clock::now(), build(game_mode), {}}).first;
+    }
+
+    auto& wire = text->second.wires[version];
+    if (!wire) {
+        const std::string& list = text->second.text;
+        Packet pack;
+        pack << (uint8_t)0xCD;
+        pack << (uint32_t)list.length();
+        pack.AppendData((uint8_t*)list.c_str(), (uint32_t)list.length() + 1);
+        wire = outbox::Encode(pack, version);
+    }
+    return wire;
+}
+
+} // namespace server_list
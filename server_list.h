@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "outbox.h"
+
+// The 0xCD server list `CLCMD_SendServerList` answers every 0xC8 with, kept framed and XORed per game mode and
+// protocol version (see `outbox::Frame`), so a request is one send of a ready buffer.
+//
+// The list changes when a server connects, disconnects or reports something the list shows: those call `Changed`
+// and the packets are rebuilt on the next request. The map time in it only moves once a minute, so a packet older
+// than `LIFETIME` is rebuilt too instead of changing the list on each `SL_UpdateInfo`.
+namespace server_list {
+
+class Cache {
+public:
+    static constexpr std::chrono::seconds LIFETIME{60};
+
+    // Makes the text of the list for a game mode.
+    using Builder = std::function<std::string(uint32_t game_mode)>;
+
+    // The list has changed, drops every packet.
+    void Changed();
+
+    // The packet for clients of `game_mode` on `version`. `build` is called if there is no text for `game_mode`
+    // since the last change; the text is shared by all versions.
+    outbox::Frame Wire(uint32_t game_mode, unsigned long version, const Builder& build);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Text {
+        Clock::time_point built;
+        std::string text;
+        // Protocol version -> packet.
+        std::map<unsigned long, outbox::Frame> wires;
+    };
+
+    std::mutex mutex;
+    // Game mode -> list.
+    std::map<uint32_t, Text> texts;
+};
+
+extern Cache cache;
+
+} // namespace server_list
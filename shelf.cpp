@@ -6,6 +6,7 @@
 #include <limits>
 
 #include "login.hpp"
+#include "unit_of_work.h"
 #include "utils.hpp"
 
 // This should be defined in inttypes.h, but some old compilers don't have that.
@@ -37,24 +38,31 @@ bool SQLUpsertOneRow(std::string query) {
     return true;
 }
 
+// Shelves of the characters that were recently on a server, to skip the SELECT on the next visit.
+static impl::Cache cache;
+
+// The DB, unless a tool replaced it with `impl::SetStorage`.
+static impl::LoadShelfFunction load_shelf = impl::LoadShelf;
+static impl::SQLQueryFunction sql_query = SQLUpsertOneRow;
+
 bool ItemsToSavingsBook(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory) {
-    return impl::ItemsToSavingsBookImpl(chr, server_id, inventory, impl::LoadShelf, SQLUpsertOneRow);
+    return impl::ItemsToSavingsBookImpl(chr, server_id, inventory, load_shelf, sql_query, &cache);
 }
 
 bool ItemsFromSavingsBook(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory) {
-    return impl::ItemsFromSavingsBookImpl(chr, server_id, inventory, impl::LoadShelf, SQLUpsertOneRow);
+    return impl::ItemsFromSavingsBookImpl(chr, server_id, inventory, load_shelf, sql_query, &cache);
 }
 
 int32_t MoneyToSavingsBook(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount) {
-    return impl::MoneyToSavingsBookImpl(chr, server_id, inventory, current_money, amount, impl::LoadShelf, SQLUpsertOneRow);
+    return impl::MoneyToSavingsBookImpl(chr, server_id, inventory, current_money, amount, load_shelf, sql_query, &cache);
 }
 
 int32_t MoneyFromSavingsBook(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount) {
-    return impl::MoneyFromSavingsBookImpl(chr, server_id, inventory, current_money, amount, impl::LoadShelf, SQLUpsertOneRow);
+    return impl::MoneyFromSavingsBookImpl(chr, server_id, inventory, current_money, amount, load_shelf, sql_query, &cache);
 }
 
 bool StoreOnShelf(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money) {
-    return impl::StoreOnShelfImpl(chr, server_id, std::move(inventory), money, impl::LoadShelf, SQLUpsertOneRow);
+    return impl::StoreOnShelfImpl(chr, server_id, std::move(inventory), money, load_shelf, sql_query, &cache);
 }
 
 bool PickFromShelf(const CCharacter& chr, int shelf_number, int32_t* mutex, std::string* items_repr, int64_t* money, bool& shelf_exists) {
@@ -63,6 +71,12 @@ bool PickFromShelf(const CCharacter& chr, int shelf_number, int32_t* mutex, std:
 
 namespace impl {
 
+void SetStorage(LoadShelfFunction load, SQLQueryFunction query) {
+    load_shelf = std::move(load);
+    sql_query = std::move(query);
+    cache.Clear();
+}
+
 bool IsSavingsBook(const CItem& item) {
     return item.Id == 3587 && // Book of Fire
         item.IsMagic &&
@@ -179,7 +193,7 @@ bool SaveShelf(const CCharacter& chr, int shelf_number, Field field, int32_t mut
     std::string items;
     if (field & Field::ITEMS) {
         CItemList item_list{.Items = std::move(new_items)};
-        items = SQL_Escape(Login_SerializeItems(item_list));
+        items = SQL_EscapeBinary(Login_SerializeItems(item_list));
     }
 
     std::string query;
@@ -229,7 +243,113 @@ bool SaveShelf(const CCharacter& chr, int shelf_number, Field field, int32_t mut
     return true;
 }
 
-bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_shelf, SQLQueryFunction sql_query) {
+Cache::Cache(size_t capacity) : capacity(capacity) {
+}
+
+uint64_t Cache::Key(const CCharacter& chr, int shelf_number) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(chr.LoginID)) << 32) |
+        (static_cast<uint64_t>(static_cast<uint16_t>(shelf_number)) << 16) |
+        static_cast<uint16_t>(Cabinet(chr));
+}
+
+const Content* Cache::Find(const CCharacter& chr, int shelf_number) const {
+    auto it = this->shelves.find(Key(chr, shelf_number));
+    return it == this->shelves.end() ? nullptr : &it->second;
+}
+
+void Cache::Store(const CCharacter& chr, int shelf_number, Content content) {
+    uint64_t key = Key(chr, shelf_number);
+    if (unit_of_work::Active()) {
+        // The content may be this save's own writes, which a rollback undoes: until the commit, the shelf is read
+        // from the DB, in the transaction.
+        this->shelves.erase(key);
+        unit_of_work::AfterCommit([this, key, content = std::move(content)]() mutable { this->Put(key, std::move(content)); });
+        return;
+    }
+    this->Put(key, std::move(content));
+}
+
+void Cache::Put(uint64_t key, Content content) {
+    if (this->shelves.size() >= this->capacity && this->shelves.count(key) == 0) {
+        // No LRU: shelves are visited rarely enough that any entry is as good to drop as another.
+        this->shelves.erase(this->shelves.begin());
+    }
+    this->shelves[key] = std::move(content);
+}
+
+void Cache::Drop(const CCharacter& chr, int shelf_number) {
+    uint64_t key = Key(chr, shelf_number);
+    this->shelves.erase(key);
+    if (unit_of_work::Active()) {
+        // Don't let an earlier `Store` of the same unit of work bring the entry back.
+        unit_of_work::AfterCommit([this, key]() { this->shelves.erase(key); });
+    }
+}
+
+void Cache::Clear() {
+    this->shelves.clear();
+}
+
+bool LoadContent(const CCharacter& chr, int shelf_number, Field field, LoadShelfFunction load_shelf, Cache* cache, Content& content, bool& cached) {
+    cached = false;
+    if (cache) {
+        if (const Content* found = cache->Find(chr, shelf_number)) {
+            content = *found;
+            cached = true;
+            return true;
+        }
+        // Load everything, so that the entry serves both item and money operations.
+        field = Field::BOTH;
+    }
+
+    std::string items_repr;
+    content = Content{};
+    if (!load_shelf(chr, shelf_number, field, &content.mutex, &items_repr, &content.money, content.exists)) {
+        return false;
+    }
+
+    if (field & Field::ITEMS) {
+        content.items = Login_UnserializeItems(items_repr).Items;
+    }
+
+    // Missing shelves aren't cached: the INSERT that creates one always follows a fresh read.
+    if (cache && content.exists) {
+        cache->Store(chr, shelf_number, content);
+    }
+    return true;
+}
+
+bool SaveContent(const CCharacter& chr, int shelf_number, Field field, const Content& before, std::vector<CItem> items, int64_t money, SQLQueryFunction sql_query, Cache* cache) {
+    Content after = before;
+    if (cache && before.exists) {
+        if (field & Field::ITEMS) {
+            after.items = items;
+        }
+        if (field & Field::MONEY) {
+            after.money = money;
+        }
+        after.mutex = before.mutex + 1;
+    }
+
+    if (!SaveShelf(chr, shelf_number, field, before.mutex, std::move(items), money, before.exists, sql_query)) {
+        if (cache) {
+            cache->Drop(chr, shelf_number);
+        }
+        return false;
+    }
+
+    if (cache) {
+        if (before.exists) {
+            cache->Store(chr, shelf_number, std::move(after));
+        } else {
+            // The columns that weren't inserted got their defaults, let the next visit read them.
+            cache->Drop(chr, shelf_number);
+        }
+    }
+    return true;
+}
+
+bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache) {
     if (!CanDeposit(chr)) {
         return true;
     }
@@ -243,19 +363,24 @@ bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::
 
     std::vector<CItem> to_shelf(inventory.cbegin(), savings_book);
 
-    int32_t mutex = 0;
-    std::string shelf_content;
-    bool shelf_exists = false;
-    if (!load_shelf(chr, shelf_number, Field::ITEMS, &mutex, &shelf_content, nullptr, shelf_exists)) {
-        return false;
-    }
+    // A stale cache entry fails the `mutex` check. Then the entry is dropped and the shelf is loaded again.
+    while (true) {
+        Content shelf;
+        bool cached;
+        if (!LoadContent(chr, shelf_number, Field::ITEMS, load_shelf, cache, shelf, cached)) {
+            return false;
+        }
 
-    std::vector<CItem> current_items = Login_UnserializeItems(shelf_content).Items;
+        std::vector<CItem> current_items = shelf.items;
 
-    MergeItemPiles(current_items, to_shelf);
+        MergeItemPiles(current_items, to_shelf);
 
-    if (!SaveShelf(chr, shelf_number, Field::ITEMS, mutex, std::move(current_items), 0, shelf_exists, sql_query)) {
-        return false;
+        if (SaveContent(chr, shelf_number, Field::ITEMS, shelf, std::move(current_items), 0, sql_query, cache)) {
+            break;
+        }
+        if (!cached) {
+            return false;
+        }
     }
 
     // +1 to remove the book too.
@@ -263,7 +388,7 @@ bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::
     return true;
 }
 
-bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_shelf, SQLQueryFunction sql_query) {
+bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache) {
     if (!CanWithdraw(chr)) {
         return true;
     }
@@ -275,24 +400,28 @@ bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std
         return true;
     }
 
-    int32_t mutex = 0;
-    std::string shelf_content;
-    bool shelf_exists;
-    if (!load_shelf(chr, shelf_number, Field::ITEMS, &mutex, &shelf_content, nullptr, shelf_exists)) {
-        return false;
-    }
-
-    std::vector<CItem> shelved_items = Login_UnserializeItems(shelf_content).Items;
+    std::vector<CItem> shelved_items;
+    while (true) {
+        Content shelf;
+        bool cached;
+        if (!LoadContent(chr, shelf_number, Field::ITEMS, load_shelf, cache, shelf, cached)) {
+            return false;
+        }
 
-    if (!shelf_exists || shelved_items.empty()) {
-        return true;
-    }
+        if (!shelf.exists || shelf.items.empty()) {
+            return true;
+        }
 
-    if (!SaveShelf(chr, shelf_number, Field::ITEMS, mutex, {}, 0, shelf_exists, sql_query)) {
-        return false;
+        if (SaveContent(chr, shelf_number, Field::ITEMS, shelf, {}, 0, sql_query, cache)) {
+            shelved_items = std::move(shelf.items);
+            break;
+        }
+        if (!cached) {
+            return false;
+        }
     }
 
-    Printf(LOG_Info, "[shelf] Loaded items for login %d on server %d at cabinet %d: '%s'\n", chr.LoginID, server_id, shelf_number, SQL_Escape(shelf_content).c_str());
+    Printf(LOG_Info, "[shelf] Loaded %u items for login %d on server %d at cabinet %d\n", shelved_items.size(), chr.LoginID, server_id, shelf_number);
 
     // Remove the book.
     inventory.erase(savings_book);
@@ -303,7 +432,7 @@ bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std
     return true;
 }
 
-int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query) {
+int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache) {
     if (!CanDeposit(chr)) {
         return current_money;
     }
@@ -324,17 +453,22 @@ int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, st
         return current_money;
     }
 
-    int32_t mutex = 0;
-    int64_t shelved_money = 0;
-    bool shelf_exists;
-    if (!load_shelf(chr, shelf_number, Field::MONEY, &mutex, nullptr, &shelved_money, shelf_exists)) {
-        return current_money;
-    }
+    int64_t money = 0;
+    while (true) {
+        Content shelf;
+        bool cached;
+        if (!LoadContent(chr, shelf_number, Field::MONEY, load_shelf, cache, shelf, cached)) {
+            return current_money;
+        }
 
-    int64_t money = shelved_money + deposit;
+        money = shelf.money + deposit;
 
-    if (!SaveShelf(chr, shelf_number, Field::MONEY, mutex, {}, money, shelf_exists, sql_query)) {
-        return current_money;
+        if (SaveContent(chr, shelf_number, Field::MONEY, shelf, {}, money, sql_query, cache)) {
+            break;
+        }
+        if (!cached) {
+            return current_money;
+        }
     }
 
     Printf(LOG_Info, "[shelf] Stored money for login %d on server %d: %d stashed (tried %d), total %" PRId64 "\n", chr.LoginID, shelf_number, deposit, amount, money);
@@ -345,7 +479,7 @@ int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, st
     return current_money - deposit;
 }
 
-int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query) {
+int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache) {
     if (!CanWithdraw(chr)) {
         return current_money;
     }    
@@ -361,26 +495,32 @@ int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id,
         return current_money;
     }
 
-    int32_t mutex = 0;
-    int64_t shelved_money = 0;
-    bool shelf_exists;
-    if (!load_shelf(chr, shelf_number, Field::MONEY, &mutex, nullptr, &shelved_money, shelf_exists)) {
-        return current_money;
-    }
+    int32_t withdraw = 0;
+    int64_t money = 0;
+    while (true) {
+        Content shelf;
+        bool cached;
+        if (!LoadContent(chr, shelf_number, Field::MONEY, load_shelf, cache, shelf, cached)) {
+            return current_money;
+        }
 
-    int32_t withdraw = std::min(amount, std::numeric_limits<int32_t>::max() - current_money);
-    if (static_cast<int64_t>(withdraw) > shelved_money) {
-        withdraw = static_cast<int32_t>(shelved_money);
-    }
+        withdraw = std::min(amount, std::numeric_limits<int32_t>::max() - current_money);
+        if (static_cast<int64_t>(withdraw) > shelf.money) {
+            withdraw = static_cast<int32_t>(shelf.money);
+        }
 
-    if (withdraw == 0) {
-        return current_money;
-    }
+        if (withdraw == 0) {
+            return current_money;
+        }
 
-    int64_t money = shelved_money - static_cast<int64_t>(withdraw);
-    
-    if (!SaveShelf(chr, shelf_number, Field::MONEY, mutex, {}, money, shelf_exists, sql_query)) {
-        return current_money;
+        money = shelf.money - static_cast<int64_t>(withdraw);
+
+        if (SaveContent(chr, shelf_number, Field::MONEY, shelf, {}, money, sql_query, cache)) {
+            break;
+        }
+        if (!cached) {
+            return current_money;
+        }
     }
 
     Printf(LOG_Info, "[shelf] Loaded money for login %d on server %d: %d withdrawn (tried %d), left %" PRId64 " stashed\n", chr.LoginID, shelf_number, withdraw, amount, money);
@@ -391,24 +531,29 @@ int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id,
     return current_money + withdraw;
 }
 
-bool StoreOnShelfImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money, LoadShelfFunction load_shelf, SQLQueryFunction sql_query) {
+bool StoreOnShelfImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache) {
     // Legend characters cannot deposit anything, we store everything into the regular character cabinet.
     int shelf_number = FixServerID(server_id);
 
-    int32_t mutex = 0;
-    std::string shelved_items_repr;
-    int64_t shelved_money = 0;
-    bool shelf_exists;
-    if (!load_shelf(chr, shelf_number, Field::BOTH, &mutex, &shelved_items_repr, &shelved_money, shelf_exists)) {
-        return false;
-    }
+    while (true) {
+        Content shelf;
+        bool cached;
+        if (!LoadContent(chr, shelf_number, Field::BOTH, load_shelf, cache, shelf, cached)) {
+            return false;
+        }
 
-    std::vector<CItem> shelved_items = Login_UnserializeItems(shelved_items_repr).Items;
+        std::vector<CItem> shelved_items = shelf.items;
 
-    int64_t save_money = shelved_money + money;
-    MergeItemPiles(shelved_items, inventory);
+        int64_t save_money = shelf.money + money;
+        MergeItemPiles(shelved_items, inventory);
 
-    return SaveShelf(chr, shelf_number, Field::BOTH, mutex, shelved_items, save_money, shelf_exists, sql_query);
+        if (SaveContent(chr, shelf_number, Field::BOTH, shelf, std::move(shelved_items), save_money, sql_query, cache)) {
+            return true;
+        }
+        if (!cached) {
+            return false;
+        }
+    }
 }
 
 } // namespace impl
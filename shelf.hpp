@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <unordered_map>
 
 #include "CCharacter.hpp"
 #include "server_id.hpp"
@@ -79,18 +81,63 @@ namespace impl {
     // Mocking SQL calls in `LoadShelf` is annoying, so let's stub out the whole function.
     using LoadShelfFunction = std::function<bool(const CCharacter&, int, Field, int32_t*, std::string*, int64_t*, bool&)>;
 
+    // Replaces the DB behind the public functions, e.g. with the in-memory stand-in of `redhat-bench`.
+    void SetStorage(LoadShelfFunction load_shelf, SQLQueryFunction sql_query);
+
     bool IsSavingsBook(const CItem& item);
     std::vector<CItem>::const_iterator FindSavingsBook(const std::vector<CItem>& inventory);
     void MergeItemPiles(std::vector<CItem>& items, const std::vector<CItem>& add_items);
     bool LoadShelf(const CCharacter& chr, int shelf_number, Field field, int32_t* mutex, std::string* items_repr, int64_t* money, bool& shelf_exists);
     bool SaveShelf(const CCharacter& chr, int shelf_number, Field field, int32_t mutex, std::vector<CItem> items, int64_t money, bool shelf_exists, SQLQueryFunction sql_query);
 
-    bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_from_shelf, SQLQueryFunction sql_query);
-    bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_from_shelf, SQLQueryFunction sql_query);
+    // What a shelf held when it was last read or written by this server.
+    struct Content {
+        bool exists = false;
+        int32_t mutex = 0;
+        std::vector<CItem> items;
+        int64_t money = 0;
+    };
+
+    // Parsed shelves by (login, shelf number, cabinet). An entry is only a guess: every write still checks
+    // the `mutex` column, and a conflict drops the entry, so a shelf changed by someone else gets read again.
+    //
+    // Inside a `unit_of_work::UnitOfWork`, `Store` and `Drop` drop the entry right away and take effect only once
+    // the unit of work commits. After a rollback the shelf isn't cached: an entry with a `mutex` the DB never
+    // committed could pass the check of a later write against content someone else saved under that `mutex`.
+    class Cache {
+    public:
+        explicit Cache(size_t capacity = 4096);
+
+        const Content* Find(const CCharacter& chr, int shelf_number) const;
+        void Store(const CCharacter& chr, int shelf_number, Content content);
+        void Drop(const CCharacter& chr, int shelf_number);
+        void Clear();
+
+        size_t Size() const {
+            return shelves.size();
+        }
+
+    private:
+        static uint64_t Key(const CCharacter& chr, int shelf_number);
+        void Put(uint64_t key, Content content);
+
+        size_t capacity;
+        std::unordered_map<uint64_t, Content> shelves;
+    };
+
+    // Takes the shelf from the cache, or loads all its fields and caches it. `cached` tells which one happened.
+    bool LoadContent(const CCharacter& chr, int shelf_number, Field field, LoadShelfFunction load_shelf, Cache* cache, Content& content, bool& cached);
+    // Saves the shelf and updates the cache: the new content on success, no entry on failure.
+    bool SaveContent(const CCharacter& chr, int shelf_number, Field field, const Content& before, std::vector<CItem> items, int64_t money, SQLQueryFunction sql_query, Cache* cache);
+
+    // `cache` may be null, then the shelf is read from the DB every time.
+    // With a cache, a write conflict on cached content is retried once with the shelf read from the DB.
+    bool ItemsToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_from_shelf, SQLQueryFunction sql_query, Cache* cache = nullptr);
+    bool ItemsFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, LoadShelfFunction load_from_shelf, SQLQueryFunction sql_query, Cache* cache = nullptr);
 
-    int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query);
-    int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query);
+    int32_t MoneyToSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache = nullptr);
+    int32_t MoneyFromSavingsBookImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem>& inventory, int32_t current_money, int32_t amount, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache = nullptr);
 
-    bool StoreOnShelfImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money, LoadShelfFunction load_shelf, SQLQueryFunction sql_query);
+    bool StoreOnShelfImpl(const CCharacter& chr, ServerIDType server_id, std::vector<CItem> inventory, int64_t money, LoadShelfFunction load_shelf, SQLQueryFunction sql_query, Cache* cache = nullptr);
 } // namespace impl
 } // namespace shelf
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Storage for objects that come and go all the time, like client connections (`Clients`).
+//
+// Both containers allocate objects in chunks of `CHUNK` and never move them, so a pointer stays good until the object
+// is deleted. `Map` also gives each object a handle: its slot and a generation that changes when the slot is freed,
+// so a handle kept after `Erase` (in a timer callback, say) finds nothing instead of whoever got the slot next.
+namespace slots {
+
+// Objects per chunk.
+constexpr size_t CHUNK = 64;
+
+namespace internal {
+
+template <typename T>
+class Chunks {
+public:
+    Chunks() = default;
+    Chunks(const Chunks&) = delete;
+    Chunks& operator=(const Chunks&) = delete;
+
+    T* Address(size_t index) const {
+        return reinterpret_cast<T*>(this->chunks[index / CHUNK]->data) + index % CHUNK;
+    }
+
+    // Adds a chunk, returns its first index.
+    size_t Grow() {
+        this->chunks.push_back(std::make_unique<Chunk>());
+        return (this->chunks.size() - 1) * CHUNK;
+    }
+
+private:
+    struct Chunk {
+        alignas(T) unsigned char data[sizeof(T) * CHUNK];
+    };
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+};
+
+} // namespace internal
+
+// A slab allocator: `New` takes the most recently freed place.
+template <typename T>
+class Pool {
+public:
+    Pool() = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+    // Objects that weren't deleted aren't destroyed, only their memory is freed.
+    ~Pool() = default;
+
+    template <typename... Args>
+    T* New(Args&&... args) {
+        if (this->free.empty()) {
+            size_t first = this->chunks.Grow();
+            for (size_t i = CHUNK; i-- > 0;) {
+                this->free.push_back(this->chunks.Address(first + i));
+            }
+        }
+
+        T* object = new (this->free.back()) T(std::forward<Args>(args)...);
+        this->free.pop_back();
+        this->live++;
+        return object;
+    }
+
+    void Delete(T* object) {
+        if (!object) {
+            return;
+        }
+        object->~T();
+        this->free.push_back(object);
+        this->live--;
+    }
+
+    size_t Size() const {
+        return this->live;
+    }
+
+private:
+    internal::Chunks<T> chunks;
+    std::vector<T*> free;
+    size_t live = 0;
+};
+
+// A generational slot map. Live objects are also kept in a dense array, in no particular order, for iteration.
+template <typename T>
+class Map {
+public:
+    // Generation << 32 | slot. 0 is never a handle.
+    using Handle = uint64_t;
+
+    Map() = default;
+    Map(const Map&) = delete;
+    Map& operator=(const Map&) = delete;
+
+    ~Map() {
+        for (uint32_t slot : this->dense) {
+            this->chunks.Address(slot)->~T();
+        }
+    }
+
+    template <typename... Args>
+    Handle Insert(Args&&... args) {
+        if (this->free.empty()) {
+            size_t first = this->chunks.Grow();
+            this->slots.resize(first + CHUNK);
+            for (size_t i = first + CHUNK; i-- > first;) {
+                this->free.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        uint32_t slot = this->free.back();
+        new (this->chunks.Address(slot)) T(std::forward<Args>(args)...);
+        this->free.pop_back();
+
+        Slot& info = this->slots[slot];
+        info.position = static_cast<uint32_t>(this->dense.size());
+        this->dense.push_back(slot);
+        return MakeHandle(info.generation, slot);
+    }
+
+    // `nullptr` if the object of `handle` was erased.
+    T* Get(Handle handle) const {
+        uint32_t slot = static_cast<uint32_t>(handle);
+        if (!this->Live(handle)) {
+            return nullptr;
+        }
+        return this->chunks.Address(slot);
+    }
+
+    // Destroys the object. The last one in the dense array takes its position: when iterating backwards,
+    // erasing the current object doesn't skip any other.
+    bool Erase(Handle handle) {
+        if (!this->Live(handle)) {
+            return false;
+        }
+
+        uint32_t slot = static_cast<uint32_t>(handle);
+        Slot& info = this->slots[slot];
+        this->chunks.Address(slot)->~T();
+
+        uint32_t last = this->dense.back();
+        this->dense[info.position] = last;
+        this->slots[last].position = info.position;
+        this->dense.pop_back();
+
+        info.position = DEAD;
+        if (++info.generation == 0) {
+            info.generation = 1;
+        }
+        this->free.push_back(slot);
+        return true;
+    }
+
+    size_t Size() const {
+        return this->dense.size();
+    }
+
+    // `position` < `Size()`.
+    T* At(size_t position) const {
+        return this->chunks.Address(this->dense[position]);
+    }
+
+    Handle HandleAt(size_t position) const {
+        uint32_t slot = this->dense[position];
+        return MakeHandle(this->slots[slot].generation, slot);
+    }
+
+private:
+    static constexpr uint32_t DEAD = 0xFFFFFFFF;
+
+    struct Slot {
+        uint32_t generation = 1;
+        // In `dense`, `DEAD` if the slot is free.
+        uint32_t position = DEAD;
+    };
+
+    static Handle MakeHandle(uint32_t generation, uint32_t slot) {
+        return static_cast<Handle>(generation) << 32 | slot;
+    }
+
+    bool Live(Handle handle) const {
+        uint32_t slot = static_cast<uint32_t>(handle);
+        return slot < this->slots.size() && this->slots[slot].position != DEAD &&
+               this->slots[slot].generation == static_cast<uint32_t>(handle >> 32);
+    }
+
+    internal::Chunks<T> chunks;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> free;
+};
+
+} // namespace slots
@@ -2,9 +2,11 @@
 #include "socket.hpp"
 #include <winsock2.h>
 
+#include <filesystem>
 #include <fstream>
 #include "utils.hpp"
 #include "hat2.hpp"
+#include "trace.h"
 
 SOCKET SOCK_Connect(std::string addr, unsigned short port, unsigned short localport)
 {
@@ -71,6 +73,7 @@ int SOCK_SendPacket(SOCKET socket, Packet& packet, unsigned long protover)
     uint8_t* data = NULL;
     uint32_t size;
     packet.GetAllData(data, size);
+    trace::Sent(socket, data, size, protover);
     int ret_code = send_msg(socket, protover, data, size, Config::SendTimeout);
     delete[] data;
     if(ret_code == -2) return SERR_TIMEOUT;
@@ -78,6 +81,40 @@ int SOCK_SendPacket(SOCKET socket, Packet& packet, unsigned long protover)
     return 0;
 }
 
+int SOCK_SendWire(SOCKET socket, const std::vector<uint8_t>& wire)
+{
+    if(send_wire(socket, wire.data(), wire.size()) != 0) return SERR_CONNECTION_LOST;
+    return 0;
+}
+
+bool SOCK_Flush(SOCKET socket, outbox::Queue& queue)
+{
+    if(queue.Empty()) return true;
+
+    // "writable" only means the send buffer has some room, a blocking send could still wait for the rest:
+    // the socket is non-blocking while the queue is flushed, and takes what it can
+    SOCK_SetBlocking(socket, false);
+    bool ok = true;
+    while(!queue.Empty())
+    {
+        int sent = send(socket, (const char*)queue.Data(), (int)queue.Left(), 0);
+        if(sent == SOCKET_ERROR)
+        {
+            ok = (WSAGetLastError() == WSAEWOULDBLOCK); // the send buffer is full, the rest goes on the next call
+            break;
+        }
+        if(!sent)
+        {
+            ok = false;
+            break;
+        }
+        queue.Sent(sent);
+    }
+    SOCK_SetBlocking(socket, true);
+
+    return ok;
+}
+
 int SOCK_ReceivePacket(SOCKET socket, Packet& packet, unsigned long protover)
 {
     packet.Reset();
@@ -116,6 +153,7 @@ int SOCK_ReceivePacket(SOCKET socket, Packet& packet, unsigned long protover)
 
 void SOCK_Destroy(SOCKET socket)
 {
+    trace::Closed(socket);
     closesocket(socket);
 }
 
@@ -266,11 +304,45 @@ namespace IPFilter
         }
         return 0;
     }
+
+    IPFFile& Global()
+    {
+        static IPFFile ipf;
+        static std::filesystem::file_time_type loaded_time;
+        static bool loaded = false;
+        static unsigned long last_check = 0;
+
+        // connections are checked as they come, the file is looked at once a second at most
+        unsigned long now = GetTickCount();
+        if(loaded && now - last_check < 1000) return ipf;
+        last_check = now;
+
+        std::error_code ec;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time("redhat.ipf", ec);
+        if(ec)
+        {
+            if(loaded && ipf.Entries.size()) Printf(LOG_Info, "[IPF] redhat.ipf is gone, no global rules.\n");
+            ipf.Entries.clear();
+            loaded = true;
+            return ipf;
+        }
+        if(loaded && time == loaded_time) return ipf;
+
+        std::ifstream ifs;
+        ifs.open("redhat.ipf", std::ios::in);
+        if(!ifs.is_open()) return ipf; // keep the old rules, try again in a second
+        std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        ifs.close();
+        ipf.ReadIPF(str);
+        loaded_time = time;
+        loaded = true;
+        return ipf;
+    }
 }
 
 void SOCK_SetBlocking(SOCKET socket, bool blocking)
 {
-    u_long iMode = 1;
+    u_long iMode = blocking ? 0 : 1;
     ioctlsocket(socket, FIONBIO, &iMode);
 }
 
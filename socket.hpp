@@ -4,6 +4,7 @@
 #include <string>
 #include <winsock2.h>
 #include "packet.hpp"
+#include "outbox.h"
 #include "serialize.hpp"
 
 #if !defined ( _BSDTYPES_DEFINED )
@@ -26,6 +27,9 @@ SOCKET SOCK_Connect(std::string address, unsigned short port, unsigned short loc
 SOCKET SOCK_Listen(std::string address, unsigned short port);
 SOCKET SOCK_Accept(SOCKET listener, sockaddr_in& addr);
 int SOCK_SendPacket(SOCKET socket, Packet& packet, unsigned long protover);
+int SOCK_SendWire(SOCKET socket, const std::vector<uint8_t>& wire);
+// sends what the socket takes from the queue without blocking; false if the connection is lost
+bool SOCK_Flush(SOCKET socket, outbox::Queue& queue);
 int SOCK_ReceivePacket(SOCKET socket, Packet& packet, unsigned long protover);
 void SOCK_Destroy(SOCKET socket);
 void SOCK_SetBlocking(SOCKET socket, bool blocking);
@@ -62,6 +66,9 @@ namespace IPFilter
         int CheckUUID(std::string uuid);
         void ReadIPF(std::string string, bool filename = false);
     };
+
+    // redhat.ipf, read again when the file changes; no entries if there is no file
+    IPFFile& Global();
 }
 
 #endif // SOCKET_HPP_INCLUDED
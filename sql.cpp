@@ -3,9 +3,17 @@
 #include "utils.hpp"
 #include "shelf.hpp"
 #include "login.hpp"
+#include "item_blob.h"
+#include "sql_backend.h"
+#include "sql_memory.h"
 
+#include <charconv>
+#include <chrono>
 #include <inttypes.h>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <vector>
 #include <mysql.h>
 
 #include <windows.h>
@@ -22,76 +30,273 @@ namespace SQL
     HANDLE Mutex;
 }
 
-std::string SQL_Error()
+static bool SQL_ConnectTo(MYSQL& connection, unsigned long log_level);
+
+namespace {
+
+class MySQLBackend : public sql_backend::Backend {
+public:
+    MySQLBackend(MYSQL& connection, bool& open) : connection(connection), open(open) {
+    }
+
+    bool Connected() override {
+        return this->open;
+    }
+
+    void Close() override {
+        if (!this->open) {
+            return;
+        }
+        mysql_close(&this->connection);
+        this->open = false;
+    }
+
+    int Query(const std::string& query) override {
+        if (!this->open) {
+            return -1;
+        }
+
+        mysql_query(&this->connection, "SET NAMES 'cp866'");
+        return mysql_real_query(&this->connection, query.data(), query.length());
+    }
+
+    bool QueryMulti(const std::string& query, int& executed) override {
+        executed = 0;
+        if (this->Query(query) != 0) {
+            return false;
+        }
+
+        // The server stops at the first failing statement. All results have to be read, or the connection stays busy.
+        while (true) {
+            MYSQL_RES* result = mysql_store_result(&this->connection);
+            if (result) {
+                mysql_free_result(result);
+            }
+            executed++;
+
+            int status = mysql_next_result(&this->connection);
+            if (status == -1) { // no more results
+                return true;
+            }
+            if (status > 0) {
+                return false;
+            }
+        }
+    }
+
+    MYSQL_RES* StoreResult() override {
+        return mysql_store_result(&this->connection);
+    }
+
+    void FreeResult(MYSQL_RES* result) override {
+        mysql_free_result(result);
+    }
+
+    int NumRows(MYSQL_RES* result) override {
+        return static_cast<int>(mysql_num_rows(result));
+    }
+
+    MYSQL_ROW FetchRow(MYSQL_RES* result) override {
+        return mysql_fetch_row(result);
+    }
+
+    unsigned long* FetchLengths(MYSQL_RES* result) override {
+        return mysql_fetch_lengths(result);
+    }
+
+    unsigned long NumFields(MYSQL_RES* result) override {
+        return mysql_num_fields(result);
+    }
+
+    MYSQL_FIELD* FetchFields(MYSQL_RES* result) override {
+        return mysql_fetch_fields(result);
+    }
+
+    int AffectedRows() override {
+        return static_cast<int>(mysql_affected_rows(&this->connection));
+    }
+
+    std::string Error() override {
+        if (!this->open) {
+            return "";
+        }
+        return std::string(mysql_error(&this->connection));
+    }
+
+    unsigned long ConnectionID() override {
+        if (!this->open) {
+            return 0;
+        }
+        return mysql_thread_id(&this->connection);
+    }
+
+private:
+    MYSQL& connection;
+    bool& open;
+};
+
+// The connection of `sql_backend::ConnectMySQL`, kept apart so that it's constructed before the backend.
+struct OwnConnection {
+    MYSQL connection;
+    bool open = false;
+};
+
+class OwnMySQLBackend : private OwnConnection, public MySQLBackend {
+public:
+    OwnMySQLBackend() : MySQLBackend(OwnConnection::connection, OwnConnection::open) {
+    }
+
+    ~OwnMySQLBackend() override {
+        this->Close();
+        // The thread's state in the client library, see `mysql_init`.
+        mysql_thread_end();
+    }
+
+    bool Connect();
+};
+
+bool OwnMySQLBackend::Connect() {
+    this->OwnConnection::open = SQL_ConnectTo(this->OwnConnection::connection, LOG_Error);
+    return this->OwnConnection::open;
+}
+
+} // namespace
+
+sql_backend::Backend& sql_backend::MySQL()
+{
+    static MySQLBackend backend(SQL::Connection, SQL::Open);
+    return backend;
+}
+
+std::unique_ptr<sql_backend::Backend> sql_backend::ConnectMySQL()
 {
     if(!SQL::Open)
-        return "";
-    return std::string(mysql_error(&SQL::Connection));
+        return nullptr;
+
+    auto backend = std::make_unique<OwnMySQLBackend>();
+    if(!backend->Connect())
+        return nullptr;
+    return backend;
 }
 
-bool SQL_Init()
+std::string SQL_Error()
+{
+    return sql_backend::Current().Error();
+}
+
+// `Backend = "memory"` in [Settings.SQL]: no MySQL server, the tables live in memory until the exit.
+static bool SQL_InitMemory()
+{
+    static sql_backend::Memory memory(Config::SqlDatabase);
+    sql_backend::Set(&memory);
+    SQL_CreateTables();
+    SQL_UpdateReclassed();
+    Printf(LOG_Warning, "[DB] Using the in-memory backend, nothing will be saved.\n");
+    return true;
+}
+
+// Connects to the server of [Settings.SQL], logging a failure at `log_level`.
+static bool SQL_ConnectTo(MYSQL& connection, unsigned long log_level)
 {
-    MYSQL* s = mysql_init(&SQL::Connection);
+    MYSQL* s = mysql_init(&connection);
 
     if(!s)
     {
-        Printf(LOG_FatalError, "[DB] Unable to establish connection to MySQL server (at %s:%u).\n", Config::SqlAddress.c_str(), Config::SqlPort);
-        Printf(LOG_FatalError, "[DB] The error reported was: %s\n", mysql_error(&SQL::Connection));
+        Printf(log_level, "[DB] Unable to establish connection to MySQL server (at %s:%u).\n", Config::SqlAddress.c_str(), Config::SqlPort);
+        Printf(log_level, "[DB] The error reported was: %s\n", mysql_error(&connection));
         return false;
     }
 
     my_bool reconnect = true;
-    mysql_options(&SQL::Connection, MYSQL_OPT_RECONNECT, &reconnect);
+    mysql_options(&connection, MYSQL_OPT_RECONNECT, &reconnect);
 
-    s = mysql_real_connect(&SQL::Connection, Config::SqlAddress.c_str(),
+    // Multi-statements let a character save go to the server in one round trip, see `SQL_QueryMulti`.
+    s = mysql_real_connect(&connection, Config::SqlAddress.c_str(),
                             Config::SqlLogin.c_str(), Config::SqlPassword.c_str(),
-                            Config::SqlDatabase.c_str(), Config::SqlPort, NULL, 0);
+                            Config::SqlDatabase.c_str(), Config::SqlPort, NULL, CLIENT_MULTI_STATEMENTS);
 
     if(!s)
     {
-        Printf(LOG_FatalError, "[DB] Unable to establish connection to MySQL server (at %s:%u).\n", Config::SqlAddress.c_str(), Config::SqlPort);
-        Printf(LOG_FatalError, "[DB] The error reported was: %s\n", mysql_error(&SQL::Connection));
+        Printf(log_level, "[DB] Unable to establish connection to MySQL server (at %s:%u).\n", Config::SqlAddress.c_str(), Config::SqlPort);
+        Printf(log_level, "[DB] The error reported was: %s\n", mysql_error(&connection));
+        mysql_close(&connection);
         return false;
     }
 
+    return true;
+}
+
+static bool SQL_Connect()
+{
+    if(ToLower(Config::SqlBackend) == "memory")
+        return SQL_InitMemory();
+
+    if(!SQL_ConnectTo(SQL::Connection, LOG_FatalError))
+        return false;
+
     SQL::Open = true;
     SQL::Mutex = CreateMutex(NULL, FALSE, NULL);
 
     return true;
 }
 
+bool SQL_Init()
+{
+    if(!SQL_Connect())
+        return false;
+
+    if(Config::SqlLatency)
+    {
+        static sql_backend::WithLatency delayed(sql_backend::Current(), std::chrono::milliseconds(Config::SqlLatency));
+        sql_backend::Set(&delayed);
+        Printf(LOG_Warning, "[DB] Every query waits for %u ms more.\n", Config::SqlLatency);
+    }
+
+    return true;
+}
+
 void SQL_Close()
 {
-    if(!SQL::Open) return;
-    mysql_close(&SQL::Connection);
-    CloseHandle(SQL::Mutex);
+    bool mysql = SQL::Open;
+    sql_backend::Current().Close();
+    if(mysql && !SQL::Open)
+        CloseHandle(SQL::Mutex);
 }
 
 bool SQL_CheckConnected()
 {
-    return SQL::Open;
+    return sql_backend::Current().Connected();
 }
 
-long int SQL_FetchInt(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname)
+// Digits only, as `CheckInt`. An empty value (or NULL) isn't a number either.
+static bool SQL_IsUnsigned(std::string_view value)
 {
-    std::string str = SQL_FetchString(row, result, fieldname);
-    if(!str.length() || !CheckInt(str)) return -1;
-    return StrToInt(str);
+    if(value.empty()) return false;
+    for(char ch : value)
+        if(ch < '0' || ch > '9') return false;
+    return true;
 }
 
-int64_t SQL_FetchInt64(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname) {
-    std::string str = SQL_FetchString(row, result, fieldname);
-    if (!str.length() || !CheckInt(str)) {
-        return -1;
-    }
+// -1 if the value isn't a number. Wraps around at 32 bits, the same as `StrToInt`.
+static long int SQL_ParseInt(std::string_view value)
+{
+    if(!SQL_IsUnsigned(value)) return -1;
+    unsigned int retval = 0;
+    for(char ch : value)
+        retval = retval * 10 + (ch - '0');
+    return retval;
+}
 
-    // StrToInt uses an int for conversion, so we cannot use it.
-	int64_t retval;
-	sscanf(str.c_str(), "%" PRId64, &retval);
-	return retval;
+static int64_t SQL_ParseInt64(std::string_view value)
+{
+    if(!SQL_IsUnsigned(value)) return -1;
+    int64_t retval = 0;
+    if(std::from_chars(value.data(), value.data() + value.size(), retval).ec != std::errc())
+        return std::numeric_limits<int64_t>::max();
+    return retval;
 }
 
-std::string SQL_FetchString(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname)
+static std::string_view SQL_FetchValue(MYSQL_ROW row, MYSQL_RES* result, const std::string& fieldname)
 {
     unsigned long* lengths = SQL_FetchLengths(result);
     unsigned long numfields = SQL_NumFields(result);
@@ -99,16 +304,23 @@ std::string SQL_FetchString(MYSQL_ROW row, MYSQL_RES* result, std::string fieldn
     for(unsigned long i = 0; i < numfields; i++)
     {
         if(fields[i].name == fieldname)
-        {
-            char* chstr = new char[lengths[i] + 1];
-            memset(chstr, 0, lengths[i] + 1);
-            memcpy(chstr, row[i], lengths[i]);
-            std::string strfrom(chstr, lengths[i]);
-            delete[] chstr;
-            return strfrom;
-        }
+            return row[i] ? std::string_view(row[i], lengths[i]) : std::string_view();
     }
-    return "";
+    return std::string_view();
+}
+
+long int SQL_FetchInt(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname)
+{
+    return SQL_ParseInt(SQL_FetchValue(row, result, fieldname));
+}
+
+int64_t SQL_FetchInt64(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname) {
+    return SQL_ParseInt64(SQL_FetchValue(row, result, fieldname));
+}
+
+std::string SQL_FetchString(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname)
+{
+    return std::string(SQL_FetchValue(row, result, fieldname));
 }
 
 void SQL_Lock()
@@ -134,7 +346,7 @@ void SQL_DropTables()
     in = ToLower(in);
     if(in == "y" || in == "ye" || (in.find("yes") == 0))
     {
-        if(mysql_query(&SQL::Connection, query_table_logins.c_str()) != 0)
+        if(SQL_Query(query_table_logins) != 0)
             Printf(LOG_Silent, "[DB] Warning: table `logins` NOT deleted.\n");
     }
     else Printf(LOG_Silent, "[DB] Table `logins` NOT deleted.\n");
@@ -144,7 +356,7 @@ void SQL_DropTables()
     in = ToLower(in);
     if(in == "y" || in == "ye" || (in.find("yes") == 0))
     {
-        if(mysql_query(&SQL::Connection, query_table_characters.c_str()) != 0)
+        if(SQL_Query(query_table_characters) != 0)
             Printf(LOG_Silent, "[DB] Warning: table `characters` NOT deleted.\n");
     }
     else Printf(LOG_Silent, "[DB] Table `characters` NOT deleted.\n");
@@ -153,7 +365,7 @@ void SQL_DropTables()
     std::cin >> in;
     in = ToLower(in);
     if (in == "y" || in == "yes") {
-        if(mysql_query(&SQL::Connection, query_table_shelf.c_str()) != 0) {
+        if(SQL_Query(query_table_shelf) != 0) {
             Printf(LOG_Silent, "[DB] Warning: failed to delete table `shelf`: %s\n", SQL_Error().c_str());
         }
     } else {
@@ -178,11 +390,11 @@ void SQL_CreateTableCheckpoint() {
             `exp_air_bludgeon` INT(1) UNSIGNED NOT NULL,
             `exp_earth_pike` INT(1) UNSIGNED NOT NULL,
             `exp_astral_shooting` INT(1) UNSIGNED NOT NULL,
-            `dress` LONGTEXT CHARACTER SET cp866 COLLATE cp866_bin NOT NULL,
+            `dress` LONGBLOB NOT NULL,
             UNIQUE(`id`)
         );
     )";
-    if (mysql_query(&SQL::Connection, create_table_checkpoint.c_str()) != 0) {
+    if (SQL_Query(create_table_checkpoint) != 0) {
         Printf(LOG_Silent, "[DB] Warning: table `checkpoint` not created: %s\n", SQL_Error().c_str());
     }
 }
@@ -224,10 +436,10 @@ void SQL_CreateTableTreasure() {
             server_id INT(1) NOT NULL COMMENT 'Server ID, 1--10',
             character_id BIGINT(1) NOT NULL COMMENT 'Character ID, same as characters.id',
             treasure_points INT(1) NOT NULL COMMENT 'Amount of treasure points',
-            INDEX treasure_id_index (server_id, character_id)
+            UNIQUE KEY treasure_id_index (server_id, character_id)
         );
     )";
-    if (mysql_query(&SQL::Connection, create_table_treasure.c_str()) != 0) {
+    if (SQL_Query(create_table_treasure) != 0) {
         Printf(LOG_Silent, "[DB] Warning: table `treasure` not created: %s\n", SQL_Error().c_str());
     }
 }
@@ -294,8 +506,8 @@ void SQL_CreateTables()
         `exp_air_bludgeon` INT(1) UNSIGNED NOT NULL, \
         `exp_earth_pike` INT(1) UNSIGNED NOT NULL, \
         `exp_astral_shooting` INT(1) UNSIGNED NOT NULL, \
-        `bag` LONGTEXT CHARACTER SET cp866 COLLATE cp866_bin NOT NULL, \
-        `dress` LONGTEXT CHARACTER SET cp866 COLLATE cp866_bin NOT NULL, \
+        `bag` LONGBLOB NOT NULL, \
+        `dress` LONGBLOB NOT NULL, \
         `sec_55555555` MEDIUMBLOB NOT NULL, \
         `sec_40A40A40` MEDIUMBLOB NOT NULL, \
         `retarded` INT(1) UNSIGNED NOT NULL, \
@@ -303,7 +515,8 @@ void SQL_CreateTables()
         `clantag` VARCHAR(16) CHARACTER SET cp866 COLLATE cp866_bin NOT NULL, \
         `ascended` INT(1) UNSIGNED NOT NULL, \
         `points` INT(1) UNSIGNED NOT NULL, \
-        UNIQUE(`id`))"; // long query to create characters table
+        UNIQUE(`id`), \
+        INDEX `characters_login_index` (`login_id`))"; // long query to create characters table
 
     std::string query_table_authlog = "CREATE TABLE IF NOT EXISTS `authlog` ( \
         `id` BIGINT(1) NOT NULL AUTO_INCREMENT, \
@@ -313,11 +526,11 @@ void SQL_CreateTables()
         `date` TIMESTAMP NOT NULL, \
         UNIQUE(`id`))"; // long query to create authlog table
 
-    if(mysql_query(&SQL::Connection, query_table_logins.c_str()) != 0)
+    if(SQL_Query(query_table_logins) != 0)
         Printf(LOG_Silent, "[DB] Warning: table `logins` not created!\n");
-    if(mysql_query(&SQL::Connection, query_table_characters.c_str()) != 0)
+    if(SQL_Query(query_table_characters) != 0)
         Printf(LOG_Silent, "[DB] Warning: table `characters` not created!\n");
-    if(mysql_query(&SQL::Connection, query_table_authlog.c_str()) != 0)
+    if(SQL_Query(query_table_authlog) != 0)
         Printf(LOG_Silent, "[DB] Warning: table `authlog` not created!\n");
 
     std::string create_table_shelf = R"(
@@ -326,12 +539,12 @@ void SQL_CreateTables()
             server_id INT(1) NOT NULL COMMENT 'Server ID, 1--7',
             cabinet INT(1) NOT NULL COMMENT 'Cabinet, 0 for regular characters, 1 for solo, 2 for solo-hardcore',
             mutex INT(1) COMMENT 'Used to detect concurrent modification. Always read this field for updates and increment by 1 when updating the row.',
-            items LONGTEXT COMMENT 'Shelved items, in DB format for CItemList',
+            items LONGBLOB COMMENT 'Shelved items, in DB format for CItemList (text or binary)',
             money BIGINT(1) COMMENT 'Shelved money',
             INDEX shelf_id_index (login_id, server_id, cabinet)
         );
     )";
-    if (mysql_query(&SQL::Connection, create_table_shelf.c_str()) != 0) {
+    if (SQL_Query(create_table_shelf) != 0) {
         Printf(LOG_Silent, "[DB] Warning: table `shelf` not created: %s\n", SQL_Error().c_str());
     }
 
@@ -372,22 +585,22 @@ void SQL_UpdateVersion1() {
     const char* query;
 
     query = "ALTER TABLE shelf ADD COLUMN cabinet INT(1) NOT NULL COMMENT 'Cabinet, 0 for regular characters, 1 for solo, 2 for solo-hardcore'";
-    if (mysql_query(&SQL::Connection, query) != 0) {
+    if (SQL_Query(query) != 0) {
         Printf(LOG_Warning, "[DB] Warning: failed to update shelf table to v1: add column: %s\n", SQL_Error().c_str());
     }
     
     query = "UPDATE shelf SET cabinet = IF(server_id < 0, 1, 0), server_id = ABS(server_id)";
-    if (mysql_query(&SQL::Connection, query) != 0) {
+    if (SQL_Query(query) != 0) {
         Printf(LOG_Warning, "[DB] Warning: failed to update shelf table to v1: update: %s\n", SQL_Error().c_str());
     }
     
     query = "ALTER TABLE shelf DROP INDEX shelf_id_index";
-    if (mysql_query(&SQL::Connection, query) != 0) {
+    if (SQL_Query(query) != 0) {
         Printf(LOG_Warning, "[DB] Warning: failed to update shelf table to v1: drop index: %s\n", SQL_Error().c_str());
     }
 
     query = "ALTER TABLE shelf ADD INDEX shelf_id_index (login_id, server_id, cabinet)";
-    if (mysql_query(&SQL::Connection, query) != 0) {
+    if (SQL_Query(query) != 0) {
         Printf(LOG_Warning, "[DB] Warning: failed to update shelf table to v1: add index: %s\n", SQL_Error().c_str());
     }
 }
@@ -408,6 +621,362 @@ void SQL_UpdateReclassed() {
     }
 }
 
+namespace {
+
+const int MIGRATE_ITEMS_BATCH = 500;
+
+struct MigrateItemsStats {
+    int rows = 0;
+    int converted = 0;
+    // Saved by a hat between the read and the write: left for the next run.
+    int skipped = 0;
+    uint64_t bytes_before = 0;
+    uint64_t bytes_after = 0;
+};
+
+bool ColumnIsBlob(const std::string& table, const std::string& column) {
+    SimpleSQL check{Format(
+        "SELECT DATA_TYPE FROM INFORMATION_SCHEMA.COLUMNS WHERE TABLE_SCHEMA = '%s' AND TABLE_NAME = '%s' AND COLUMN_NAME = '%s';",
+        SQL_Escape(Config::SqlDatabase).c_str(), table.c_str(), column.c_str())};
+    if (!check || SQL_NumRows(check.result) == 0) {
+        return false;
+    }
+
+    MYSQL_ROW row = SQL_FetchRow(check.result);
+    return ToLower(SQL_FetchString(row, check.result, "DATA_TYPE")) == "longblob";
+}
+
+// Converts a column to LONGBLOB. The bytes are kept as is, so both item formats survive the conversion.
+bool MigrateItemsColumn(const std::string& table, const std::string& column, const char* definition) {
+    if (ColumnIsBlob(table, column)) {
+        return true;
+    }
+
+    Printf(LOG_Info, "[DB] converting `%s`.`%s` to LONGBLOB\n", table.c_str(), column.c_str());
+    return SimpleSQL(Format("ALTER TABLE `%s` MODIFY `%s` %s;", table.c_str(), column.c_str(), definition));
+}
+
+// Returns the escaped binary form of `items`, or an empty string if it's already binary.
+std::string MigrateItemsValue(const std::string& items, MigrateItemsStats& stats) {
+    stats.bytes_before += items.size();
+    if (item_blob::IsBlob(items)) {
+        stats.bytes_after += items.size();
+        return "";
+    }
+
+    std::string blob = item_blob::Encode(Login_UnserializeItems(items));
+    stats.bytes_after += blob.size();
+    return SQL_EscapeBinary(blob);
+}
+
+// Adds the bytes of a row to `stats`.
+void MigrateItemsCount(MigrateItemsStats& stats, const MigrateItemsStats& row) {
+    stats.bytes_before += row.bytes_before;
+    stats.bytes_after += row.bytes_after;
+}
+
+// Tables keyed by `id`: walks the table in `id` order, one transaction per batch. A row is written only if its items
+// are still the ones that were read, so a save made meanwhile isn't overwritten.
+bool MigrateItemsById(const std::string& table, const std::vector<std::string>& columns, MigrateItemsStats& stats) {
+    std::string column_list;
+    for (const auto& column : columns) {
+        column_list += ", `" + column + "`";
+    }
+
+    int64_t last_id = 0;
+    while (true) {
+        SimpleSQL batch{Format("SELECT `id`%s FROM `%s` WHERE `id` > %" PRId64 " ORDER BY `id` LIMIT %d;",
+            column_list.c_str(), table.c_str(), last_id, MIGRATE_ITEMS_BATCH)};
+        if (!batch) {
+            return false;
+        }
+
+        int rows = SQL_NumRows(batch.result);
+        if (rows == 0) {
+            break;
+        }
+
+        if (!SimpleSQL("START TRANSACTION;")) {
+            return false;
+        }
+
+        for (int i = 0; i < rows; i++) {
+            MYSQL_ROW row = SQL_FetchRow(batch.result);
+            last_id = SQL_FetchInt64(row, batch.result, "id");
+            stats.rows++;
+
+            MigrateItemsStats row_stats;
+            std::string assignments;
+            std::string unchanged;
+            for (const auto& column : columns) {
+                std::string items = SQL_FetchString(row, batch.result, column);
+                unchanged += " AND `" + column + "` = '" + SQL_EscapeBinary(items) + "'";
+                std::string value = MigrateItemsValue(items, row_stats);
+                if (value.empty()) {
+                    continue;
+                }
+                if (!assignments.empty()) {
+                    assignments += ", ";
+                }
+                assignments += "`" + column + "` = '" + value + "'";
+            }
+
+            if (assignments.empty()) {
+                MigrateItemsCount(stats, row_stats);
+                continue;
+            }
+
+            if (!SimpleSQL(Format("UPDATE `%s` SET %s WHERE `id` = %" PRId64 "%s;", table.c_str(), assignments.c_str(), last_id, unchanged.c_str()))) {
+                SimpleSQL("ROLLBACK;");
+                return false;
+            }
+            if (!SQL_AffectedRows()) {
+                stats.skipped++;
+                continue;
+            }
+            MigrateItemsCount(stats, row_stats);
+            stats.converted++;
+        }
+
+        if (!SimpleSQL("COMMIT;")) {
+            return false;
+        }
+
+        Printf(LOG_Info, "[DB] `%s`: %d rows checked, %d converted, %d skipped\n", table.c_str(), stats.rows, stats.converted, stats.skipped);
+    }
+
+    return true;
+}
+
+// The shelf has no `id`, so it's walked by its (login_id, server_id, cabinet) key instead.
+bool MigrateItemsShelf(MigrateItemsStats& stats) {
+    int64_t login_id = 0;
+    int server_id = 0;
+    int cabinet = 0;
+
+    while (true) {
+        SimpleSQL batch{Format(
+            "SELECT login_id, server_id, cabinet, mutex, items FROM shelf "
+            "WHERE (login_id, server_id, cabinet) > (%" PRId64 ", %d, %d) "
+            "ORDER BY login_id, server_id, cabinet LIMIT %d;",
+            login_id, server_id, cabinet, MIGRATE_ITEMS_BATCH)};
+        if (!batch) {
+            return false;
+        }
+
+        int rows = SQL_NumRows(batch.result);
+        if (rows == 0) {
+            break;
+        }
+
+        if (!SimpleSQL("START TRANSACTION;")) {
+            return false;
+        }
+
+        for (int i = 0; i < rows; i++) {
+            MYSQL_ROW row = SQL_FetchRow(batch.result);
+            login_id = SQL_FetchInt64(row, batch.result, "login_id");
+            server_id = SQL_FetchInt(row, batch.result, "server_id");
+            cabinet = SQL_FetchInt(row, batch.result, "cabinet");
+            int32_t mutex = SQL_FetchInt(row, batch.result, "mutex");
+            stats.rows++;
+
+            std::string items = SQL_FetchString(row, batch.result, "items");
+            if (items.empty()) {
+                continue;
+            }
+
+            MigrateItemsStats row_stats;
+            std::string value = MigrateItemsValue(items, row_stats);
+            if (value.empty()) {
+                MigrateItemsCount(stats, row_stats);
+                continue;
+            }
+
+            // Same optimistic locking as `shelf::SaveShelf`.
+            if (!SimpleSQL(Format(
+                    "UPDATE shelf SET items = '%s', mutex = %d WHERE login_id = %" PRId64 " AND server_id = %d AND cabinet = %d AND mutex = %d;",
+                    value.c_str(), mutex + 1, login_id, server_id, cabinet, mutex))) {
+                SimpleSQL("ROLLBACK;");
+                return false;
+            }
+            if (!SQL_AffectedRows()) {
+                stats.skipped++;
+                continue;
+            }
+            MigrateItemsCount(stats, row_stats);
+            stats.converted++;
+        }
+
+        if (!SimpleSQL("COMMIT;")) {
+            return false;
+        }
+
+        Printf(LOG_Info, "[DB] `shelf`: %d rows checked, %d converted, %d skipped\n", stats.rows, stats.converted, stats.skipped);
+    }
+
+    return true;
+}
+
+void ReportMigrateItems(const char* table, const MigrateItemsStats& stats) {
+    Printf(LOG_Info, "[DB] `%s`: %d rows, %d converted, items %" PRId64 " -> %" PRId64 " bytes\n",
+        table, stats.rows, stats.converted, static_cast<int64_t>(stats.bytes_before), static_cast<int64_t>(stats.bytes_after));
+    if (stats.skipped) {
+        Printf(LOG_Warning, "[DB] `%s`: %d rows were saved while they were converted, run -migrate-items again for them\n",
+            table, stats.skipped);
+    }
+}
+
+} // namespace
+
+void SQL_MigrateItems() {
+    if (!MigrateItemsColumn("characters", "bag", "LONGBLOB NOT NULL") ||
+        !MigrateItemsColumn("characters", "dress", "LONGBLOB NOT NULL") ||
+        !MigrateItemsColumn("checkpoint", "dress", "LONGBLOB NOT NULL") ||
+        !MigrateItemsColumn("shelf", "items", "LONGBLOB COMMENT 'Shelved items, in DB format for CItemList (text or binary)'")) {
+        Printf(LOG_Error, "[DB] -migrate-items: failed to convert item columns to LONGBLOB\n");
+        return;
+    }
+
+    MigrateItemsStats characters, checkpoints, shelves;
+
+    if (!MigrateItemsById("characters", {"bag", "dress"}, characters)) {
+        Printf(LOG_Error, "[DB] -migrate-items: failed on `characters`, run it again to resume\n");
+        return;
+    }
+    ReportMigrateItems("characters", characters);
+
+    if (!MigrateItemsById("checkpoint", {"dress"}, checkpoints)) {
+        Printf(LOG_Error, "[DB] -migrate-items: failed on `checkpoint`, run it again to resume\n");
+        return;
+    }
+    ReportMigrateItems("checkpoint", checkpoints);
+
+    if (!MigrateItemsShelf(shelves)) {
+        Printf(LOG_Error, "[DB] -migrate-items: failed on `shelf`, run it again to resume\n");
+        return;
+    }
+    ReportMigrateItems("shelf", shelves);
+
+    Printf(LOG_Info, "[DB] -migrate-items: done. Set `BinaryItems = true` in [Settings.SQL] to write the binary format.\n");
+}
+
+namespace {
+
+// `true` if `table` has an index that starts with `column`, a unique one if `unique`.
+bool HasIndex(const std::string& table, const std::string& column, bool unique) {
+    SimpleSQL check{Format(
+        "SELECT 1 FROM INFORMATION_SCHEMA.STATISTICS WHERE TABLE_SCHEMA = '%s' AND TABLE_NAME = '%s' AND COLUMN_NAME = '%s' AND SEQ_IN_INDEX = 1%s;",
+        SQL_Escape(Config::SqlDatabase).c_str(), table.c_str(), column.c_str(), unique ? " AND NON_UNIQUE = 0" : "")};
+    return check && SQL_NumRows(check.result) > 0;
+}
+
+bool HasUniqueKey(const std::string& table, const std::string& column) {
+    return HasIndex(table, column, true);
+}
+
+} // namespace
+
+bool SQL_CheckUniqueKeys() {
+    bool ok = true;
+    if (!HasUniqueKey("treasure", "server_id")) {
+        Printf(LOG_Error, "[DB] `treasure` has no unique key on (server_id, character_id), treasure points will be duplicated. Run with -add-unique-keys.\n");
+        ok = false;
+    }
+    if (!HasUniqueKey("checkpoint", "id")) {
+        Printf(LOG_Error, "[DB] `checkpoint` has no unique key on `id`, checkpoints will be duplicated. Run with -add-unique-keys.\n");
+        ok = false;
+    }
+    return ok;
+}
+
+void SQL_AddUniqueKeys() {
+    // Duplicates of `treasure` are merged into one row with the sum of their points.
+    if (!HasUniqueKey("treasure", "server_id")) {
+        bool merged = SimpleSQL{"START TRANSACTION;"} &&
+            SimpleSQL{"CREATE TEMPORARY TABLE treasure_dedupe AS SELECT server_id, character_id, SUM(treasure_points) AS treasure_points FROM treasure GROUP BY server_id, character_id HAVING COUNT(*) > 1;"} &&
+            SimpleSQL{"DELETE treasure FROM treasure JOIN treasure_dedupe USING (server_id, character_id);"};
+        int deleted = merged ? SQL_AffectedRows() : 0;
+        merged = merged &&
+            SimpleSQL{"INSERT INTO treasure (server_id, character_id, treasure_points) SELECT server_id, character_id, treasure_points FROM treasure_dedupe;"};
+        int inserted = merged ? SQL_AffectedRows() : 0;
+        merged = merged && SimpleSQL{"COMMIT;"};
+        SimpleSQL{"DROP TEMPORARY TABLE IF EXISTS treasure_dedupe;"};
+
+        if (!merged) {
+            SimpleSQL{"ROLLBACK;"};
+            Printf(LOG_Error, "[DB] -add-unique-keys: failed to merge duplicate `treasure` rows\n");
+            return;
+        }
+        Printf(LOG_Info, "[DB] -add-unique-keys: merged %d duplicate `treasure` rows into %d\n", deleted, inserted);
+
+        if (!SimpleSQL{"ALTER TABLE treasure DROP INDEX treasure_id_index, ADD UNIQUE KEY treasure_id_index (server_id, character_id);"}) {
+            Printf(LOG_Error, "[DB] -add-unique-keys: failed to add the unique key to `treasure`\n");
+            return;
+        }
+    }
+
+    // `checkpoint.id` is the character ID. Keep the checkpoint with the most deaths, it's the latest one. No other
+    // column tells the rows of an ID apart, so all but one of them are deleted by count: rows that are the same in
+    // every column go too, and of the rows that tie on deaths one is kept.
+    if (!HasUniqueKey("checkpoint", "id")) {
+        std::map<int64_t, int> rows;
+        {
+            SimpleSQL ids{"SELECT id FROM `checkpoint`;"};
+            if (!ids) {
+                Printf(LOG_Error, "[DB] -add-unique-keys: failed to read `checkpoint`\n");
+                return;
+            }
+            ResultView row(ids.result);
+            while (row.Next()) {
+                rows[row.Int64("id")]++;
+            }
+        }
+
+        bool deduped = SimpleSQL{"START TRANSACTION;"};
+        int deleted = 0;
+        for (const auto& [id, count] : rows) {
+            if (count > 1 && deduped) {
+                deduped = SimpleSQL{Format("DELETE FROM `checkpoint` WHERE id = %" PRId64 " ORDER BY deaths LIMIT %d;", id, count - 1)};
+                deleted += deduped ? SQL_AffectedRows() : 0;
+            }
+        }
+        deduped = deduped && SimpleSQL{"COMMIT;"};
+        if (!deduped) {
+            SimpleSQL{"ROLLBACK;"};
+            Printf(LOG_Error, "[DB] -add-unique-keys: failed to delete duplicate `checkpoint` rows\n");
+            return;
+        }
+        Printf(LOG_Info, "[DB] -add-unique-keys: deleted %d duplicate `checkpoint` rows\n", deleted);
+
+        if (!SimpleSQL{"ALTER TABLE `checkpoint` ADD UNIQUE (`id`);"}) {
+            Printf(LOG_Error, "[DB] -add-unique-keys: failed to add the unique key to `checkpoint`\n");
+            return;
+        }
+    }
+
+    Printf(LOG_Info, "[DB] -add-unique-keys: done\n");
+}
+
+bool SQL_CheckIndices() {
+    if (!HasIndex("characters", "login_id", false)) {
+        Printf(LOG_Warning, "[DB] `characters` has no index on `login_id`, character lists scan the whole table. Run with -add-indices.\n");
+        return false;
+    }
+    return true;
+}
+
+void SQL_AddIndices() {
+    if (!HasIndex("characters", "login_id", false)) {
+        if (!SimpleSQL{"ALTER TABLE `characters` ADD INDEX `characters_login_index` (`login_id`);"}) {
+            Printf(LOG_Error, "[DB] -add-indices: failed to add the index on `characters`.`login_id`: %s\n", SQL_Error().c_str());
+            return;
+        }
+    }
+
+    Printf(LOG_Info, "[DB] -add-indices: done\n");
+}
+
 #include "CCharacter.hpp"
 #include "login.hpp"
 
@@ -449,7 +1018,7 @@ bool SQL_RecoverCharacter(uint32_t login_id, CCharacter& chr)
                                             chr.ExpFireBlade, chr.ExpWaterAxe,
                                             chr.ExpAirBludgeon, chr.ExpEarthPike,
                                             chr.ExpAstralShooting,
-                                            Login_SerializeItems(chr.Bag).c_str(), Login_SerializeItems(chr.Dress).c_str());
+                                            SQL_EscapeBinary(Login_SerializeItems(chr.Bag)).c_str(), SQL_EscapeBinary(Login_SerializeItems(chr.Dress)).c_str());
 
     for(size_t i = 0; i < data_55555555.size(); i++)
         chr_query_update += (char)data_55555555[i];
@@ -468,7 +1037,7 @@ void SQL_UpdateTables()
 {
     if(SQL_Query("RENAME TABLE `characters` TO `characters_old`") != 0)
     {
-        Printf(LOG_Silent, "[DB] Error: %s\n", mysql_error(&SQL::Connection));
+        Printf(LOG_Silent, "[DB] Error: %s\n", SQL_Error().c_str());
         Printf(LOG_Silent, "[DB] Error: table `characters` not updated!\n");
         return;
     }
@@ -528,65 +1097,98 @@ std::string SQL_Escape(std::string string)
     return output;
 }
 
+std::string SQL_EscapeBinary(const std::string& data)
+{
+    // Unlike SQL_Escape, doesn't trim and escapes NUL, so the result can go through Format("%s").
+    std::string output;
+    output.reserve(data.size() + data.size() / 8);
+    for(std::string::const_iterator it = data.begin(); it != data.end(); ++it)
+    {
+        char ch = (*it);
+        if(ch == '\0') output += "\\0";
+        else if(ch == '\\') output += "\\\\";
+        else if(ch == '\'') output += "\\'";
+        else if(ch == '"') output += "\\\"";
+        else output += ch;
+    }
+
+    return output;
+}
+
 int SQL_Query(std::string query)
 {
     //Printf("SQL_Query: %s\n", query.c_str());
-    if(!SQL::Open) return -1;
+    sql_backend::Backend& backend = sql_backend::Current();
+    if(!backend.Connected()) return -1;
 
-    mysql_query(&SQL::Connection, "SET NAMES 'cp866'");
-    int result = mysql_real_query(&SQL::Connection, query.data(), query.length());
+    int result = backend.Query(query);
     if(result != 0 && Config::ReportDatabaseErrors) // error
-        Printf(LOG_Error, "[DB] Error: %s\n", mysql_error(&SQL::Connection));
+        Printf(LOG_Error, "[DB] Error: %s\n", backend.Error().c_str());
 
     return result;
 }
 
+bool SQL_QueryMulti(std::string query, int& executed)
+{
+    sql_backend::Backend& backend = sql_backend::Current();
+    if(backend.QueryMulti(query, executed)) return true;
+
+    if(Config::ReportDatabaseErrors && backend.Connected())
+        Printf(LOG_Error, "[DB] Error: %s\n", backend.Error().c_str());
+    return false;
+}
+
+unsigned long SQL_ConnectionID()
+{
+    return sql_backend::Current().ConnectionID();
+}
+
 int SQL_NumRows(MYSQL_RES* result)
 {
     //Printf("SQL_NumRows()\n");
-    return static_cast<int>(mysql_num_rows(result));
+    return sql_backend::Current().NumRows(result);
 }
 
 MYSQL_RES* SQL_StoreResult()
 {
     //Printf("SQL_StoreResult()\n");
-    return mysql_store_result(&SQL::Connection);
+    return sql_backend::Current().StoreResult();
 }
 
 void SQL_FreeResult(MYSQL_RES* result)
 {
     //Printf("SQL_FreeResult()\n");
-    mysql_free_result(result);
+    sql_backend::Current().FreeResult(result);
 }
 
 MYSQL_ROW SQL_FetchRow(MYSQL_RES* result)
 {
     //Printf("SQL_FetchRow()\n");
-    return mysql_fetch_row(result);
+    return sql_backend::Current().FetchRow(result);
 }
 
 int SQL_AffectedRows()
 {
     //Printf("SQL_AffectedRows()\n");
-    return static_cast<int>(mysql_affected_rows(&SQL::Connection));
+    return sql_backend::Current().AffectedRows();
 }
 
 unsigned long* SQL_FetchLengths(MYSQL_RES* result)
 {
     //Printf("SQL_FetchLengths()\n");
-    return mysql_fetch_lengths(result);
+    return sql_backend::Current().FetchLengths(result);
 }
 
 unsigned long SQL_NumFields(MYSQL_RES* result)
 {
     //Printf("SQL_NumFields()\n");
-    return mysql_num_fields(result);
+    return sql_backend::Current().NumFields(result);
 }
 
 MYSQL_FIELD* SQL_FetchFields(MYSQL_RES* result)
 {
     //Printf("SQL_FetchFields()\n");
-    return mysql_fetch_fields(result);
+    return sql_backend::Current().FetchFields(result);
 }
 
 SimpleSQL::SimpleSQL(std::string query) {
@@ -618,3 +1220,51 @@ SimpleSQL::~SimpleSQL() {
         SQL_FreeResult(this->result);
     }
 }
+
+ResultView::ResultView(MYSQL_RES* result) : result(result), row(nullptr), lengths(nullptr), next_column(0) {
+    if (!result) {
+        return;
+    }
+
+    MYSQL_FIELD* fields = SQL_FetchFields(result);
+    unsigned long count = SQL_NumFields(result);
+    this->names.reserve(count);
+    for (unsigned long i = 0; i < count; i++) {
+        this->names.emplace_back(fields[i].name, fields[i].name_length);
+    }
+}
+
+bool ResultView::Next() {
+    this->row = this->result ? SQL_FetchRow(this->result) : nullptr;
+    this->lengths = this->row ? SQL_FetchLengths(this->result) : nullptr;
+    this->next_column = 0;
+    return this->row != nullptr;
+}
+
+int ResultView::Column(std::string_view name) const {
+    size_t count = this->names.size();
+    for (size_t i = 0; i < count; i++) {
+        size_t column = (this->next_column + i) % count;
+        if (this->names[column] == name) {
+            this->next_column = column + 1;
+            return static_cast<int>(column);
+        }
+    }
+    return -1;
+}
+
+std::string_view ResultView::String(std::string_view name) const {
+    int column = this->Column(name);
+    if (column < 0 || !this->row || !this->row[column]) {
+        return std::string_view();
+    }
+    return std::string_view(this->row[column], this->lengths[column]);
+}
+
+long int ResultView::Int(std::string_view name) const {
+    return SQL_ParseInt(this->String(name));
+}
+
+int64_t ResultView::Int64(std::string_view name) const {
+    return SQL_ParseInt64(this->String(name));
+}
@@ -1,10 +1,13 @@
 #ifndef SQL_HPP_INCLUDED
 #define SQL_HPP_INCLUDED
 
+#include <cstdint>
 #include <memory>
 #include <winsock2.h>
 #include <mysql.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace SQL
 {
@@ -20,6 +23,7 @@ long long int SQL_FetchInt64(MYSQL_ROW row, MYSQL_RES* result, std::string field
 std::string SQL_FetchString(MYSQL_ROW row, MYSQL_RES* result, std::string fieldname);
 
 std::string SQL_Escape(std::string string);
+std::string SQL_EscapeBinary(const std::string& data);
 
 void SQL_Lock();
 void SQL_Unlock();
@@ -36,8 +40,21 @@ void SQL_UpdateTables();
 void SQL_UpdateVersion1();
 void SQL_UpdateAllowFemale();
 void SQL_UpdateReclassed();
+void SQL_MigrateItems();
+
+// Treasure and checkpoint saves are upserts and need unique keys. `SQL_AddUniqueKeys` merges duplicate rows and adds the keys.
+bool SQL_CheckUniqueKeys();
+void SQL_AddUniqueKeys();
+
+// Indices the hat's lookups rely on, besides the unique keys. `SQL_AddIndices` adds the missing ones.
+bool SQL_CheckIndices();
+void SQL_AddIndices();
 
 int SQL_Query(std::string query);
+// Runs `;`-separated statements in one round trip. `executed` is the number of statements that succeeded.
+bool SQL_QueryMulti(std::string query, int& executed);
+// Changes when the client reconnects, which drops any open transaction.
+unsigned long SQL_ConnectionID();
 int SQL_NumRows(MYSQL_RES* result);
 MYSQL_RES* SQL_StoreResult();
 void SQL_FreeResult(MYSQL_RES* result);
@@ -61,4 +78,31 @@ struct SimpleSQL {
     }
 };
 
+// Reads the rows of a result by column name, without the overhead of `SQL_Fetch*` on every value: the field names
+// are fetched once per result, and the values are returned in place instead of copied.
+class ResultView {
+public:
+    explicit ResultView(MYSQL_RES* result);
+
+    // Moves to the next row. `false` if there are no more rows.
+    bool Next();
+
+    // Index of the column, -1 if the result has none. Columns are usually read in the order of the SELECT,
+    // so the one after the previous lookup is checked first.
+    int Column(std::string_view name) const;
+
+    // The value in the current row, empty for NULL or an unknown column. Valid until the result is freed.
+    std::string_view String(std::string_view name) const;
+    // Same as `SQL_FetchInt` and `SQL_FetchInt64`: -1 unless the value is a non-negative integer.
+    long int Int(std::string_view name) const;
+    int64_t Int64(std::string_view name) const;
+
+private:
+    MYSQL_RES* result;
+    MYSQL_ROW row;
+    unsigned long* lengths;
+    std::vector<std::string_view> names;
+    mutable size_t next_column;
+};
+
 #endif // SQL_HPP_INCLUDED
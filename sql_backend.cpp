@@ -0,0 +1,101 @@
+#include "sql_backend.h"
+
+#include <atomic>
+#include <thread>
+
+namespace sql_backend {
+
+namespace {
+
+std::atomic<Backend*> current{nullptr};
+thread_local Backend* thread_current = nullptr;
+
+} // namespace
+
+Backend& Current() {
+    if (thread_current) {
+        return *thread_current;
+    }
+    Backend* backend = current.load(std::memory_order_acquire);
+    return backend ? *backend : MySQL();
+}
+
+void Set(Backend* backend) {
+    current.store(backend, std::memory_order_release);
+}
+
+ThreadScope::ThreadScope(Backend& backend) : previous(thread_current) {
+    thread_current = &backend;
+}
+
+ThreadScope::~ThreadScope() {
+    thread_current = this->previous;
+}
+
+WithLatency::WithLatency(Backend& backend, std::chrono::microseconds latency) : backend(backend), latency(latency) {
+}
+
+void WithLatency::Wait() {
+    std::this_thread::sleep_for(this->latency);
+}
+
+bool WithLatency::Connected() {
+    return this->backend.Connected();
+}
+
+void WithLatency::Close() {
+    this->backend.Close();
+}
+
+int WithLatency::Query(const std::string& query) {
+    this->Wait();
+    return this->backend.Query(query);
+}
+
+bool WithLatency::QueryMulti(const std::string& query, int& executed) {
+    this->Wait();
+    return this->backend.QueryMulti(query, executed);
+}
+
+// The result is already on the client, so only queries pay the latency.
+MYSQL_RES* WithLatency::StoreResult() {
+    return this->backend.StoreResult();
+}
+
+void WithLatency::FreeResult(MYSQL_RES* result) {
+    this->backend.FreeResult(result);
+}
+
+int WithLatency::NumRows(MYSQL_RES* result) {
+    return this->backend.NumRows(result);
+}
+
+MYSQL_ROW WithLatency::FetchRow(MYSQL_RES* result) {
+    return this->backend.FetchRow(result);
+}
+
+unsigned long* WithLatency::FetchLengths(MYSQL_RES* result) {
+    return this->backend.FetchLengths(result);
+}
+
+unsigned long WithLatency::NumFields(MYSQL_RES* result) {
+    return this->backend.NumFields(result);
+}
+
+MYSQL_FIELD* WithLatency::FetchFields(MYSQL_RES* result) {
+    return this->backend.FetchFields(result);
+}
+
+int WithLatency::AffectedRows() {
+    return this->backend.AffectedRows();
+}
+
+std::string WithLatency::Error() {
+    return this->backend.Error();
+}
+
+unsigned long WithLatency::ConnectionID() {
+    return this->backend.ConnectionID();
+}
+
+} // namespace sql_backend
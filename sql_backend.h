@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <winsock2.h>
+#include <mysql.h>
+
+namespace sql_backend {
+
+// What `SQL_Query`, `SQL_StoreResult`, `SQL_Fetch*` and `SimpleSQL` talk to. The MySQL server by default.
+//
+// Results are `MYSQL_RES*` handles whatever the backend is, so the callers don't change: a handle must only go
+// back to the backend that returned it.
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    virtual bool Connected() = 0;
+    virtual void Close() = 0;
+
+    // Same as `mysql_real_query`: 0 on success.
+    virtual int Query(const std::string& query) = 0;
+    // `;`-separated statements in one round trip. `executed` is the number of statements that succeeded.
+    virtual bool QueryMulti(const std::string& query, int& executed) = 0;
+
+    // Result of the last query, nullptr if it had none.
+    virtual MYSQL_RES* StoreResult() = 0;
+    virtual void FreeResult(MYSQL_RES* result) = 0;
+    virtual int NumRows(MYSQL_RES* result) = 0;
+    virtual MYSQL_ROW FetchRow(MYSQL_RES* result) = 0;
+    // Lengths of the values of the row fetched last.
+    virtual unsigned long* FetchLengths(MYSQL_RES* result) = 0;
+    virtual unsigned long NumFields(MYSQL_RES* result) = 0;
+    virtual MYSQL_FIELD* FetchFields(MYSQL_RES* result) = 0;
+
+    virtual int AffectedRows() = 0;
+    virtual std::string Error() = 0;
+    virtual unsigned long ConnectionID() = 0;
+};
+
+// Forwards everything to another backend, but every round trip to the server takes at least `latency`.
+// To see locally how pipelining and pooling would behave against a remote DB.
+class WithLatency : public Backend {
+public:
+    WithLatency(Backend& backend, std::chrono::microseconds latency);
+
+    bool Connected() override;
+    void Close() override;
+    int Query(const std::string& query) override;
+    bool QueryMulti(const std::string& query, int& executed) override;
+    MYSQL_RES* StoreResult() override;
+    void FreeResult(MYSQL_RES* result) override;
+    int NumRows(MYSQL_RES* result) override;
+    MYSQL_ROW FetchRow(MYSQL_RES* result) override;
+    unsigned long* FetchLengths(MYSQL_RES* result) override;
+    unsigned long NumFields(MYSQL_RES* result) override;
+    MYSQL_FIELD* FetchFields(MYSQL_RES* result) override;
+    int AffectedRows() override;
+    std::string Error() override;
+    unsigned long ConnectionID() override;
+
+private:
+    void Wait();
+
+    Backend& backend;
+    std::chrono::microseconds latency;
+};
+
+// The backend of the `SQL_*` functions: the one of `ThreadScope` on this thread, or the one of `Set`.
+Backend& Current();
+
+// Replaces the backend, nullptr restores MySQL. Doesn't take ownership: `backend` must outlive its use.
+void Set(Backend* backend);
+
+// The MySQL backend, connected by `SQL_Init`.
+Backend& MySQL();
+
+// A connection of its own to the MySQL server of [Settings.SQL], for a thread that mustn't wait for the main
+// connection or hold it up. nullptr if connecting fails, or if `SQL_Init` didn't connect to MySQL: the in-memory
+// backend has only the one. Create and destroy it on the thread that uses it.
+std::unique_ptr<Backend> ConnectMySQL();
+
+// Makes the `SQL_*` functions of the calling thread use `backend` while in scope.
+class ThreadScope {
+public:
+    explicit ThreadScope(Backend& backend);
+    ~ThreadScope();
+
+    ThreadScope(const ThreadScope&) = delete;
+    ThreadScope& operator=(const ThreadScope&) = delete;
+
+private:
+    Backend* previous;
+};
+
+} // namespace sql_backend
@@ -0,0 +1,2766 @@
+#include "sql_memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace sql_backend {
+
+namespace {
+
+// NULL is `std::nullopt`.
+using Value = std::optional<std::string>;
+using Row = std::vector<Value>;
+
+// Fails the statement. The message is what `Error()` returns.
+struct QueryError {
+    std::string message;
+};
+
+[[noreturn]] void Fail(std::string message) {
+    throw QueryError{std::move(message)};
+}
+
+[[noreturn]] void Unsupported(const std::string& what) {
+    Fail(what + " is not supported by the in-memory backend");
+}
+
+bool EqualsNoCase(const std::string& a, const char* b) {
+    size_t i = 0;
+    for (; i < a.size() && b[i]; i++) {
+        if (toupper(static_cast<unsigned char>(a[i])) != toupper(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return i == a.size() && !b[i];
+}
+
+bool IsDigit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+// Numbers
+
+// `true` if all of `text` is a number, e.g. "-12" or "1.5". Such strings compare as numbers, as in MySQL.
+bool IsNumber(const std::string& text, bool* integral = nullptr) {
+    size_t i = 0;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+        i++;
+    }
+
+    size_t digits = 0;
+    bool is_integral = true;
+    for (; i < text.size() && IsDigit(text[i]); i++) {
+        digits++;
+    }
+    if (i < text.size() && text[i] == '.') {
+        is_integral = false;
+        for (i++; i < text.size() && IsDigit(text[i]); i++) {
+            digits++;
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        is_integral = false;
+        i++;
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            i++;
+        }
+        if (i == text.size() || !IsDigit(text[i])) {
+            return false;
+        }
+        while (i < text.size() && IsDigit(text[i])) {
+            i++;
+        }
+    }
+
+    if (i != text.size()) {
+        return false;
+    }
+    if (integral) {
+        *integral = is_integral;
+    }
+    return true;
+}
+
+struct Number {
+    bool integral;
+    long long i;
+    double d;
+};
+
+Number ToNumber(const std::string& text) {
+    bool integral = false;
+    if (IsNumber(text, &integral) && integral) {
+        errno = 0;
+        long long i = std::strtoll(text.c_str(), nullptr, 10);
+        if (errno != ERANGE) {
+            return {true, i, static_cast<double>(i)};
+        }
+    }
+
+    // Like MySQL: the number the text starts with, 0 if there's none.
+    return {false, 0, std::strtod(text.c_str(), nullptr)};
+}
+
+std::string FormatInteger(long long value) {
+    return std::to_string(value);
+}
+
+std::string FormatDouble(double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    return buffer;
+}
+
+int Compare(const std::string& a, const std::string& b) {
+    if (IsNumber(a) && IsNumber(b)) {
+        Number x = ToNumber(a);
+        Number y = ToNumber(b);
+        if (x.integral && y.integral) {
+            return (x.i > y.i) - (x.i < y.i);
+        }
+        return (x.d > y.d) - (x.d < y.d);
+    }
+
+    int result = a.compare(b);
+    return (result > 0) - (result < 0);
+}
+
+std::optional<bool> Truth(const Value& value) {
+    if (!value) {
+        return std::nullopt;
+    }
+    Number number = ToNumber(*value);
+    return number.integral ? number.i != 0 : number.d != 0;
+}
+
+bool IsTrue(const Value& value) {
+    return Truth(value).value_or(false);
+}
+
+Value Bool(std::optional<bool> value) {
+    if (!value) {
+        return std::nullopt;
+    }
+    return std::string(*value ? "1" : "0");
+}
+
+Value Arithmetic(const std::string& op, const Value& a, const Value& b) {
+    if (!a || !b) {
+        return std::nullopt;
+    }
+
+    Number x = ToNumber(*a);
+    Number y = ToNumber(*b);
+
+    if (op == "/") {
+        if (y.d == 0) {
+            return std::nullopt;
+        }
+        return FormatDouble(x.d / y.d);
+    }
+
+    if (op == "&" || op == "|") {
+        unsigned long long left = x.integral ? x.i : std::llround(x.d);
+        unsigned long long right = y.integral ? y.i : std::llround(y.d);
+        return std::to_string(op == "&" ? left & right : left | right);
+    }
+
+    if (x.integral && y.integral) {
+        if (op == "+") {
+            return FormatInteger(x.i + y.i);
+        } else if (op == "-") {
+            return FormatInteger(x.i - y.i);
+        } else if (op == "*") {
+            return FormatInteger(x.i * y.i);
+        } else if (op == "%" || op == "MOD" || op == "DIV") {
+            if (y.i == 0) {
+                return std::nullopt;
+            }
+            return FormatInteger(op == "DIV" ? x.i / y.i : x.i % y.i);
+        }
+    } else {
+        if (op == "+") {
+            return FormatDouble(x.d + y.d);
+        } else if (op == "-") {
+            return FormatDouble(x.d - y.d);
+        } else if (op == "*") {
+            return FormatDouble(x.d * y.d);
+        } else if (op == "%" || op == "MOD" || op == "DIV") {
+            if (y.d == 0) {
+                return std::nullopt;
+            }
+            return op == "DIV" ? FormatInteger(static_cast<long long>(x.d / y.d)) : FormatDouble(std::fmod(x.d, y.d));
+        }
+    }
+
+    Unsupported("operator " + op);
+}
+
+std::string Now() {
+    time_t now = time(nullptr);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    return buffer;
+}
+
+// Tokens
+
+enum TokenType {
+    TOKEN_END,
+    TOKEN_WORD,
+    // `name` in backticks: never a keyword.
+    TOKEN_QUOTED,
+    TOKEN_STRING,
+    TOKEN_NUMBER,
+    TOKEN_SYMBOL,
+};
+
+struct Token {
+    TokenType type;
+    // Unescaped for strings, without the backticks for quoted names, decimal for hex numbers.
+    std::string text;
+    // Position in the query.
+    size_t begin;
+    size_t end;
+};
+
+bool IsWordChar(char ch) {
+    return isalnum(static_cast<unsigned char>(ch)) || ch == '_' || ch == '$';
+}
+
+std::vector<Token> Tokenize(const std::string& query) {
+    std::vector<Token> tokens;
+    size_t size = query.size();
+    size_t i = 0;
+
+    while (i < size) {
+        char ch = query[i];
+        size_t begin = i;
+
+        if (IsWhitespace(ch)) {
+            i++;
+            continue;
+        }
+
+        if (ch == '#' || (ch == '-' && i + 2 <= size && query[i + 1] == '-' && (i + 2 == size || IsWhitespace(query[i + 2])))) {
+            while (i < size && query[i] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (ch == '/' && i + 1 < size && query[i + 1] == '*') {
+            size_t close = query.find("*/", i + 2);
+            i = close == std::string::npos ? size : close + 2;
+            continue;
+        }
+
+        if (ch == '\'' || ch == '"') {
+            std::string text;
+            i++;
+            while (true) {
+                if (i >= size) {
+                    Fail("unterminated string in the query");
+                }
+                char next = query[i++];
+                if (next == '\\' && i < size) {
+                    char escaped = query[i++];
+                    switch (escaped) {
+                    case '0': text += '\0'; break;
+                    case 'n': text += '\n'; break;
+                    case 'r': text += '\r'; break;
+                    case 't': text += '\t'; break;
+                    case 'b': text += '\b'; break;
+                    case 'Z': text += '\x1A'; break;
+                    default: text += escaped; break;
+                    }
+                } else if (next == ch) {
+                    // 'it''s'
+                    if (i < size && query[i] == ch) {
+                        text += ch;
+                        i++;
+                    } else {
+                        break;
+                    }
+                } else {
+                    text += next;
+                }
+            }
+            tokens.push_back({TOKEN_STRING, std::move(text), begin, i});
+            continue;
+        }
+
+        if (ch == '`') {
+            size_t close = query.find('`', i + 1);
+            if (close == std::string::npos) {
+                Fail("unterminated name in the query");
+            }
+            tokens.push_back({TOKEN_QUOTED, query.substr(i + 1, close - i - 1), begin, close + 1});
+            i = close + 1;
+            continue;
+        }
+
+        if (IsDigit(ch) || (ch == '.' && i + 1 < size && IsDigit(query[i + 1]))) {
+            if (ch == '0' && i + 1 < size && (query[i + 1] == 'x' || query[i + 1] == 'X')) {
+                i += 2;
+                while (i < size && isxdigit(static_cast<unsigned char>(query[i]))) {
+                    i++;
+                }
+                unsigned long long value = std::strtoull(query.substr(begin + 2, i - begin - 2).c_str(), nullptr, 16);
+                tokens.push_back({TOKEN_NUMBER, std::to_string(value), begin, i});
+                continue;
+            }
+
+            while (i < size && (IsDigit(query[i]) || query[i] == '.')) {
+                i++;
+            }
+            if (i < size && (query[i] == 'e' || query[i] == 'E')) {
+                i++;
+                if (i < size && (query[i] == '-' || query[i] == '+')) {
+                    i++;
+                }
+                while (i < size && IsDigit(query[i])) {
+                    i++;
+                }
+            }
+            tokens.push_back({TOKEN_NUMBER, query.substr(begin, i - begin), begin, i});
+            continue;
+        }
+
+        if (IsWordChar(ch)) {
+            while (i < size && IsWordChar(query[i])) {
+                i++;
+            }
+            tokens.push_back({TOKEN_WORD, query.substr(begin, i - begin), begin, i});
+            continue;
+        }
+
+        static const char* const symbols[] = {"<=>", "<=", ">=", "<>", "!=", "||", "&&"};
+        std::string symbol(1, ch);
+        for (const char* candidate : symbols) {
+            if (query.compare(i, strlen(candidate), candidate) == 0) {
+                symbol = candidate;
+                break;
+            }
+        }
+        i += symbol.size();
+        tokens.push_back({TOKEN_SYMBOL, std::move(symbol), begin, i});
+    }
+
+    return tokens;
+}
+
+// Words that end an expression or a name, so they can't be an alias.
+bool IsReserved(const std::string& word) {
+    static const char* const reserved[] = {
+        "SELECT", "FROM", "WHERE", "ORDER", "BY", "GROUP", "HAVING", "LIMIT", "OFFSET", "JOIN", "LEFT", "RIGHT",
+        "INNER", "OUTER", "CROSS", "ON", "USING", "AS", "SET", "VALUES", "VALUE", "UNION", "AND", "OR", "NOT", "IS",
+        "IN", "LIKE", "BETWEEN", "FOR", "LOCK", "DESC", "ASC", "INTO", "DUPLICATE", "KEY", "UPDATE", "NULL", "XOR",
+        "DIV", "MOD",
+    };
+    for (const char* keyword : reserved) {
+        if (EqualsNoCase(word, keyword)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tokens of one statement.
+class Cursor {
+public:
+    Cursor(const std::string& query, const std::vector<Token>& tokens, size_t begin, size_t end)
+        : query(query), tokens(tokens), position(begin), end(end), end_token{TOKEN_END, "", query.size(), query.size()} {
+    }
+
+    const Token& Peek(size_t ahead = 0) const {
+        return this->position + ahead < this->end ? this->tokens[this->position + ahead] : this->end_token;
+    }
+
+    const Token& Next() {
+        const Token& token = this->Peek();
+        if (this->position < this->end) {
+            this->position++;
+        }
+        return token;
+    }
+
+    bool AtEnd() const {
+        return this->position >= this->end;
+    }
+
+    size_t Position() const {
+        return this->position;
+    }
+
+    // A keyword: an unquoted word, case doesn't matter.
+    bool Is(const char* keyword, size_t ahead = 0) const {
+        const Token& token = this->Peek(ahead);
+        return token.type == TOKEN_WORD && EqualsNoCase(token.text, keyword);
+    }
+
+    bool IsSymbol(const char* symbol, size_t ahead = 0) const {
+        const Token& token = this->Peek(ahead);
+        return token.type == TOKEN_SYMBOL && token.text == symbol;
+    }
+
+    bool Accept(const char* keyword) {
+        if (!this->Is(keyword)) {
+            return false;
+        }
+        this->position++;
+        return true;
+    }
+
+    bool AcceptSymbol(const char* symbol) {
+        if (!this->IsSymbol(symbol)) {
+            return false;
+        }
+        this->position++;
+        return true;
+    }
+
+    void Expect(const char* keyword) {
+        if (!this->Accept(keyword)) {
+            this->SyntaxError();
+        }
+    }
+
+    void ExpectSymbol(const char* symbol) {
+        if (!this->AcceptSymbol(symbol)) {
+            this->SyntaxError();
+        }
+    }
+
+    // A table, column or alias name.
+    std::string Name() {
+        const Token& token = this->Peek();
+        if (token.type != TOKEN_QUOTED && token.type != TOKEN_WORD) {
+            this->SyntaxError();
+        }
+        return this->Next().text;
+    }
+
+    // `true` if the next token can be an alias: `FROM shelf s`.
+    bool AtAlias() const {
+        const Token& token = this->Peek();
+        return token.type == TOKEN_QUOTED || (token.type == TOKEN_WORD && !IsReserved(token.text));
+    }
+
+    // Query text of the tokens [from, to).
+    std::string Text(size_t from, size_t to) const {
+        if (from >= to) {
+            return "";
+        }
+        return this->query.substr(this->tokens[from].begin, this->tokens[to - 1].end - this->tokens[from].begin);
+    }
+
+    [[noreturn]] void SyntaxError() const {
+        Fail("You have an error in your SQL syntax near '" + this->query.substr(this->Peek().begin, 40) + "'");
+    }
+
+private:
+    const std::string& query;
+    const std::vector<Token>& tokens;
+    size_t position;
+    size_t end;
+    Token end_token;
+};
+
+// Schema
+
+struct Column {
+    std::string name;
+    // Lower case, as DATA_TYPE in INFORMATION_SCHEMA: "int", "varchar", "longblob".
+    std::string type;
+    // As COLUMN_TYPE: "int(1) unsigned".
+    std::string column_type;
+    bool integer = false;
+    bool nullable = true;
+    bool auto_increment = false;
+    bool has_default = false;
+    bool default_now = false;
+    Value default_value;
+};
+
+struct Key {
+    std::string name;
+    std::vector<size_t> columns;
+    bool unique = false;
+};
+
+struct Table {
+    std::string name;
+    std::vector<Column> columns;
+    std::vector<Key> keys;
+    // By row ID, in the order of insertion.
+    std::map<uint64_t, Row> rows;
+    uint64_t next_row = 1;
+    long long auto_increment = 1;
+
+    // Index of the column, -1 if there's none. Case doesn't matter, as in MySQL.
+    int Find(const std::string& column) const {
+        for (size_t i = 0; i < this->columns.size(); i++) {
+            if (EqualsNoCase(this->columns[i].name, column.c_str())) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    int AutoIncrementColumn() const {
+        for (size_t i = 0; i < this->columns.size(); i++) {
+            if (this->columns[i].auto_increment) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+};
+
+// Converts a value to the type of the column.
+Value Store(const Column& column, Value value) {
+    if (!value) {
+        if (!column.nullable) {
+            Fail(Format("Column '%s' cannot be null", column.name.c_str()));
+        }
+        return value;
+    }
+    if (column.integer) {
+        Number number = ToNumber(*value);
+        return FormatInteger(number.integral ? number.i : std::llround(number.d));
+    }
+    return value;
+}
+
+// The value of a column an INSERT doesn't mention. The server isn't in strict mode, so NOT NULL columns without a
+// default get 0 or ''.
+Value Default(const Column& column) {
+    if (column.default_now) {
+        return Now();
+    }
+    if (column.has_default) {
+        return column.default_value ? Store(column, column.default_value) : column.default_value;
+    }
+    if (column.nullable) {
+        return std::nullopt;
+    }
+    if (column.integer) {
+        return std::string("0");
+    }
+    if (column.type == "timestamp" || column.type == "datetime") {
+        return std::string("0000-00-00 00:00:00");
+    }
+    return std::string();
+}
+
+std::string DuplicateEntry(const Table& table, const Key& key, const Row& row) {
+    std::string entry;
+    for (size_t column : key.columns) {
+        if (!entry.empty()) {
+            entry += "-";
+        }
+        entry += row[column].value_or("NULL");
+    }
+    return Format("Duplicate entry '%s' for key '%s'", entry.c_str(), key.name.c_str());
+}
+
+// The key that `row` would duplicate and the ID of the row it would duplicate. NULLs never conflict, as in MySQL.
+const Key* FindConflict(const Table& table, const Row& row, uint64_t skip, uint64_t& conflict) {
+    for (const Key& key : table.keys) {
+        if (!key.unique) {
+            continue;
+        }
+        if (std::any_of(key.columns.begin(), key.columns.end(), [&](size_t column) { return !row[column]; })) {
+            continue;
+        }
+
+        for (const auto& [id, other] : table.rows) {
+            if (id == skip) {
+                continue;
+            }
+            if (std::all_of(key.columns.begin(), key.columns.end(), [&](size_t column) { return other[column] == row[column]; })) {
+                conflict = id;
+                return &key;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Expressions
+
+struct Expr;
+using ExprPtr = std::unique_ptr<Expr>;
+
+struct Expr {
+    enum Kind {
+        LITERAL,
+        COLUMN,
+        // VALUES(column) in ON DUPLICATE KEY UPDATE.
+        VALUES,
+        UNARY,
+        BINARY,
+        FUNCTION,
+        // (a, b, c) in a comparison.
+        TUPLE,
+        IS_NULL,
+        IN,
+        AGGREGATE,
+    };
+
+    Kind kind = LITERAL;
+    Value value;
+    // Upper case operator or function name.
+    std::string op;
+    // Qualifier of the column, lower case, empty if none.
+    std::string table;
+    std::string column;
+    // Set by `Bind`.
+    size_t source = 0;
+    size_t index = 0;
+    // IS NOT NULL, NOT IN.
+    bool negated = false;
+    std::vector<ExprPtr> args;
+};
+
+ExprPtr Literal(Value value) {
+    auto expr = std::make_unique<Expr>();
+    expr->kind = Expr::LITERAL;
+    expr->value = std::move(value);
+    return expr;
+}
+
+ExprPtr Operation(Expr::Kind kind, std::string op, ExprPtr left, ExprPtr right = nullptr) {
+    auto expr = std::make_unique<Expr>();
+    expr->kind = kind;
+    expr->op = std::move(op);
+    expr->args.push_back(std::move(left));
+    if (right) {
+        expr->args.push_back(std::move(right));
+    }
+    return expr;
+}
+
+// A table in FROM and its current row.
+struct Source {
+    const Table* table;
+    // Lower case. The table name if there's no alias.
+    std::string alias;
+    // nullptr on the missing side of a LEFT JOIN.
+    const Row* row = nullptr;
+};
+
+struct Scope {
+    std::vector<Source> sources;
+    // For VALUES(column): the table and the row an INSERT wanted to add.
+    const Table* values_table = nullptr;
+    const Row* values = nullptr;
+};
+
+// Resolves the columns of `expr` to the first `visible` sources.
+void Bind(Expr& expr, const Scope& scope, size_t visible) {
+    for (auto& arg : expr.args) {
+        Bind(*arg, scope, visible);
+    }
+
+    if (expr.kind == Expr::COLUMN) {
+        bool found = false;
+        for (size_t i = 0; i < visible; i++) {
+            const Source& source = scope.sources[i];
+            if (!expr.table.empty() && expr.table != source.alias) {
+                continue;
+            }
+            int index = source.table->Find(expr.column);
+            if (index < 0) {
+                continue;
+            }
+            if (found) {
+                Fail(Format("Column '%s' in field list is ambiguous", expr.column.c_str()));
+            }
+            found = true;
+            expr.source = i;
+            expr.index = index;
+        }
+        if (!found) {
+            std::string name = expr.table.empty() ? expr.column : expr.table + "." + expr.column;
+            Fail(Format("Unknown column '%s' in 'field list'", name.c_str()));
+        }
+    } else if (expr.kind == Expr::VALUES) {
+        if (!scope.values_table) {
+            Unsupported("VALUES() outside of ON DUPLICATE KEY UPDATE");
+        }
+        int index = scope.values_table->Find(expr.column);
+        if (index < 0) {
+            Fail(Format("Unknown column '%s' in 'field list'", expr.column.c_str()));
+        }
+        expr.index = index;
+    }
+}
+
+Value Evaluate(const Expr& expr, const Scope& scope);
+
+// <0, 0 or >0. Tuples compare element by element. nullopt if a NULL decides.
+std::optional<int> CompareOperands(const Expr& a, const Expr& b, const Scope& scope) {
+    if (a.kind == Expr::TUPLE || b.kind == Expr::TUPLE) {
+        if (a.kind != b.kind || a.args.size() != b.args.size()) {
+            Fail("Operand should contain the same number of columns");
+        }
+        for (size_t i = 0; i < a.args.size(); i++) {
+            std::optional<int> result = CompareOperands(*a.args[i], *b.args[i], scope);
+            if (!result || *result != 0) {
+                return result;
+            }
+        }
+        return 0;
+    }
+
+    Value x = Evaluate(a, scope);
+    Value y = Evaluate(b, scope);
+    if (!x || !y) {
+        return std::nullopt;
+    }
+    return Compare(*x, *y);
+}
+
+Value EvaluateBinary(const Expr& expr, const Scope& scope) {
+    const std::string& op = expr.op;
+    const Expr& a = *expr.args[0];
+    const Expr& b = *expr.args[1];
+
+    if (op == "AND") {
+        std::optional<bool> left = Truth(Evaluate(a, scope));
+        if (left == false) {
+            return Bool(false);
+        }
+        std::optional<bool> right = Truth(Evaluate(b, scope));
+        if (right == false) {
+            return Bool(false);
+        }
+        return (left && right) ? Bool(true) : std::nullopt;
+    }
+    if (op == "OR") {
+        std::optional<bool> left = Truth(Evaluate(a, scope));
+        if (left == true) {
+            return Bool(true);
+        }
+        std::optional<bool> right = Truth(Evaluate(b, scope));
+        if (right == true) {
+            return Bool(true);
+        }
+        return (left && right) ? Bool(false) : std::nullopt;
+    }
+
+    if (op == "<=>") {
+        Value x = Evaluate(a, scope);
+        Value y = Evaluate(b, scope);
+        if (!x || !y) {
+            return Bool(!x && !y);
+        }
+        return Bool(Compare(*x, *y) == 0);
+    }
+    if (op == "=" || op == "<>" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=") {
+        std::optional<int> result = CompareOperands(a, b, scope);
+        if (!result) {
+            return std::nullopt;
+        }
+        int c = *result;
+        if (op == "=") {
+            return Bool(c == 0);
+        } else if (op == "<>" || op == "!=") {
+            return Bool(c != 0);
+        } else if (op == "<") {
+            return Bool(c < 0);
+        } else if (op == ">") {
+            return Bool(c > 0);
+        } else if (op == "<=") {
+            return Bool(c <= 0);
+        }
+        return Bool(c >= 0);
+    }
+
+    return Arithmetic(op, Evaluate(a, scope), Evaluate(b, scope));
+}
+
+Value EvaluateFunction(const Expr& expr, const Scope& scope) {
+    const std::string& name = expr.op;
+    std::vector<Value> args;
+    if (name != "IF") {
+        for (const auto& arg : expr.args) {
+            args.push_back(Evaluate(*arg, scope));
+        }
+    }
+
+    auto expect_args = [&](size_t count) {
+        if (expr.args.size() != count) {
+            Fail(Format("Incorrect parameter count in the call to native function '%s'", name.c_str()));
+        }
+    };
+
+    if (name == "LOWER" || name == "LCASE" || name == "UPPER" || name == "UCASE") {
+        expect_args(1);
+        if (!args[0]) {
+            return std::nullopt;
+        }
+        return (name == "LOWER" || name == "LCASE") ? ToLower(*args[0]) : ToUpper(*args[0]);
+    } else if (name == "ABS") {
+        expect_args(1);
+        if (!args[0]) {
+            return std::nullopt;
+        }
+        Number number = ToNumber(*args[0]);
+        return number.integral ? FormatInteger(std::llabs(number.i)) : FormatDouble(std::fabs(number.d));
+    } else if (name == "LENGTH") {
+        expect_args(1);
+        if (!args[0]) {
+            return std::nullopt;
+        }
+        return FormatInteger(static_cast<long long>(args[0]->size()));
+    } else if (name == "CONCAT") {
+        std::string out;
+        for (const auto& arg : args) {
+            if (!arg) {
+                return std::nullopt;
+            }
+            out += *arg;
+        }
+        return out;
+    } else if (name == "IFNULL" || name == "COALESCE") {
+        if (name == "IFNULL") {
+            expect_args(2);
+        }
+        for (const auto& arg : args) {
+            if (arg) {
+                return arg;
+            }
+        }
+        return std::nullopt;
+    } else if (name == "IF") {
+        expect_args(3);
+        return IsTrue(Evaluate(*expr.args[0], scope)) ? Evaluate(*expr.args[1], scope) : Evaluate(*expr.args[2], scope);
+    } else if (name == "GREATEST" || name == "LEAST") {
+        if (args.empty()) {
+            expect_args(1);
+        }
+        Value best = args[0];
+        for (const auto& arg : args) {
+            if (!arg) {
+                return std::nullopt;
+            }
+            int c = Compare(*arg, *best);
+            if (name == "GREATEST" ? c > 0 : c < 0) {
+                best = arg;
+            }
+        }
+        return best;
+    }
+
+    Unsupported("function " + name);
+}
+
+Value Evaluate(const Expr& expr, const Scope& scope) {
+    switch (expr.kind) {
+    case Expr::LITERAL:
+        return expr.value;
+
+    case Expr::COLUMN: {
+        const Row* row = scope.sources[expr.source].row;
+        return row ? (*row)[expr.index] : std::nullopt;
+    }
+
+    case Expr::VALUES:
+        return scope.values ? (*scope.values)[expr.index] : std::nullopt;
+
+    case Expr::UNARY: {
+        Value value = Evaluate(*expr.args[0], scope);
+        if (expr.op == "NOT") {
+            std::optional<bool> truth = Truth(value);
+            return truth ? Bool(!*truth) : std::nullopt;
+        }
+        return Arithmetic("-", std::string("0"), value);
+    }
+
+    case Expr::BINARY:
+        return EvaluateBinary(expr, scope);
+
+    case Expr::FUNCTION:
+        return EvaluateFunction(expr, scope);
+
+    case Expr::TUPLE:
+        Fail("Operand should contain 1 column(s)");
+
+    case Expr::IS_NULL:
+        return Bool(Evaluate(*expr.args[0], scope).has_value() == expr.negated);
+
+    case Expr::IN: {
+        if (expr.args[0]->kind == Expr::TUPLE) {
+            // (a, b) IN ((1, 2), (3, 4))
+            bool has_null = false;
+            for (size_t i = 1; i < expr.args.size(); i++) {
+                std::optional<int> result = CompareOperands(*expr.args[0], *expr.args[i], scope);
+                if (!result) {
+                    has_null = true;
+                } else if (*result == 0) {
+                    return Bool(!expr.negated);
+                }
+            }
+            return has_null ? std::nullopt : Bool(expr.negated);
+        }
+
+        Value value = Evaluate(*expr.args[0], scope);
+        if (!value) {
+            return std::nullopt;
+        }
+        bool has_null = false;
+        for (size_t i = 1; i < expr.args.size(); i++) {
+            Value item = Evaluate(*expr.args[i], scope);
+            if (!item) {
+                has_null = true;
+            } else if (Compare(*value, *item) == 0) {
+                return Bool(!expr.negated);
+            }
+        }
+        return has_null ? std::nullopt : Bool(expr.negated);
+    }
+
+    case Expr::AGGREGATE:
+        Unsupported("aggregate functions inside expressions");
+    }
+
+    return std::nullopt;
+}
+
+// Results
+
+struct Result {
+    std::vector<std::string> names;
+    std::vector<MYSQL_FIELD> fields;
+    std::vector<Row> rows;
+    size_t next = 0;
+    // The row `FetchRow` returned last.
+    std::vector<char*> current;
+    std::vector<unsigned long> lengths;
+
+    // The fields point into `names`: call once the names are final.
+    void MakeFields() {
+        this->fields.assign(this->names.size(), MYSQL_FIELD{});
+        for (size_t i = 0; i < this->names.size(); i++) {
+            this->fields[i].name = this->names[i].data();
+            this->fields[i].name_length = static_cast<unsigned int>(this->names[i].size());
+        }
+        this->current.assign(this->names.size(), nullptr);
+        this->lengths.assign(this->names.size(), 0);
+    }
+};
+
+Result* AsResult(MYSQL_RES* result) {
+    return reinterpret_cast<Result*>(result);
+}
+
+// A change to undo on ROLLBACK.
+struct Undo {
+    // Lower case.
+    std::string table;
+    uint64_t row;
+    // The row before the change, nullopt if the change inserted it.
+    std::optional<Row> before;
+};
+
+Column MakeColumn(const char* name, bool integer) {
+    Column column;
+    column.name = name;
+    column.integer = integer;
+    column.type = integer ? "bigint" : "varchar";
+    column.column_type = column.type;
+    return column;
+}
+
+} // namespace
+
+struct Memory::State {
+    explicit State(std::string database) : database(std::move(database)) {
+    }
+
+    void Execute(Cursor& c);
+
+    // Statements
+    std::unique_ptr<Result> Select(Cursor& c);
+    void Insert(Cursor& c);
+    void Update(Cursor& c);
+    void Delete(Cursor& c);
+    void Create(Cursor& c);
+    void Alter(Cursor& c);
+    void Drop(Cursor& c);
+    void Rename(Cursor& c);
+    void Truncate(Cursor& c);
+    void Commit();
+    void RollbackTo(size_t mark);
+
+    // Parts of statements
+    ExprPtr ParseExpr(Cursor& c);
+    ExprPtr ParseAnd(Cursor& c);
+    ExprPtr ParseNot(Cursor& c);
+    ExprPtr ParseComparison(Cursor& c);
+    ExprPtr ParseBitOr(Cursor& c);
+    ExprPtr ParseBitAnd(Cursor& c);
+    ExprPtr ParseAdditive(Cursor& c);
+    ExprPtr ParseMultiplicative(Cursor& c);
+    ExprPtr ParseUnary(Cursor& c);
+    ExprPtr ParsePrimary(Cursor& c);
+    Value Subquery(Cursor& c);
+    uint64_t ParseCount(Cursor& c);
+    std::string ParseTableName(Cursor& c, std::string* schema = nullptr);
+    void AddSource(Cursor& c, Scope& scope, std::vector<std::unique_ptr<Table>>& virtual_tables);
+    std::vector<std::pair<size_t, ExprPtr>> ParseAssignments(Cursor& c, const Table& table);
+    Column ParseColumn(Cursor& c, bool& primary, bool& unique);
+    std::vector<std::string> ParseKeyColumns(Cursor& c);
+    void AddKey(Table& table, std::string name, const std::vector<std::string>& columns, bool unique, bool primary);
+
+    Table& GetTable(const std::string& name);
+    std::unique_ptr<Table> InformationSchema(const std::string& name) const;
+
+    std::mutex mutex;
+    std::string database;
+    bool connected = true;
+
+    // By lower case name.
+    std::map<std::string, Table> tables;
+
+    bool in_transaction = false;
+    std::vector<Undo> undo;
+
+    std::unique_ptr<Result> result;
+    int affected_rows = 0;
+    long long last_insert_id = 0;
+    std::string error;
+};
+
+void Memory::State::Execute(Cursor& c) {
+    this->result.reset();
+    this->affected_rows = 0;
+
+    const Token& first = c.Peek();
+    if (first.type != TOKEN_WORD) {
+        c.SyntaxError();
+    }
+    std::string verb = ToUpper(first.text);
+
+    // DDL commits the transaction, as in MySQL.
+    bool ddl = verb == "CREATE" || verb == "ALTER" || verb == "DROP" || verb == "RENAME" || verb == "TRUNCATE";
+    if (ddl) {
+        this->Commit();
+    }
+
+    // A failed statement leaves no changes behind, even outside of a transaction.
+    size_t mark = this->undo.size();
+    try {
+        if (verb == "SELECT") {
+            this->result = this->Select(c);
+            this->affected_rows = -1;
+        } else if (verb == "INSERT") {
+            this->Insert(c);
+        } else if (verb == "UPDATE") {
+            this->Update(c);
+        } else if (verb == "DELETE") {
+            this->Delete(c);
+        } else if (verb == "CREATE") {
+            this->Create(c);
+        } else if (verb == "ALTER") {
+            this->Alter(c);
+        } else if (verb == "DROP") {
+            this->Drop(c);
+        } else if (verb == "RENAME") {
+            this->Rename(c);
+        } else if (verb == "TRUNCATE") {
+            this->Truncate(c);
+        } else if (verb == "START" || verb == "BEGIN") {
+            c.Next();
+            if (verb == "START") {
+                c.Expect("TRANSACTION");
+            }
+            // READ WRITE, WITH CONSISTENT SNAPSHOT and so on.
+            while (!c.AtEnd()) {
+                c.Next();
+            }
+            this->Commit();
+            this->in_transaction = true;
+            return;
+        } else if (verb == "COMMIT") {
+            c.Next();
+            c.Accept("WORK");
+            this->Commit();
+        } else if (verb == "ROLLBACK") {
+            c.Next();
+            c.Accept("WORK");
+            if (!c.AtEnd()) {
+                Unsupported("ROLLBACK TO SAVEPOINT");
+            }
+            this->RollbackTo(0);
+            this->in_transaction = false;
+        } else if (verb == "SET") {
+            // SET NAMES and session variables don't matter here.
+            while (!c.AtEnd()) {
+                c.Next();
+            }
+        } else {
+            Unsupported(verb);
+        }
+
+        if (!c.AtEnd()) {
+            c.SyntaxError();
+        }
+    } catch (...) {
+        this->RollbackTo(mark);
+        throw;
+    }
+
+    if (!this->in_transaction) {
+        this->undo.clear();
+    }
+}
+
+void Memory::State::Commit() {
+    this->in_transaction = false;
+    this->undo.clear();
+}
+
+void Memory::State::RollbackTo(size_t mark) {
+    while (this->undo.size() > mark) {
+        Undo change = std::move(this->undo.back());
+        this->undo.pop_back();
+
+        auto table = this->tables.find(change.table);
+        if (table == this->tables.end()) {
+            continue;
+        }
+        if (change.before) {
+            table->second.rows[change.row] = std::move(*change.before);
+        } else {
+            table->second.rows.erase(change.row);
+        }
+    }
+}
+
+Table& Memory::State::GetTable(const std::string& name) {
+    auto table = this->tables.find(ToLower(name));
+    if (table == this->tables.end()) {
+        Fail(Format("Table '%s.%s' doesn't exist", this->database.c_str(), name.c_str()));
+    }
+    return table->second;
+}
+
+// Expressions, from the lowest precedence.
+
+ExprPtr Memory::State::ParseExpr(Cursor& c) {
+    ExprPtr left = this->ParseAnd(c);
+    while (c.Accept("OR") || c.AcceptSymbol("||")) {
+        left = Operation(Expr::BINARY, "OR", std::move(left), this->ParseAnd(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseAnd(Cursor& c) {
+    ExprPtr left = this->ParseNot(c);
+    while (c.Accept("AND") || c.AcceptSymbol("&&")) {
+        left = Operation(Expr::BINARY, "AND", std::move(left), this->ParseNot(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseNot(Cursor& c) {
+    if (c.Accept("NOT") || c.AcceptSymbol("!")) {
+        return Operation(Expr::UNARY, "NOT", this->ParseNot(c));
+    }
+    return this->ParseComparison(c);
+}
+
+ExprPtr Memory::State::ParseComparison(Cursor& c) {
+    ExprPtr left = this->ParseBitOr(c);
+
+    if (c.Accept("IS")) {
+        auto expr = Operation(Expr::IS_NULL, "IS", std::move(left));
+        expr->negated = c.Accept("NOT");
+        c.Expect("NULL");
+        return expr;
+    }
+
+    bool negated = false;
+    if (c.Is("NOT") && (c.Is("IN", 1) || c.Is("LIKE", 1) || c.Is("BETWEEN", 1))) {
+        c.Next();
+        negated = true;
+    }
+    if (c.Is("LIKE") || c.Is("BETWEEN") || c.Is("REGEXP")) {
+        Unsupported(ToUpper(c.Peek().text));
+    }
+    if (c.Accept("IN")) {
+        auto expr = Operation(Expr::IN, "IN", std::move(left));
+        expr->negated = negated;
+        c.ExpectSymbol("(");
+        if (c.Is("SELECT")) {
+            std::unique_ptr<Result> rows = this->Select(c);
+            if (rows->names.size() != 1) {
+                Fail("Operand should contain 1 column(s)");
+            }
+            for (auto& row : rows->rows) {
+                expr->args.push_back(Literal(std::move(row[0])));
+            }
+        } else {
+            do {
+                expr->args.push_back(this->ParseExpr(c));
+            } while (c.AcceptSymbol(","));
+        }
+        c.ExpectSymbol(")");
+        return expr;
+    }
+    if (negated) {
+        c.SyntaxError();
+    }
+
+    static const char* const comparisons[] = {"=", "<=>", "<>", "!=", "<", ">", "<=", ">="};
+    for (const char* op : comparisons) {
+        if (c.AcceptSymbol(op)) {
+            return Operation(Expr::BINARY, op, std::move(left), this->ParseBitOr(c));
+        }
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseBitOr(Cursor& c) {
+    ExprPtr left = this->ParseBitAnd(c);
+    while (c.AcceptSymbol("|")) {
+        left = Operation(Expr::BINARY, "|", std::move(left), this->ParseBitAnd(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseBitAnd(Cursor& c) {
+    ExprPtr left = this->ParseAdditive(c);
+    while (c.AcceptSymbol("&")) {
+        left = Operation(Expr::BINARY, "&", std::move(left), this->ParseAdditive(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseAdditive(Cursor& c) {
+    ExprPtr left = this->ParseMultiplicative(c);
+    while (c.IsSymbol("+") || c.IsSymbol("-")) {
+        std::string op = c.Next().text;
+        left = Operation(Expr::BINARY, op, std::move(left), this->ParseMultiplicative(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseMultiplicative(Cursor& c) {
+    ExprPtr left = this->ParseUnary(c);
+    while (c.IsSymbol("*") || c.IsSymbol("/") || c.IsSymbol("%") || c.Is("DIV") || c.Is("MOD")) {
+        std::string op = ToUpper(c.Next().text);
+        left = Operation(Expr::BINARY, op, std::move(left), this->ParseUnary(c));
+    }
+    return left;
+}
+
+ExprPtr Memory::State::ParseUnary(Cursor& c) {
+    if (c.AcceptSymbol("-")) {
+        return Operation(Expr::UNARY, "-", this->ParseUnary(c));
+    }
+    if (c.AcceptSymbol("+")) {
+        return this->ParseUnary(c);
+    }
+    return this->ParsePrimary(c);
+}
+
+ExprPtr Memory::State::ParsePrimary(Cursor& c) {
+    const Token& token = c.Peek();
+
+    if (token.type == TOKEN_NUMBER || token.type == TOKEN_STRING) {
+        return Literal(c.Next().text);
+    }
+
+    if (c.AcceptSymbol("(")) {
+        if (c.Is("SELECT")) {
+            Value value = this->Subquery(c);
+            c.ExpectSymbol(")");
+            return Literal(std::move(value));
+        }
+
+        ExprPtr first = this->ParseExpr(c);
+        if (!c.IsSymbol(",")) {
+            c.ExpectSymbol(")");
+            return first;
+        }
+
+        auto tuple = std::make_unique<Expr>();
+        tuple->kind = Expr::TUPLE;
+        tuple->args.push_back(std::move(first));
+        while (c.AcceptSymbol(",")) {
+            tuple->args.push_back(this->ParseExpr(c));
+        }
+        c.ExpectSymbol(")");
+        return tuple;
+    }
+
+    if (token.type == TOKEN_WORD) {
+        if (c.Accept("NULL")) {
+            return Literal(std::nullopt);
+        }
+        if (c.Accept("TRUE")) {
+            return Literal(std::string("1"));
+        }
+        if (c.Accept("FALSE")) {
+            return Literal(std::string("0"));
+        }
+        if (c.Is("CASE") || c.Is("EXISTS") || c.Is("INTERVAL")) {
+            Unsupported(ToUpper(token.text));
+        }
+
+        if (c.IsSymbol("(", 1)) {
+            std::string name = ToUpper(c.Next().text);
+            c.Next();
+
+            // Same for the whole statement, as in MySQL.
+            if (name == "NOW" || name == "CURRENT_TIMESTAMP" || name == "LAST_INSERT_ID" || name == "UNIX_TIMESTAMP") {
+                c.ExpectSymbol(")");
+                if (name == "LAST_INSERT_ID") {
+                    return Literal(FormatInteger(this->last_insert_id));
+                }
+                if (name == "UNIX_TIMESTAMP") {
+                    return Literal(FormatInteger(static_cast<long long>(time(nullptr))));
+                }
+                return Literal(Now());
+            }
+
+            if (name == "VALUES") {
+                auto expr = std::make_unique<Expr>();
+                expr->kind = Expr::VALUES;
+                expr->column = c.Name();
+                c.ExpectSymbol(")");
+                return expr;
+            }
+
+            auto expr = std::make_unique<Expr>();
+            expr->op = name;
+            if (name == "COUNT" || name == "SUM" || name == "MIN" || name == "MAX" || name == "AVG") {
+                expr->kind = Expr::AGGREGATE;
+                if (c.Is("DISTINCT")) {
+                    Unsupported(name + "(DISTINCT)");
+                }
+                if (name == "COUNT" && c.AcceptSymbol("*")) {
+                    c.ExpectSymbol(")");
+                    return expr;
+                }
+            } else {
+                static const char* const functions[] = {
+                    "LOWER", "LCASE", "UPPER", "UCASE", "ABS", "LENGTH", "CONCAT", "IFNULL", "COALESCE", "IF", "GREATEST", "LEAST",
+                };
+                if (std::none_of(std::begin(functions), std::end(functions), [&](const char* known) { return name == known; })) {
+                    Unsupported("function " + name);
+                }
+                expr->kind = Expr::FUNCTION;
+            }
+
+            if (!c.IsSymbol(")")) {
+                do {
+                    expr->args.push_back(this->ParseExpr(c));
+                } while (c.AcceptSymbol(","));
+            }
+            c.ExpectSymbol(")");
+            return expr;
+        }
+
+        if (c.Is("CURRENT_TIMESTAMP")) {
+            c.Next();
+            return Literal(Now());
+        }
+        if (IsReserved(token.text)) {
+            c.SyntaxError();
+        }
+    }
+
+    if (token.type == TOKEN_WORD || token.type == TOKEN_QUOTED) {
+        auto expr = std::make_unique<Expr>();
+        expr->kind = Expr::COLUMN;
+        expr->column = c.Name();
+        if (c.AcceptSymbol(".")) {
+            expr->table = ToLower(expr->column);
+            expr->column = c.Name();
+        }
+        return expr;
+    }
+
+    c.SyntaxError();
+}
+
+// (SELECT ...) as a value: the only column of the only row, NULL if there are no rows.
+Value Memory::State::Subquery(Cursor& c) {
+    std::unique_ptr<Result> rows = this->Select(c);
+    if (rows->names.size() != 1) {
+        Fail("Operand should contain 1 column(s)");
+    }
+    if (rows->rows.size() > 1) {
+        Fail("Subquery returns more than 1 row");
+    }
+    return rows->rows.empty() ? std::nullopt : rows->rows[0][0];
+}
+
+uint64_t Memory::State::ParseCount(Cursor& c) {
+    const Token& token = c.Peek();
+    bool integral = false;
+    if (token.type != TOKEN_NUMBER || !IsNumber(token.text, &integral) || !integral) {
+        c.SyntaxError();
+    }
+    return std::strtoull(c.Next().text.c_str(), nullptr, 10);
+}
+
+// `table` or `schema`.`table`.
+std::string Memory::State::ParseTableName(Cursor& c, std::string* schema) {
+    std::string name = c.Name();
+    if (c.AcceptSymbol(".")) {
+        if (schema) {
+            *schema = name;
+        }
+        name = c.Name();
+    }
+    return name;
+}
+
+void Memory::State::AddSource(Cursor& c, Scope& scope, std::vector<std::unique_ptr<Table>>& virtual_tables) {
+    std::string schema;
+    std::string name = this->ParseTableName(c, &schema);
+
+    const Table* table;
+    if (EqualsNoCase(schema, "INFORMATION_SCHEMA")) {
+        virtual_tables.push_back(this->InformationSchema(name));
+        table = virtual_tables.back().get();
+    } else {
+        table = &this->GetTable(name);
+    }
+
+    std::string alias = ToLower(name);
+    if (c.Accept("AS") || c.AtAlias()) {
+        alias = ToLower(c.Name());
+    }
+    for (const Source& source : scope.sources) {
+        if (source.alias == alias) {
+            Fail(Format("Not unique table/alias: '%s'", alias.c_str()));
+        }
+    }
+
+    scope.sources.push_back(Source{table, alias});
+}
+
+std::unique_ptr<Result> Memory::State::Select(Cursor& c) {
+    c.Expect("SELECT");
+    if (c.Is("DISTINCT")) {
+        Unsupported("SELECT DISTINCT");
+    }
+    c.Accept("ALL");
+
+    struct Item {
+        ExprPtr expr;
+        std::string name;
+        bool star = false;
+        // `t`.* if not empty.
+        std::string star_table;
+    };
+
+    std::vector<Item> items;
+    do {
+        Item item;
+        size_t first = c.Position();
+        if (c.AcceptSymbol("*")) {
+            item.star = true;
+        } else if ((c.Peek().type == TOKEN_WORD || c.Peek().type == TOKEN_QUOTED) && c.IsSymbol(".", 1) && c.IsSymbol("*", 2)) {
+            item.star = true;
+            item.star_table = ToLower(c.Next().text);
+            c.Next();
+            c.Next();
+        } else {
+            item.expr = this->ParseExpr(c);
+            size_t last = c.Position();
+            if (c.Accept("AS")) {
+                item.name = c.Peek().type == TOKEN_STRING ? c.Next().text : c.Name();
+            } else if (c.AtAlias()) {
+                item.name = c.Name();
+            } else if (item.expr->kind == Expr::COLUMN) {
+                item.name = item.expr->column;
+            } else {
+                item.name = c.Text(first, last);
+            }
+        }
+        items.push_back(std::move(item));
+    } while (c.AcceptSymbol(","));
+
+    Scope scope;
+    std::vector<std::unique_ptr<Table>> virtual_tables;
+    // Indexed by source.
+    std::vector<ExprPtr> on;
+    std::vector<bool> left_join;
+
+    if (c.Accept("FROM")) {
+        this->AddSource(c, scope, virtual_tables);
+        on.emplace_back();
+        left_join.push_back(false);
+
+        while (true) {
+            bool left = false;
+            if (c.Accept("LEFT")) {
+                c.Accept("OUTER");
+                c.Expect("JOIN");
+                left = true;
+            } else if (c.Accept("INNER") || c.Accept("CROSS")) {
+                c.Expect("JOIN");
+            } else if (!c.Accept("JOIN") && !c.AcceptSymbol(",")) {
+                break;
+            }
+
+            this->AddSource(c, scope, virtual_tables);
+            ExprPtr condition;
+            if (c.Accept("ON")) {
+                condition = this->ParseExpr(c);
+            } else if (c.Is("USING")) {
+                Unsupported("JOIN ... USING");
+            }
+            on.push_back(std::move(condition));
+            left_join.push_back(left);
+        }
+    }
+
+    ExprPtr where;
+    if (c.Accept("WHERE")) {
+        where = this->ParseExpr(c);
+    }
+    if (c.Is("GROUP") || c.Is("HAVING") || c.Is("UNION")) {
+        Unsupported(ToUpper(c.Peek().text));
+    }
+
+    struct Order {
+        ExprPtr expr;
+        bool descending = false;
+        // Index of the select item the term names, -1 if it's an expression.
+        int item = -1;
+    };
+
+    std::vector<Order> order;
+    if (c.Accept("ORDER")) {
+        c.Expect("BY");
+        do {
+            Order term;
+            term.expr = this->ParseExpr(c);
+            term.descending = c.Accept("DESC");
+            if (!term.descending) {
+                c.Accept("ASC");
+            }
+            order.push_back(std::move(term));
+        } while (c.AcceptSymbol(","));
+    }
+
+    uint64_t offset = 0;
+    uint64_t limit = UINT64_MAX;
+    if (c.Accept("LIMIT")) {
+        limit = this->ParseCount(c);
+        if (c.AcceptSymbol(",")) {
+            offset = limit;
+            limit = this->ParseCount(c);
+        } else if (c.Accept("OFFSET")) {
+            offset = this->ParseCount(c);
+        }
+    }
+
+    // Only one query runs at a time, the rows are locked anyway.
+    if (c.Accept("FOR")) {
+        c.Expect("UPDATE");
+    } else if (c.Accept("LOCK")) {
+        c.Expect("IN");
+        c.Expect("SHARE");
+        c.Expect("MODE");
+    }
+
+    // Resolve the names.
+    std::vector<Item> columns;
+    for (auto& item : items) {
+        if (!item.star) {
+            Bind(*item.expr, scope, scope.sources.size());
+            columns.push_back(std::move(item));
+            continue;
+        }
+
+        if (scope.sources.empty()) {
+            Fail("No tables used");
+        }
+        bool found = false;
+        for (size_t i = 0; i < scope.sources.size(); i++) {
+            const Source& source = scope.sources[i];
+            if (!item.star_table.empty() && item.star_table != source.alias) {
+                continue;
+            }
+            found = true;
+            for (size_t j = 0; j < source.table->columns.size(); j++) {
+                Item column;
+                column.expr = std::make_unique<Expr>();
+                column.expr->kind = Expr::COLUMN;
+                column.expr->source = i;
+                column.expr->index = j;
+                column.name = source.table->columns[j].name;
+                columns.push_back(std::move(column));
+            }
+        }
+        if (!found) {
+            Fail(Format("Unknown table '%s'", item.star_table.c_str()));
+        }
+    }
+
+    for (size_t i = 0; i < on.size(); i++) {
+        if (on[i]) {
+            Bind(*on[i], scope, i + 1);
+        }
+    }
+    if (where) {
+        Bind(*where, scope, scope.sources.size());
+    }
+    for (auto& term : order) {
+        // ORDER BY names a select item first, as in MySQL.
+        if (term.expr->kind == Expr::COLUMN && term.expr->table.empty()) {
+            for (size_t i = 0; i < columns.size(); i++) {
+                if (EqualsNoCase(columns[i].name, term.expr->column.c_str())) {
+                    term.item = static_cast<int>(i);
+                    break;
+                }
+            }
+        }
+        if (term.item < 0) {
+            Bind(*term.expr, scope, scope.sources.size());
+        }
+    }
+
+    bool aggregate = std::any_of(columns.begin(), columns.end(), [](const Item& item) { return item.expr->kind == Expr::AGGREGATE; });
+
+    // Rows of all sources that pass ON and WHERE.
+    std::vector<std::vector<const Row*>> matches;
+    uint64_t wanted = (order.empty() && !aggregate && limit != UINT64_MAX) ? offset + limit : UINT64_MAX;
+
+    auto join = [&](auto& self, size_t level) -> void {
+        if (matches.size() >= wanted) {
+            return;
+        }
+        if (level == scope.sources.size()) {
+            if (!where || IsTrue(Evaluate(*where, scope))) {
+                std::vector<const Row*> match;
+                for (const Source& source : scope.sources) {
+                    match.push_back(source.row);
+                }
+                matches.push_back(std::move(match));
+            }
+            return;
+        }
+
+        Source& source = scope.sources[level];
+        bool matched = false;
+        for (const auto& [id, row] : source.table->rows) {
+            source.row = &row;
+            if (on[level] && !IsTrue(Evaluate(*on[level], scope))) {
+                continue;
+            }
+            matched = true;
+            self(self, level + 1);
+        }
+        if (!matched && left_join[level]) {
+            source.row = nullptr;
+            self(self, level + 1);
+        }
+        source.row = nullptr;
+    };
+    join(join, 0);
+
+    auto use = [&](const std::vector<const Row*>& match) {
+        for (size_t i = 0; i < match.size(); i++) {
+            scope.sources[i].row = match[i];
+        }
+    };
+
+    auto result = std::make_unique<Result>();
+    for (const auto& column : columns) {
+        result->names.push_back(column.name);
+    }
+
+    if (aggregate) {
+        Row row;
+        for (const auto& column : columns) {
+            const Expr& expr = *column.expr;
+            if (expr.kind != Expr::AGGREGATE) {
+                if (!matches.empty()) {
+                    use(matches[0]);
+                }
+                row.push_back(matches.empty() ? std::nullopt : Evaluate(expr, scope));
+                continue;
+            }
+
+            long long count = 0;
+            Value best;
+            bool integral = true;
+            long long sum = 0;
+            double sum_double = 0;
+            for (const auto& match : matches) {
+                use(match);
+                if (expr.args.empty()) {
+                    count++;
+                    continue;
+                }
+                Value value = Evaluate(*expr.args[0], scope);
+                if (!value) {
+                    continue;
+                }
+                count++;
+                Number number = ToNumber(*value);
+                integral = integral && number.integral;
+                sum += number.i;
+                sum_double += number.d;
+                if (!best || (expr.op == "MIN" ? Compare(*value, *best) < 0 : Compare(*value, *best) > 0)) {
+                    best = value;
+                }
+            }
+
+            if (expr.op == "COUNT") {
+                row.push_back(FormatInteger(count));
+            } else if (count == 0) {
+                row.push_back(std::nullopt);
+            } else if (expr.op == "SUM") {
+                row.push_back(integral ? FormatInteger(sum) : FormatDouble(sum_double));
+            } else if (expr.op == "AVG") {
+                row.push_back(FormatDouble(sum_double / count));
+            } else {
+                row.push_back(best);
+            }
+        }
+        if (offset == 0 && limit > 0) {
+            result->rows.push_back(std::move(row));
+        }
+    } else {
+        if (!order.empty()) {
+            std::vector<std::vector<Value>> keys(matches.size());
+            for (size_t i = 0; i < matches.size(); i++) {
+                use(matches[i]);
+                for (const auto& term : order) {
+                    keys[i].push_back(Evaluate(term.item >= 0 ? *columns[term.item].expr : *term.expr, scope));
+                }
+            }
+
+            std::vector<size_t> sorted(matches.size());
+            std::iota(sorted.begin(), sorted.end(), 0);
+            std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+                for (size_t i = 0; i < order.size(); i++) {
+                    const Value& x = keys[a][i];
+                    const Value& y = keys[b][i];
+                    // NULLs first.
+                    int c = (!x || !y) ? (y.has_value() - x.has_value()) * -1 : Compare(*x, *y);
+                    if (c != 0) {
+                        return order[i].descending ? c > 0 : c < 0;
+                    }
+                }
+                return false;
+            });
+
+            std::vector<std::vector<const Row*>> ordered;
+            for (size_t i : sorted) {
+                ordered.push_back(std::move(matches[i]));
+            }
+            matches = std::move(ordered);
+        }
+
+        for (uint64_t i = offset; i < matches.size() && i - offset < limit; i++) {
+            use(matches[i]);
+            Row row;
+            for (const auto& column : columns) {
+                row.push_back(Evaluate(*column.expr, scope));
+            }
+            result->rows.push_back(std::move(row));
+        }
+    }
+
+    result->MakeFields();
+    return result;
+}
+
+std::vector<std::pair<size_t, ExprPtr>> Memory::State::ParseAssignments(Cursor& c, const Table& table) {
+    std::vector<std::pair<size_t, ExprPtr>> assignments;
+    do {
+        std::string name = c.Name();
+        if (c.AcceptSymbol(".")) {
+            name = c.Name();
+        }
+        int index = table.Find(name);
+        if (index < 0) {
+            Fail(Format("Unknown column '%s' in 'field list'", name.c_str()));
+        }
+        c.ExpectSymbol("=");
+        assignments.emplace_back(index, this->ParseExpr(c));
+    } while (c.AcceptSymbol(","));
+    return assignments;
+}
+
+void Memory::State::Insert(Cursor& c) {
+    c.Expect("INSERT");
+    c.Accept("LOW_PRIORITY");
+    bool ignore = c.Accept("IGNORE");
+    c.Accept("INTO");
+
+    Table& table = this->GetTable(this->ParseTableName(c));
+    std::string table_key = ToLower(table.name);
+
+    std::vector<size_t> columns;
+    if (c.AcceptSymbol("(")) {
+        do {
+            std::string name = c.Name();
+            int index = table.Find(name);
+            if (index < 0) {
+                Fail(Format("Unknown column '%s' in 'field list'", name.c_str()));
+            }
+            columns.push_back(index);
+        } while (c.AcceptSymbol(","));
+        c.ExpectSymbol(")");
+    } else {
+        for (size_t i = 0; i < table.columns.size(); i++) {
+            columns.push_back(i);
+        }
+    }
+
+    if (c.Is("SELECT") || c.Is("SET")) {
+        Unsupported("INSERT ... " + ToUpper(c.Peek().text));
+    }
+    if (!c.Accept("VALUES")) {
+        c.Expect("VALUE");
+    }
+
+    std::vector<std::vector<ExprPtr>> tuples;
+    do {
+        c.ExpectSymbol("(");
+        std::vector<ExprPtr> tuple;
+        if (!c.IsSymbol(")")) {
+            do {
+                tuple.push_back(this->ParseExpr(c));
+            } while (c.AcceptSymbol(","));
+        }
+        c.ExpectSymbol(")");
+        if (tuple.size() != columns.size()) {
+            Fail(Format("Column count doesn't match value count at row %d", static_cast<int>(tuples.size() + 1)));
+        }
+        tuples.push_back(std::move(tuple));
+    } while (c.AcceptSymbol(","));
+
+    std::vector<std::pair<size_t, ExprPtr>> updates;
+    if (c.Accept("ON")) {
+        c.Expect("DUPLICATE");
+        c.Expect("KEY");
+        c.Expect("UPDATE");
+        updates = this->ParseAssignments(c, table);
+    }
+
+    Scope no_columns;
+    Scope scope;
+    scope.sources.push_back(Source{&table, table_key});
+    scope.values_table = &table;
+    for (auto& tuple : tuples) {
+        for (auto& expr : tuple) {
+            Bind(*expr, no_columns, 0);
+        }
+    }
+    for (auto& [column, expr] : updates) {
+        Bind(*expr, scope, 1);
+    }
+
+    int auto_column = table.AutoIncrementColumn();
+    long long first_id = 0;
+    int affected = 0;
+
+    for (const auto& tuple : tuples) {
+        Row row(table.columns.size());
+        std::vector<bool> given(table.columns.size(), false);
+        for (size_t i = 0; i < columns.size(); i++) {
+            row[columns[i]] = Evaluate(*tuple[i], no_columns);
+            given[columns[i]] = true;
+        }
+
+        for (size_t i = 0; i < table.columns.size(); i++) {
+            if (static_cast<int>(i) == auto_column) {
+                // NULL and 0 take the next ID, once the row is really inserted.
+                if (!given[i] || !row[i] || ToNumber(*row[i]).d == 0) {
+                    row[i] = std::nullopt;
+                } else {
+                    row[i] = Store(table.columns[i], row[i]);
+                }
+            } else {
+                row[i] = given[i] ? Store(table.columns[i], row[i]) : Default(table.columns[i]);
+            }
+        }
+
+        uint64_t conflict = 0;
+        if (const Key* key = FindConflict(table, row, 0, conflict)) {
+            if (updates.empty()) {
+                if (ignore) {
+                    continue;
+                }
+                Fail(DuplicateEntry(table, *key, row));
+            }
+
+            Row& existing = table.rows[conflict];
+            Row updated = existing;
+            scope.sources[0].row = &updated;
+            scope.values = &row;
+            for (const auto& [column, expr] : updates) {
+                Value value = Store(table.columns[column], Evaluate(*expr, scope));
+                updated[column] = std::move(value);
+            }
+            scope.sources[0].row = nullptr;
+            scope.values = nullptr;
+
+            // Same as MySQL: 2 for an updated row, 0 if nothing changed.
+            if (updated == existing) {
+                continue;
+            }
+            uint64_t other = 0;
+            if (const Key* duplicate = FindConflict(table, updated, conflict, other)) {
+                Fail(DuplicateEntry(table, *duplicate, updated));
+            }
+            this->undo.push_back(Undo{table_key, conflict, existing});
+            existing = std::move(updated);
+            affected += 2;
+            continue;
+        }
+
+        if (auto_column >= 0) {
+            if (!row[auto_column]) {
+                long long id = table.auto_increment++;
+                row[auto_column] = FormatInteger(id);
+                if (first_id == 0) {
+                    first_id = id;
+                }
+            } else {
+                long long id = ToNumber(*row[auto_column]).i;
+                table.auto_increment = std::max(table.auto_increment, id + 1);
+            }
+        }
+
+        uint64_t id = table.next_row++;
+        table.rows.emplace(id, std::move(row));
+        this->undo.push_back(Undo{table_key, id, std::nullopt});
+        affected++;
+    }
+
+    if (first_id != 0) {
+        this->last_insert_id = first_id;
+    }
+    this->affected_rows = affected;
+}
+
+void Memory::State::Update(Cursor& c) {
+    c.Expect("UPDATE");
+    c.Accept("LOW_PRIORITY");
+    c.Accept("IGNORE");
+
+    std::string name = this->ParseTableName(c);
+    Table& table = this->GetTable(name);
+    std::string table_key = ToLower(table.name);
+
+    std::string alias = ToLower(name);
+    if (c.Accept("AS") || c.AtAlias()) {
+        alias = ToLower(c.Name());
+    }
+    if (c.IsSymbol(",") || c.Is("JOIN") || c.Is("LEFT") || c.Is("INNER")) {
+        Unsupported("multi-table UPDATE");
+    }
+
+    c.Expect("SET");
+    std::vector<std::pair<size_t, ExprPtr>> assignments = this->ParseAssignments(c, table);
+
+    ExprPtr where;
+    if (c.Accept("WHERE")) {
+        where = this->ParseExpr(c);
+    }
+    if (c.Is("ORDER")) {
+        Unsupported("UPDATE ... ORDER BY");
+    }
+    uint64_t limit = UINT64_MAX;
+    if (c.Accept("LIMIT")) {
+        limit = this->ParseCount(c);
+    }
+
+    Scope scope;
+    scope.sources.push_back(Source{&table, alias});
+    for (auto& [column, expr] : assignments) {
+        Bind(*expr, scope, 1);
+    }
+    if (where) {
+        Bind(*where, scope, 1);
+    }
+
+    uint64_t matched = 0;
+    int changed = 0;
+    for (auto& [id, row] : table.rows) {
+        if (matched >= limit) {
+            break;
+        }
+        scope.sources[0].row = &row;
+        if (where && !IsTrue(Evaluate(*where, scope))) {
+            continue;
+        }
+        matched++;
+
+        // Assignments see the ones before them, as in MySQL.
+        Row updated = row;
+        scope.sources[0].row = &updated;
+        for (const auto& [column, expr] : assignments) {
+            Value value = Store(table.columns[column], Evaluate(*expr, scope));
+            updated[column] = std::move(value);
+        }
+        if (updated == row) {
+            continue;
+        }
+
+        uint64_t other = 0;
+        if (const Key* key = FindConflict(table, updated, id, other)) {
+            Fail(DuplicateEntry(table, *key, updated));
+        }
+        this->undo.push_back(Undo{table_key, id, row});
+        row = std::move(updated);
+        changed++;
+    }
+
+    this->affected_rows = changed;
+}
+
+void Memory::State::Delete(Cursor& c) {
+    c.Expect("DELETE");
+    c.Accept("LOW_PRIORITY");
+    c.Accept("QUICK");
+    c.Accept("IGNORE");
+    if (!c.Accept("FROM")) {
+        Unsupported("multi-table DELETE");
+    }
+
+    std::string name = this->ParseTableName(c);
+    Table& table = this->GetTable(name);
+    std::string table_key = ToLower(table.name);
+
+    std::string alias = ToLower(name);
+    if (c.Accept("AS") || c.AtAlias()) {
+        alias = ToLower(c.Name());
+    }
+    if (c.IsSymbol(",") || c.Is("JOIN") || c.Is("USING")) {
+        Unsupported("multi-table DELETE");
+    }
+
+    ExprPtr where;
+    if (c.Accept("WHERE")) {
+        where = this->ParseExpr(c);
+    }
+    // Expressions and DESC.
+    std::vector<std::pair<ExprPtr, bool>> order;
+    if (c.Accept("ORDER")) {
+        c.Expect("BY");
+        do {
+            ExprPtr expr = this->ParseExpr(c);
+            bool descending = c.Accept("DESC");
+            if (!descending) {
+                c.Accept("ASC");
+            }
+            order.emplace_back(std::move(expr), descending);
+        } while (c.AcceptSymbol(","));
+    }
+    uint64_t limit = UINT64_MAX;
+    if (c.Accept("LIMIT")) {
+        limit = this->ParseCount(c);
+    }
+
+    Scope scope;
+    scope.sources.push_back(Source{&table, alias});
+    if (where) {
+        Bind(*where, scope, 1);
+    }
+    for (auto& term : order) {
+        Bind(*term.first, scope, 1);
+    }
+
+    // Ids of the matching rows, with their ORDER BY keys.
+    std::vector<std::pair<uint64_t, std::vector<Value>>> matches;
+    for (auto& [id, row] : table.rows) {
+        scope.sources[0].row = &row;
+        if (where && !IsTrue(Evaluate(*where, scope))) {
+            continue;
+        }
+        std::vector<Value> keys;
+        for (const auto& term : order) {
+            keys.push_back(Evaluate(*term.first, scope));
+        }
+        matches.emplace_back(id, std::move(keys));
+        if (order.empty() && matches.size() >= limit) {
+            break;
+        }
+    }
+    scope.sources[0].row = nullptr;
+
+    if (!order.empty()) {
+        std::stable_sort(matches.begin(), matches.end(), [&](const auto& a, const auto& b) {
+            for (size_t i = 0; i < order.size(); i++) {
+                const Value& x = a.second[i];
+                const Value& y = b.second[i];
+                // NULLs first.
+                int c = (!x || !y) ? x.has_value() - y.has_value() : Compare(*x, *y);
+                if (c != 0) {
+                    return order[i].second ? c > 0 : c < 0;
+                }
+            }
+            return false;
+        });
+    }
+
+    uint64_t deleted = 0;
+    for (const auto& match : matches) {
+        if (deleted >= limit) {
+            break;
+        }
+        auto it = table.rows.find(match.first);
+        this->undo.push_back(Undo{table_key, it->first, std::move(it->second)});
+        table.rows.erase(it);
+        deleted++;
+    }
+
+    this->affected_rows = static_cast<int>(deleted);
+}
+
+// A column definition: `name` TYPE(size) [UNSIGNED] [NOT NULL] [DEFAULT x] [AUTO_INCREMENT] [COMMENT '...'] ...
+Column Memory::State::ParseColumn(Cursor& c, bool& primary, bool& unique) {
+    static const char* const integer_types[] = {"TINYINT", "SMALLINT", "MEDIUMINT", "INT", "INTEGER", "BIGINT", "BOOL", "BOOLEAN"};
+
+    Column column;
+    column.name = c.Name();
+
+    if (c.Peek().type != TOKEN_WORD) {
+        c.SyntaxError();
+    }
+    column.type = ToLower(c.Next().text);
+    column.column_type = column.type;
+    column.integer = std::any_of(std::begin(integer_types), std::end(integer_types), [&](const char* type) { return EqualsNoCase(column.type, type); });
+
+    if (c.IsSymbol("(")) {
+        size_t first = c.Position();
+        while (!c.AtEnd() && !c.IsSymbol(")")) {
+            c.Next();
+        }
+        c.ExpectSymbol(")");
+        column.column_type += c.Text(first, c.Position());
+    }
+
+    primary = false;
+    unique = false;
+    while (!c.AtEnd() && !c.IsSymbol(",") && !c.IsSymbol(")")) {
+        if (c.Accept("UNSIGNED")) {
+            column.column_type += " unsigned";
+        } else if (c.Accept("SIGNED") || c.Accept("ZEROFILL") || c.Accept("BINARY")) {
+        } else if (c.Accept("NOT")) {
+            c.Expect("NULL");
+            column.nullable = false;
+        } else if (c.Accept("NULL")) {
+            column.nullable = true;
+        } else if (c.Accept("AUTO_INCREMENT")) {
+            column.auto_increment = true;
+        } else if (c.Accept("DEFAULT")) {
+            column.has_default = true;
+            if (c.Accept("CURRENT_TIMESTAMP")) {
+                column.default_now = true;
+                if (c.AcceptSymbol("(")) {
+                    c.ExpectSymbol(")");
+                }
+            } else {
+                ExprPtr expr = this->ParseUnary(c);
+                column.default_value = Evaluate(*expr, Scope{});
+            }
+        } else if (c.Accept("ON")) {
+            c.Expect("UPDATE");
+            c.Next();
+            if (c.AcceptSymbol("(")) {
+                c.ExpectSymbol(")");
+            }
+        } else if (c.Accept("COMMENT")) {
+            c.Next();
+        } else if (c.Accept("CHARACTER")) {
+            c.Expect("SET");
+            c.Next();
+        } else if (c.Accept("CHARSET") || c.Accept("COLLATE")) {
+            c.Next();
+        } else if (c.Accept("PRIMARY")) {
+            c.Expect("KEY");
+            primary = true;
+        } else if (c.Accept("UNIQUE")) {
+            c.Accept("KEY");
+            unique = true;
+        } else if (c.Accept("KEY")) {
+            primary = true;
+        } else {
+            c.SyntaxError();
+        }
+    }
+
+    if (primary) {
+        column.nullable = false;
+    }
+    return column;
+}
+
+// (`a`, `b`(10), `c` DESC)
+std::vector<std::string> Memory::State::ParseKeyColumns(Cursor& c) {
+    std::vector<std::string> columns;
+    c.ExpectSymbol("(");
+    do {
+        columns.push_back(c.Name());
+        if (c.AcceptSymbol("(")) {
+            this->ParseCount(c);
+            c.ExpectSymbol(")");
+        }
+        if (!c.Accept("ASC")) {
+            c.Accept("DESC");
+        }
+    } while (c.AcceptSymbol(","));
+    c.ExpectSymbol(")");
+    return columns;
+}
+
+void Memory::State::AddKey(Table& table, std::string name, const std::vector<std::string>& columns, bool unique, bool primary) {
+    Key key;
+    key.unique = unique || primary;
+    for (const auto& column : columns) {
+        int index = table.Find(column);
+        if (index < 0) {
+            Fail(Format("Key column '%s' doesn't exist in table", column.c_str()));
+        }
+        key.columns.push_back(index);
+    }
+
+    auto exists = [&](const std::string& candidate) {
+        return std::any_of(table.keys.begin(), table.keys.end(), [&](const Key& other) { return EqualsNoCase(other.name, candidate.c_str()); });
+    };
+
+    if (primary) {
+        if (exists("PRIMARY")) {
+            Fail("Multiple primary key defined");
+        }
+        key.name = "PRIMARY";
+        for (size_t column : key.columns) {
+            table.columns[column].nullable = false;
+        }
+    } else if (name.empty()) {
+        // Named after the first column, as in MySQL.
+        std::string base = table.columns[key.columns[0]].name;
+        key.name = base;
+        for (int i = 2; exists(key.name); i++) {
+            key.name = base + "_" + std::to_string(i);
+        }
+    } else if (exists(name)) {
+        Fail(Format("Duplicate key name '%s'", name.c_str()));
+    } else {
+        key.name = std::move(name);
+    }
+
+    if (key.unique) {
+        std::set<Row> seen;
+        for (const auto& [id, row] : table.rows) {
+            Row values;
+            for (size_t column : key.columns) {
+                values.push_back(row[column]);
+            }
+            if (std::any_of(values.begin(), values.end(), [](const Value& value) { return !value; })) {
+                continue;
+            }
+            if (!seen.insert(values).second) {
+                Fail(DuplicateEntry(table, key, row));
+            }
+        }
+    }
+
+    table.keys.push_back(std::move(key));
+}
+
+void Memory::State::Create(Cursor& c) {
+    c.Expect("CREATE");
+    if (c.Is("TEMPORARY")) {
+        Unsupported("CREATE TEMPORARY TABLE");
+    }
+
+    // CREATE [UNIQUE] INDEX name ON table (columns)
+    bool unique_index = c.Accept("UNIQUE");
+    if (unique_index || c.Is("INDEX")) {
+        c.Expect("INDEX");
+        std::string name = c.Name();
+        c.Expect("ON");
+        Table& table = this->GetTable(this->ParseTableName(c));
+        Table altered = table;
+        this->AddKey(altered, name, this->ParseKeyColumns(c), unique_index, false);
+        table = std::move(altered);
+        return;
+    }
+
+    c.Expect("TABLE");
+    bool if_not_exists = false;
+    if (c.Accept("IF")) {
+        c.Expect("NOT");
+        c.Expect("EXISTS");
+        if_not_exists = true;
+    }
+
+    std::string name = this->ParseTableName(c);
+    if (this->tables.count(ToLower(name))) {
+        if (!if_not_exists) {
+            Fail(Format("Table '%s' already exists", name.c_str()));
+        }
+        while (!c.AtEnd()) {
+            c.Next();
+        }
+        return;
+    }
+
+    struct KeySpec {
+        std::string name;
+        std::vector<std::string> columns;
+        bool unique;
+        bool primary;
+    };
+
+    Table table;
+    table.name = name;
+    std::vector<KeySpec> keys;
+
+    c.ExpectSymbol("(");
+    do {
+        if (c.Accept("PRIMARY")) {
+            c.Expect("KEY");
+            keys.push_back(KeySpec{"", this->ParseKeyColumns(c), true, true});
+        } else if (c.Is("UNIQUE") || c.Is("KEY") || c.Is("INDEX")) {
+            bool unique = c.Accept("UNIQUE");
+            if (!c.Accept("KEY")) {
+                c.Accept("INDEX");
+            }
+            std::string key_name = c.IsSymbol("(") ? "" : c.Name();
+            keys.push_back(KeySpec{key_name, this->ParseKeyColumns(c), unique, false});
+        } else if (c.Is("CONSTRAINT") || c.Is("FOREIGN") || c.Is("FULLTEXT") || c.Is("SPATIAL") || c.Is("CHECK")) {
+            Unsupported(ToUpper(c.Peek().text) + " in CREATE TABLE");
+        } else {
+            bool primary = false;
+            bool unique = false;
+            Column column = this->ParseColumn(c, primary, unique);
+            if (table.Find(column.name) >= 0) {
+                Fail(Format("Duplicate column name '%s'", column.name.c_str()));
+            }
+            if (primary || unique) {
+                keys.push_back(KeySpec{"", {column.name}, unique, primary});
+            }
+            table.columns.push_back(std::move(column));
+        }
+    } while (c.AcceptSymbol(","));
+    c.ExpectSymbol(")");
+
+    if (c.Is("AS") || c.Is("SELECT") || c.Is("LIKE")) {
+        Unsupported("CREATE TABLE ... " + ToUpper(c.Peek().text));
+    }
+    // ENGINE, DEFAULT CHARSET and other table options don't matter here.
+    while (!c.AtEnd()) {
+        c.Next();
+    }
+
+    for (const auto& key : keys) {
+        this->AddKey(table, key.name, key.columns, key.unique, key.primary);
+    }
+    this->tables.emplace(ToLower(name), std::move(table));
+}
+
+void Memory::State::Alter(Cursor& c) {
+    c.Expect("ALTER");
+    c.Accept("IGNORE");
+    c.Expect("TABLE");
+
+    Table& table = this->GetTable(this->ParseTableName(c));
+    // Changes go to a copy, so that a failed ALTER changes nothing.
+    Table altered = table;
+    std::string rename;
+
+    do {
+        if (c.Accept("ADD")) {
+            if (c.Accept("PRIMARY")) {
+                c.Expect("KEY");
+                this->AddKey(altered, "", this->ParseKeyColumns(c), true, true);
+            } else if (c.Is("UNIQUE") || c.Is("KEY") || c.Is("INDEX")) {
+                bool unique = c.Accept("UNIQUE");
+                if (!c.Accept("KEY")) {
+                    c.Accept("INDEX");
+                }
+                std::string name = c.IsSymbol("(") ? "" : c.Name();
+                this->AddKey(altered, name, this->ParseKeyColumns(c), unique, false);
+            } else {
+                c.Accept("COLUMN");
+                bool primary = false;
+                bool unique = false;
+                Column column = this->ParseColumn(c, primary, unique);
+                if (altered.Find(column.name) >= 0) {
+                    Fail(Format("Duplicate column name '%s'", column.name.c_str()));
+                }
+
+                size_t position = altered.columns.size();
+                if (c.Accept("FIRST")) {
+                    position = 0;
+                } else if (c.Accept("AFTER")) {
+                    std::string after = c.Name();
+                    int index = altered.Find(after);
+                    if (index < 0) {
+                        Fail(Format("Unknown column '%s' in '%s'", after.c_str(), altered.name.c_str()));
+                    }
+                    position = index + 1;
+                }
+
+                for (auto& key : altered.keys) {
+                    for (size_t& index : key.columns) {
+                        if (index >= position) {
+                            index++;
+                        }
+                    }
+                }
+                for (auto& [id, row] : altered.rows) {
+                    row.insert(row.begin() + position, Default(column));
+                }
+                std::string name = column.name;
+                altered.columns.insert(altered.columns.begin() + position, std::move(column));
+                if (primary || unique) {
+                    this->AddKey(altered, "", {name}, unique, primary);
+                }
+            }
+        } else if (c.Accept("DROP")) {
+            bool primary = c.Accept("PRIMARY");
+            if (primary || c.Accept("INDEX") || c.Accept("KEY")) {
+                std::string name = "PRIMARY";
+                if (primary) {
+                    c.Expect("KEY");
+                } else {
+                    name = c.Name();
+                }
+                auto key = std::find_if(altered.keys.begin(), altered.keys.end(), [&](const Key& k) { return EqualsNoCase(k.name, name.c_str()); });
+                if (key == altered.keys.end()) {
+                    Fail(Format("Can't DROP '%s'; check that column/key exists", name.c_str()));
+                }
+                altered.keys.erase(key);
+            } else {
+                c.Accept("COLUMN");
+                std::string name = c.Name();
+                int index = altered.Find(name);
+                if (index < 0) {
+                    Fail(Format("Can't DROP '%s'; check that column/key exists", name.c_str()));
+                }
+                for (auto& key : altered.keys) {
+                    key.columns.erase(std::remove(key.columns.begin(), key.columns.end(), static_cast<size_t>(index)), key.columns.end());
+                    for (size_t& column : key.columns) {
+                        if (column > static_cast<size_t>(index)) {
+                            column--;
+                        }
+                    }
+                }
+                altered.keys.erase(std::remove_if(altered.keys.begin(), altered.keys.end(), [](const Key& key) { return key.columns.empty(); }), altered.keys.end());
+                for (auto& [id, row] : altered.rows) {
+                    row.erase(row.begin() + index);
+                }
+                altered.columns.erase(altered.columns.begin() + index);
+            }
+        } else if (c.Is("MODIFY") || c.Is("CHANGE")) {
+            bool change = c.Accept("CHANGE");
+            if (!change) {
+                c.Expect("MODIFY");
+            }
+            c.Accept("COLUMN");
+
+            std::string name = change ? c.Name() : c.Peek().text;
+            int index = altered.Find(name);
+            if (index < 0) {
+                Fail(Format("Unknown column '%s' in '%s'", name.c_str(), altered.name.c_str()));
+            }
+
+            bool primary = false;
+            bool unique = false;
+            Column column = this->ParseColumn(c, primary, unique);
+            if (c.Is("FIRST") || c.Is("AFTER")) {
+                Unsupported("moving columns");
+            }
+            if (change && !EqualsNoCase(column.name, name.c_str()) && altered.Find(column.name) >= 0) {
+                Fail(Format("Duplicate column name '%s'", column.name.c_str()));
+            }
+
+            // The values are converted to the new type. NULLs in a column that became NOT NULL get the default.
+            for (auto& [id, row] : altered.rows) {
+                Value& value = row[index];
+                value = value ? Store(column, value) : Default(column);
+            }
+            std::string column_name = column.name;
+            altered.columns[index] = std::move(column);
+            if (primary || unique) {
+                this->AddKey(altered, "", {column_name}, unique, primary);
+            }
+        } else if (c.Accept("RENAME")) {
+            if (!c.Accept("TO")) {
+                c.Accept("AS");
+            }
+            rename = this->ParseTableName(c);
+        } else {
+            Unsupported("ALTER TABLE " + ToUpper(c.Peek().text));
+        }
+    } while (c.AcceptSymbol(","));
+
+    if (rename.empty()) {
+        table = std::move(altered);
+        return;
+    }
+
+    if (this->tables.count(ToLower(rename))) {
+        Fail(Format("Table '%s' already exists", rename.c_str()));
+    }
+    std::string old_key = ToLower(table.name);
+    altered.name = rename;
+    this->tables.erase(old_key);
+    this->tables.emplace(ToLower(rename), std::move(altered));
+}
+
+void Memory::State::Drop(Cursor& c) {
+    c.Expect("DROP");
+    c.Accept("TEMPORARY");
+    c.Expect("TABLE");
+    bool if_exists = false;
+    if (c.Accept("IF")) {
+        c.Expect("EXISTS");
+        if_exists = true;
+    }
+
+    do {
+        std::string name = this->ParseTableName(c);
+        if (!this->tables.erase(ToLower(name)) && !if_exists) {
+            Fail(Format("Unknown table '%s.%s'", this->database.c_str(), name.c_str()));
+        }
+    } while (c.AcceptSymbol(","));
+}
+
+void Memory::State::Rename(Cursor& c) {
+    c.Expect("RENAME");
+    c.Expect("TABLE");
+
+    do {
+        std::string from = this->ParseTableName(c);
+        c.Expect("TO");
+        std::string to = this->ParseTableName(c);
+
+        Table& table = this->GetTable(from);
+        if (this->tables.count(ToLower(to))) {
+            Fail(Format("Table '%s' already exists", to.c_str()));
+        }
+        Table renamed = std::move(table);
+        renamed.name = to;
+        this->tables.erase(ToLower(from));
+        this->tables.emplace(ToLower(to), std::move(renamed));
+    } while (c.AcceptSymbol(","));
+}
+
+void Memory::State::Truncate(Cursor& c) {
+    c.Expect("TRUNCATE");
+    c.Accept("TABLE");
+    Table& table = this->GetTable(this->ParseTableName(c));
+    table.rows.clear();
+    table.auto_increment = 1;
+}
+
+// INFORMATION_SCHEMA.COLUMNS, STATISTICS and TABLES, made from the tables as they are now.
+std::unique_ptr<Table> Memory::State::InformationSchema(const std::string& name) const {
+    auto table = std::make_unique<Table>();
+    table->name = ToUpper(name);
+
+    auto add = [&](Row row) {
+        uint64_t id = table->next_row++;
+        table->rows.emplace(id, std::move(row));
+    };
+
+    if (table->name == "COLUMNS") {
+        for (const char* column : {"TABLE_SCHEMA", "TABLE_NAME", "COLUMN_NAME", "COLUMN_DEFAULT", "IS_NULLABLE", "DATA_TYPE", "COLUMN_TYPE", "EXTRA"}) {
+            table->columns.push_back(MakeColumn(column, false));
+        }
+        table->columns.push_back(MakeColumn("ORDINAL_POSITION", true));
+
+        for (const auto& [key, source] : this->tables) {
+            for (size_t i = 0; i < source.columns.size(); i++) {
+                const Column& column = source.columns[i];
+                add(Row{
+                    this->database, source.name, column.name,
+                    column.has_default ? column.default_value : std::nullopt,
+                    std::string(column.nullable ? "YES" : "NO"), column.type, column.column_type,
+                    std::string(column.auto_increment ? "auto_increment" : ""),
+                    FormatInteger(static_cast<long long>(i + 1)),
+                });
+            }
+        }
+    } else if (table->name == "STATISTICS") {
+        for (const char* column : {"TABLE_SCHEMA", "TABLE_NAME", "INDEX_NAME", "COLUMN_NAME"}) {
+            table->columns.push_back(MakeColumn(column, false));
+        }
+        table->columns.push_back(MakeColumn("NON_UNIQUE", true));
+        table->columns.push_back(MakeColumn("SEQ_IN_INDEX", true));
+
+        for (const auto& [key, source] : this->tables) {
+            for (const auto& index : source.keys) {
+                for (size_t i = 0; i < index.columns.size(); i++) {
+                    add(Row{
+                        this->database, source.name, index.name, source.columns[index.columns[i]].name,
+                        std::string(index.unique ? "0" : "1"), FormatInteger(static_cast<long long>(i + 1)),
+                    });
+                }
+            }
+        }
+    } else if (table->name == "TABLES") {
+        table->columns.push_back(MakeColumn("TABLE_SCHEMA", false));
+        table->columns.push_back(MakeColumn("TABLE_NAME", false));
+        table->columns.push_back(MakeColumn("TABLE_ROWS", true));
+        table->columns.push_back(MakeColumn("AUTO_INCREMENT", true));
+
+        for (const auto& [key, source] : this->tables) {
+            add(Row{
+                this->database, source.name, FormatInteger(static_cast<long long>(source.rows.size())),
+                source.AutoIncrementColumn() >= 0 ? Value(FormatInteger(source.auto_increment)) : std::nullopt,
+            });
+        }
+    } else {
+        Fail(Format("Unknown table '%s' in information_schema", name.c_str()));
+    }
+
+    return table;
+}
+
+Memory::Memory(std::string database) : state(std::make_unique<State>(std::move(database))) {
+}
+
+Memory::~Memory() = default;
+
+bool Memory::Connected() {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    return this->state->connected;
+}
+
+void Memory::Close() {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    this->state->connected = false;
+}
+
+int Memory::Query(const std::string& query) {
+    int executed = 0;
+    return this->QueryMulti(query, executed) ? 0 : 1;
+}
+
+bool Memory::QueryMulti(const std::string& query, int& executed) {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    executed = 0;
+    this->state->error.clear();
+    this->state->result.reset();
+
+    if (!this->state->connected) {
+        this->state->error = "MySQL server has gone away";
+        return false;
+    }
+
+    try {
+        std::vector<Token> tokens = Tokenize(query);
+
+        // Statements end at `;`. Like the server, stops at the first one that fails.
+        size_t begin = 0;
+        for (size_t i = 0; i <= tokens.size(); i++) {
+            if (i < tokens.size() && !(tokens[i].type == TOKEN_SYMBOL && tokens[i].text == ";")) {
+                continue;
+            }
+            if (i > begin) {
+                Cursor cursor(query, tokens, begin, i);
+                this->state->Execute(cursor);
+                executed++;
+            }
+            begin = i + 1;
+        }
+
+        if (executed == 0) {
+            Fail("Query was empty");
+        }
+    } catch (const QueryError& e) {
+        this->state->error = e.message;
+        return false;
+    } catch (const std::exception& e) {
+        this->state->error = e.what();
+        return false;
+    }
+
+    return true;
+}
+
+MYSQL_RES* Memory::StoreResult() {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    return reinterpret_cast<MYSQL_RES*>(this->state->result.release());
+}
+
+void Memory::FreeResult(MYSQL_RES* result) {
+    delete AsResult(result);
+}
+
+int Memory::NumRows(MYSQL_RES* result) {
+    return result ? static_cast<int>(AsResult(result)->rows.size()) : 0;
+}
+
+MYSQL_ROW Memory::FetchRow(MYSQL_RES* result) {
+    Result* rows = AsResult(result);
+    if (!rows || rows->next >= rows->rows.size()) {
+        return nullptr;
+    }
+
+    Row& row = rows->rows[rows->next++];
+    for (size_t i = 0; i < row.size(); i++) {
+        rows->current[i] = row[i] ? row[i]->data() : nullptr;
+        rows->lengths[i] = row[i] ? static_cast<unsigned long>(row[i]->size()) : 0;
+    }
+    return rows->current.data();
+}
+
+unsigned long* Memory::FetchLengths(MYSQL_RES* result) {
+    return result ? AsResult(result)->lengths.data() : nullptr;
+}
+
+unsigned long Memory::NumFields(MYSQL_RES* result) {
+    return result ? static_cast<unsigned long>(AsResult(result)->names.size()) : 0;
+}
+
+MYSQL_FIELD* Memory::FetchFields(MYSQL_RES* result) {
+    return result ? AsResult(result)->fields.data() : nullptr;
+}
+
+int Memory::AffectedRows() {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    return this->state->affected_rows;
+}
+
+std::string Memory::Error() {
+    std::lock_guard<std::mutex> lock(this->state->mutex);
+    return this->state->error;
+}
+
+unsigned long Memory::ConnectionID() {
+    // One connection that never resets.
+    return 1;
+}
+
+} // namespace sql_backend
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "sql_backend.h"
+
+namespace sql_backend {
+
+// Tables in memory instead of a MySQL server, for tests and load benchmarks. Nothing survives the process.
+// Create the schema with `SQL_CreateTables`, the same as for a new MySQL database.
+//
+// Understands the SQL the hat sends:
+//   CREATE TABLE and CREATE INDEX with UNIQUE and PRIMARY keys, ALTER TABLE ADD/DROP/MODIFY/CHANGE, DROP TABLE;
+//   SELECT FROM tables [[LEFT] JOIN ... ON ...] [WHERE] [ORDER BY] [LIMIT], COUNT/SUM/MIN/MAX without GROUP BY;
+//   INSERT ... VALUES ... [ON DUPLICATE KEY UPDATE], UPDATE ... SET ... [WHERE],
+//   DELETE FROM ... [WHERE] [ORDER BY] [LIMIT];
+//   START TRANSACTION, COMMIT and ROLLBACK;
+//   SELECT from INFORMATION_SCHEMA.COLUMNS, STATISTICS and TABLES.
+// Expressions are comparisons, AND/OR/NOT, IS NULL, IN, arithmetic, `&`, `|`, row tuples, scalar subqueries and
+// a few functions: LOWER, UPPER, ABS, IF, IFNULL, CONCAT, NOW, VALUES and LAST_INSERT_ID. Anything else (GROUP BY,
+// LIKE, multi-table UPDATE) fails the query with an error, so a missing feature can't pass unnoticed.
+//
+// Every query scans the whole table: there are no indices besides the checks of the unique keys.
+class Memory : public Backend {
+public:
+    // `database` is what INFORMATION_SCHEMA reports as TABLE_SCHEMA.
+    explicit Memory(std::string database = "logins");
+    ~Memory() override;
+
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    bool Connected() override;
+    void Close() override;
+    int Query(const std::string& query) override;
+    bool QueryMulti(const std::string& query, int& executed) override;
+    MYSQL_RES* StoreResult() override;
+    void FreeResult(MYSQL_RES* result) override;
+    int NumRows(MYSQL_RES* result) override;
+    MYSQL_ROW FetchRow(MYSQL_RES* result) override;
+    unsigned long* FetchLengths(MYSQL_RES* result) override;
+    unsigned long NumFields(MYSQL_RES* result) override;
+    MYSQL_FIELD* FetchFields(MYSQL_RES* result) override;
+    int AffectedRows() override;
+    std::string Error() override;
+    unsigned long ConnectionID() override;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace sql_backend
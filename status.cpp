@@ -1,4 +1,5 @@
 #include "status.hpp"
+#include "admission.h"
 #include <fstream>
 #include <string>
 #include "server.hpp"
@@ -102,6 +103,17 @@ void ST_GenStatus()
         status += " </server>\n";
     }
 
+    // client connections dropped by CL_Admit since the start
+    admission::Counters adm = admission::limiter.Stats();
+    status += " <admission>\n";
+    status += Format("  <admitted>%llu</admitted>\n", (unsigned long long)adm.admitted);
+    status += Format("  <blocked>%llu</blocked>\n", (unsigned long long)adm.blocked);
+    status += Format("  <rate_limited>%llu</rate_limited>\n", (unsigned long long)adm.rate_limited);
+    status += Format("  <preauth_full>%llu</preauth_full>\n", (unsigned long long)adm.preauth_full);
+    status += Format("  <preauth>%u</preauth>\n", (unsigned)adm.preauth);
+    status += Format("  <buckets>%u</buckets>\n", (unsigned)adm.buckets);
+    status += " </admission>\n";
+
     status += "</status>";
 
     std::ofstream f_stat;
@@ -0,0 +1,79 @@
+#include "UnitTest++.h"
+
+#include "../admission.h"
+
+namespace
+{
+
+const uint32_t IP = 0x0A000001; // 10.0.0.1
+
+admission::Settings Settings(double rate, double burst, unsigned prefix_bits = 32, size_t max_preauth = 0) {
+    return admission::Settings{rate, burst, prefix_bits, max_preauth};
+}
+
+TEST(Admission_RefillsBuckets) {
+    admission::Limiter limiter;
+    auto settings = Settings(2, 3);
+
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP, false, 1000, settings));
+    }
+    CHECK_EQUAL(admission::RESULT_RATE, limiter.Admit(IP, false, 1000, settings));
+    // Another address has its own bucket.
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP + 1, false, 1000, settings));
+
+    // 2 per second: one more after half a second, never more than the burst.
+    CHECK_EQUAL(admission::RESULT_RATE, limiter.Admit(IP, false, 1400, settings));
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP, false, 1500, settings));
+    CHECK_EQUAL(admission::RESULT_RATE, limiter.Admit(IP, false, 1500, settings));
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP, false, 60000, settings));
+    }
+    CHECK_EQUAL(admission::RESULT_RATE, limiter.Admit(IP, false, 60000, settings));
+
+    admission::Counters stats = limiter.Stats();
+    CHECK_EQUAL(8u, stats.admitted);
+    CHECK_EQUAL(4u, stats.rate_limited);
+    CHECK_EQUAL(2u, stats.buckets);
+
+    // No limit.
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP, false, 60000, Settings(0, 0)));
+}
+
+TEST(Admission_SharesBucketsPerPrefix) {
+    admission::Limiter limiter;
+    auto settings = Settings(1, 2, 24);
+
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(0x0A000001, false, 0, settings));
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(0x0A0000FE, false, 0, settings));
+    CHECK_EQUAL(admission::RESULT_RATE, limiter.Admit(0x0A000077, false, 0, settings));
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(0x0A000101, false, 0, settings));
+    CHECK_EQUAL(2u, limiter.Stats().buckets);
+}
+
+TEST(Admission_CapsConnectionsBeforeLogin) {
+    admission::Limiter limiter;
+    auto settings = Settings(0, 0, 32, 2);
+
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP, false, 0, settings));
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP + 1, false, 0, settings));
+    CHECK_EQUAL(admission::RESULT_PREAUTH, limiter.Admit(IP + 2, false, 0, settings));
+    limiter.Authenticated();
+    CHECK_EQUAL(admission::RESULT_ADMITTED, limiter.Admit(IP + 2, false, 0, settings));
+
+    // Blocked addresses are dropped first and don't take a pre-auth slot.
+    CHECK_EQUAL(admission::RESULT_BLOCKED, limiter.Admit(IP + 3, true, 0, Settings(0, 0)));
+
+    admission::Counters stats = limiter.Stats();
+    CHECK_EQUAL(3u, stats.admitted);
+    CHECK_EQUAL(1u, stats.blocked);
+    CHECK_EQUAL(1u, stats.preauth_full);
+    CHECK_EQUAL(2u, stats.preauth);
+
+    limiter.Authenticated();
+    limiter.Authenticated();
+    limiter.Authenticated();
+    CHECK_EQUAL(0u, limiter.Stats().preauth);
+}
+
+}
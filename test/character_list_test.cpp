@@ -0,0 +1,72 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../character_list.h"
+
+namespace
+{
+
+std::vector<CharacterInfo> List(std::initializer_list<unsigned long> ids) {
+    std::vector<CharacterInfo> info;
+    for (unsigned long id : ids) {
+        info.push_back(CharacterInfo{id, id + 1});
+    }
+    return info;
+}
+
+TEST(CharacterList_CachesLoginIds) {
+    character_list::Cache cache;
+
+    CHECK(!cache.LoginID("Player").has_value());
+    cache.SetLoginID("Player", 7);
+    CHECK_EQUAL(7, cache.LoginID("PLAYER").value_or(-1));
+    // Cyrillic is folded the same way as by MySQL.
+    cache.SetLoginID("\x80\x81", 8);
+    CHECK_EQUAL(8, cache.LoginID("\xA0\xA1").value_or(-1));
+
+    cache.Forget("player", 7);
+    CHECK(!cache.LoginID("Player").has_value());
+}
+
+TEST(CharacterList_CachesListsPerHat) {
+    character_list::Cache cache;
+    std::vector<CharacterInfo> info;
+
+    CHECK(!cache.Get(7, 1000, info));
+    cache.Put(7, 1000, List({10, 20}));
+    cache.Put(7, 2000, List({30}));
+    cache.Put(8, 1000, List({}));
+
+    CHECK(cache.Get(7, 1000, info));
+    CHECK_EQUAL(2u, info.size());
+    CHECK_EQUAL(20u, info[1].ID1);
+    CHECK(cache.Get(7, 2000, info));
+    CHECK_EQUAL(1u, info.size());
+    // An empty list is cached too.
+    CHECK(cache.Get(8, 1000, info));
+    CHECK(info.empty());
+
+    // A save of one character drops the lists of all hats of the login, and only of that login.
+    cache.Invalidate(7);
+    CHECK(!cache.Get(7, 1000, info));
+    CHECK(!cache.Get(7, 2000, info));
+    CHECK(cache.Get(8, 1000, info));
+}
+
+TEST(CharacterList_Expires) {
+    character_list::Cache cache(std::chrono::milliseconds(0));
+    std::vector<CharacterInfo> info;
+
+    cache.SetLoginID("Player", 7);
+    cache.Put(7, 1000, List({10}));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+    // The login may have been deleted and created again with another id.
+    CHECK(!cache.LoginID("Player").has_value());
+    CHECK(!cache.Get(7, 1000, info));
+}
+
+}
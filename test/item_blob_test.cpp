@@ -0,0 +1,72 @@
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../config.hpp"
+#include "../item_blob.h"
+#include "../login.hpp"
+#include "../sql.hpp"
+
+namespace
+{
+
+const std::string full_bag = "[0,0,0,4];[3667,0,0,1];[1000,1,31415,1,{7:100:0:0},{5:10:3:255}];[200,0,2,300];[65535,0,4000000000,65535]";
+
+std::string RoundTrip(const std::string& text) {
+    CItemList list = Login_UnserializeItems(text);
+    CItemList decoded;
+    if (!item_blob::Decode(item_blob::Encode(list), decoded)) {
+        return "decode failed";
+    }
+    return Login_SerializeItems(decoded);
+}
+
+TEST(ItemBlob_RoundTrip) {
+    CHECK_EQUAL("[0,0,0,0]", RoundTrip("[0,0,0,0]"));
+    CHECK_EQUAL("[0,0,40,12];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1]",
+        RoundTrip("[0,0,40,12];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1];[0,0,0,1]"));
+    CHECK_EQUAL(full_bag, RoundTrip(full_bag));
+}
+
+TEST(ItemBlob_Smaller) {
+    CItemList list = Login_UnserializeItems(full_bag);
+    std::string blob = item_blob::Encode(list);
+
+    CHECK(item_blob::IsBlob(blob));
+    CHECK(!item_blob::IsBlob(full_bag));
+    CHECK(blob.size() < full_bag.size());
+}
+
+TEST(ItemBlob_UnserializeDetectsFormat) {
+    CItemList list = Login_UnserializeItems(full_bag);
+    CItemList from_blob = Login_UnserializeItems(item_blob::Encode(list));
+
+    CHECK_EQUAL(full_bag, Login_SerializeItems(from_blob));
+}
+
+TEST(ItemBlob_Corrupted) {
+    std::string blob = item_blob::Encode(Login_UnserializeItems(full_bag));
+    CItemList list;
+
+    CHECK(!item_blob::Decode(blob.substr(0, blob.size() - 1), list));
+    CHECK(!item_blob::Decode(blob + '\x01', list));
+    CHECK(!item_blob::Decode(std::string("\x00\x02\x00", 3), list));
+
+    // Corrupted blobs read as an empty list, same as a broken text.
+    CHECK_EQUAL(0u, Login_UnserializeItems(blob.substr(0, blob.size() - 1)).Items.size());
+}
+
+TEST(ItemBlob_SerializesBinary) {
+    Config::BinaryItems = true;
+    CItemList list = Login_UnserializeItems("[0,0,0,1];[39,1,92,34,{0:0:0:0}]");
+    std::string blob = Login_SerializeItems(list);
+    Config::BinaryItems = false;
+
+    // The bytes as they are, escaped by the query that writes them.
+    CHECK(blob == item_blob::Encode(list));
+    std::string escaped = SQL_EscapeBinary(blob);
+    CHECK_EQUAL(std::string::npos, escaped.find('\0'));
+    CHECK_EQUAL(std::string("\\0\x01\x0d\\0\\0\\0\x01\\'\x01\\\\\\\"\x01\\0\\0\\0\\0"), escaped);
+}
+
+}
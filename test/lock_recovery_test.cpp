@@ -0,0 +1,92 @@
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../lock_recovery.h"
+#include "../sql.hpp"
+#include "../sql_memory.h"
+#include "../utils.hpp"
+
+namespace
+{
+
+void AddLogin(const std::string& name, int locked, int server) {
+    CHECK(SimpleSQL(Format("INSERT INTO logins (name, password, banned_reason, muted_reason, ip_filter, locked, locked_id1, locked_id2, locked_srvid) "
+                           "VALUES ('%s', '', '', '', '', %d, 11, 22, %d)", name.c_str(), locked, server)));
+}
+
+int CountLocked() {
+    SimpleSQL select{"SELECT COUNT(*) AS n FROM logins WHERE locked = 1"};
+    if (!select) {
+        return -1;
+    }
+    return SQL_FetchInt(SQL_FetchRow(select.result), select.result, "n");
+}
+
+std::string SelectLockedServer(const std::string& name) {
+    SimpleSQL select{Format("SELECT locked_srvid FROM logins WHERE name = '%s'", name.c_str())};
+    if (!select || SQL_NumRows(select.result) != 1) {
+        return "<no row>";
+    }
+    return SQL_FetchString(SQL_FetchRow(select.result), select.result, "locked_srvid");
+}
+
+TEST(LockRecovery_UnlocksWhatTheServerDoesntHave) {
+    sql_backend::Memory memory;
+    sql_backend::Set(&memory);
+    SQL_CreateTables();
+
+    AddLogin("Playing", 1, 3);
+    AddLogin("Gone", 1, 3);
+    AddLogin("AlsoGone", 1, 3);
+    AddLogin("Elsewhere", 1, 5);
+    AddLogin("Offline", 0, 0);
+    CHECK(lock_recovery::Load());
+
+    CHECK(lock_recovery::Pending(3));
+    CHECK(lock_recovery::Pending(5));
+    CHECK(!lock_recovery::Pending(4));
+
+    // Logins are compared case-insensitively, as in `CL_Login`.
+    CHECK_EQUAL(2, lock_recovery::Reconcile(3, {"PLAYING"}));
+    CHECK(!lock_recovery::Pending(3));
+    CHECK_EQUAL(2, CountLocked());
+    CHECK_EQUAL("3", SelectLockedServer("Playing"));
+    CHECK_EQUAL("0", SelectLockedServer("Gone"));
+
+    // Each server is reconciled once.
+    CHECK_EQUAL(0, lock_recovery::Reconcile(3, {}));
+    CHECK_EQUAL(2, CountLocked());
+
+    // The player went to another server since the hat started: that lock isn't stale.
+    CHECK(SimpleSQL("UPDATE logins SET locked_srvid = 6 WHERE name = 'Elsewhere'"));
+    CHECK_EQUAL(0, lock_recovery::Reconcile(5, {}));
+    CHECK_EQUAL("6", SelectLockedServer("Elsewhere"));
+
+    sql_backend::Set(nullptr);
+}
+
+TEST(LockRecovery_KeepsLocksTakenSinceTheRestart) {
+    sql_backend::Memory memory;
+    sql_backend::Set(&memory);
+    SQL_CreateTables();
+
+    AddLogin("Stale", 1, 3);
+    AddLogin("Back", 1, 3);
+    AddLogin("Moved", 1, 3);
+    CHECK(lock_recovery::Load());
+
+    // Back on the same server before its first report lists them: locked by the hat...
+    lock_recovery::Changed("BACK");
+    // ... or by something else, with another character.
+    CHECK(SimpleSQL("UPDATE logins SET locked_id1 = 12 WHERE name = 'Moved'"));
+
+    CHECK_EQUAL(1, lock_recovery::Reconcile(3, {}));
+    CHECK_EQUAL("0", SelectLockedServer("Stale"));
+    CHECK_EQUAL("3", SelectLockedServer("Back"));
+    CHECK_EQUAL("3", SelectLockedServer("Moved"));
+
+    sql_backend::Set(nullptr);
+}
+
+}
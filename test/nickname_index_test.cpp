@@ -0,0 +1,128 @@
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../nickname_index.h"
+#include "../sql.hpp"
+#include "../sql_backend.h"
+#include "../sql_memory.h"
+#include "../utils.hpp"
+
+namespace
+{
+
+using nickname_index::Index;
+using nickname_index::Key;
+
+TEST(NicknameIndex_BloomFilterHasNoFalseNegatives) {
+    nickname_index::BloomFilter bloom(1000);
+    for (int i = 0; i < 1000; i++) {
+        bloom.Add(Format("nick%d", i));
+    }
+
+    int false_positives = 0;
+    for (int i = 0; i < 1000; i++) {
+        CHECK(bloom.MayContain(Format("nick%d", i)));
+        false_positives += bloom.MayContain(Format("other%d", i));
+    }
+    CHECK(false_positives < 50);
+}
+
+TEST(NicknameIndex_FiltersByHat) {
+    Index index;
+    index.Set(Key{1, 10, 20}, 1000, "Hero");
+    index.Set(Key{2, 10, 20}, 2000, "hero");
+
+    CHECK(index.Contains("HERO", 1000));
+    CHECK(index.Contains("HERO", 2000));
+    CHECK(!index.Contains("HERO", 3000));
+    CHECK(index.Contains("HERO", 0));
+    CHECK(!index.Contains("Heroes", 0));
+
+    // One of the two is gone, the other one still holds the nickname.
+    index.Remove(Key{1, 10, 20});
+    CHECK(!index.Contains("hero", 1000));
+    CHECK(index.Contains("hero", 0));
+}
+
+TEST(NicknameIndex_RenamesAndGrows) {
+    Index index;
+    index.Set(Key{1, 10, 20}, 1000, "Old");
+    index.Set(Key{1, 10, 20}, 1000, "New");
+
+    CHECK(!index.Contains("old", 1000));
+    CHECK(index.Contains("new", 1000));
+    CHECK_EQUAL(1u, index.Size());
+
+    // Well past the size the Bloom filter started with.
+    for (unsigned long i = 0; i < 500; i++) {
+        index.Set(Key{2, i, 0}, 1000, Format("player%u", i));
+    }
+    for (unsigned long i = 0; i < 500; i++) {
+        CHECK(index.Contains(Format("PLAYER%u", i), 1000));
+    }
+    CHECK(index.Contains("new", 1000));
+}
+
+TEST(NicknameIndex_LoadsAndFollowsSaves) {
+    sql_backend::Memory memory;
+    sql_backend::Set(&memory);
+    SQL_CreateTables();
+
+    CHECK(SimpleSQL("INSERT INTO characters (login_id, id1, id2, hat_id, nick, deleted) VALUES "
+                    "(1, 10, 20, 1000, 'Alive', 0), (1, 11, 20, 1000, 'Deleted', 1)"));
+    CHECK(nickname_index::Load());
+
+    CHECK(*nickname_index::Exists("alive", 1000));
+    CHECK(!*nickname_index::Exists("deleted", 1000));
+
+    // A new character without a hat of its own, then a rename that moves it.
+    nickname_index::Saved(Key{1, 12, 20}, Key{1, 12, 20}, std::nullopt, "Fresh");
+    CHECK(*nickname_index::Exists("FRESH", 0));
+    nickname_index::Saved(Key{1, 10, 20}, Key{1, 10, 21}, std::nullopt, "Renamed");
+    CHECK(!*nickname_index::Exists("alive", 1000));
+    CHECK(*nickname_index::Exists("renamed", 1000));
+
+    nickname_index::Deleted(Key{1, 10, 21});
+    CHECK(!*nickname_index::Exists("renamed", 0));
+
+    // The DB is the truth: a reload brings back what the index missed and drops what it made up.
+    CHECK(nickname_index::Load());
+    CHECK(*nickname_index::Exists("alive", 1000));
+    CHECK(!*nickname_index::Exists("fresh", 0));
+
+    sql_backend::Set(nullptr);
+}
+
+TEST(NicknameIndex_ReloadsInTheBackground) {
+    sql_backend::Memory memory;
+    sql_backend::Set(&memory);
+    SQL_CreateTables();
+
+    CHECK(SimpleSQL("INSERT INTO characters (login_id, id1, id2, hat_id, nick, deleted) VALUES (1, 10, 20, 1000, 'Alive', 0)"));
+    CHECK(nickname_index::Load());
+    // Created behind the hat's back.
+    CHECK(SimpleSQL("INSERT INTO characters (login_id, id1, id2, hat_id, nick, deleted) VALUES (2, 10, 20, 1000, 'Behind', 0)"));
+
+    // The read takes a while, the main thread goes on meanwhile.
+    auto connect = [&memory]() -> std::unique_ptr<sql_backend::Backend> {
+        return std::make_unique<sql_backend::WithLatency>(memory, std::chrono::milliseconds(100));
+    };
+    CHECK(nickname_index::ReloadAsync(connect));
+    CHECK(!nickname_index::ReloadAsync(connect));
+    nickname_index::Saved(Key{3, 10, 20}, Key{3, 10, 20}, 1000, "Typed");
+    nickname_index::Deleted(Key{1, 10, 20});
+    CHECK(*nickname_index::Exists("typed", 1000));
+    CHECK(!*nickname_index::Exists("behind", 1000));
+
+    nickname_index::WaitReload();
+    CHECK(*nickname_index::Exists("behind", 1000));
+    CHECK(*nickname_index::Exists("typed", 1000));
+    CHECK(!*nickname_index::Exists("alive", 1000));
+
+    sql_backend::Set(nullptr);
+}
+
+}
@@ -0,0 +1,180 @@
+#include <random>
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../cp866.h"
+#include "../nickname.h"
+#include "../utils.hpp"
+
+namespace
+{
+
+// The codes `CheckNickname` sends, from client.hpp.
+const uint32_t WRONG_NAME = 27;
+const uint32_t SHORT_NAME = 28;
+const uint32_t BAD_CHARACTER = 29;
+
+// `CheckNickname` and `CheckNickname_creation` before the tables, without the DB lookup.
+uint32_t ReferenceCheck(std::string nickname, bool creation, bool secondary) {
+    size_t w = nickname.find_first_of('|');
+    if (w == nickname.npos)
+        w = nickname.length();
+
+    bool in_clan = false;
+
+    if (nickname[nickname.length() - 1] == '|')
+        return WRONG_NAME;
+
+    uint32_t result = 0;
+    if (w < 3 && !secondary) result = SHORT_NAME;
+    else if (w > 10 && !secondary) result = BAD_CHARACTER;
+    else {
+        for (size_t i = 0; i < nickname.length(); i++) {
+            uint8_t ch = nickname[i];
+            if (ch == '|' && !in_clan) {
+                in_clan = true;
+                continue;
+            }
+
+            if (ch < 0x20)
+                return WRONG_NAME;
+
+            bool allowed;
+            if (creation) {
+                allowed = (ch >= 'A' && ch <= 'Z') ||
+                          (ch >= 'a' && ch <= 'z') ||
+                          (i == 0 && (ch == '@' || ch == '_' || ch == '!'));
+            } else {
+                allowed = ((ch >= 0x30 && ch <= 0x39) ||
+                           (ch >= 0x41 && ch <= 0x5A) ||
+                           (ch >= 0x61 && ch <= 0x7A) ||
+                           (ch == '-') ||
+                           (ch == ' ') ||
+                           (ch >= 0x80 && ch <= 0x9F) ||
+                           (ch >= 0xA0 && ch <= 0xAF) ||
+                           (ch >= 0xE0 && ch <= 0xEF) ||
+                           (ch == 0xF0 || ch == 0xF1) ||
+                           (ch == '!' || ch == '?') ||
+                           (ch == '@') ||
+                           (ch == '.') ||
+                           (ch == '=') ||
+                           (ch == '+') ||
+                           (ch == '_') ||
+                           (ch == '$') ||
+                           (ch == '(') || (ch == ')') ||
+                           (ch == '<') || (ch == '>') ||
+                           (in_clan && (
+                               (ch == 0x7F) ||
+                               (ch == '{' || ch == '}') ||
+                               (ch == ':' || ch == ';') ||
+                               (ch == '*' || ch == '^') ||
+                               (ch == '#') ||
+                               (ch == '<' || ch == '>') ||
+                               (ch == '&'))));
+            }
+
+            if (!allowed) return WRONG_NAME;
+        }
+    }
+
+    return result;
+}
+
+std::string ReferenceTrim(std::string nickname) {
+    size_t clanSep = nickname.find_first_of('|');
+    if (clanSep != std::string::npos) {
+        return Trim(nickname.substr(0, clanSep)) + "|" + Trim(nickname.substr(clanSep + 1));
+    }
+    return Trim(nickname);
+}
+
+uint32_t Code(nickname::Result result) {
+    const uint32_t codes[] = {0, SHORT_NAME, BAD_CHARACTER, WRONG_NAME};
+    return codes[result];
+}
+
+// Checks the nickname with both rules, with and without the length checks. Returns the number of mismatches.
+int Compare(const std::string& nickname) {
+    int mismatches = 0;
+    for (bool creation : {false, true}) {
+        for (bool secondary : {false, true}) {
+            auto rules = creation ? nickname::RULES_CREATION : nickname::RULES_REGULAR;
+            if (Code(nickname::Check(nickname, rules, secondary)) != ReferenceCheck(nickname, creation, secondary)) {
+                mismatches++;
+            }
+        }
+    }
+    if (nickname::Trim(nickname) != ReferenceTrim(nickname)) {
+        mismatches++;
+    }
+    return mismatches;
+}
+
+TEST(Nickname_FoldsLikeMySQL) {
+    CHECK_EQUAL("hero_1", cp866::Fold("HeRo_1"));
+    // А..П, Р..Я and Ё.
+    CHECK_EQUAL("\xA0\xAF\xE0\xEF\xF1", cp866::Fold("\x80\x8F\x90\x9F\xF0"));
+    // Already lower case, or not a letter.
+    CHECK_EQUAL("\xA0\xE0\xF1\xB0 |", cp866::Fold("\xA0\xE0\xF1\xB0 |"));
+
+    CHECK(cp866::EqualFolded("\x80\x42", "\xA0\x62"));
+    CHECK(!cp866::EqualFolded("ab", "abc"));
+}
+
+TEST(Nickname_Checks) {
+    CHECK_EQUAL(nickname::RESULT_OK, nickname::Check("Hero|{Clan}#", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_WRONG, nickname::Check("He#ro", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_WRONG, nickname::Check("Hero|", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_SHORT, nickname::Check("He|Clan", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_LONG, nickname::Check("Hero567890A", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_OK, nickname::Check("_Hero", nickname::RULES_CREATION));
+    CHECK_EQUAL(nickname::RESULT_WRONG, nickname::Check("He_ro", nickname::RULES_CREATION));
+    // Nothing to read past the end of.
+    CHECK_EQUAL(nickname::RESULT_SHORT, nickname::Check("", nickname::RULES_REGULAR));
+    CHECK_EQUAL(nickname::RESULT_OK, nickname::Check("", nickname::RULES_REGULAR, true));
+
+    CHECK_EQUAL("Hero", std::string(nickname::Name("Hero|Clan")));
+    CHECK_EQUAL("Hero|Clan", nickname::Trim(" Hero \t| Clan\xFF"));
+}
+
+// Every nickname of up to two bytes, and every byte at every position of the name and the clan.
+TEST(Nickname_MatchesTheOldCheckForEveryByte) {
+    int mismatches = 0;
+    for (int a = 0; a < 256; a++) {
+        mismatches += Compare(std::string(1, static_cast<char>(a)));
+        for (int b = 0; b < 256; b++) {
+            mismatches += Compare(std::string{static_cast<char>(a), static_cast<char>(b)});
+        }
+    }
+
+    const std::string base = "Abcdefghij|Klmnopqrstuvwxyz01234";
+    for (size_t position = 0; position < base.size(); position++) {
+        for (int c = 0; c < 256; c++) {
+            std::string nickname = base;
+            nickname[position] = static_cast<char>(c);
+            mismatches += Compare(nickname);
+        }
+    }
+
+    CHECK_EQUAL(0, mismatches);
+}
+
+// Random nicknames up to 32 bytes, mostly from the bytes the rules care about.
+TEST(Nickname_MatchesTheOldCheckForRandomNicknames) {
+    const std::string interesting = "aZ09 |-_@!#&{}<>\x7F\x80\x9F\xA0\xAF\xB0\xE0\xEF\xF0\xF1\xF2\xFF\t\r\n";
+
+    std::mt19937 random(866);
+    int mismatches = 0;
+    for (int i = 0; i < 200000; i++) {
+        std::string nickname(1 + random() % 32, '\0');
+        for (char& ch : nickname) {
+            ch = (random() % 4) ? interesting[random() % interesting.size()] : static_cast<char>(random() % 256);
+        }
+        mismatches += Compare(nickname);
+    }
+
+    CHECK_EQUAL(0, mismatches);
+}
+
+}
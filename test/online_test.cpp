@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../online.h"
+
+namespace
+{
+
+ServerPlayer Player(const std::string& login, unsigned long id1, const std::string& ip) {
+    return ServerPlayer{"Nick" + login, login, id1, id1 + 1, !ip.empty(), ip};
+}
+
+std::vector<int> Sorted(std::vector<int> servers) {
+    std::sort(servers.begin(), servers.end());
+    return servers;
+}
+
+// What `SL_UpdateInfo` does with a report.
+size_t Report(online::Index& index, online::Diff& diff, int server, std::vector<ServerPlayer>& players,
+              std::vector<ServerPlayer> reported, const std::vector<std::string>& locked) {
+    size_t changed = index.Update(server, diff.Compare(players, reported), locked);
+    players.swap(reported);
+    return changed;
+}
+
+TEST(Online_DiffsReports) {
+    online::Diff diff;
+    std::vector<ServerPlayer> previous = {Player("Alice", 10, "1.2.3.4"), Player("Bob", 20, ""), Player("Carol", 30, "")};
+    std::vector<ServerPlayer> reported = {Player("Dave", 40, ""), Player("Carol", 30, ""), Player("Alice", 10, "")};
+
+    const std::vector<online::Event>& events = diff.Compare(previous, reported);
+    // Alice disconnected and keeps her address; Carol didn't change.
+    CHECK_EQUAL("1.2.3.4", reported[2].IPAddress);
+    CHECK(!reported[2].Connected);
+    CHECK_EQUAL(3u, events.size());
+    CHECK_EQUAL(online::EVENT_JOINED, events[0].type);
+    CHECK(events[0].player == &reported[0]);
+    CHECK_EQUAL(online::EVENT_CHANGED, events[1].type);
+    CHECK(events[1].previous == &previous[0]);
+    CHECK(events[1].player == &reported[2]);
+    CHECK_EQUAL(online::EVENT_LEFT, events[2].type);
+    CHECK(events[2].previous == &previous[1]);
+
+    CHECK(diff.Compare(reported, reported).empty());
+}
+
+TEST(Online_TracksReportedPlayers) {
+    online::Index index;
+    online::Diff diff;
+    std::vector<ServerPlayer> players;
+
+    CHECK_EQUAL(3u, Report(index, diff, 1, players, {Player("Alice", 10, "1.2.3.4"), Player("Bob", 20, "")}, {"Carol"}));
+    CHECK(index.Holds(1, "ALICE", 10, 11));
+    // Another character of the login isn't on the server, but a locked login holds any character.
+    CHECK(!index.Holds(1, "Alice", 30, 31));
+    CHECK(index.Holds(1, "carol", 0, 0));
+    CHECK(!index.Holds(2, "Alice", 10, 11));
+
+    // The same report again changes nothing; Alice disconnects, Bob leaves and Carol's character comes back.
+    CHECK_EQUAL(0u, Report(index, diff, 1, players, {Player("Alice", 10, "1.2.3.4"), Player("Bob", 20, "")}, {"Carol"}));
+    CHECK_EQUAL(3u, Report(index, diff, 1, players, {Player("Alice", 10, "")}, {}));
+    CHECK(!index.Holds(1, "Bob", 20, 21));
+    CHECK(!index.Holds(1, "Carol", 0, 0));
+    CHECK(index.Holds(1, "Alice", 10, 11));
+
+    // A dupe: the same character on two servers.
+    online::Diff other_diff;
+    std::vector<ServerPlayer> other_players;
+    Report(index, other_diff, 2, other_players, {Player("Alice", 10, "5.6.7.8")}, {"Dave"});
+    CHECK(Sorted({1, 2}) == Sorted(index.Servers("Alice", 10, 11)));
+
+    index.Unlocked(2, "DAVE");
+    CHECK(index.Servers("Dave", 0, 0).empty());
+
+    index.Drop(2);
+    CHECK(std::vector<int>{1} == index.Servers("Alice", 10, 11));
+}
+
+}
@@ -0,0 +1,63 @@
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../outbox.h"
+
+namespace
+{
+
+outbox::Frame Message(uint8_t id, size_t size) {
+    Packet pack;
+    pack << id;
+    for (size_t i = 0; i < size; i++) {
+        pack << (uint8_t)i;
+    }
+    return outbox::Encode(pack, 20);
+}
+
+TEST(Outbox_EncodesLikeSendPacket) {
+    Packet pack;
+    pack << (uint8_t)0x63;
+    pack << std::string("Server is going down");
+    uint8_t* data = nullptr;
+    uint32_t size = 0;
+    pack.GetAllData(data, size);
+    std::vector<uint8_t> expected = PACKET_Frame(data, size, 20);
+    delete[] data;
+
+    CHECK(expected == *outbox::Encode(pack, 20));
+}
+
+TEST(Outbox_SharesFramesBetweenQueues) {
+    outbox::Frame frame = Message(0x63, 300);
+    outbox::Queue first, second;
+    first.Push(frame);
+    second.Push(frame);
+    CHECK_EQUAL(3, frame.use_count());
+    CHECK_EQUAL(frame->size(), first.Bytes());
+
+    // The first queue is stuck after a part of the frame, the second one goes on.
+    first.Sent(100);
+    CHECK_EQUAL(frame->size() - 100, first.Left());
+    CHECK(first.Data() == frame->data() + 100);
+    second.Sent(second.Left());
+    CHECK(second.Empty());
+    CHECK_EQUAL(2, frame.use_count());
+
+    first.Push(Message(0x65, 10));
+    size_t bytes = first.Bytes();
+    first.Sent(first.Left());
+    CHECK(!first.Empty());
+    CHECK_EQUAL(bytes - (frame->size() - 100), first.Bytes());
+    first.Sent(first.Left());
+    CHECK(first.Empty());
+    CHECK_EQUAL(0u, first.Bytes());
+
+    outbox::Delivery delivery = first.TakeDelivery();
+    CHECK_EQUAL(2u, delivery.frames);
+    CHECK(delivery.max <= delivery.total);
+    CHECK_EQUAL(0u, first.TakeDelivery().frames);
+}
+
+}
@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../packet.hpp"
+#include "../peer.h"
+
+namespace
+{
+
+std::vector<uint8_t> Payload(size_t size) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = static_cast<uint8_t>(i * 7);
+    }
+    return payload;
+}
+
+// What `PACKET_Frame` appends.
+std::vector<uint8_t> WithEnd(std::vector<uint8_t> payload) {
+    const uint8_t end[] = {0x64, 0x01, 0x00, 0x00, 0x00};
+    payload.insert(payload.end(), end, end + sizeof(end));
+    return payload;
+}
+
+TEST(Peer_DecodesFramesFedInPieces) {
+    std::vector<uint8_t> first = Payload(3);
+    std::vector<uint8_t> second = Payload(0x200);
+    std::vector<uint8_t> wire = PACKET_Frame(first.data(), first.size(), 20);
+    std::vector<uint8_t> more = PACKET_Frame(second.data(), second.size(), 20);
+    wire.insert(wire.end(), more.begin(), more.end());
+
+    peer::Decoder decoder;
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<uint8_t> packet;
+    for (size_t i = 0; i < wire.size(); i++) {
+        decoder.Feed(&wire[i], 1);
+        while (decoder.Next(packet, 20)) {
+            packets.push_back(packet);
+        }
+    }
+
+    CHECK(!decoder.Broken());
+    CHECK_EQUAL(2u, packets.size());
+    CHECK(WithEnd(first) == packets[0]);
+    CHECK(WithEnd(second) == packets[1]);
+    CHECK(!decoder.Next(packet, 20));
+}
+
+TEST(Peer_RejectsBrokenHeaders) {
+    peer::Decoder decoder;
+    const uint8_t header[8] = {0x00, 0x10, 0, 0, 0, 0, 0, 1};
+    decoder.Feed(header, sizeof(header));
+
+    std::vector<uint8_t> packet;
+    CHECK(!decoder.Next(packet, 20));
+    CHECK(decoder.Broken());
+}
+
+}
@@ -0,0 +1,85 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../packet.hpp"
+#include "../server_list.h"
+
+namespace
+{
+
+// What `send_msg` used to send, chunk by chunk.
+std::vector<uint8_t> OldFrame(std::vector<uint8_t> msg, unsigned long version) {
+    const uint8_t end[] = {0x64, 0x01, 0x00, 0x00, 0x00};
+    msg.insert(msg.end(), end, end + 5);
+
+    std::vector<uint8_t> wire;
+    uint8_t pack[0x96] = {};
+    for (size_t idx = 0; idx < msg.size(); idx += pack[0]) {
+        if (msg.size() - idx > 0x8E) {
+            pack[0] = 0x8E;
+            pack[7] = 0;
+        } else {
+            pack[0] = (uint8_t)(msg.size() - idx);
+            pack[7] = 1;
+        }
+        memcpy(pack + 8, &msg[idx], pack[0]);
+        PACKET_XorByKey(pack + 8, pack[0], version);
+        wire.insert(wire.end(), pack, pack + pack[0] + 8);
+    }
+    return wire;
+}
+
+TEST(ServerList_FramesLikeSendMsg) {
+    for (unsigned long version : {0ul, 8ul, 10ul, 11ul, 20ul}) {
+        // Around the chunk boundary, the 5-byte end included.
+        for (size_t size : {0, 1, 0x89, 0x8A, 0x8E, 0x8F, 0x11C, 0x11D, 5000}) {
+            std::vector<uint8_t> msg(size);
+            for (size_t i = 0; i < size; i++) {
+                msg[i] = (uint8_t)(i * 7 + size);
+            }
+            CHECK(OldFrame(msg, version) == PACKET_Frame(msg.data(), msg.size(), version));
+        }
+    }
+}
+
+TEST(ServerList_BuildsOncePerChange) {
+    server_list::Cache cache;
+    int built = 0;
+    auto build = [&built](uint32_t game_mode) {
+        built++;
+        return "list " + std::to_string(game_mode);
+    };
+
+    auto wire = cache.Wire(1, 20, build);
+    CHECK_EQUAL(1, built);
+    std::string list = "list 1";
+    Packet pack;
+    pack << (uint8_t)0xCD;
+    pack << (uint32_t)list.length();
+    pack.AppendData((uint8_t*)list.c_str(), (uint32_t)list.length() + 1);
+    uint8_t* data = nullptr;
+    uint32_t size = 0;
+    pack.GetAllData(data, size);
+    std::vector<uint8_t> expected = PACKET_Frame(data, size, 20);
+    delete[] data;
+    CHECK(expected == *wire);
+
+    // The same buffer for the next client.
+    CHECK(cache.Wire(1, 20, build) == wire);
+    // Another version shares the text, another game mode doesn't.
+    CHECK(cache.Wire(1, 11, build) != wire);
+    CHECK_EQUAL(1, built);
+    cache.Wire(2, 20, build);
+    CHECK_EQUAL(2, built);
+
+    // A buffer handed out before a change stays valid.
+    cache.Changed();
+    CHECK(cache.Wire(1, 20, build) != wire);
+    CHECK_EQUAL(3, built);
+    CHECK(expected == *wire);
+}
+
+}
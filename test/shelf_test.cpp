@@ -125,8 +125,11 @@ struct FakeLoadFromShelf {
     int64_t fake_money;
     bool fake_shelf_exists;
 
+    int calls = 0;
+
     shelf::impl::LoadShelfFunction Bind() {
         return [this] (const CCharacter& chr, int shelf_number, shelf::impl::Field field, int32_t* mutex, std::string* items_repr, int64_t* money, bool& shelf_exists) -> bool {
+            calls++;
             CHECK_EQUAL(want_login_id, chr.LoginID);
             CHECK_EQUAL(want_shelf_number, shelf_number);
 
@@ -831,4 +834,115 @@ TEST(StoreOnShelf_Giga) {
     CHECK_EQUAL(true, got);
 }
 
+TEST(ShelfCache_HitSkipsLoad) {
+    FakeSQLQuery sql_query{.queries={
+        {"UPDATE shelf SET mutex = 4, money = 150 WHERE login_id = 42 AND server_id = 6 AND cabinet = 0 AND mutex = 3", true},
+        {"UPDATE shelf SET mutex = 5, money = 200 WHERE login_id = 42 AND server_id = 6 AND cabinet = 0 AND mutex = 4", true},
+    }};
+
+    FakeLoadFromShelf load_from_shelf{
+        .want_login_id=42,
+        .want_shelf_number=NIGHTMARE,
+        .fake_mutex=3,
+        .fake_result=true,
+        .fake_money=100,
+        .fake_shelf_exists=true,
+    };
+
+    shelf::impl::Cache cache;
+
+    std::vector<CItem> inventory{book, book};
+    auto got = shelf::impl::MoneyToSavingsBookImpl(FakeChar(42), NIGHTMARE, inventory, 1000, 50, load_from_shelf.Bind(), sql_query.Bind(), &cache);
+    CHECK_EQUAL(950, got);
+
+    got = shelf::impl::MoneyToSavingsBookImpl(FakeChar(42), NIGHTMARE, inventory, got, 50, load_from_shelf.Bind(), sql_query.Bind(), &cache);
+    CHECK_EQUAL(900, got);
+
+    CHECK_EQUAL(1, load_from_shelf.calls);
+    std::vector<CItem> want{};
+    CHECK_EQUAL(want, inventory);
+}
+
+TEST(ShelfCache_ConflictReloads) {
+    FakeSQLQuery sql_query{.queries={
+        {"UPDATE shelf SET mutex = 4, items = '[0,0,0,1];[6162,1,0,1,{2:2:0:0}]' WHERE login_id = 42 AND server_id = 6 AND cabinet = 0 AND mutex = 3", false},
+        {"UPDATE shelf SET mutex = 8, items = '[0,0,0,2];[53517,1,0,1,{17:50:0:0}];[6162,1,0,1,{2:2:0:0}]' WHERE login_id = 42 AND server_id = 6 AND cabinet = 0 AND mutex = 7", true},
+    }};
+
+    // Someone else put a staff on the shelf since it was cached.
+    FakeLoadFromShelf load_from_shelf{
+        .want_login_id=42,
+        .want_shelf_number=NIGHTMARE,
+        .fake_mutex=7,
+        .fake_result=true,
+        .fake_items={staff},
+        .fake_shelf_exists=true,
+    };
+
+    shelf::impl::Cache cache;
+    cache.Store(FakeChar(42), NIGHTMARE, shelf::impl::Content{.exists=true, .mutex=3});
+
+    std::vector<CItem> inventory{cuirass, book, helm};
+    auto got = shelf::impl::ItemsToSavingsBookImpl(FakeChar(42), NIGHTMARE, inventory, load_from_shelf.Bind(), sql_query.Bind(), &cache);
+    CHECK_EQUAL(true, got);
+    CHECK_EQUAL(1, load_from_shelf.calls);
+
+    std::vector<CItem> want{helm};
+    CHECK_EQUAL(want, inventory);
+
+    const shelf::impl::Content* cached = cache.Find(FakeChar(42), NIGHTMARE);
+    CHECK(cached != nullptr);
+    if (cached) {
+        CHECK_EQUAL(8, cached->mutex);
+        std::vector<CItem> want_shelf{staff, cuirass};
+        CHECK_EQUAL(want_shelf, cached->items);
+    }
+}
+
+TEST(ShelfCache_ConflictOnFreshShelfFails) {
+    FakeSQLQuery sql_query{.queries={
+        {"UPDATE shelf SET mutex = 8, money = 550 WHERE login_id = 42 AND server_id = 6 AND cabinet = 0 AND mutex = 7", false},
+    }};
+
+    FakeLoadFromShelf load_from_shelf{
+        .want_login_id=42,
+        .want_shelf_number=NIGHTMARE,
+        .fake_mutex=7,
+        .fake_result=true,
+        .fake_money=500,
+        .fake_shelf_exists=true,
+    };
+
+    shelf::impl::Cache cache;
+
+    std::vector<CItem> inventory{book};
+    auto got = shelf::impl::MoneyToSavingsBookImpl(FakeChar(42), NIGHTMARE, inventory, 1000, 50, load_from_shelf.Bind(), sql_query.Bind(), &cache);
+    CHECK_EQUAL(1000, got);
+    CHECK_EQUAL(1, load_from_shelf.calls);
+    CHECK_EQUAL(0u, cache.Size());
+
+    std::vector<CItem> want{book};
+    CHECK_EQUAL(want, inventory);
+}
+
+TEST(ShelfCache_MissingShelfNotCached) {
+    FakeSQLQuery sql_query{.queries={
+        {"INSERT INTO shelf (login_id, server_id, cabinet, mutex, items, money) VALUES (42, 2, 0, 0, '[0,0,0,1];[3587,1,0,1,{42:1:0:0}]', 200)", true},
+    }};
+
+    FakeLoadFromShelf load_from_shelf{
+        .want_login_id=42,
+        .want_shelf_number=KIDS,
+        .fake_result=true,
+        .fake_shelf_exists=false,
+    };
+
+    shelf::impl::Cache cache;
+
+    std::vector<CItem> inventory{book};
+    auto got = shelf::impl::StoreOnShelfImpl(FakeChar(42), KIDS, inventory, 200, load_from_shelf.Bind(), sql_query.Bind(), &cache);
+    CHECK_EQUAL(true, got);
+    CHECK_EQUAL(0u, cache.Size());
+}
+
 }
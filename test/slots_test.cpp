@@ -0,0 +1,94 @@
+#include <set>
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../slots.h"
+
+namespace
+{
+
+struct Counted {
+    static int alive;
+
+    explicit Counted(std::string name = "") : name(std::move(name)) {
+        alive++;
+    }
+    ~Counted() {
+        alive--;
+    }
+
+    std::string name;
+};
+
+int Counted::alive = 0;
+
+TEST(Slots_HandlesOutliveTheirObjects) {
+    {
+        slots::Map<Counted> map;
+        auto first = map.Insert("first");
+        auto second = map.Insert("second");
+        Counted* address = map.Get(first);
+        CHECK_EQUAL("first", address->name);
+        CHECK_EQUAL(2, Counted::alive);
+
+        CHECK(map.Erase(first));
+        CHECK(!map.Erase(first));
+        CHECK(map.Get(first) == nullptr);
+        CHECK(map.Get(0) == nullptr);
+        CHECK_EQUAL(1, Counted::alive);
+
+        // The slot is taken again, but not by the old handle.
+        auto third = map.Insert("third");
+        CHECK(third != first);
+        CHECK(map.Get(third) == address);
+        CHECK(map.Get(first) == nullptr);
+        CHECK_EQUAL("second", map.Get(second)->name);
+    }
+    CHECK_EQUAL(0, Counted::alive);
+}
+
+TEST(Slots_IteratesWhileErasing) {
+    slots::Map<Counted> map;
+    std::vector<Counted*> addresses;
+    for (int i = 0; i < 200; i++) {
+        addresses.push_back(map.Get(map.Insert(std::to_string(i))));
+    }
+
+    // Objects don't move when their chunk fills or others are erased.
+    std::set<std::string> visited;
+    for (size_t i = map.Size(); i-- > 0;) {
+        Counted* object = map.At(i);
+        visited.insert(object->name);
+        if (std::stoi(object->name) % 3) {
+            CHECK(map.Erase(map.HandleAt(i)));
+        }
+    }
+    CHECK_EQUAL(200u, visited.size());
+    CHECK_EQUAL(67u, map.Size());
+
+    for (size_t i = 0; i < map.Size(); i++) {
+        int n = std::stoi(map.At(i)->name);
+        CHECK_EQUAL(0, n % 3);
+        CHECK(addresses[n] == map.At(i));
+        CHECK(map.Get(map.HandleAt(i)) == map.At(i));
+    }
+}
+
+TEST(Slots_PoolReusesPlaces) {
+    slots::Pool<Counted> pool;
+    Counted* first = pool.New("first");
+    Counted* second = pool.New("second");
+    CHECK_EQUAL(2u, pool.Size());
+
+    pool.Delete(first);
+    CHECK_EQUAL(1, Counted::alive);
+    CHECK(pool.New("third") == first);
+
+    pool.Delete(first);
+    pool.Delete(second);
+    CHECK_EQUAL(0u, pool.Size());
+    CHECK_EQUAL(0, Counted::alive);
+}
+
+}
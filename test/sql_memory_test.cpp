@@ -0,0 +1,307 @@
+#include <chrono>
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../item_blob.h"
+#include "../shelf.hpp"
+#include "../sql.hpp"
+#include "../sql_memory.h"
+#include "../unit_of_work.h"
+#include "../update_character.h"
+#include "../utils.hpp"
+
+namespace
+{
+
+// A fresh in-memory DB with the hat's schema for the `SQL_*` functions, while in scope.
+struct MemoryDB {
+    sql_backend::Memory memory;
+
+    MemoryDB() {
+        sql_backend::Set(&memory);
+        SQL_CreateTables();
+        SQL_UpdateReclassed();
+    }
+
+    ~MemoryDB() {
+        sql_backend::Set(nullptr);
+    }
+};
+
+std::string SelectOne(const std::string& query, const char* field) {
+    SimpleSQL select{query};
+    if (!select || SQL_NumRows(select.result) != 1) {
+        return "<no row>";
+    }
+    MYSQL_ROW row = SQL_FetchRow(select.result);
+    return SQL_FetchString(row, select.result, field);
+}
+
+TEST(SqlMemory_CreatesTheSchema) {
+    MemoryDB db;
+
+    CHECK(SQL_CheckUniqueKeys());
+    CHECK(SimpleSQL("INSERT INTO logins (name, password, banned_reason, muted_reason, ip_filter) VALUES ('Player', 'secret', '', '', '')"));
+    CHECK_EQUAL("1", SelectOne("SELECT id FROM logins WHERE LOWER(name) = LOWER('PLAYER')", "id"));
+    CHECK_EQUAL("-1", SelectOne("SELECT allow_female FROM logins WHERE id = 1", "allow_female"));
+    CHECK_EQUAL("0", SelectOne("SELECT COUNT(*) AS n FROM characters WHERE login_id = 1 AND reclassed = 0", "n"));
+}
+
+TEST(SqlMemory_AddsIndices) {
+    MemoryDB db;
+
+    CHECK(SQL_CheckIndices());
+    // A table created before the index was added to `SQL_CreateTables`.
+    CHECK(SimpleSQL("ALTER TABLE characters DROP INDEX characters_login_index"));
+    CHECK(!SQL_CheckIndices());
+
+    SQL_AddIndices();
+    CHECK(SQL_CheckIndices());
+}
+
+TEST(SqlMemory_CountsAffectedRows) {
+    MemoryDB db;
+
+    CHECK(SimpleSQL("INSERT INTO shelf (login_id, server_id, cabinet, mutex, money) VALUES (1, 1, 0, 0, 10), (1, 2, 0, 0, 20)"));
+    CHECK_EQUAL(2, SQL_AffectedRows());
+
+    // Only the rows that changed, as with MySQL.
+    CHECK(SimpleSQL("UPDATE shelf SET money = 20 WHERE login_id = 1"));
+    CHECK_EQUAL(1, SQL_AffectedRows());
+
+    // The `mutex` check of a stale shelf write.
+    CHECK(SimpleSQL("UPDATE shelf SET mutex = 1, money = 0 WHERE login_id = 1 AND server_id = 1 AND mutex = 5"));
+    CHECK_EQUAL(0, SQL_AffectedRows());
+}
+
+TEST(SqlMemory_UpsertsTreasure) {
+    MemoryDB db;
+
+    update_character::SaveTreasurePoints(7, NIGHTMARE, 2);
+    update_character::SaveTreasurePoints(7, NIGHTMARE, 3);
+    update_character::SaveTreasurePoints(7, EASY, 1);
+
+    CHECK_EQUAL("5", SelectOne(Format("SELECT treasure_points FROM treasure WHERE character_id = 7 AND server_id = %d", NIGHTMARE), "treasure_points"));
+    CHECK_EQUAL("2", SelectOne("SELECT COUNT(*) AS n FROM treasure", "n"));
+
+    CHECK(SQL_Query("INSERT INTO treasure (server_id, character_id, treasure_points) VALUES (1, 7, 1)") != 0);
+    CHECK(SQL_Error().find("Duplicate entry") != std::string::npos);
+}
+
+TEST(SqlMemory_AddsUniqueKeys) {
+    MemoryDB db;
+
+    // A table created before `id` was unique.
+    CHECK(SimpleSQL("ALTER TABLE `checkpoint` DROP INDEX `id`"));
+    CHECK(!SQL_CheckUniqueKeys());
+
+    const char* insert = "INSERT INTO `checkpoint` (id, deaths, dress) VALUES (%d, %d, '%s')";
+    // Exact duplicates.
+    CHECK(SimpleSQL(Format(insert, 1, 3, "a")));
+    CHECK(SimpleSQL(Format(insert, 1, 3, "a")));
+    // The one with the most deaths stays, the rest go whatever their dress.
+    CHECK(SimpleSQL(Format(insert, 2, 1, "z")));
+    CHECK(SimpleSQL(Format(insert, 2, 5, "b")));
+    CHECK(SimpleSQL(Format(insert, 2, 5, "c")));
+    CHECK(SimpleSQL(Format(insert, 3, 0, "d")));
+
+    SQL_AddUniqueKeys();
+    CHECK(SQL_CheckUniqueKeys());
+    CHECK_EQUAL("3", SelectOne("SELECT COUNT(*) AS n FROM `checkpoint`", "n"));
+    CHECK_EQUAL("a", SelectOne("SELECT dress FROM `checkpoint` WHERE id = 1", "dress"));
+    CHECK_EQUAL("5", SelectOne("SELECT deaths FROM `checkpoint` WHERE id = 2", "deaths"));
+    CHECK_EQUAL("d", SelectOne("SELECT dress FROM `checkpoint` WHERE id = 3", "dress"));
+}
+
+// Runs `save` once, just before the first query that starts with `prefix`: a hat that saves between two queries.
+class SaveBefore : public sql_backend::WithLatency {
+public:
+    SaveBefore(sql_backend::Backend& backend, std::string prefix, std::string save)
+        : WithLatency(backend, std::chrono::microseconds(0)), prefix(std::move(prefix)), save(std::move(save)) {}
+
+    int Query(const std::string& query) override {
+        if (!this->save.empty() && query.compare(0, this->prefix.size(), this->prefix) == 0) {
+            WithLatency::Query(this->save);
+            this->save.clear();
+        }
+        return WithLatency::Query(query);
+    }
+
+private:
+    std::string prefix;
+    std::string save;
+};
+
+TEST(SqlMemory_MigratesItemsWithoutLosingSaves) {
+    MemoryDB db;
+
+    const char* insert = "INSERT INTO characters (login_id, id1, id2, hat_id, nick, deleted, bag, dress) VALUES (%d, 10, 20, 1000, '%s', 0, '%s', '%s')";
+    CHECK(SimpleSQL(Format(insert, 1, "Saved", "[0,0,0,1];[1000,1,2,1,{7:1:0:0}]", "[0,0,0,0]")));
+    CHECK(SimpleSQL(Format(insert, 2, "Idle", "[0,0,0,1];[1000,1,2,1,{7:3:0:0}]", "[0,0,0,0]")));
+
+    SaveBefore saving(db.memory, "UPDATE `characters`", "UPDATE characters SET bag = '[0,0,0,1];[1000,1,2,1,{7:2:0:0}]' WHERE id = 1");
+    sql_backend::Set(&saving);
+    SQL_MigrateItems();
+    sql_backend::Set(&db.memory);
+
+    // The save stays, for the next run to convert.
+    CHECK_EQUAL("[0,0,0,1];[1000,1,2,1,{7:2:0:0}]", SelectOne("SELECT bag FROM characters WHERE id = 1", "bag"));
+    CHECK(item_blob::IsBlob(SelectOne("SELECT bag FROM characters WHERE id = 2", "bag")));
+
+    SQL_MigrateItems();
+    CHECK(item_blob::IsBlob(SelectOne("SELECT bag FROM characters WHERE id = 1", "bag")));
+    CHECK(item_blob::IsBlob(SelectOne("SELECT dress FROM characters WHERE id = 1", "dress")));
+}
+
+TEST(SqlMemory_DeletesInOrder) {
+    MemoryDB db;
+
+    CHECK(SimpleSQL("INSERT INTO shelf (login_id, server_id, cabinet, mutex, money) VALUES (1, 1, 0, 0, 30), (1, 2, 0, 0, 10), (1, 3, 0, 0, 20)"));
+    CHECK(SimpleSQL("DELETE FROM shelf WHERE login_id = 1 ORDER BY money DESC LIMIT 2"));
+    CHECK_EQUAL(2, SQL_AffectedRows());
+    CHECK_EQUAL("10", SelectOne("SELECT money FROM shelf", "money"));
+}
+
+TEST(SqlMemory_RollsBack) {
+    MemoryDB db;
+
+    CHECK(SimpleSQL("INSERT INTO shelf (login_id, server_id, cabinet, mutex, money) VALUES (1, 1, 0, 0, 10)"));
+    CHECK(SimpleSQL("START TRANSACTION"));
+    CHECK(SimpleSQL("UPDATE shelf SET money = 99"));
+    CHECK(SimpleSQL("DELETE FROM shelf"));
+    CHECK(SimpleSQL("INSERT INTO shelf (login_id, server_id, cabinet, mutex, money) VALUES (2, 1, 0, 0, 5)"));
+    CHECK(SimpleSQL("ROLLBACK"));
+
+    CHECK_EQUAL("10", SelectOne("SELECT money FROM shelf", "money"));
+}
+
+TEST(SqlMemory_CommitsUnitOfWork) {
+    MemoryDB db;
+
+    {
+        unit_of_work::UnitOfWork save("test");
+        update_character::SaveTreasurePoints(1, EASY, 4);
+        CHECK(unit_of_work::Write("INSERT INTO shelf (login_id, server_id, cabinet, mutex, money) VALUES (1, 1, 0, 0, 10)"));
+        CHECK(save.Commit());
+    }
+    CHECK_EQUAL("4", SelectOne("SELECT treasure_points FROM treasure", "treasure_points"));
+
+    // A failing statement leaves nothing behind.
+    {
+        unit_of_work::UnitOfWork save("test");
+        update_character::SaveTreasurePoints(1, EASY, 4);
+        CHECK(unit_of_work::Write("UPDATE no_such_table SET x = 1"));
+        CHECK(!save.Commit());
+    }
+    CHECK_EQUAL("4", SelectOne("SELECT treasure_points FROM treasure", "treasure_points"));
+}
+
+TEST(SqlMemory_KeepsShelves) {
+    MemoryDB db;
+
+    CCharacter chr;
+    chr.LoginID = 31337;
+    chr.Nick = "shelver";
+
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 1000));
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 500));
+
+    int32_t mutex = 0;
+    std::string items;
+    int64_t money = 0;
+    bool exists = false;
+    CHECK(shelf::PickFromShelf(chr, EASY, &mutex, &items, &money, exists));
+    CHECK(exists);
+    CHECK_EQUAL(1500, money);
+    CHECK_EQUAL(1, mutex);
+}
+
+TEST(SqlMemory_ShelfCacheSurvivesRollback) {
+    MemoryDB db;
+
+    CCharacter chr;
+    chr.LoginID = 31338;
+    chr.Nick = "shelver";
+
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 1000));
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 500));
+
+    // The shelf is saved at `mutex` 2, then the save fails to commit.
+    {
+        unit_of_work::UnitOfWork save("test");
+        CHECK(shelf::StoreOnShelf(chr, EASY, {}, 200));
+        CHECK(unit_of_work::Write("UPDATE no_such_table SET x = 1"));
+        CHECK(!save.Commit());
+    }
+
+    // Someone else commits `mutex` 2 with other content.
+    CHECK(SimpleSQL("UPDATE shelf SET mutex = 2, money = 9 WHERE login_id = 31338"));
+
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 100));
+    CHECK_EQUAL("109", SelectOne("SELECT money FROM shelf WHERE login_id = 31338", "money"));
+
+    // A committed save is cached as usual.
+    {
+        unit_of_work::UnitOfWork save("test");
+        CHECK(shelf::StoreOnShelf(chr, EASY, {}, 1));
+        CHECK(save.Commit());
+    }
+    CHECK(shelf::StoreOnShelf(chr, EASY, {}, 1));
+    CHECK_EQUAL("111", SelectOne("SELECT money FROM shelf WHERE login_id = 31338", "money"));
+    CHECK_EQUAL("5", SelectOne("SELECT mutex FROM shelf WHERE login_id = 31338", "mutex"));
+}
+
+TEST(SqlMemory_FailsUnsupportedQueries) {
+    MemoryDB db;
+
+    CHECK(SQL_Query("SELECT login_id, COUNT(*) FROM shelf GROUP BY login_id") != 0);
+    CHECK(SQL_Error().find("not supported") != std::string::npos);
+
+    CHECK(SQL_Query("SELECT nothing FROM shelf") != 0);
+    CHECK(SQL_Error().find("Unknown column") != std::string::npos);
+}
+
+TEST(ResultView_ReadsColumnsByName) {
+    MemoryDB db;
+
+    CHECK(SimpleSQL("INSERT INTO shelf (login_id, server_id, cabinet, mutex, items, money) VALUES (1, 1, 0, NULL, 'abc', 4000000000), (2, 2, 0, 3, '', -5)"));
+
+    SimpleSQL select{"SELECT login_id, items, money, mutex FROM shelf ORDER BY server_id"};
+    CHECK(select);
+    ResultView view(select.result);
+
+    CHECK(view.Next());
+    CHECK_EQUAL(1, view.Int("login_id"));
+    CHECK_EQUAL("abc", std::string(view.String("items")));
+    CHECK_EQUAL(4000000000LL, view.Int64("money"));
+    // Same as `SQL_FetchInt`: NULL isn't a number.
+    CHECK_EQUAL(-1, view.Int("mutex"));
+    // Out of order.
+    CHECK_EQUAL(1, view.Int("login_id"));
+    CHECK_EQUAL(-1, view.Column("no_such_column"));
+    CHECK(view.String("no_such_column").empty());
+
+    CHECK(view.Next());
+    CHECK_EQUAL(2, view.Int("login_id"));
+    CHECK_EQUAL(3, view.Int("mutex"));
+    CHECK_EQUAL(-1, view.Int64("money"));
+
+    CHECK(!view.Next());
+}
+
+TEST(SqlMemory_AddsLatency) {
+    sql_backend::Memory memory;
+    sql_backend::WithLatency delayed(memory, std::chrono::milliseconds(20));
+
+    auto started = std::chrono::steady_clock::now();
+    CHECK_EQUAL(0, delayed.Query("CREATE TABLE t (a INT)"));
+    CHECK(std::chrono::steady_clock::now() - started >= std::chrono::milliseconds(20));
+
+    // Reading the result is free.
+    started = std::chrono::steady_clock::now();
+    CHECK_EQUAL(0, delayed.NumRows(delayed.StoreResult()));
+    CHECK(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(20));
+}
+
+}
@@ -11,13 +11,7 @@
 int main() {
     Config::LogLevel = LOG_Silent; // Silence all logs for all tests.
 
-    try {
-#include "thresholds.generated.h"
-        thresholds::thresholds.LoadFromContent(default_thresholds);
-    } catch (const thresholds::ParseException& e) {
-        printf("Thresholds: %s\n", e.what());
-        return 1;
-    }
+    thresholds::thresholds.LoadBaked();
 
     return UnitTest::RunAllTests();
 }
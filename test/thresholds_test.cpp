@@ -0,0 +1,228 @@
+#include <fstream>
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../constants.h"
+#include "../thresholds.h"
+#include "thresholds.baked.h"
+#include "thresholds.generated.h"
+
+namespace
+{
+
+const char* content = R"(
+money {
+    female | hell {
+        EASY = 5
+        NIVAL {
+            legend = 7
+            default = 8
+        }
+    }
+    default {
+        EASY = 1k
+        HARD = 2m
+    }
+}
+kills {
+    HARD {
+        1 = 10
+        2 = 20
+    }
+}
+)";
+
+const thresholds::Key MONEY("money");
+const thresholds::Key KILLS("kills");
+const thresholds::Key MISSING("money.nothing.here");
+const thresholds::Key REBORN_REACTION("reborn.stats.reaction");
+
+CCharacter Character(uint8_t sex, std::string nick) {
+    CCharacter chr;
+    chr.Sex = sex;
+    chr.Nick = nick;
+    chr.Deaths = 5;
+    return chr;
+}
+
+TEST(Thresholds_KeyMatchesString) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter warrior = Character(sex::warrior, "warrior");
+    CCharacter witch = Character(sex::witch, "witch");
+    CCharacter legend = Character(sex::amazon, "_legend");
+
+    CHECK_EQUAL(1000u, t.Value(MONEY, warrior, EASY));
+    CHECK_EQUAL(2000000u, t.Value(MONEY, warrior, HARD));
+    CHECK_EQUAL(0u, t.Value(MONEY, warrior, NIVAL));
+    CHECK_EQUAL(5u, t.Value(MONEY, witch, EASY));
+    CHECK_EQUAL(8u, t.Value(MONEY, witch, NIVAL));
+    CHECK_EQUAL(7u, t.Value(MONEY, legend, NIVAL));
+
+    for (auto server_id : {EASY, NIVAL, HARD}) {
+        for (const auto& chr : {warrior, witch, legend}) {
+            CHECK_EQUAL(t.Value("money", chr, server_id), t.Value(MONEY, chr, server_id));
+        }
+    }
+}
+
+TEST(Thresholds_AliasedSections) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter hell = Character(sex::warrior, "1hell");
+    CCharacter witch = Character(sex::witch, "witch");
+
+    CHECK_EQUAL(5u, t.Value(MONEY, hell, EASY));
+    CHECK_EQUAL(t.Value(MONEY, witch, NIVAL), t.Value(MONEY, hell, NIVAL));
+}
+
+TEST(Thresholds_KeyMobs) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    auto mobs = t.Mobs(KILLS, chr, HARD);
+    CHECK_EQUAL(2u, mobs.size());
+    if (mobs.size() == 2) {
+        CHECK_EQUAL(1, mobs[0].id);
+        CHECK_EQUAL(10, mobs[0].kills);
+        CHECK_EQUAL(2, mobs[1].id);
+        CHECK_EQUAL(20, mobs[1].kills);
+    }
+
+    CHECK(t.Mobs(KILLS, chr, EASY).empty());
+}
+
+TEST(Thresholds_KeyMissing) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    CHECK_EQUAL(0u, t.Value(MISSING, chr, EASY));
+    CHECK_EQUAL(0u, t.Value("money.nothing.here", chr, EASY));
+    CHECK_EQUAL(1000u, t.Value(MONEY, chr, EASY)); // The failed lookup doesn't break the tree.
+}
+
+TEST(Thresholds_KeyCreatedAfterLoad) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    thresholds::Key late("money.default");
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    CHECK_EQUAL(2000000u, t.Value(late, chr, HARD));
+}
+
+TEST(Thresholds_KeyReload) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+    t.LoadFromContent("money {\n    EASY = 3\n}\n");
+
+    CCharacter chr = Character(sex::witch, "witch");
+
+    CHECK_EQUAL(3u, t.Value(MONEY, chr, EASY));
+    CHECK(t.Mobs(KILLS, chr, HARD).empty());
+}
+
+
+TEST(Thresholds_PinKeepsSnapshot) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    {
+        thresholds::Pin pin(t);
+        t.LoadFromContent("money {\n    EASY = 3\n}\n");
+        CHECK_EQUAL(1000u, t.Value(MONEY, chr, EASY));
+        CHECK_EQUAL(2u, t.Mobs(KILLS, chr, HARD).size());
+    }
+
+    CHECK_EQUAL(3u, t.Value(MONEY, chr, EASY));
+}
+
+TEST(Thresholds_MobsOutliveReload) {
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    auto mobs = t.Mobs(KILLS, chr, HARD);
+    t.LoadFromContent("money {\n    EASY = 3\n}\n");
+
+    CHECK_EQUAL(2u, mobs.size());
+    if (mobs.size() == 2) {
+        CHECK_EQUAL(1, mobs[0].id);
+        CHECK_EQUAL(20, mobs[1].kills);
+    }
+}
+
+TEST(Thresholds_ReloadAsync) {
+    const char* file_name = "thresholds_test.tmp";
+    thresholds::Thresholds t;
+    t.LoadFromContent(content);
+
+    CCharacter chr = Character(sex::warrior, "warrior");
+
+    std::ofstream(file_name) << "money {\n    EASY = 3\n}\n";
+    CHECK(t.ReloadAsync(file_name));
+    t.WaitReload();
+    CHECK_EQUAL(3u, t.Value(MONEY, chr, EASY));
+
+    // A broken file keeps the current thresholds.
+    std::ofstream(file_name) << "money {\n    EASY = lots\n}\n";
+    CHECK(t.ReloadAsync(file_name));
+    t.WaitReload();
+    CHECK_EQUAL(3u, t.Value(MONEY, chr, EASY));
+
+    std::remove(file_name);
+}
+
+TEST(Thresholds_BakedMatchesParsed) {
+    thresholds::Thresholds parsed;
+    parsed.LoadFromContent(default_thresholds);
+    thresholds::Thresholds baked;
+    baked.LoadBaked();
+
+    auto p = parsed.Snapshot();
+    auto b = baked.Snapshot();
+    CHECK(thresholds::Validate(p->Nodes(), p->Children(), p->AllMobs()));
+
+    REQUIRE CHECK_EQUAL(p->Nodes().size(), b->Nodes().size());
+    for (size_t i = 0; i < p->Nodes().size(); i++) {
+        const auto& pn = p->Nodes()[i];
+        const auto& bn = b->Nodes()[i];
+        CHECK_EQUAL(pn.number, bn.number);
+        CHECK_EQUAL(pn.is_leaf, bn.is_leaf);
+        CHECK_EQUAL(pn.first_child, bn.first_child);
+        CHECK_EQUAL(pn.child_count, bn.child_count);
+        CHECK_ARRAY_EQUAL(pn.kind, bn.kind, thresholds::KIND_COUNT);
+        CHECK_EQUAL(pn.has_by_server, bn.has_by_server);
+        CHECK_ARRAY_EQUAL(pn.by_server, bn.by_server, thresholds::SERVER_ID_COUNT);
+        CHECK_EQUAL(pn.first_mob, bn.first_mob);
+        CHECK_EQUAL(pn.mob_count, bn.mob_count);
+    }
+
+    REQUIRE CHECK_EQUAL(p->Children().size(), b->Children().size());
+    for (size_t i = 0; i < p->Children().size(); i++) {
+        CHECK_EQUAL(std::string(p->Children()[i].name), std::string(b->Children()[i].name));
+        CHECK_EQUAL(p->Children()[i].node, b->Children()[i].node);
+    }
+
+    REQUIRE CHECK_EQUAL(p->AllMobs().size(), b->AllMobs().size());
+    for (size_t i = 0; i < p->AllMobs().size(); i++) {
+        CHECK_EQUAL(p->AllMobs()[i].id, b->AllMobs()[i].id);
+        CHECK_EQUAL(p->AllMobs()[i].kills, b->AllMobs()[i].kills);
+    }
+
+    // Keys resolve the same way without parsing.
+    REQUIRE CHECK(p->Resolved(REBORN_REACTION) != nullptr);
+    CHECK_EQUAL(p->Resolved(REBORN_REACTION) - p->Nodes().data(), b->Resolved(REBORN_REACTION) - b->Nodes().data());
+}
+
+}
@@ -0,0 +1,100 @@
+#include <random>
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../timers.h"
+
+namespace
+{
+
+TEST(Timers_FireOnceAtTheirTick) {
+    timers::Wheel wheel(1000, 100);
+    std::vector<int> fired;
+
+    wheel.Schedule(250, [&] { fired.push_back(1); });
+    timers::Wheel::Id cancelled = wheel.Schedule(250, [&] { fired.push_back(2); });
+    wheel.Schedule(0, [&] { fired.push_back(3); });
+    CHECK_EQUAL(3u, wheel.Size());
+    CHECK(wheel.Cancel(cancelled));
+    CHECK(!wheel.Cancel(cancelled));
+    CHECK(!wheel.Cancel(0));
+
+    CHECK_EQUAL(0u, wheel.Advance(1099));
+    CHECK_EQUAL(1u, wheel.Advance(1100));
+    CHECK(std::vector<int>{3} == fired);
+    CHECK_EQUAL(0u, wheel.Advance(1299));
+    CHECK_EQUAL(1u, wheel.Advance(1300));
+    CHECK(std::vector<int>({3, 1}) == fired);
+    CHECK_EQUAL(0u, wheel.Size());
+
+    // A callback reschedules itself, as a deadline extended on activity.
+    int repeats = 0;
+    std::function<void()> repeat = [&] {
+        if (++repeats < 3) {
+            wheel.Schedule(1000, repeat);
+        }
+    };
+    wheel.Schedule(1000, repeat);
+    for (uint64_t now = 1400; now <= 10000; now += 100) {
+        wheel.Advance(now);
+    }
+    CHECK_EQUAL(3, repeats);
+}
+
+TEST(Timers_HundredThousandTimers) {
+    const size_t COUNT = 100000;
+    const uint64_t START = 123456789;
+    timers::Wheel wheel(START, 100);
+    std::mt19937 random(42);
+
+    struct Timer {
+        uint64_t due;
+        uint64_t fired_at = 0;
+        bool cancelled = false;
+        timers::Wheel::Id id;
+    };
+    std::vector<Timer> all(COUNT);
+    uint64_t now = START;
+
+    // Up to about a day: every level of the wheel, and some beyond its reach of 64^4 ticks.
+    std::uniform_int_distribution<uint64_t> delays[] = {
+        std::uniform_int_distribution<uint64_t>(0, 6400),
+        std::uniform_int_distribution<uint64_t>(0, 409600),
+        std::uniform_int_distribution<uint64_t>(0, 90000000),
+        std::uniform_int_distribution<uint64_t>(1677721600, 1700000000),
+    };
+    for (size_t i = 0; i < COUNT; i++) {
+        uint64_t delay = delays[i % 40 == 0 ? 3 : i % 3](random);
+        all[i].due = now + delay;
+        all[i].id = wheel.Schedule(delay, [&all, &now, i] { all[i].fired_at = now; });
+    }
+    for (size_t i = 0; i < COUNT; i += 7) {
+        CHECK(wheel.Cancel(all[i].id));
+        all[i].cancelled = true;
+    }
+
+    // Uneven steps, as the event loop runs.
+    std::uniform_int_distribution<uint64_t> step(1, 5000);
+    size_t fired = 0;
+    while (wheel.Size()) {
+        now += step(random);
+        fired += wheel.Advance(now);
+    }
+
+    size_t expected = 0;
+    bool on_time = true;
+    for (const Timer& timer : all) {
+        if (timer.cancelled) {
+            on_time = on_time && !timer.fired_at;
+            continue;
+        }
+        expected++;
+        // Not before the deadline, and within the step that reached it.
+        on_time = on_time && timer.fired_at >= timer.due && timer.fired_at < timer.due + 100 + 5000;
+    }
+    CHECK(on_time);
+    CHECK_EQUAL(expected, fired);
+}
+
+}
@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "UnitTest++.h"
+
+#include "../client.hpp"
+#include "../packet.hpp"
+#include "../trace.h"
+
+namespace
+{
+
+const char* PATH = "trace_test.trace";
+
+sockaddr_in Address(uint32_t ip, uint16_t port) {
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(ip);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+std::vector<uint8_t> Bytes(Packet& pack) {
+    uint8_t* data = NULL;
+    uint32_t size;
+    pack.GetAllData(data, size);
+    std::vector<uint8_t> bytes(data, data + size);
+    delete[] data;
+    return bytes;
+}
+
+// A 2.0 login as the hat receives it: encrypted, see `CL_Login`.
+Packet Auth(const std::string& login, const std::string& password) {
+    uint8_t data[0x40] = {};
+    Packet pack;
+    pack << (uint8_t)0;
+    pack.AppendData(data, sizeof(data));
+    pack << (uint32_t)(20 << 24 | login.length());
+    pack << (login + password);
+
+    std::vector<uint8_t> bytes = Bytes(pack);
+    PACKET_XorByKey(bytes.data(), (unsigned long)bytes.size(), 20);
+    Packet encrypted;
+    encrypted.AppendData(bytes.data(), (uint32_t)bytes.size());
+    return encrypted;
+}
+
+// Login and password of an `Auth` packet.
+std::pair<std::string, std::string> Credentials(std::vector<uint8_t> packet) {
+    PACKET_XorByKey(packet.data(), (unsigned long)packet.size(), 20);
+    uint32_t header;
+    uint16_t length;
+    std::memcpy(&header, &packet[0x41], 4);
+    std::memcpy(&length, &packet[0x45], 2);
+    std::string text(packet.begin() + 0x47, packet.begin() + 0x47 + length);
+    return {text.substr(0, header & 0xFFFF), text.substr(header & 0xFFFF)};
+}
+
+std::vector<trace::Record> ReadAll(bool& anonymized) {
+    trace::Reader reader;
+    std::vector<trace::Record> records;
+    if (!reader.Open(PATH)) {
+        return records;
+    }
+    anonymized = reader.Anonymized();
+    trace::Record record;
+    while (reader.Next(record)) {
+        records.push_back(record);
+    }
+    return records;
+}
+
+TEST(Trace_RecordsTheConnectionsOpenedWhileOn) {
+    Packet before;
+    before << (uint8_t)0xC8;
+    trace::Opened(5, trace::PEER_CLIENT, Address(0x0A000001, 1234));
+    trace::Received(5, before, 20);
+
+    CHECK(trace::Start(PATH, false));
+    trace::Opened(7, trace::PEER_SERVER, Address(0x7F000001, 8001));
+
+    // The end bytes `PACKET_Frame` adds aren't kept.
+    Packet request;
+    request << (uint8_t)0xD2 << (uint8_t)0x64 << (uint8_t)0x01 << (uint8_t)0x00 << (uint8_t)0x00 << (uint8_t)0x00;
+    trace::Received(7, request, 20);
+    trace::Received(5, before, 20);
+    const uint8_t answer[] = {0xD5, 1, 2, 3};
+    trace::Sent(7, answer, sizeof(answer), 20);
+    trace::Closed(7);
+    trace::Stop();
+    CHECK(!trace::Active());
+
+    bool anonymized = true;
+    std::vector<trace::Record> records = ReadAll(anonymized);
+    std::remove(PATH);
+    CHECK(!anonymized);
+    CHECK_EQUAL(4u, records.size());
+    if (records.size() != 4) {
+        return;
+    }
+
+    CHECK_EQUAL(trace::RECORD_OPENED, records[0].type);
+    CHECK_EQUAL(1u, records[0].connection);
+    CHECK_EQUAL(trace::PEER_SERVER, records[0].peer);
+    CHECK_EQUAL(htonl(0x7F000001), records[0].address);
+    CHECK_EQUAL(8001, records[0].port);
+
+    CHECK_EQUAL(trace::RECORD_RECEIVED, records[1].type);
+    CHECK_EQUAL(20, records[1].version);
+    CHECK(records[1].packet == std::vector<uint8_t>{0xD2});
+
+    CHECK_EQUAL(trace::RECORD_SENT, records[2].type);
+    CHECK(records[2].packet == std::vector<uint8_t>(answer, answer + sizeof(answer)));
+
+    CHECK_EQUAL(trace::RECORD_CLOSED, records[3].type);
+    CHECK_EQUAL(1u, records[3].connection);
+    CHECK(records[0].us <= records[1].us && records[1].us <= records[2].us && records[2].us <= records[3].us);
+}
+
+TEST(Trace_AnonymizesLoginsConsistently) {
+    CHECK(trace::Start(PATH, true));
+    trace::Opened(5, trace::PEER_CLIENT, Address(0x0A000001, 1234));
+    trace::Opened(6, trace::PEER_CLIENT, Address(0x0A000002, 1235));
+    trace::Opened(7, trace::PEER_SERVER, Address(0x7F000001, 8001));
+
+    Packet first = Auth("Player", "secret");
+    Packet second = Auth("PLAYER", "secret");
+    trace::Received(5, first, 0);
+    trace::Received(6, second, 0);
+
+    // What `SVCMD_ReceivedCharacter` sends.
+    Packet received;
+    received << (uint8_t)0xD3 << (uint32_t)0 << std::string("player");
+    std::vector<uint8_t> bytes = Bytes(received);
+    trace::Sent(7, bytes.data(), bytes.size(), 20);
+    trace::Stop();
+
+    bool anonymized = false;
+    std::vector<trace::Record> records = ReadAll(anonymized);
+    std::remove(PATH);
+    CHECK(anonymized);
+    CHECK_EQUAL(6u, records.size());
+    if (records.size() != 6) {
+        return;
+    }
+
+    // No client addresses; the servers' are needed to replay.
+    CHECK_EQUAL(0u, records[0].address);
+    CHECK_EQUAL(1234, records[0].port);
+    CHECK_EQUAL(htonl(0x7F000001), records[2].address);
+
+    std::pair<std::string, std::string> one = Credentials(records[3].packet);
+    std::pair<std::string, std::string> other = Credentials(records[4].packet);
+    CHECK_EQUAL(6u, one.first.length());
+    CHECK(one.first != "Player");
+    CHECK_EQUAL(one.first, other.first);
+    CHECK_EQUAL(6u, one.second.length());
+    CHECK(one.second != "secret");
+    CHECK_EQUAL(one.second, other.second);
+
+    // Signature, zero, string length, then the login.
+    CHECK_EQUAL(one.first, std::string(records[5].packet.begin() + 7, records[5].packet.begin() + 13));
+}
+
+TEST(Trace_AnonymizesScreenshotsAndUnknownFirstPackets) {
+    CHECK(trace::Start(PATH, true));
+    trace::Opened(5, trace::PEER_CLIENT, Address(0x0A000001, 1234));
+    trace::Opened(6, trace::PEER_CLIENT, Address(0x0A000002, 1235));
+    trace::Opened(7, trace::PEER_CLIENT, Address(0x0A000003, 1236));
+
+    Packet auth = Auth("Player", "secret");
+    trace::Received(5, auth, 0);
+
+    // What `CL_Screenshot` reads, once uploaded.
+    Packet screenshot;
+    screenshot << (uint32_t)SCREENSHOT_PID << std::string("player") << (uint32_t)0x1F410001 << (uint8_t)1
+               << std::string("http://example.com/player.png");
+    trace::Received(6, screenshot, 0);
+
+    // A 1.10 login, which isn't taken apart.
+    Packet old;
+    old << (uint8_t)(0x29 ^ key_10[0]) << std::string("Player") << std::string("secret");
+    std::vector<uint8_t> old_bytes = Bytes(old);
+    trace::Received(7, old, 0);
+    trace::Stop();
+
+    bool anonymized = false;
+    std::vector<trace::Record> records = ReadAll(anonymized);
+    std::remove(PATH);
+    CHECK_EQUAL(6u, records.size());
+    if (records.size() != 6) {
+        return;
+    }
+
+    // Id, login, uid, status, and an empty URL.
+    const std::vector<uint8_t>& shot = records[4].packet;
+    std::string login = Credentials(records[3].packet).first;
+    CHECK_EQUAL(4u + 2 + 6 + 1 + 4 + 1 + 2 + 1, shot.size());
+    CHECK_EQUAL(login, std::string(shot.begin() + 6, shot.begin() + 12));
+    CHECK_EQUAL(1, shot[17]);
+    CHECK(std::vector<uint8_t>(shot.end() - 3, shot.end()) == std::vector<uint8_t>(3, 0));
+
+    std::vector<uint8_t> blank(old_bytes.size(), 0);
+    blank[0] = old_bytes[0];
+    CHECK(records[5].packet == blank);
+}
+
+}
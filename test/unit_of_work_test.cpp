@@ -0,0 +1,73 @@
+#include <string>
+
+#include "UnitTest++.h"
+
+#include "../checkpoint.h"
+#include "../unit_of_work.h"
+#include "../update_character.h"
+
+namespace
+{
+
+// The tests run without a DB connection: queued writes don't reach it, immediate ones fail.
+
+TEST(UnitOfWork_QueuesWrites) {
+    unit_of_work::UnitOfWork save("test");
+
+    CHECK(unit_of_work::Write("UPDATE logins SET allow_mage = 1 WHERE id = 1;"));
+    CHECK(unit_of_work::Write("UPDATE logins SET allow_female = 1 WHERE id = 1"));
+    CHECK_EQUAL(2u, save.Size());
+
+    // No transaction without a connection, nothing is committed.
+    CHECK(!save.Commit());
+}
+
+TEST(UnitOfWork_SkipsEmptyStatements) {
+    unit_of_work::UnitOfWork save("test");
+
+    save.Add("");
+    save.Add(" ;\n");
+    CHECK_EQUAL(0u, save.Size());
+}
+
+TEST(UnitOfWork_WritesImmediatelyOutsideOfScope) {
+    {
+        unit_of_work::UnitOfWork save("test");
+        CHECK(unit_of_work::Write("UPDATE logins SET allow_mage = 1 WHERE id = 1"));
+    }
+
+    // Runs right away, and fails.
+    CHECK(!unit_of_work::Write("UPDATE logins SET allow_mage = 1 WHERE id = 1"));
+}
+
+TEST(UnitOfWork_RunsAfterCommitOnlyOnCommit) {
+    int runs = 0;
+    {
+        unit_of_work::UnitOfWork save("test");
+        CHECK(unit_of_work::Active());
+        unit_of_work::AfterCommit([&runs]() { runs++; });
+        CHECK(!save.Commit());
+    }
+    CHECK_EQUAL(0, runs);
+
+    // Right away without a unit of work.
+    CHECK(!unit_of_work::Active());
+    unit_of_work::AfterCommit([&runs]() { runs++; });
+    CHECK_EQUAL(1, runs);
+}
+
+TEST(UnitOfWork_UpsertsAreSingleStatements) {
+    unit_of_work::UnitOfWork save("test");
+
+    update_character::SaveTreasurePoints(1, NIGHTMARE, 0);
+    CHECK_EQUAL(0u, save.Size());
+
+    update_character::SaveTreasurePoints(1, NIGHTMARE, 3);
+    CHECK_EQUAL(1u, save.Size());
+
+    CCharacter chr;
+    CHECK(checkpoint::Checkpoint(chr, true).SaveToDB(1));
+    CHECK_EQUAL(2u, save.Size());
+}
+
+}
@@ -1,8 +1,11 @@
 #include "thresholds.h"
 
+#include <algorithm>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <stack>
+#include <unordered_map>
 
 #include "circle.h"
 #include "utils.hpp"
@@ -11,6 +14,109 @@ namespace thresholds {
 
 Thresholds thresholds;
 
+namespace {
+
+std::vector<std::string>& KeyRegistry() {
+    static std::vector<std::string> registry;
+    return registry;
+}
+
+// A section as written in the file. Only used while parsing, then flattened into a `Tree`.
+struct Section {
+    Section() : is_leaf(false), number(0) {
+    }
+
+    explicit Section(uint32_t n) : is_leaf(true), number(n) {
+    }
+
+    std::map<std::string, std::shared_ptr<Section>> children;
+    bool is_leaf;
+    uint32_t number;
+
+    std::map<ServerIDType, std::shared_ptr<Section>> by_server;
+    std::map<uint16_t, int> mobs;
+};
+
+const char* KIND_NAMES[KIND_COUNT] = {"female", "hell", "legend", "ironman", "hardcore", "default"};
+
+class Flattener {
+public:
+    uint32_t Add(const Section* section) {
+        auto seen = this->indices.find(section);
+        if (seen != this->indices.end()) {
+            return seen->second;
+        }
+
+        uint32_t index = static_cast<uint32_t>(this->nodes.size());
+        this->indices[section] = index;
+        this->nodes.emplace_back();
+
+        Node node{};
+        node.number = section->number;
+        node.is_leaf = section->is_leaf;
+        std::fill(std::begin(node.kind), std::end(node.kind), NO_NODE);
+        std::fill(std::begin(node.by_server), std::end(node.by_server), NO_NODE);
+
+        // Children first, so that their ranges don't interleave with ours. `std::map` keeps them sorted by name.
+        std::vector<uint32_t> child_nodes;
+        for (const auto& [name, child] : section->children) {
+            child_nodes.push_back(this->Add(child.get()));
+        }
+
+        node.first_child = static_cast<uint32_t>(this->children.size());
+        node.child_count = static_cast<uint32_t>(child_nodes.size());
+        size_t i = 0;
+        for (const auto& [name, child] : section->children) {
+            this->children.push_back(Child{{}, child_nodes[i++]});
+            this->child_names.push_back(name);
+
+            for (int kind = 0; kind < KIND_COUNT; kind++) {
+                if (name == KIND_NAMES[kind]) {
+                    node.kind[kind] = this->children.back().node;
+                }
+            }
+        }
+
+        node.has_by_server = !section->by_server.empty();
+        for (const auto& [server_id, child] : section->by_server) {
+            node.by_server[server_id] = this->Add(child.get());
+        }
+
+        node.first_mob = static_cast<uint32_t>(this->mobs.size());
+        node.mob_count = static_cast<uint32_t>(section->mobs.size());
+        for (const auto& [id, kills] : section->mobs) {
+            this->mobs.push_back(Mob{id, kills});
+        }
+
+        this->nodes[index] = node;
+        return index;
+    }
+
+    std::shared_ptr<const Tree> Build() {
+        // The views point into `child_names` for now, the tree rebases them into its own copy of `names`.
+        std::string names;
+        for (size_t i = 0; i < this->children.size(); i++) {
+            this->children[i].name = this->child_names[i];
+            names += this->child_names[i];
+        }
+
+        return std::make_shared<const Tree>(std::move(this->nodes), std::move(this->children), std::move(this->mobs), std::move(names));
+    }
+
+private:
+    std::unordered_map<const Section*, uint32_t> indices;
+    std::vector<Node> nodes;
+    std::vector<Child> children;
+    std::vector<std::string> child_names;
+    std::vector<Mob> mobs;
+};
+
+} // namespace
+
+Key::Key(std::string path) : path(std::move(path)), index(KeyRegistry().size()) {
+    KeyRegistry().push_back(this->path);
+}
+
 ServerIDType ServerType(const std::string& value) {
     if (value == "EASY") {
         return EASY;
@@ -36,26 +142,124 @@ ServerIDType ServerType(const std::string& value) {
     return UNDEFINED;
 }
 
-void Thresholds::LoadFromContent(std::string content) {
-    std::istringstream stream(content);
-    LoadFromStream(stream);
+Tree::Tree(std::vector<Node> nodes, std::vector<Child> children, std::vector<Mob> mobs, std::string names)
+    : owned_nodes(std::move(nodes)), owned_children(std::move(children)), owned_mobs(std::move(mobs)), names(std::move(names)),
+      nodes(this->owned_nodes), children(this->owned_children), mobs(this->owned_mobs) {
+    // The names are concatenated in the order of `children`, point the views into our copy.
+    size_t offset = 0;
+    for (auto& child : this->owned_children) {
+        size_t length = child.name.size();
+        child.name = std::string_view(this->names).substr(offset, length);
+        offset += length;
+    }
+
+    this->ResolveKeys();
 }
 
-void Thresholds::LoadFromFile(std::string file_name) {
-    std::ifstream fin(file_name);
-    if (!fin) {
-        throw ParseException(Format("failed to open file '%s'\n", file_name.c_str()));
+Tree::Tree(std::span<const Node> nodes, std::span<const Child> children, std::span<const Mob> mobs)
+    : nodes(nodes), children(children), mobs(mobs) {
+    this->ResolveKeys();
+}
+
+void Tree::ResolveKeys() {
+    const auto& keys = KeyRegistry();
+    this->resolved.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Node* node = this->Path(keys[i]);
+        this->resolved[i] = node ? static_cast<uint32_t>(node - this->nodes.data()) : NO_NODE;
     }
+}
 
-    LoadFromStream(fin);
+const Node* Tree::Path(std::string_view key) const {
+    if (this->nodes.empty()) {
+        return nullptr;
+    }
+
+    const Node* node = &this->nodes[0];
+
+    while (true) {
+        size_t dot = key.find('.');
+        std::string_view name = key.substr(0, dot);
+
+        auto first = this->children.begin() + node->first_child;
+        auto last = first + node->child_count;
+        auto child = std::lower_bound(first, last, name, [](const Child& c, std::string_view n) { return c.name < n; });
+        if (child == last || child->name != name) {
+            return nullptr;
+        }
+        node = &this->nodes[child->node];
+
+        if (dot == std::string_view::npos) {
+            return node;
+        }
+        key.remove_prefix(dot + 1);
+    }
 }
 
-void Thresholds::LoadFromStream(std::istream& stream) {
+const Node* Tree::Resolved(const Key& key) const {
+    if (key.Index() < this->resolved.size()) {
+        return this->At(this->resolved[key.Index()]);
+    }
+    return this->Path(key.Path());
+}
+
+const Node* Tree::Descend(const Node* at, const CCharacter& chr, ServerIDType server_id) const {
+    if (!at) {
+        return nullptr;
+    }
+
+    // First descend by character kind.
+    if (at->child_count) {
+        if (chr.IsFemale() && at->kind[KIND_FEMALE] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_FEMALE]), chr, server_id);
+        }
+
+        if (circle::Circle(chr) > 0 && at->kind[KIND_HELL] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_HELL]), chr, server_id);
+        }
+
+        if (IsLegend(chr) && at->kind[KIND_LEGEND] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_LEGEND]), chr, server_id);
+        }
+
+        if (IsIronMan(chr) && at->kind[KIND_IRONMAN] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_IRONMAN]), chr, server_id);
+        }
+
+        if (chr.Deaths <= 1 && at->kind[KIND_HARDCORE] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_HARDCORE]), chr, server_id);
+        }
+
+        if (at->kind[KIND_DEFAULT] != NO_NODE) {
+            return this->Descend(this->At(at->kind[KIND_DEFAULT]), chr, server_id);
+        }
+    }
+
+    // Then descend by server ID.
+    if (at->has_by_server) {
+        // Intentional. If settings aren't filled for the server ID, there are no thresholds.
+        if (static_cast<size_t>(server_id) >= SERVER_ID_COUNT) {
+            return nullptr;
+        }
+        return this->Descend(this->At(at->by_server[server_id]), chr, server_id);
+    }
+
+    return at;
+}
+
+std::span<const Mob> Tree::Mobs(const Node* node) const {
+    if (!node) {
+        return {};
+    }
+    return this->mobs.subspan(node->first_mob, node->mob_count);
+}
+
+std::shared_ptr<const Tree> Parse(std::istream& stream) {
     std::string line;
     int line_number = 0;
 
-    std::stack<std::shared_ptr<Node>> stack;
-    auto root = std::make_shared<Node>();
+    std::stack<std::shared_ptr<Section>> stack;
+    auto root = std::make_shared<Section>();
     stack.push(root);
 
     while (std::getline(stream, line)) {
@@ -74,7 +278,7 @@ void Thresholds::LoadFromStream(std::istream& stream) {
         if (line.back() == '{') {
             std::string section_name = Trim(line.substr(0, line.length() - 1));
 
-            auto node = std::make_shared<Node>();
+            auto node = std::make_shared<Section>();
             for (auto alias : Explode(section_name, "|")) {
                 alias = Trim(alias);
 
@@ -100,7 +304,7 @@ void Thresholds::LoadFromStream(std::istream& stream) {
             size_t equals = line.find('=');
 
             if (equals == std::string::npos) {
-                throw ParseException(Format("line %d: invalid syntax: '%s' is not a section or a key-value pair", line_number, line));
+                throw ParseException(Format("line %d: invalid syntax: '%s' is not a section or a key-value pair", line_number, line.c_str()));
             }
 
             std::string key = Trim(line.substr(0, equals));
@@ -118,7 +322,7 @@ void Thresholds::LoadFromStream(std::istream& stream) {
             }
 
             if (!CheckInt(value)) {
-                throw ParseException(Format("line %d: invalid syntax: '%s' is not a number", line_number, value));
+                throw ParseException(Format("line %d: invalid syntax: '%s' is not a number", line_number, value.c_str()));
             }
 
             uint32_t number = static_cast<uint32_t>(StrToInt(value)) * multiplier;
@@ -128,13 +332,13 @@ void Thresholds::LoadFromStream(std::istream& stream) {
             // Parse the key type. Can be a regular key-value mapping or a server_id mapping, or a mob mapping.
             auto server = ServerType(key);
             if (server != UNDEFINED) {
-                node->by_server[server] = std::make_shared<Node>(number);
+                node->by_server[server] = std::make_shared<Section>(number);
             } else {
                 if (CheckInt(key)) {
                     uint16_t mob_id = static_cast<uint16_t>(StrToInt(key));
                     node->mobs[mob_id] = static_cast<int>(number);
                 } else {
-                    node->children[key] = std::make_shared<Node>(number);
+                    node->children[key] = std::make_shared<Section>(number);
                 }
             }
 
@@ -148,94 +352,186 @@ void Thresholds::LoadFromStream(std::istream& stream) {
         throw ParseException(Format("line %d: invalid syntax: section was not closed", line_number));
     }
 
-    this->root = std::move(root);
+    Flattener flattener;
+    flattener.Add(root.get());
+    return flattener.Build();
 }
 
-uint32_t Thresholds::Value(std::string key, const CCharacter& chr, ServerIDType server_id) const {
-    Printf(LOG_Info, "[thresholds] Picking value at key '%s' for character '%s' on s%d\n", key.c_str(), chr.GetFullName().c_str(), server_id);
-    const Node* node = this->Descend(this->Path(key), chr, server_id);
-    return node ? node->number : 0;
-}
+void WriteBaked(const Tree& tree, std::ostream& out) {
+    auto write_indices = [&out](const uint32_t* first, const uint32_t* last) {
+        out << "{";
+        for (auto it = first; it != last; ++it) {
+            out << (it == first ? "" : ", ");
+            if (*it == NO_NODE) {
+                out << "NO_NODE";
+            } else {
+                out << *it;
+            }
+        }
+        out << "}";
+    };
+
+    out << "// Generated from thresholds.txt by thresholds-compile. Do not edit.\n"
+        << "#pragma once\n\n"
+        << "#include <array>\n\n"
+        << "#include \"thresholds.h\"\n\n"
+        << "namespace thresholds::baked {\n\n";
+
+    // Node: number, is_leaf, first_child, child_count, kind, has_by_server, by_server, first_mob, mob_count.
+    out << "inline constexpr std::array<Node, " << tree.Nodes().size() << "> nodes = {{\n";
+    for (const Node& node : tree.Nodes()) {
+        out << "    {" << node.number << "u, " << (node.is_leaf ? "true" : "false") << ", "
+            << node.first_child << ", " << node.child_count << ", ";
+        write_indices(std::begin(node.kind), std::end(node.kind));
+        out << ", " << (node.has_by_server ? "true" : "false") << ", ";
+        write_indices(std::begin(node.by_server), std::end(node.by_server));
+        out << ", " << node.first_mob << ", " << node.mob_count << "},\n";
+    }
+    out << "}};\n\n";
+
+    out << "inline constexpr std::array<Child, " << tree.Children().size() << "> children = {{\n";
+    for (const Child& child : tree.Children()) {
+        out << "    {\"";
+        for (char c : child.name) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << "\", " << child.node << "},\n";
+    }
+    out << "}};\n\n";
 
-const std::unordered_map<uint16_t, int>* Thresholds::Mobs(std::string key, const CCharacter& chr, ServerIDType server_id) const {
-    Printf(LOG_Info, "[thresholds] Picking mobs at key '%s' for character '%s' on s%d\n", key.c_str(), chr.GetFullName().c_str(), server_id);
-    const Node* node = this->Descend(this->Path(key), chr, server_id);
-    return node ? &node->mobs : nullptr;
+    out << "inline constexpr std::array<Mob, " << tree.AllMobs().size() << "> mobs = {{\n";
+    for (const Mob& mob : tree.AllMobs()) {
+        out << "    {" << mob.id << ", " << mob.kills << "},\n";
+    }
+    out << "}};\n\n";
+
+    out << "static_assert(Validate(nodes, children, mobs), \"thresholds tables are inconsistent\");\n\n"
+        << "} // namespace thresholds::baked\n";
 }
 
-const Node* Thresholds::Path(std::string key) const {
-    Node* node = this->root.get();
+void Thresholds::LoadFromContent(std::string content) {
+    std::istringstream stream(content);
+    LoadFromStream(stream);
+}
 
-    for (auto p: Explode(key, ".")) {
-        node = node->children[p].get();
-        if (!node) {
-            return nullptr;
-        }
+void Thresholds::LoadFromFile(std::string file_name) {
+    std::ifstream fin(file_name);
+    if (!fin) {
+        throw ParseException(Format("failed to open file '%s'\n", file_name.c_str()));
     }
 
-    return node;
+    LoadFromStream(fin);
 }
 
-const Node* Thresholds::Descend(const Node* at, const CCharacter& chr, ServerIDType server_id) const {
-    if (!at) {
-        return nullptr;
+void Thresholds::LoadFromStream(std::istream& stream) {
+    this->tree.store(Parse(stream));
+}
+
+Thresholds::~Thresholds() {
+    this->WaitReload();
+}
+
+bool Thresholds::ReloadAsync(std::string file_name) {
+    if (this->reloading.exchange(true)) {
+        Printf(LOG_Warning, "[thresholds] Reload of '%s' skipped: another reload is running\n", file_name.c_str());
+        return false;
     }
 
-    // First descend by character kind.
-    if (!at->children.empty()) {
-        if (chr.IsFemale()) {
-            auto ptr = at->children.find("female");
-            if (ptr != at->children.end()) {
-                return this->Descend(ptr->second.get(), chr, server_id);
-            }
-        }
+    // The previous worker has finished, but still has to be joined.
+    if (this->reload_thread.joinable()) {
+        this->reload_thread.join();
+    }
 
-        if (circle::Circle(chr) > 0) {
-            auto ptr = at->children.find("hell");
-            if (ptr != at->children.end()) {
-                return this->Descend(ptr->second.get(), chr, server_id);
+    this->reload_thread = std::thread([this, file_name]() {
+        try {
+            std::ifstream fin(file_name);
+            if (!fin) {
+                throw ParseException(Format("failed to open file '%s'", file_name.c_str()));
             }
-        }
 
-        if (IsLegend(chr)) {
-            auto ptr = at->children.find("legend");
-            if (ptr != at->children.end()) {
-                return this->Descend(ptr->second.get(), chr, server_id);
-            }
+            auto tree = Parse(fin);
+            this->tree.store(std::move(tree));
+            Printf(LOG_Info, "[thresholds] Reloaded thresholds from '%s'\n", file_name.c_str());
+        } catch (const ParseException& e) {
+            Printf(LOG_Error, "[thresholds] Reload of '%s' failed, keeping the current thresholds: %s\n", file_name.c_str(), e.what());
         }
 
-        if (IsIronMan(chr)) {
-            auto ptr = at->children.find("ironman");
-            if (ptr != at->children.end()) {
-                return this->Descend(ptr->second.get(), chr, server_id);
-            }
-        }
+        this->reloading.store(false);
+    });
 
-        if (chr.Deaths <= 1) {
-            auto ptr = at->children.find("hardcore");
-            if (ptr != at->children.end()) {
-                return this->Descend(ptr->second.get(), chr, server_id);
-            }
-        }
-        
-        auto ptr = at->children.find("default");
-        if (ptr != at->children.end()) {
-            return this->Descend(ptr->second.get(), chr, server_id);
-        }
+    return true;
+}
+
+void Thresholds::WaitReload() {
+    if (this->reload_thread.joinable()) {
+        this->reload_thread.join();
     }
+}
 
-    // Then descend by server ID.
-    if (!at->by_server.empty()) {
-        auto ptr = at->by_server.find(server_id);
-        if (ptr == at->by_server.end()) {
-            // Intentional. If settings aren't filled for the server ID, there are no thresholds.
-            return nullptr;
-        }
+namespace {
+
+thread_local const Thresholds* pinned_owner = nullptr;
+thread_local std::shared_ptr<const Tree> pinned_tree;
+
+} // namespace
+
+std::shared_ptr<const Tree> Thresholds::Snapshot() const {
+    if (pinned_owner == this) {
+        return pinned_tree;
+    }
+    return this->tree.load();
+}
+
+Pin::Pin(const Thresholds& t) : previous_owner(pinned_owner), previous_tree(std::move(pinned_tree)) {
+    // Nested pins of the same thresholds keep the outer snapshot.
+    pinned_tree = previous_owner == &t ? previous_tree : t.Snapshot();
+    pinned_owner = &t;
+}
+
+Pin::~Pin() {
+    pinned_owner = this->previous_owner;
+    pinned_tree = std::move(this->previous_tree);
+}
 
-        return this->Descend(ptr->second.get(), chr, server_id);
+uint32_t Thresholds::Value(const Key& key, const CCharacter& chr, ServerIDType server_id) const {
+    auto tree = this->Snapshot();
+    if (!tree) {
+        return 0;
     }
+    const Node* node = tree->Descend(tree->Resolved(key), chr, server_id);
+    return node ? node->number : 0;
+}
 
-    return at;
+MobList Thresholds::Mobs(const Key& key, const CCharacter& chr, ServerIDType server_id) const {
+    auto tree = this->Snapshot();
+    if (!tree) {
+        return {};
+    }
+    std::span<const Mob> mobs = tree->Mobs(tree->Descend(tree->Resolved(key), chr, server_id));
+    return MobList(std::move(tree), mobs);
+}
+
+uint32_t Thresholds::Value(std::string key, const CCharacter& chr, ServerIDType server_id) const {
+    Printf(LOG_Info, "[thresholds] Picking value at key '%s' for character '%s' on s%d\n", key.c_str(), chr.GetFullName().c_str(), server_id);
+    auto tree = this->Snapshot();
+    if (!tree) {
+        return 0;
+    }
+    const Node* node = tree->Descend(tree->Path(key), chr, server_id);
+    return node ? node->number : 0;
+}
+
+MobList Thresholds::Mobs(std::string key, const CCharacter& chr, ServerIDType server_id) const {
+    Printf(LOG_Info, "[thresholds] Picking mobs at key '%s' for character '%s' on s%d\n", key.c_str(), chr.GetFullName().c_str(), server_id);
+    auto tree = this->Snapshot();
+    if (!tree) {
+        return {};
+    }
+    std::span<const Mob> mobs = tree->Mobs(tree->Descend(tree->Path(key), chr, server_id));
+    return MobList(std::move(tree), mobs);
 }
 
-} // namespace thresholds
+} // namespace thresholds
\ No newline at end of file
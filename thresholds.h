@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <iosfwd>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
-#include <unordered_map>
 
 #include "CCharacter.hpp"
 #include "server_id.hpp"
@@ -21,40 +25,267 @@ struct ParseException : std::exception {
     std::string message;
 };
 
-// A node contains either a mapping to children nodes or a leaf value.
-// The leaf values can be a number or a mob mapping.
+// Character kinds a section can be split by, in the order they are checked.
+enum Kind {
+    KIND_FEMALE,
+    KIND_HELL,
+    KIND_LEGEND,
+    KIND_IRONMAN,
+    KIND_HARDCORE,
+    KIND_DEFAULT,
+    KIND_COUNT,
+};
+
+const uint32_t NO_NODE = 0xFFFFFFFF;
+const size_t SERVER_ID_COUNT = QUEST_T4 + 1;
+
+struct Mob {
+    uint16_t id;
+    int kills;
+};
+
+struct Child {
+    std::string_view name;
+    uint32_t node;
+};
+
+// A node contains either children, a by-server mapping, a leaf value or mobs.
+// Nodes refer to each other by index in the tree's node array. Aliased sections (`female | hell`) share one node.
 struct Node {
-    Node() : is_leaf(false), number(0) {
+    uint32_t number;
+    bool is_leaf;
+
+    // Range in `Tree::children`, sorted by name.
+    uint32_t first_child;
+    uint32_t child_count;
+
+    // Children that `Descend` picks by character kind, NO_NODE if missing.
+    uint32_t kind[KIND_COUNT];
+
+    // Indexed by ServerIDType, NO_NODE if missing.
+    bool has_by_server;
+    uint32_t by_server[SERVER_ID_COUNT];
+
+    // Range in `Tree::mobs`, sorted by mob ID.
+    uint32_t first_mob;
+    uint32_t mob_count;
+};
+
+// A dotted key, resolved to a node once per load instead of on every lookup.
+// Define keys at namespace scope, so they are registered before the thresholds are loaded:
+//
+//   const thresholds::Key HELL_REACTION("hell.stats.reaction");
+//
+// Keys created after loading still work, but fall back to resolving the path on each lookup.
+class Key {
+public:
+    explicit Key(std::string path);
+
+    const std::string& Path() const {
+        return path;
     }
 
-    explicit Node(uint32_t n) : is_leaf(true), number(n) {
+    size_t Index() const {
+        return index;
     }
 
-    std::unordered_map<std::string, std::shared_ptr<Node>> children;
-    bool is_leaf;
-    uint32_t number;
+private:
+    std::string path;
+    size_t index;
+};
+
+// Checks that all indices and ranges of the tables are in bounds and that children and mobs are sorted.
+// Constexpr, so that the tables baked in at build time are checked by the compiler.
+constexpr bool Validate(std::span<const Node> nodes, std::span<const Child> children, std::span<const Mob> mobs) {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    auto valid_node = [&](uint32_t index) { return index == NO_NODE || index < nodes.size(); };
+
+    for (const Node& node : nodes) {
+        if (node.first_child > children.size() || node.child_count > children.size() - node.first_child) {
+            return false;
+        }
+        for (uint32_t i = node.first_child; i < node.first_child + node.child_count; i++) {
+            if (children[i].node >= nodes.size()) {
+                return false;
+            }
+            if (i > node.first_child && !(children[i - 1].name < children[i].name)) {
+                return false;
+            }
+        }
+
+        for (uint32_t index : node.kind) {
+            if (!valid_node(index)) {
+                return false;
+            }
+        }
+        for (uint32_t index : node.by_server) {
+            if (!valid_node(index)) {
+                return false;
+            }
+        }
+
+        if (node.first_mob > mobs.size() || node.mob_count > mobs.size() - node.first_mob) {
+            return false;
+        }
+        for (uint32_t i = node.first_mob + 1; i < node.first_mob + node.mob_count; i++) {
+            if (mobs[i - 1].id >= mobs[i].id) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Immutable, contiguous thresholds tree. Node 0 is the root.
+class Tree {
+public:
+    // Takes ownership of the parsed tables.
+    Tree(std::vector<Node> nodes, std::vector<Child> children, std::vector<Mob> mobs, std::string names);
+
+    // Refers to static tables, e.g. the ones baked in at build time. Nothing is copied.
+    Tree(std::span<const Node> nodes, std::span<const Child> children, std::span<const Mob> mobs);
+
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+
+    const Node* Path(std::string_view key) const;
+    const Node* Resolved(const Key& key) const;
+    const Node* Descend(const Node* at, const CCharacter& chr, ServerIDType server_id) const;
+    std::span<const Mob> Mobs(const Node* node) const;
+
+    // Raw tables, for the table generator and tests.
+    std::span<const Node> Nodes() const {
+        return nodes;
+    }
+
+    std::span<const Child> Children() const {
+        return children;
+    }
+
+    std::span<const Mob> AllMobs() const {
+        return mobs;
+    }
+
+private:
+    const Node* At(uint32_t index) const {
+        return index == NO_NODE ? nullptr : &nodes[index];
+    }
+
+    void ResolveKeys();
+
+private:
+    // Storage of a parsed tree, empty for a static one.
+    std::vector<Node> owned_nodes;
+    std::vector<Child> owned_children;
+    std::vector<Mob> owned_mobs;
+
+    // Storage for `Child::name`.
+    std::string names;
+
+    std::span<const Node> nodes;
+    std::span<const Child> children;
+    std::span<const Mob> mobs;
+
+    // Nodes for all registered keys, indexed by `Key::Index()`.
+    std::vector<uint32_t> resolved;
+};
+
+// Mobs of a node, with the tree they are in: they stay valid while the list lives, whatever reloads happen meanwhile.
+class MobList {
+public:
+    MobList() = default;
+
+    MobList(std::shared_ptr<const Tree> tree, std::span<const Mob> mobs) : tree(std::move(tree)), mobs(mobs) {
+    }
+
+    const Mob* begin() const {
+        return mobs.data();
+    }
+
+    const Mob* end() const {
+        return mobs.data() + mobs.size();
+    }
+
+    size_t size() const {
+        return mobs.size();
+    }
+
+    bool empty() const {
+        return mobs.empty();
+    }
+
+    const Mob& operator[](size_t index) const {
+        return mobs[index];
+    }
 
-    std::unordered_map<ServerIDType, std::shared_ptr<Node>> by_server;
-    std::unordered_map<uint16_t, int> mobs;
+private:
+    std::shared_ptr<const Tree> tree;
+    std::span<const Mob> mobs;
 };
 
+// Thresholds can be replaced at runtime. Readers take a snapshot of the current tree, a reload
+// publishes a new tree with an atomic pointer swap, and the old tree lives until its last reader is done.
 class Thresholds {
 public:
+    ~Thresholds();
+
     void LoadFromContent(std::string content);
     void LoadFromFile(std::string file_name);
     void LoadFromStream(std::istream& stream);
 
+    // Loads the tables compiled from thresholds.txt at build time. Nothing is parsed.
+    void LoadBaked();
+
+    // Parses the file in a background thread and publishes it if it's valid. On a parse error the
+    // current thresholds stay. Returns `false` if a reload is already running.
+    bool ReloadAsync(std::string file_name);
+
+    // Blocks until the background reload, if any, is finished.
+    void WaitReload();
+
+    // Called dozens of times per character update, so unlike the string overloads they log nothing.
+    uint32_t Value(const Key& key, const CCharacter& chr, ServerIDType server_id) const;
+    MobList Mobs(const Key& key, const CCharacter& chr, ServerIDType server_id) const;
+
+    // String keys are resolved on every call, and each lookup is logged. Prefer `Key` in the game logic.
     uint32_t Value(std::string key, const CCharacter& chr, ServerIDType server_id) const;
-    const std::unordered_map<uint16_t, int>* Mobs(std::string key, const CCharacter& chr, ServerIDType server_id) const;
+    MobList Mobs(std::string key, const CCharacter& chr, ServerIDType server_id) const;
+
+    // The tree pinned by `Pin` on this thread, or the current one.
+    std::shared_ptr<const Tree> Snapshot() const;
 
 private:
-    const Node* Path(std::string key) const;
-    const Node* Descend(const Node* at, const CCharacter& chr, ServerIDType server_id) const;
+    std::atomic<std::shared_ptr<const Tree>> tree;
+
+    std::thread reload_thread;
+    std::atomic<bool> reloading{false};
+};
+
+// Pins the current thresholds for the calling thread while in scope, so that all lookups within
+// one character update see the same config even if a reload lands in the middle of it.
+class Pin {
+public:
+    explicit Pin(const Thresholds& t);
+    ~Pin();
+
+    Pin(const Pin&) = delete;
+    Pin& operator=(const Pin&) = delete;
 
 private:
-    std::shared_ptr<Node> root;
+    const Thresholds* previous_owner;
+    std::shared_ptr<const Tree> previous_tree;
 };
 
+// Parses thresholds.txt syntax into a tree. Throws ParseException.
+std::shared_ptr<const Tree> Parse(std::istream& stream);
+
+// Writes the tree as a C++ header with constexpr tables in `namespace thresholds::baked`.
+void WriteBaked(const Tree& tree, std::ostream& out);
+
 extern Thresholds thresholds;
 
-} // namespace thresholds
\ No newline at end of file
+} // namespace thresholds
@@ -0,0 +1,12 @@
+// Kept apart from thresholds.cpp, which is also built into thresholds-compile, the tool that generates the tables.
+#include "thresholds.h"
+
+#include "thresholds.baked.h"
+
+namespace thresholds {
+
+void Thresholds::LoadBaked() {
+    this->tree.store(std::make_shared<const Tree>(std::span<const Node>(baked::nodes), std::span<const Child>(baked::children), std::span<const Mob>(baked::mobs)));
+}
+
+} // namespace thresholds
@@ -0,0 +1,49 @@
+// Build-time tool: validates thresholds.txt and compiles it into constexpr tables.
+//
+//   thresholds-compile thresholds.txt thresholds.baked.h
+//
+// Fails the build on a syntax error, instead of the server failing at startup.
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "config.hpp"
+#include "thresholds.h"
+#include "utils.hpp"
+
+// utils.cpp logs through these, thresholds-compile doesn't link config.cpp.
+namespace Config {
+    std::string LogFile = "thresholds-compile.log";
+    unsigned long LogLevel = LOG_Silent;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: thresholds-compile <thresholds.txt> <output.h>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << argv[1] << ": failed to open file" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream out;
+    try {
+        thresholds::WriteBaked(*thresholds::Parse(in), out);
+    } catch (const thresholds::ParseException& e) {
+        std::cerr << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Written only on success, so that a parse error doesn't leave a half-written header behind.
+    std::ofstream f_out(argv[2], std::ios::binary);
+    f_out << out.str();
+    if (!f_out) {
+        std::cerr << argv[2] << ": failed to write file" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "timers.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace timers {
+
+uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Wheel wheel{Now()};
+
+Wheel::Wheel(uint64_t now_ms, uint32_t tick_ms)
+    : tick_ms(tick_ms), now_ms(now_ms), current(now_ms / tick_ms), heads(LEVELS * SLOTS + 1, NONE) {}
+
+Wheel::Id Wheel::Schedule(uint64_t delay_ms, Callback callback) {
+    uint32_t node;
+    if (!this->free_nodes.empty()) {
+        node = this->free_nodes.back();
+        this->free_nodes.pop_back();
+    } else {
+        node = static_cast<uint32_t>(this->nodes.size());
+        this->nodes.emplace_back();
+    }
+
+    // Never due in the tick that is firing right now.
+    uint64_t deadline = (this->now_ms + delay_ms + this->tick_ms - 1) / this->tick_ms;
+    this->nodes[node].deadline = std::max(deadline, this->current + 1);
+    this->nodes[node].callback = std::move(callback);
+    this->Place(node);
+    this->size++;
+
+    return (static_cast<uint64_t>(this->nodes[node].generation) << 32) | node;
+}
+
+bool Wheel::Cancel(Id id) {
+    uint32_t node = static_cast<uint32_t>(id);
+    if (!id || node >= this->nodes.size() || this->nodes[node].generation != static_cast<uint32_t>(id >> 32) ||
+        this->nodes[node].slot == NONE) {
+        return false;
+    }
+
+    this->Unlink(node);
+    this->Free(node);
+    this->size--;
+    return true;
+}
+
+size_t Wheel::Advance(uint64_t now_ms) {
+    uint64_t target = now_ms / this->tick_ms;
+    this->now_ms = std::max(this->now_ms, now_ms);
+    if (!this->size) {
+        this->current = std::max(this->current, target);
+        return 0;
+    }
+
+    size_t fired = 0;
+    while (this->current < target) {
+        this->current++;
+
+        // Each level moves its slot down when the level below wraps around.
+        for (unsigned level = 1; level < LEVELS; level++) {
+            if ((this->current >> (SLOT_BITS * (level - 1))) & (SLOTS - 1)) {
+                break;
+            }
+            this->Cascade(level);
+        }
+
+        uint32_t slot = this->current & (SLOTS - 1);
+        this->heads[FIRING] = this->heads[slot];
+        this->heads[slot] = NONE;
+        for (uint32_t node = this->heads[FIRING]; node != NONE; node = this->nodes[node].next) {
+            this->nodes[node].slot = FIRING;
+        }
+
+        while (this->heads[FIRING] != NONE) {
+            uint32_t node = this->heads[FIRING];
+            Callback callback = std::move(this->nodes[node].callback);
+            this->Unlink(node);
+            this->Free(node);
+            this->size--;
+            fired++;
+            callback();
+        }
+    }
+
+    return fired;
+}
+
+void Wheel::Place(uint32_t node) {
+    uint64_t deadline = this->nodes[node].deadline;
+    uint64_t delta = deadline - this->current;
+
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    // Further than the wheel reaches: parked in the last slot it can see, and placed again when cascaded.
+    uint64_t reach = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    if (delta > reach) {
+        deadline = this->current + reach;
+    }
+
+    uint32_t slot = (deadline >> (SLOT_BITS * level)) & (SLOTS - 1);
+    this->Link(node, level * SLOTS + slot);
+}
+
+void Wheel::Link(uint32_t node, uint32_t slot) {
+    Node& linked = this->nodes[node];
+    linked.slot = slot;
+    linked.prev = NONE;
+    linked.next = this->heads[slot];
+    if (linked.next != NONE) {
+        this->nodes[linked.next].prev = node;
+    }
+    this->heads[slot] = node;
+}
+
+void Wheel::Unlink(uint32_t node) {
+    Node& linked = this->nodes[node];
+    if (linked.prev != NONE) {
+        this->nodes[linked.prev].next = linked.next;
+    } else {
+        this->heads[linked.slot] = linked.next;
+    }
+    if (linked.next != NONE) {
+        this->nodes[linked.next].prev = linked.prev;
+    }
+    linked.slot = NONE;
+    linked.prev = NONE;
+    linked.next = NONE;
+}
+
+void Wheel::Free(uint32_t node) {
+    this->nodes[node].generation++;
+    this->nodes[node].callback = nullptr;
+    this->free_nodes.push_back(node);
+}
+
+void Wheel::Cascade(unsigned level) {
+    uint32_t slot = level * SLOTS + ((this->current >> (SLOT_BITS * level)) & (SLOTS - 1));
+    uint32_t node = this->heads[slot];
+    this->heads[slot] = NONE;
+    while (node != NONE) {
+        uint32_t next = this->nodes[node].next;
+        this->Place(node);
+        node = next;
+    }
+}
+
+} // namespace timers
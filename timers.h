@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Deadlines of client connections (login, activity, session entry, screenshot), kept in a hierarchical timer wheel so
+// that `CL_Process` doesn't compare clocks for every client on every tick, and a connection that does nothing costs
+// nothing until its deadline.
+//
+// Four levels of 64 slots: level 0 holds what is due within 64 ticks, level 1 within 64^2, and so on; a slot of a
+// higher level is moved down when the level below wraps around. Scheduling and cancelling are O(1).
+namespace timers {
+
+// Milliseconds of a monotonic clock.
+uint64_t Now();
+
+class Wheel {
+public:
+    using Callback = std::function<void()>;
+    // 0 is never a valid timer.
+    using Id = uint64_t;
+
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+
+    explicit Wheel(uint64_t now_ms, uint32_t tick_ms = 100);
+
+    // Calls `callback` from `Advance` once `delay_ms` have passed since the last `Advance`, rounded up to a tick.
+    Id Schedule(uint64_t delay_ms, Callback callback);
+    // `false` if the timer has already fired or was cancelled; `id` may be 0.
+    bool Cancel(Id id);
+
+    // Fires the timers due by `now_ms`. Callbacks may schedule and cancel timers. Returns the number fired.
+    size_t Advance(uint64_t now_ms);
+
+    size_t Size() const {
+        return this->size;
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    // The pseudo-slot with the timers being fired.
+    static constexpr uint32_t FIRING = LEVELS * SLOTS;
+
+    struct Node {
+        uint64_t deadline;
+        uint32_t generation = 1;
+        uint32_t slot = NONE;
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+        Callback callback;
+    };
+
+    void Place(uint32_t node);
+    void Link(uint32_t node, uint32_t slot);
+    void Unlink(uint32_t node);
+    void Free(uint32_t node);
+    void Cascade(unsigned level);
+
+    uint32_t tick_ms;
+    // The last time given to `Advance`, what delays count from.
+    uint64_t now_ms;
+    // Ticks of `tick_ms` since the clock's epoch; everything up to it has fired.
+    uint64_t current;
+    size_t size = 0;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_nodes;
+    std::vector<uint32_t> heads;
+};
+
+extern Wheel wheel;
+
+} // namespace timers
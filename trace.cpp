@@ -0,0 +1,495 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+#include "client.hpp"
+#include "cp866.h"
+#include "peer.h"
+#include "utils.hpp"
+
+namespace trace {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char MAGIC[4] = {'R', 'H', 'T', 'R'};
+// What `PACKET_Frame` adds to every packet.
+const uint8_t END[] = {0x64, 0x01, 0x00, 0x00, 0x00};
+
+// The buffer is written out when it's this big, or this old.
+const size_t FLUSH_BYTES = 1 << 16;
+const Clock::duration FLUSH_INTERVAL = std::chrono::seconds(1);
+
+struct Connection {
+    uint32_t id;
+    Peer peer;
+};
+
+std::atomic<bool> active{false};
+std::mutex mutex;
+FILE* file = nullptr;
+std::vector<uint8_t> buffer;
+bool anonymize = false;
+uint64_t salt = 0;
+Clock::time_point started;
+Clock::time_point flushed;
+uint64_t last_us = 0;
+std::unordered_map<SOCKET, Connection> connections;
+uint32_t next_connection = 1;
+
+void Put(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void PutVarint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void Flush() {
+    if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        Printf(LOG_Error, "[trace] failed to write the trace, stopping it\n");
+        std::fclose(file);
+        file = nullptr;
+        active = false;
+        connections.clear();
+    }
+    buffer.clear();
+    flushed = Clock::now();
+}
+
+// Type, time and connection of a record.
+void Begin(Type type, uint32_t connection) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count();
+    buffer.push_back(type);
+    PutVarint(us - last_us);
+    PutVarint(connection);
+    last_us = us;
+}
+
+void End() {
+    if (buffer.size() >= FLUSH_BYTES || Clock::now() - flushed >= FLUSH_INTERVAL) {
+        Flush();
+    }
+}
+
+// Letters from a salted FNV-1a of `seed`: the same seed gives the same pseudonym all through a trace.
+std::string Pseudonym(const std::string& seed, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325ull ^ salt;
+    for (char c : seed) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+    }
+
+    std::string pseudonym(length, 'a');
+    for (size_t i = 0; i < length; i++) {
+        // xorshift64*
+        hash ^= hash >> 12;
+        hash ^= hash << 25;
+        hash ^= hash >> 27;
+        pseudonym[i] = static_cast<char>('a' + (hash * 0x2545F4914F6CDD1Dull >> 32) % 26);
+    }
+    return pseudonym;
+}
+
+bool Get16(const std::vector<uint8_t>& packet, size_t offset, uint16_t& value) {
+    if (offset + 2 > packet.size()) {
+        return false;
+    }
+    std::memcpy(&value, &packet[offset], 2);
+    return true;
+}
+
+bool Get32(const std::vector<uint8_t>& packet, size_t offset, uint32_t& value) {
+    if (offset + 4 > packet.size()) {
+        return false;
+    }
+    std::memcpy(&value, &packet[offset], 4);
+    return true;
+}
+
+// Replaces the login of `length` bytes at `offset`.
+bool ReplaceLogin(std::vector<uint8_t>& packet, size_t offset, size_t length) {
+    if (offset + length > packet.size()) {
+        return false;
+    }
+    std::string login(packet.begin() + offset, packet.begin() + offset + length);
+    std::string pseudonym = Pseudonym(cp866::Fold(Trim(login)), length);
+    std::copy(pseudonym.begin(), pseudonym.end(), packet.begin() + offset);
+    return true;
+}
+
+// Goes over an `Archive` string at `offset`: uint16 length, the bytes, a zero.
+bool String(const std::vector<uint8_t>& packet, size_t& offset, size_t& begin, size_t& length) {
+    uint16_t size;
+    if (!Get16(packet, offset, size) || offset + 2 + size + 1 > packet.size()) {
+        return false;
+    }
+    begin = offset + 2;
+    length = size;
+    offset += 2 + size + 1;
+    return true;
+}
+
+// A 2.0 or 1.11 login, still encrypted, see `CL_Login`. `false` if it isn't one.
+bool AnonymizeAuth(std::vector<uint8_t>& packet) {
+    unsigned long version;
+    if (packet[0] == key_20[0]) {
+        version = 20;
+    } else if (packet[0] == key_11[0]) {
+        version = 11;
+    } else {
+        return false;
+    }
+
+    PACKET_XorByKey(packet.data(), static_cast<unsigned long>(packet.size()), version);
+
+    // Signature, CRCs, session and UUID, then version, game mode and login length, then login and password as one
+    // string.
+    size_t offset = 1 + 0x40;
+    uint32_t header;
+    size_t begin, length;
+    bool parsed = Get32(packet, offset, header) && String(packet, offset += 4, begin, length);
+    if (parsed) {
+        size_t login_length = std::min<size_t>(header & 0xFFFF, length);
+        std::string login(packet.begin() + begin, packet.begin() + begin + login_length);
+        std::string password(packet.begin() + begin + login_length, packet.begin() + begin + length);
+        std::string pseudonym = Pseudonym(cp866::Fold(Trim(login)), login_length) +
+                                Pseudonym(cp866::Fold(Trim(login)) + '\0' + password, length - login_length);
+        std::copy(pseudonym.begin(), pseudonym.end(), packet.begin() + begin);
+    }
+
+    PACKET_XorByKey(packet.data(), static_cast<unsigned long>(packet.size()), version);
+    return parsed;
+}
+
+// What `CL_Screenshot` reads: `SCREENSHOT_PID`, login, uid, status, and the URL of the uploaded screenshot if the
+// status isn't 0. The URL is dropped. `false` if it isn't one.
+bool AnonymizeScreenshot(std::vector<uint8_t>& packet) {
+    uint32_t id;
+    size_t offset = 4;
+    size_t begin, length;
+    if (!Get32(packet, 0, id) || id != SCREENSHOT_PID || !String(packet, offset, begin, length) ||
+        offset + 5 > packet.size()) {
+        return false;
+    }
+    ReplaceLogin(packet, begin, length);
+
+    offset += 5;
+    if (packet[offset - 1] == 0) {
+        packet.resize(offset);
+        return true;
+    }
+    size_t url = offset;
+    if (!String(packet, offset, begin, length)) {
+        return false;
+    }
+    packet.resize(url);
+    packet.insert(packet.end(), 3, 0);
+    return true;
+}
+
+// What `SL_UpdateInfo` reads.
+void AnonymizeServerInfo(std::vector<uint8_t>& packet) {
+    // Id, game mode, map, level, width, height, time, mode.
+    size_t offset = 5;
+    size_t begin, length;
+    uint32_t count;
+    if (!String(packet, offset, begin, length) || !Get32(packet, offset += 1 + 16, count)) {
+        return;
+    }
+    offset += 4;
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t nickname, nickname_length;
+        if (!String(packet, offset, nickname, nickname_length) || !String(packet, offset, begin, length)) {
+            return;
+        }
+        ReplaceLogin(packet, begin, length);
+        // Ids, connected.
+        offset += 9;
+        if (!String(packet, offset, begin, length)) {
+            return;
+        }
+        for (size_t c = begin; c < begin + length; c++) {
+            if (packet[c] >= '0' && packet[c] <= '9') {
+                packet[c] = '0';
+            }
+        }
+    }
+
+    if (!Get32(packet, offset, count)) {
+        return;
+    }
+    offset += 4;
+    for (uint32_t i = 0; i < count && String(packet, offset, begin, length); i++) {
+        ReplaceLogin(packet, begin, length);
+    }
+}
+
+// Packets that have logins in them; the rest only have nicknames, which the game shows to everyone.
+void Anonymize(Peer peer, Type type, unsigned long version, std::vector<uint8_t>& packet) {
+    if (packet.empty()) {
+        return;
+    }
+
+    uint32_t length, size;
+    if (peer == PEER_CLIENT && type == RECORD_RECEIVED && version == 0) {
+        // The hat reads these as they come, so only the first byte is kept of those that aren't known: a 2.0 version
+        // request, or a login of a client older than 1.11.
+        if (!AnonymizeScreenshot(packet) && !AnonymizeAuth(packet)) {
+            std::fill(packet.begin() + 1, packet.end(), 0);
+        }
+    } else if (peer == PEER_SERVER && type == RECORD_RECEIVED && packet[0] == 0xCF) {
+        // Size, ids, login length, character size, character, login; see `SV_ReturnCharacter`.
+        if (Get32(packet, 13, length) && Get32(packet, 17, size)) {
+            ReplaceLogin(packet, 21 + static_cast<size_t>(size), length);
+        }
+    } else if (peer == PEER_SERVER && type == RECORD_SENT && packet[0] == 0xDD) {
+        // Size, ids, login length, nickname length, character size, sex, character, login; see `SV_TryClient`.
+        if (Get32(packet, 13, length) && Get32(packet, 21, size)) {
+            ReplaceLogin(packet, 29 + static_cast<size_t>(size), length);
+        }
+    } else if (peer == PEER_SERVER && type == RECORD_SENT && packet[0] == 0xD3) {
+        size_t offset = 5;
+        size_t begin, string_length;
+        if (String(packet, offset, begin, string_length)) {
+            ReplaceLogin(packet, begin, string_length);
+        }
+    } else if (peer == PEER_LAYER && type == RECORD_RECEIVED && packet[0] == 0x12) {
+        AnonymizeServerInfo(packet);
+    }
+}
+
+void Write(SOCKET socket, Type type, const uint8_t* data, size_t size, unsigned long version) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto connection = connections.find(socket);
+    if (!active || connection == connections.end()) {
+        return;
+    }
+
+    std::vector<uint8_t> packet(data, data + size);
+    if (packet.size() >= sizeof(END) && std::equal(END, END + sizeof(END), packet.end() - sizeof(END))) {
+        packet.resize(packet.size() - sizeof(END));
+    }
+    if (anonymize) {
+        Anonymize(connection->second.peer, type, version, packet);
+    }
+
+    Begin(type, connection->second.id);
+    buffer.push_back(static_cast<uint8_t>(version));
+    PutVarint(packet.size());
+    Put(packet.data(), packet.size());
+    End();
+}
+
+} // namespace
+
+bool Start(const std::string& path, bool anonymize_logins) {
+    Stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        Printf(LOG_Error, "[trace] failed to create '%s'\n", path.c_str());
+        return false;
+    }
+
+    anonymize = anonymize_logins;
+    std::random_device random;
+    salt = static_cast<uint64_t>(random()) << 32 | random();
+    started = flushed = Clock::now();
+    last_us = 0;
+    next_connection = 1;
+
+    uint64_t epoch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    Put(MAGIC, sizeof(MAGIC));
+    buffer.push_back(FORMAT);
+    buffer.push_back(anonymize ? FLAG_ANONYMIZED : 0);
+    Put(&epoch_ms, sizeof(epoch_ms));
+
+    active = true;
+    Printf(LOG_Info, "[trace] tracing the connections from now on to '%s'%s\n", path.c_str(),
+           anonymize ? ", anonymized" : "");
+    return true;
+}
+
+void Stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) {
+        return;
+    }
+    Flush();
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    active = false;
+    connections.clear();
+    Printf(LOG_Info, "[trace] stopped\n");
+}
+
+bool Active() {
+    return active;
+}
+
+void Opened(SOCKET socket, Peer peer, const sockaddr_in& addr) {
+    if (!active) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!active) {
+        return;
+    }
+    Connection& connection = connections[socket];
+    connection = Connection{next_connection++, peer};
+
+    uint32_t address = anonymize && peer == PEER_CLIENT ? 0 : addr.sin_addr.s_addr;
+    uint16_t port = ntohs(addr.sin_port);
+    Begin(RECORD_OPENED, connection.id);
+    buffer.push_back(peer);
+    Put(&address, sizeof(address));
+    Put(&port, sizeof(port));
+    End();
+}
+
+void Received(SOCKET socket, Packet& pack, unsigned long version) {
+    if (!active) {
+        return;
+    }
+
+    uint8_t* data = NULL;
+    uint32_t size;
+    pack.GetAllData(data, size);
+    Write(socket, RECORD_RECEIVED, data, size, version);
+    delete[] data;
+}
+
+void Sent(SOCKET socket, const uint8_t* data, size_t size, unsigned long version) {
+    if (active) {
+        Write(socket, RECORD_SENT, data, size, version);
+    }
+}
+
+void SentFrame(SOCKET socket, const std::vector<uint8_t>& wire, unsigned long version) {
+    if (!active) {
+        return;
+    }
+
+    peer::Decoder decoder;
+    decoder.Feed(wire.data(), wire.size());
+    std::vector<uint8_t> packet;
+    while (decoder.Next(packet, version)) {
+        Write(socket, RECORD_SENT, packet.data(), packet.size(), version);
+    }
+}
+
+void Closed(SOCKET socket) {
+    if (!active) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto connection = connections.find(socket);
+    if (!active || connection == connections.end()) {
+        return;
+    }
+    Begin(RECORD_CLOSED, connection->second.id);
+    connections.erase(connection);
+    End();
+}
+
+bool Reader::Open(const std::string& path) {
+    this->file.open(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    uint8_t format;
+    if (!this->file || !this->Bytes(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !this->Bytes(&format, 1) || format != FORMAT) {
+        return false;
+    }
+    return this->Bytes(&this->flags, 1) && this->Bytes(&this->started, sizeof(this->started));
+}
+
+bool Reader::Anonymized() const {
+    return (this->flags & FLAG_ANONYMIZED) != 0;
+}
+
+uint64_t Reader::Started() const {
+    return this->started;
+}
+
+bool Reader::Next(Record& record) {
+    uint8_t type;
+    uint64_t delta, connection;
+    if (!this->Bytes(&type, 1) || type < RECORD_OPENED || type > RECORD_CLOSED || !this->Varint(delta) ||
+        !this->Varint(connection)) {
+        return false;
+    }
+
+    this->us += delta;
+    record.type = static_cast<Type>(type);
+    record.us = this->us;
+    record.connection = static_cast<uint32_t>(connection);
+    record.packet.clear();
+
+    switch (record.type) {
+        case RECORD_OPENED: {
+            uint8_t peer;
+            if (!this->Bytes(&peer, 1) || !this->Bytes(&record.address, 4) || !this->Bytes(&record.port, 2)) {
+                return false;
+            }
+            record.peer = static_cast<Peer>(peer);
+            return true;
+        }
+        case RECORD_RECEIVED:
+        case RECORD_SENT: {
+            uint64_t size;
+            // Longer than any packet the game sends.
+            if (!this->Bytes(&record.version, 1) || !this->Varint(size) || size > (1 << 24)) {
+                return false;
+            }
+            record.packet.resize(static_cast<size_t>(size));
+            return this->Bytes(record.packet.data(), record.packet.size());
+        }
+        default:
+            return true;
+    }
+}
+
+bool Reader::Varint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (!this->Bytes(&byte, 1)) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Reader::Bytes(void* data, size_t size) {
+    if (!size) {
+        return true;
+    }
+    this->file.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(this->file.gcount()) == size;
+}
+
+} // namespace trace
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "packet.hpp"
+#include "socket.hpp"
+
+// A capture of the hat's traffic for `redhat-replay`: the packets of the client, game server and layer connections
+// accepted while a trace is on, decrypted, with the time they were received or sent.
+//
+// The file is a header and records. Numbers are little-endian, "varint" ones are LEB128:
+//   "RHTR", uint8 `FORMAT`, uint8 flags (`FLAG_ANONYMIZED`), uint64 start (ms since the epoch)
+//   uint8 type, varint us since the previous record, varint connection (from 1, in the order they were opened), then
+//     RECORD_OPENED: uint8 peer, uint32 IPv4 address in network order (0 if anonymized), uint16 port
+//     RECORD_RECEIVED, RECORD_SENT: uint8 protocol version, varint size, the packet without the end bytes
+//     RECORD_CLOSED: nothing
+// The version is the one the packet was (de)crypted with: 0 for the first packet of a connection, which the hat reads
+// as it comes and decrypts itself (`CL_Login`, `SV_Login`).
+//
+// Anonymized traces have pseudonyms of the same length instead of logins and passwords: the same one for a login all
+// through the trace, case-insensitively, and for a password of the same login, so a replay logs in as the capture
+// did. The pseudonyms are salted per trace. Client addresses are left out, and so are the URLs of screenshots. Of
+// the other first packets of a client only the first byte is kept.
+//
+// Layer commands (`SLCMD_*`, `SL_Broadcast`) go through `outbox::Queue` without a socket and aren't recorded.
+namespace trace {
+
+constexpr uint8_t FORMAT = 1;
+constexpr uint8_t FLAG_ANONYMIZED = 1;
+
+enum Peer : uint8_t { PEER_CLIENT = 1, PEER_SERVER = 2, PEER_LAYER = 3 };
+
+enum Type : uint8_t { RECORD_OPENED = 1, RECORD_RECEIVED = 2, RECORD_SENT = 3, RECORD_CLOSED = 4 };
+
+struct Record {
+    Type type = RECORD_CLOSED;
+    // Since the start of the trace.
+    uint64_t us = 0;
+    uint32_t connection = 0;
+
+    // RECORD_OPENED
+    Peer peer = PEER_CLIENT;
+    uint32_t address = 0;
+    uint16_t port = 0;
+
+    // RECORD_RECEIVED, RECORD_SENT
+    uint8_t version = 0;
+    std::vector<uint8_t> packet;
+};
+
+// Starts writing to `path`, stopping a trace that's on. `false` if the file can't be created.
+bool Start(const std::string& path, bool anonymize);
+// Writes what's buffered and closes the file.
+void Stop();
+bool Active();
+
+// The calls below record nothing if no trace is on, or for connections accepted before it started.
+void Opened(SOCKET socket, Peer peer, const sockaddr_in& addr);
+void Received(SOCKET socket, Packet& pack, unsigned long version);
+void Sent(SOCKET socket, const uint8_t* data, size_t size, unsigned long version);
+// A packet sent as it goes on the wire, see `PACKET_Frame`.
+void SentFrame(SOCKET socket, const std::vector<uint8_t>& wire, unsigned long version);
+void Closed(SOCKET socket);
+
+// Reads a trace record by record.
+class Reader {
+public:
+    bool Open(const std::string& path);
+    bool Anonymized() const;
+    // Ms since the epoch.
+    uint64_t Started() const;
+
+    // `false` at the end of the trace, or if the rest of it is broken (a trace of a hat that crashed ends in the
+    // middle of a record).
+    bool Next(Record& record);
+
+private:
+    bool Varint(uint64_t& value);
+    bool Bytes(void* data, size_t size);
+
+    std::ifstream file;
+    uint8_t flags = 0;
+    uint64_t started = 0;
+    uint64_t us = 0;
+};
+
+} // namespace trace
@@ -0,0 +1,123 @@
+#include "unit_of_work.h"
+
+#include "sql.hpp"
+#include "utils.hpp"
+
+namespace unit_of_work {
+
+namespace {
+
+thread_local UnitOfWork* current = nullptr;
+
+} // namespace
+
+UnitOfWork::UnitOfWork(std::string name)
+    : name(std::move(name)), started(std::chrono::steady_clock::now()), connection_id(0), active(false), previous(current) {
+    if (this->previous) {
+        Printf(LOG_Error, "[DB] unit of work '%s' started inside '%s', the writes go to the inner one\n", this->name.c_str(), this->previous->name.c_str());
+    }
+    current = this;
+
+    if (SQL_Query("START TRANSACTION") == 0) {
+        this->active = true;
+        this->connection_id = SQL_ConnectionID();
+    }
+}
+
+UnitOfWork::~UnitOfWork() {
+    if (this->active) {
+        SQL_Query("ROLLBACK");
+        this->Finish(false, "not committed");
+    }
+    current = this->previous;
+}
+
+void UnitOfWork::Add(std::string statement) {
+    // The statements are joined with `;`, an empty statement in between would fail the batch.
+    size_t end = statement.find_last_not_of(" \t\r\n;");
+    statement.erase(end == std::string::npos ? 0 : end + 1);
+    if (!statement.empty()) {
+        this->statements.push_back(std::move(statement));
+    }
+}
+
+void UnitOfWork::AfterCommit(std::function<void()> action) {
+    this->after_commit.push_back(std::move(action));
+}
+
+bool UnitOfWork::Commit() {
+    if (!this->active) {
+        Printf(LOG_Error, "[DB] save of '%s' failed: no transaction (%s)\n", this->name.c_str(), SQL_Error().c_str());
+        return false;
+    }
+
+    if (SQL_ConnectionID() != this->connection_id) {
+        // Whatever ran before the reconnect was rolled back by the server.
+        this->Finish(false, "connection was reset");
+        return false;
+    }
+
+    std::string query;
+    for (const auto& statement : this->statements) {
+        query += statement;
+        query += ";\n";
+    }
+    query += "COMMIT";
+
+    int executed = 0;
+    if (!SQL_QueryMulti(query, executed)) {
+        std::string error = SQL_Error();
+        if (executed < static_cast<int>(this->statements.size())) {
+            Printf(LOG_Error, "[DB] save of '%s': statement %d failed: %s --- %s\n", this->name.c_str(), executed + 1, this->statements[executed].c_str(), error.c_str());
+        } else {
+            Printf(LOG_Error, "[DB] save of '%s': COMMIT failed: %s\n", this->name.c_str(), error.c_str());
+        }
+        SQL_Query("ROLLBACK");
+        this->Finish(false, "statement failed");
+        return false;
+    }
+
+    this->Finish(true, "");
+    for (auto& action : this->after_commit) {
+        action();
+    }
+    this->after_commit.clear();
+    return true;
+}
+
+void UnitOfWork::Finish(bool committed, const char* reason) {
+    this->active = false;
+    if (!committed) {
+        this->after_commit.clear();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->started);
+    if (committed) {
+        Printf(LOG_Info, "[DB] saved '%s' in %.1f ms (%u statements)\n", this->name.c_str(), elapsed.count() / 1000.0, this->statements.size());
+    } else {
+        Printf(LOG_Error, "[DB] rolled back '%s' after %.1f ms (%u statements): %s\n", this->name.c_str(), elapsed.count() / 1000.0, this->statements.size(), reason);
+    }
+}
+
+bool Write(std::string statement) {
+    if (current) {
+        current->Add(std::move(statement));
+        return true;
+    }
+
+    return SimpleSQL(std::move(statement));
+}
+
+bool Active() {
+    return current != nullptr;
+}
+
+void AfterCommit(std::function<void()> action) {
+    if (current) {
+        current->AfterCommit(std::move(action));
+    } else {
+        action();
+    }
+}
+
+} // namespace unit_of_work
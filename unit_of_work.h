@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace unit_of_work {
+
+// Collects the writes of one character save and sends them to the DB in a single round trip, as one transaction.
+//
+// The transaction starts when the unit of work is created. While it's in scope, `Write` on the same thread queues
+// the statement instead of running it. Reads and the writes that need their result right away (the shelf checks
+// the affected rows of its `mutex` update) still run immediately, but inside the same transaction. Nothing is
+// saved unless `Commit` succeeds, so a failure in the middle of a save leaves the DB as it was before.
+//
+// Only one unit of work can be active on a thread at a time.
+class UnitOfWork {
+public:
+    // `name` identifies the save in the log, e.g. the character name.
+    explicit UnitOfWork(std::string name);
+
+    // Rolls back if `Commit` wasn't called.
+    ~UnitOfWork();
+
+    UnitOfWork(const UnitOfWork&) = delete;
+    UnitOfWork& operator=(const UnitOfWork&) = delete;
+
+    void Add(std::string statement);
+
+    // Runs `action` once `Commit` succeeds. If the unit of work rolls back, it never runs.
+    void AfterCommit(std::function<void()> action);
+
+    // Sends the queued statements followed by COMMIT as one multi-statement query. On failure the whole
+    // transaction is rolled back. Either way, logs how long the save took.
+    bool Commit();
+
+    size_t Size() const {
+        return statements.size();
+    }
+
+    const std::vector<std::string>& Statements() const {
+        return statements;
+    }
+
+private:
+    void Finish(bool committed, const char* reason);
+
+private:
+    std::string name;
+    std::vector<std::string> statements;
+    std::vector<std::function<void()>> after_commit;
+    std::chrono::steady_clock::time_point started;
+
+    // The connection the transaction was started on. If the client reconnects meanwhile, the transaction is gone.
+    unsigned long connection_id;
+    bool active;
+
+    UnitOfWork* previous;
+};
+
+// Queues the statement into the unit of work of this thread, or runs it right away if there's none.
+// Returns `false` only if the statement was run and failed.
+bool Write(std::string statement);
+
+// `true` if a unit of work is in scope on this thread: what's written now may still be rolled back.
+bool Active();
+
+// Runs `action` after the unit of work of this thread commits, or right away if there's none. For caches of what
+// the DB holds, which must not see writes that get rolled back.
+void AfterCommit(std::function<void()> action);
+
+} // namespace unit_of_work
@@ -6,13 +6,39 @@
 #include "shelf.hpp"
 #include "sql.hpp"
 #include "thresholds.h"
+#include "unit_of_work.h"
 #include "utils.hpp"
 
 namespace update_character {
 
+namespace {
+
+const thresholds::Key REBORN_MOBS("reborn.mobs");
+const thresholds::Key REBORN_STATS_MIND("reborn.stats.mind");
+const thresholds::Key REBORN_STATS_REACTION("reborn.stats.reaction");
+const thresholds::Key REBORN_STATS_SPIRIT("reborn.stats.spirit");
+const thresholds::Key REBORN_TREASURES("reborn.treasures");
+const thresholds::Key REBORN_EXPERIENCE("reborn.experience");
+const thresholds::Key REBORN_FAILURE_STAT_CEILING("reborn.failure.stat_ceiling");
+const thresholds::Key REBORN_MONEY("reborn.money");
+const thresholds::Key TREASURE_AWARD("treasure_award");
+const thresholds::Key REBORN_EXPERIENCE_CUTOFF("reborn.experience_cutoff");
+const thresholds::Key EXPERIENCE_LIMIT_MAIN_SKILL("experience_limit.main_skill");
+const thresholds::Key EXPERIENCE_LIMIT_SECONDARY("experience_limit.secondary");
+const thresholds::Key RECLASS_MONEY("reclass.money");
+const thresholds::Key RECLASS_EXPERIENCE("reclass.experience");
+const thresholds::Key ASCEND_MONEY("ascend.money");
+const thresholds::Key ASCEND_EXPERIENCE("ascend.experience");
+const thresholds::Key ASCEND_STATS_BODY("ascend.stats.body");
+const thresholds::Key ASCEND_STATS_REACTION("ascend.stats.reaction");
+const thresholds::Key ASCEND_STATS_MIND("ascend.stats.mind");
+const thresholds::Key ASCEND_STATS_SPIRIT("ascend.stats.spirit");
+
+} // namespace
+
 bool HasKillsForReborn(CCharacter& chr, ServerIDType server_id) {
-    auto* mobs = thresholds::thresholds.Mobs("reborn.mobs", chr, server_id);
-    if (!mobs) {
+    auto mobs = thresholds::thresholds.Mobs(REBORN_MOBS, chr, server_id);
+    if (mobs.empty()) {
         return true;
     }
 
@@ -21,9 +47,9 @@ bool HasKillsForReborn(CCharacter& chr, ServerIDType server_id) {
         return true; // Should not happen. Return `true` to simplify tests.
     }
 
-    for (auto it = mobs->begin(); it != mobs->end(); ++it) {
-        if (stats.by_server_id[it->first] < it->second) {
-            Printf(LOG_Info, "[reborn-kills] Player %s has %d kills of %d, want %d\n", chr.GetFullName().c_str(), stats.by_server_id[it->first], it->first, it->second);
+    for (const auto& mob : mobs) {
+        if (stats.by_server_id[mob.id] < mob.kills) {
+            Printf(LOG_Info, "[reborn-kills] Player %s has %d kills of %d, want %d\n", chr.GetFullName().c_str(), stats.by_server_id[mob.id], mob.id, mob.kills);
             return false;
         }
     }
@@ -155,16 +181,8 @@ void SaveTreasurePoints(int character_id, ServerIDType server_id, unsigned int p
         return;
     }
 
-    auto read = SimpleSQL{Format("SELECT treasure_points FROM treasure WHERE server_id = %d AND character_id = %d;", server_id, character_id)};
-    if (!read) {
-        return;
-    }
-
-    if (SQL_NumRows(read.result) > 0) {
-        SimpleSQL{Format("UPDATE treasure SET treasure_points = treasure_points + %d WHERE server_id = %d AND character_id = %d;", points, server_id, character_id)};
-    } else {
-        SimpleSQL{Format("INSERT INTO treasure (server_id, character_id, treasure_points) VALUES (%d, %d, %d);", server_id, character_id, points)};
-    }
+    // `(server_id, character_id)` is unique, see `SQL_AddUniqueKeys`.
+    unit_of_work::Write(Format("INSERT INTO treasure (server_id, character_id, treasure_points) VALUES (%d, %d, %d) ON DUPLICATE KEY UPDATE treasure_points = treasure_points + VALUES(treasure_points);", server_id, character_id, points));
 }
 
 void VisitShelf(CCharacter& chr, ServerIDType server_id) {
@@ -222,17 +240,17 @@ void StoreOnShelf(ServerIDType server_id, CCharacter& chr, bool store_dress, she
 }
 
 bool IsAttemptingReborn(const CCharacter& chr, ServerIDType server_id) {
-    uint32_t mind = thresholds::thresholds.Value("reborn.stats.mind", chr, server_id);
+    uint32_t mind = thresholds::thresholds.Value(REBORN_STATS_MIND, chr, server_id);
     if (mind != 0 && chr.Mind < mind) {
         return false;
     }
 
-    uint32_t reaction = thresholds::thresholds.Value("reborn.stats.reaction", chr, server_id);
+    uint32_t reaction = thresholds::thresholds.Value(REBORN_STATS_REACTION, chr, server_id);
     if (reaction != 0 && chr.Reaction < reaction) {
         return false;
     }
 
-    uint32_t spirit = thresholds::thresholds.Value("reborn.stats.spirit", chr, server_id);
+    uint32_t spirit = thresholds::thresholds.Value(REBORN_STATS_SPIRIT, chr, server_id);
     if (spirit != 0 && chr.Spirit < spirit) {
         return false;
     }
@@ -241,7 +259,7 @@ bool IsAttemptingReborn(const CCharacter& chr, ServerIDType server_id) {
 }
 
 bool MeetsRebornCriteria(CCharacter& chr, ServerIDType server_id, int have_treasures) {
-    int need_treasures = (int)thresholds::thresholds.Value("reborn.treasures", chr, server_id);
+    int need_treasures = (int)thresholds::thresholds.Value(REBORN_TREASURES, chr, server_id);
     if (have_treasures < need_treasures) {
         return false;
     }
@@ -251,7 +269,7 @@ bool MeetsRebornCriteria(CCharacter& chr, ServerIDType server_id, int have_treas
         return false;
     }
 
-    uint32_t need_experience = thresholds::thresholds.Value("reborn.experience", chr, server_id);
+    uint32_t need_experience = thresholds::thresholds.Value(REBORN_EXPERIENCE, chr, server_id);
     if (chr.TotalExperience() < need_experience) {
         return false;
     }
@@ -260,7 +278,7 @@ bool MeetsRebornCriteria(CCharacter& chr, ServerIDType server_id, int have_treas
 }
 
 void FailReborn(CCharacter& chr, ServerIDType server_id) {
-    uint8_t stat_ceiling = (uint8_t)thresholds::thresholds.Value("reborn.failure.stat_ceiling", chr, server_id);
+    uint8_t stat_ceiling = (uint8_t)thresholds::thresholds.Value(REBORN_FAILURE_STAT_CEILING, chr, server_id);
     if (stat_ceiling == 0) {
         return;
     }
@@ -273,7 +291,7 @@ void FailReborn(CCharacter& chr, ServerIDType server_id) {
 }
 
 uint32_t RebornPrice(const CCharacter& chr, ServerIDType server_id) {
-    return thresholds::thresholds.Value("reborn.money", chr, server_id);
+    return thresholds::thresholds.Value(REBORN_MONEY, chr, server_id);
 }
 
 int ConsumeTreasures(CCharacter& chr, ServerIDType server_id) {
@@ -301,7 +319,7 @@ int ConsumeTreasures(CCharacter& chr, ServerIDType server_id) {
 
         // Award player some gold for the treasure.
         uint64_t new_money = static_cast<uint64_t>(chr.Money);
-        new_money += thresholds::thresholds.Value("treasure_award", chr, server_id);
+        new_money += thresholds::thresholds.Value(TREASURE_AWARD, chr, server_id);
 
         chr.Money = (uint32_t)std::min(new_money, (uint64_t)std::numeric_limits<int32_t>::max());
     }
@@ -396,7 +414,7 @@ void PerformReborn(CCharacter& chr, ServerIDType server_id, shelf::StoreOnShelfF
 }
 
 void CutOffExperienceOnReborn(CCharacter& chr, ServerIDType server_id) {
-    uint32_t limit = thresholds::thresholds.Value("reborn.experience_cutoff", chr, server_id);
+    uint32_t limit = thresholds::thresholds.Value(REBORN_EXPERIENCE_CUTOFF, chr, server_id);
     if (limit == 0) {
         return;
     }
@@ -422,11 +440,11 @@ void ExperienceLimit(CCharacter& chr, ServerIDType server_id) {
         return;
     }
 
-    uint32_t limit_main = thresholds::thresholds.Value("experience_limit.main_skill", chr, server_id);
+    uint32_t limit_main = thresholds::thresholds.Value(EXPERIENCE_LIMIT_MAIN_SKILL, chr, server_id);
     if (limit_main == 0) {
         return;
     }
-    uint32_t limit_secondary = thresholds::thresholds.Value("experience_limit.secondary", chr, server_id);
+    uint32_t limit_secondary = thresholds::thresholds.Value(EXPERIENCE_LIMIT_SECONDARY, chr, server_id);
     if (limit_secondary == 0) {
         return;
     }
@@ -443,12 +461,12 @@ bool ShouldReclass(const CCharacter& chr, ServerIDType server_id) {
         return false;
     }
 
-    uint32_t need_money = thresholds::thresholds.Value("reclass.money", chr, server_id);
+    uint32_t need_money = thresholds::thresholds.Value(RECLASS_MONEY, chr, server_id);
     if (chr.Money < need_money) {
         return false;
     }
 
-    uint32_t need_experience = thresholds::thresholds.Value("reclass.experience", chr, server_id);
+    uint32_t need_experience = thresholds::thresholds.Value(RECLASS_EXPERIENCE, chr, server_id);
     if (chr.TotalExperience() < need_experience) {
         return false;
     }
@@ -460,7 +478,7 @@ void PerformReclass(CCharacter& chr, ServerIDType server_id, shelf::StoreOnShelf
     ClearMonsterKills(chr);
 
     // Save to shelf upon reclass. Note that this function removes money, empties the bag and dress.
-    chr.Money -= thresholds::thresholds.Value("reclass.money", chr, server_id);;
+    chr.Money -= thresholds::thresholds.Value(RECLASS_MONEY, chr, server_id);;
     StoreOnShelf(server_id, chr, true, store_on_shelf);
 
     if (chr.Deaths == 0) {
@@ -490,26 +508,26 @@ bool ShouldAscend(const CCharacter& chr, ServerIDType server_id) {
         return false;
     }
 
-    uint32_t need_money = thresholds::thresholds.Value("ascend.money", chr, server_id);
+    uint32_t need_money = thresholds::thresholds.Value(ASCEND_MONEY, chr, server_id);
     if (chr.Money < need_money) {
         return false;
     }
 
-    uint32_t need_experience = thresholds::thresholds.Value("ascend.experience", chr, server_id);
+    uint32_t need_experience = thresholds::thresholds.Value(ASCEND_EXPERIENCE, chr, server_id);
     if (chr.TotalExperience() < need_experience) {
         return false;
     }
 
-    if (chr.Body < thresholds::thresholds.Value("ascend.stats.body", chr, server_id)) {
+    if (chr.Body < thresholds::thresholds.Value(ASCEND_STATS_BODY, chr, server_id)) {
         return false;
     }
-    if (chr.Reaction < thresholds::thresholds.Value("ascend.stats.reaction", chr, server_id)) {
+    if (chr.Reaction < thresholds::thresholds.Value(ASCEND_STATS_REACTION, chr, server_id)) {
         return false;
     }
-    if (chr.Mind < thresholds::thresholds.Value("ascend.stats.mind", chr, server_id)) {
+    if (chr.Mind < thresholds::thresholds.Value(ASCEND_STATS_MIND, chr, server_id)) {
         return false;
     }
-    if (chr.Spirit < thresholds::thresholds.Value("ascend.stats.spirit", chr, server_id)) {
+    if (chr.Spirit < thresholds::thresholds.Value(ASCEND_STATS_SPIRIT, chr, server_id)) {
         return false;
     }
 
@@ -517,7 +535,7 @@ bool ShouldAscend(const CCharacter& chr, ServerIDType server_id) {
 }
 
 void PerformAscend(CCharacter& chr, ServerIDType server_id, shelf::StoreOnShelfFunction store_on_shelf) {
-    chr.Money -= thresholds::thresholds.Value("ascend.money", chr, server_id);
+    chr.Money -= thresholds::thresholds.Value(ASCEND_MONEY, chr, server_id);
 
     // Loose some stats as price for ascend,
     // but still save some be able stay on #7;
@@ -559,8 +577,8 @@ void MaybeAllowFemale(const CCharacter& chr, ServerIDType server_id) {
         uint32_t exp_requirement = chr.IsWarrior() ? 77777777 : 177777777;
         if (chr.TotalExperience() >= exp_requirement) {
             int allowed = chr.Nick[0] == '_' ? 3 : chr.Nick[0] == '!' ? 2 : chr.Nick[0] == '@' ? 1 : 0;
-            SimpleSQL{Format("UPDATE logins SET allow_female = %d WHERE id = %d AND allow_female < %d;", allowed, chr.LoginID, allowed)};
-            Printf(LOG_Info, "allow female: allowing player '%s' with login %d to create females of kind %d: %d rows affected\n", chr.GetFullName().c_str(), chr.LoginID, allowed, SQL_AffectedRows());
+            unit_of_work::Write(Format("UPDATE logins SET allow_female = %d WHERE id = %d AND allow_female < %d;", allowed, chr.LoginID, allowed));
+            Printf(LOG_Info, "allow female: allowing player '%s' with login %d to create females of kind %d\n", chr.GetFullName().c_str(), chr.LoginID, allowed);
         }
     }
 }